@@ -0,0 +1,62 @@
+#!/bin/sh
+# Encode signals that use every Steim2 packing with miniseed_tool, decode them
+# again and compare with what was encoded. When ObsPy is installed the
+# records are also read with it, as a reference reader.
+#
+#   miniseed_roundtrip.sh <miniseed_tool>
+set -e
+
+tool=$1
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+# Differences from 0 up to the widest Steim2 holds, 30 bits, so that every
+# packing gets used
+awk 'BEGIN { for (i = 0; i < 300; i++) print i % 2 }' > "$work/alternating.txt"
+awk 'BEGIN { for (i = 0; i < 1000; i++) print 0 }' > "$work/zeros.txt"
+awk 'BEGIN { for (i = 0; i < 5000; i++) print int(1000000 * sin(i / 50)) }' > "$work/sine.txt"
+awk 'BEGIN {
+    srand(1)
+    for (i = 0; i < 20000; i++) {
+        bits = 1 + int(rand() * 23)
+        print int((rand() * 2 - 1) * 2 ^ bits)
+    }
+}' > "$work/random.txt"
+awk 'BEGIN { for (i = 0; i < 2000; i++) print (i % 2 ? 1 : -1) * (2 ^ 28 - 1 - i) }' > "$work/extremes.txt"
+
+status=0
+for input in "$work"/*.txt; do
+    name=$(basename "$input" .txt)
+    "$tool" encode XX MIC 00 BDF 100 < "$input" > "$work/$name.mseed"
+    if ! "$tool" dump < "$work/$name.mseed" > "$work/$name.dump"; then
+        echo "$name: records failed to decode"
+        status=1
+    elif ! cut -d ' ' -f 2 "$work/$name.dump" | cmp -s "$input" -; then
+        echo "$name: decoded samples differ from those encoded"
+        status=1
+    else
+        echo "$name: $(wc -l < "$input") samples in $(($(wc -c < "$work/$name.mseed") / 512)) records"
+    fi
+
+    if python3 -c 'import obspy' 2> /dev/null; then
+        if ! python3 - "$work/$name.mseed" "$input" <<'EOF'
+import sys
+import numpy
+from obspy import read
+
+stream = read(sys.argv[1], format="MSEED")
+samples = numpy.concatenate([trace.data for trace in stream])
+expected = numpy.loadtxt(sys.argv[2], dtype=numpy.int64, ndmin=1)
+sys.exit(0 if numpy.array_equal(samples, expected) else 1)
+EOF
+        then
+            echo "$name: ObsPy reads different samples"
+            status=1
+        fi
+    fi
+done
+
+if ! python3 -c 'import obspy' 2> /dev/null; then
+    echo "ObsPy is not installed, so the records were not checked with it"
+fi
+exit $status
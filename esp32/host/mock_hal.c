@@ -0,0 +1,75 @@
+#include "mock_hal.h"
+
+static Ad7768Model adc_model;
+static uint32_t gpio_out;
+static uint32_t notifications;
+
+/**
+ * @brief 
+ * Power up the model ADC on the mock SPI bus
+ * @param signal Waveform the model converts
+ * @param mclk_frequency 
+ */
+void mock_adc_initialize(const WaveformSettings *signal, double mclk_frequency) {
+    ad7768_model_initialize(&adc_model, signal, mclk_frequency);
+}
+
+/**
+ * @brief 
+ * Make a conversion, as the ADC does before it raises data ready
+ */
+void mock_adc_convert(void) {
+    ad7768_model_convert(&adc_model);
+}
+
+const Ad7768Model *mock_adc_model(void) {
+    return &adc_model;
+}
+
+/**
+ * @brief 
+ * One full duplex transaction with the ADC, chip select to chip select
+ * @param tx Bytes sent, or NULL to send zeros
+ * @param rx Receives as many bytes as are sent
+ * @param length 
+ */
+void mock_spi_transfer(const uint8_t tx[], uint8_t rx[], size_t length) {
+    ad7768_model_transfer(&adc_model, tx, rx, length);
+}
+
+void mock_spi_write_register(uint8_t address, uint8_t value) {
+    uint8_t tx[2] = {address, value};
+    uint8_t rx[2];
+    mock_spi_transfer(tx, rx, sizeof(tx));
+}
+
+/**
+ * @brief 
+ * Set the levels of the output pins in `mask`, leaving the others
+ */
+void mock_gpio_write(uint32_t mask, uint32_t levels) {
+    gpio_out = (gpio_out & ~mask) | (levels & mask);
+}
+
+uint32_t mock_gpio_read(void) {
+    return gpio_out;
+}
+
+/**
+ * @brief 
+ * Notify the acquisition task, as the data ready ISR does
+ */
+void mock_queue_give(void) {
+    notifications++;
+}
+
+/**
+ * @brief 
+ * Take every notification given since the last take, without waiting
+ * @return Number of notifications taken
+ */
+uint32_t mock_queue_take(void) {
+    uint32_t count = notifications;
+    notifications = 0;
+    return count;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "waveform.h"
+#include "ad7768_model.h"
+
+/*
+ * Stand-ins for the hardware under the firmware's sample pipeline, so that 
+ * the pipeline code can be built and run on a workstation:
+ *
+ *   SPI    the ADC's end of the bus, answered by the AD7768-1 model
+ *   GPIO   the output register the VGA gain pins are driven through
+ *   queue  the data ready notification the ISR gives the acquisition task
+ *
+ * They keep no more state than the hardware does, in globals like it, and 
+ * are meant for one thread.
+ */
+
+void mock_adc_initialize(const WaveformSettings *signal, double mclk_frequency);
+void mock_adc_convert(void);
+const Ad7768Model *mock_adc_model(void);
+
+void mock_spi_transfer(const uint8_t tx[], uint8_t rx[], size_t length);
+void mock_spi_write_register(uint8_t address, uint8_t value);
+
+void mock_gpio_write(uint32_t mask, uint32_t levels);
+uint32_t mock_gpio_read(void);
+
+void mock_queue_give(void);
+uint32_t mock_queue_take(void);
@@ -0,0 +1,836 @@
+/*
+ * Microbenchmarks of the firmware's sample pipeline, built for the host
+ * against the mocked SPI, GPIO and data ready queue of mock_hal.h:
+ *
+ *   cmake -S esp32/host -B build/host && cmake --build build/host
+ *   build/host/pipeline_bench [-f regex] [-t seconds] [-o results.csv] [-b baseline.csv] [-r ratio]
+ *
+ *   -f <regex>    run only the benchmarks whose name matches
+ *   -t <seconds>  least time to run each benchmark for (default 0.5)
+ *   -o <file>     save the results as CSV, to compare later runs with
+ *   -b <file>     compare with saved results and fail on a regression
+ *   -r <ratio>    CPU time per iteration over the saved one that counts as a
+ *                 regression (default 1.25)
+ *
+ * Like Google Benchmark, each benchmark is run with a growing number of
+ * iterations until it takes at least the minimum time, and its wall and CPU
+ * time per iteration and its throughput are reported. Benchmarks check what
+ * they compute, and the run fails if any result is wrong.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <math.h>
+#include <time.h>
+#include <regex.h>
+#include <unistd.h>
+
+#include "mock_hal.h"
+#include "adc_profile.h"
+#include "adc_readout.h"
+#include "sample_broker.h"
+#include "recording.h"
+#include "telemetry_frame.h"
+#include "miniseed.h"
+#include "cobs.h"
+#include "decimator.h"
+#include "spectrum.h"
+#include "event_detector.h"
+#include "agc.h"
+#include "vga_gain.h"
+#include "waveform.h"
+
+#define DEFAULT_MIN_TIME 0.5
+#define DEFAULT_REGRESSION_RATIO 1.25
+#define MAX_ITERATIONS 1000000000ULL
+#define MAX_BASELINE_ENTRIES 64
+
+// Samples of test signal the benchmarks cycle through, a whole number of
+// blocks
+#define SIGNAL_LENGTH (SAMPLE_BLOCK_LENGTH * 512)
+#define SIGNAL_RATE 1000.0
+
+// Pool of the broker benchmarks, as deep as the firmware's default
+#define POOL_BLOCKS 32
+#define SUBSCRIBER_DEPTH 16
+
+// Interface format register fields, as set by the firmware
+#define INTERFACE_FORMAT_CONTINUOUS_READ 0x01
+#define INTERFACE_FORMAT_CRC_SELECT_SHIFT 2
+#define INTERFACE_FORMAT_STATUS_ENABLE 0x10
+#define READ_CONVERSION_RESULT (0x40 | 0x2c)
+
+// MCLK of the ADC model. Its rate does not matter to the host, which runs
+// conversions as fast as they are read.
+#define MODEL_MCLK_FREQUENCY 16384000.0
+
+// The acquisition benchmark misses a conversion once in this many blocks,
+// to take the readout through resynchronization
+#define ACQUISITION_MISS_PERIOD 16
+
+typedef struct {
+    uint64_t iterations;
+    // Work done by one iteration, for the throughput columns. Zero leaves
+    // the column empty.
+    double items_per_iteration;
+    double bytes_per_iteration;
+
+    double start_wall;
+    double start_cpu;
+    double wall;
+    double cpu;
+    bool failed;
+} BenchState;
+
+typedef void (*BenchFunction)(BenchState *state);
+
+typedef struct {
+    const char *name;
+    BenchFunction function;
+} Benchmark;
+
+typedef struct {
+    char name[64];
+    double cpu_ns;
+} BaselineEntry;
+
+static int32_t test_signal[SIGNAL_LENGTH];
+
+static double clock_seconds(clockid_t clock) {
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return now.tv_sec + now.tv_nsec * 1E-9;
+}
+
+static void bench_start(BenchState *state) {
+    state->start_wall = clock_seconds(CLOCK_MONOTONIC);
+    state->start_cpu = clock_seconds(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+static void bench_stop(BenchState *state) {
+    state->wall = clock_seconds(CLOCK_MONOTONIC) - state->start_wall;
+    state->cpu = clock_seconds(CLOCK_PROCESS_CPUTIME_ID) - state->start_cpu;
+}
+
+static void bench_fail(BenchState *state, const char *format, ...) {
+    va_list arguments;
+    va_start(arguments, format);
+    fprintf(stderr, "error: ");
+    vfprintf(stderr, format, arguments);
+    fprintf(stderr, "\n");
+    va_end(arguments);
+    state->failed = true;
+}
+
+static const int32_t *signal_block(uint64_t index) {
+    return test_signal + (index % (SIGNAL_LENGTH / SAMPLE_BLOCK_LENGTH)) * SAMPLE_BLOCK_LENGTH;
+}
+
+/**
+ * @brief
+ * A microphone's worth of signal: a tone and a chirp over noise, at about a
+ * tenth of full scale
+ */
+static void generate_test_signal(void) {
+    WaveformSettings tone = {
+        .type = WAVEFORM_SINE,
+        .amplitude = WAVEFORM_FULL_SCALE / 10.0,
+        .noise = 2000,
+        .frequency = 13
+    };
+    WaveformSettings chirp = {
+        .type = WAVEFORM_CHIRP,
+        .amplitude = WAVEFORM_FULL_SCALE / 20.0,
+        .frequency = 0.5,
+        .end_frequency = 200,
+        .sweep_period = 10
+    };
+    Waveform tone_waveform;
+    Waveform chirp_waveform;
+    waveform_initialize(&tone_waveform, &tone, SIGNAL_RATE);
+    waveform_initialize(&chirp_waveform, &chirp, SIGNAL_RATE);
+    for (size_t i = 0; i < SIGNAL_LENGTH; i++) {
+        test_signal[i] = waveform_next(&tone_waveform) + waveform_next(&chirp_waveform);
+    }
+}
+
+/**
+ * @brief
+ * Start the model ADC converting the test tone with its status byte and a
+ * CRC every `crc_interval` conversions, in continuous read mode
+ */
+static void start_mock_adc(unsigned int crc_interval) {
+    WaveformSettings signal = {
+        .type = WAVEFORM_SINE,
+        .amplitude = WAVEFORM_FULL_SCALE / 4.0,
+        .noise = 256,
+        .frequency = 1
+    };
+    mock_adc_initialize(&signal, MODEL_MCLK_FREQUENCY);
+
+    uint8_t crc_select = crc_interval == 4 ? 0b01 : crc_interval == 16 ? 0b10 : 0b00;
+    mock_spi_write_register(
+        ADC_INTERFACE_FORMAT_REGISTER,
+        INTERFACE_FORMAT_CONTINUOUS_READ | INTERFACE_FORMAT_STATUS_ENABLE |
+            crc_select << INTERFACE_FORMAT_CRC_SELECT_SHIFT
+    );
+}
+
+/**
+ * @brief
+ * Decode continuous readouts recorded from the model ADC, a block per
+ * iteration
+ */
+static void run_readout_decode(BenchState *state, unsigned int crc_interval) {
+    enum { NUM_READOUTS = SAMPLE_BLOCK_LENGTH * 64 };
+    static uint8_t readouts[NUM_READOUTS][ADC_READOUT_MAX_LENGTH];
+    static int32_t expected_samples[NUM_READOUTS];
+
+    // The recording is a whole number of CRC windows, so it can be played
+    // round and round
+    start_mock_adc(crc_interval);
+    AdcReadout recorder;
+    adc_readout_initialize(&recorder, 1, crc_interval);
+    adc_readout_synchronize(&recorder);
+    for (size_t i = 0; i < NUM_READOUTS; i++) {
+        mock_adc_convert();
+        mock_spi_transfer(NULL, readouts[i], adc_readout_length(&recorder));
+        adc_readout_decode(&recorder, readouts[i], &expected_samples[i]);
+    }
+
+    AdcReadout readout;
+    adc_readout_initialize(&readout, 1, crc_interval);
+    adc_readout_synchronize(&readout);
+    int32_t samples[SAMPLE_BLOCK_LENGTH];
+    uint32_t flags = 0;
+    size_t next = 0;
+
+    bench_start(state);
+    for (uint64_t n = 0; n < state->iterations; n++) {
+        for (size_t i = 0; i < SAMPLE_BLOCK_LENGTH; i++) {
+            flags |= adc_readout_decode(&readout, readouts[next + i], &samples[i]);
+        }
+        next = (next + SAMPLE_BLOCK_LENGTH) % NUM_READOUTS;
+    }
+    bench_stop(state);
+
+    if (flags != 0) {
+        bench_fail(state, "readout flagged 0x%x", (unsigned) flags);
+    }
+    size_t last = (next + NUM_READOUTS - SAMPLE_BLOCK_LENGTH) % NUM_READOUTS;
+    if (memcmp(samples, &expected_samples[last], sizeof(samples))) {
+        bench_fail(state, "decoded samples differ from the model's");
+    }
+    state->items_per_iteration = SAMPLE_BLOCK_LENGTH;
+}
+
+static void bench_readout_decode(BenchState *state) {
+    run_readout_decode(state, 0);
+}
+
+static void bench_readout_decode_crc4(BenchState *state) {
+    run_readout_decode(state, 4);
+}
+
+static void bench_recording_unpack(BenchState *state) {
+    static uint8_t packed[SIGNAL_LENGTH * RECORDING_SAMPLE_WIDTH];
+    recording_pack_samples(packed, test_signal, SIGNAL_LENGTH);
+
+    int32_t samples[SAMPLE_BLOCK_LENGTH];
+    uint64_t n = 0;
+    bench_start(state);
+    for (n = 0; n < state->iterations; n++) {
+        size_t offset = (n % (SIGNAL_LENGTH / SAMPLE_BLOCK_LENGTH)) * SAMPLE_BLOCK_LENGTH;
+        recording_unpack_samples(samples, packed + offset * RECORDING_SAMPLE_WIDTH, SAMPLE_BLOCK_LENGTH);
+    }
+    bench_stop(state);
+
+    if (memcmp(samples, signal_block(n - 1), sizeof(samples))) {
+        bench_fail(state, "unpacked samples differ from the packed ones");
+    }
+    state->items_per_iteration = SAMPLE_BLOCK_LENGTH;
+    state->bytes_per_iteration = SAMPLE_BLOCK_LENGTH * RECORDING_SAMPLE_WIDTH;
+}
+
+/**
+ * @brief
+ * The acquisition task's work for a block, on the mocks: each conversion is
+ * notified through the queue and read over SPI in continuous read mode with
+ * a CRC every 4 conversions, and full blocks are published to a broker with
+ * one subscriber. A conversion is missed now and then, and the readout is
+ * put back in step with a command read as the firmware does.
+ */
+static void bench_acquisition(BenchState *state) {
+    static SampleBlock blocks[POOL_BLOCKS];
+    static SampleBroker broker;
+    sample_broker_initialize(&broker, blocks, POOL_BLOCKS);
+    SampleSubscriber *subscriber = sample_broker_subscribe(&broker, SUBSCRIBER_DEPTH);
+
+    start_mock_adc(4);
+    AdcReadout readout;
+    adc_readout_initialize(&readout, 1, 4);
+    adc_readout_synchronize(&readout);
+    uint8_t interface_format = mock_adc_model()->registers[ADC_INTERFACE_FORMAT_REGISTER];
+
+    uint64_t sample_index = 0;
+    uint64_t num_samples = 0;
+    uint64_t num_resynchronizations = 0;
+    bool conversion_pending = false;
+    uint32_t flags = 0;
+
+    bench_start(state);
+    for (uint64_t n = 0; n < state->iterations; n++) {
+        SampleBlock *block = sample_broker_begin_publish(&broker);
+        if (block == NULL) {
+            bench_fail(state, "sample pool exhausted");
+            break;
+        }
+        block->first_sample_index = sample_index;
+        block->flags = 0;
+        block->length = 0;
+
+        while (block->length < SAMPLE_BLOCK_LENGTH) {
+            if (! conversion_pending) {
+                mock_adc_convert();
+                mock_queue_give();
+                if (block->length == 1 && n % ACQUISITION_MISS_PERIOD == 0) {
+                    mock_adc_convert();
+                    mock_queue_give();
+                }
+
+                // A block is closed at a lost conversion, so that it holds 
+                // consecutive samples, and the latest conversion starts the 
+                // next one
+                uint32_t pending = mock_queue_take();
+                conversion_pending = true;
+                if (pending > 1) {
+                    readout.synchronized = false;
+                    sample_index += pending - 1;
+                    if (block->length > 0) {
+                        break;
+                    }
+                    block->first_sample_index = sample_index;
+                }
+            }
+
+            uint8_t bytes[ADC_READOUT_MAX_LENGTH + 1];
+            int32_t sample;
+            if (! readout.synchronized) {
+                uint8_t command[ADC_READOUT_MAX_LENGTH + 1] = {READ_CONVERSION_RESULT};
+                mock_spi_transfer(command, bytes, ADC_READOUT_DATA_BYTES + 2);
+                block->flags |= adc_readout_decode(&readout, bytes + 1, &sample);
+                mock_spi_write_register(ADC_INTERFACE_FORMAT_REGISTER, interface_format);
+                adc_readout_synchronize(&readout);
+                num_resynchronizations++;
+            }
+            else {
+                mock_spi_transfer(NULL, bytes, adc_readout_length(&readout));
+                block->flags |= adc_readout_decode(&readout, bytes, &sample);
+            }
+            block->samples[block->length++] = sample;
+            conversion_pending = false;
+            sample_index++;
+        }
+        num_samples += block->length;
+        sample_broker_publish(&broker);
+
+        const SampleBlock *received = sample_subscriber_receive(subscriber);
+        if (received != NULL) {
+            flags |= received->flags;
+            sample_block_release(received);
+        }
+    }
+    bench_stop(state);
+
+    if (flags & (SAMPLE_BLOCK_ADC_STATUS_ERROR | SAMPLE_BLOCK_ADC_CRC_ERROR)) {
+        bench_fail(state, "readout flagged 0x%x", (unsigned) flags);
+    }
+    if (state->iterations >= ACQUISITION_MISS_PERIOD && num_resynchronizations == 0) {
+        bench_fail(state, "the readout was never resynchronized");
+    }
+    sample_broker_unsubscribe(subscriber);
+    state->items_per_iteration = (double) num_samples / state->iterations;
+}
+
+/**
+ * @brief
+ * Publish a block of samples to `num_subscribers` subscribers and have each
+ * of them take and release it
+ */
+static void run_broker(BenchState *state, size_t num_subscribers) {
+    static SampleBlock blocks[POOL_BLOCKS];
+    static SampleBroker broker;
+    sample_broker_initialize(&broker, blocks, POOL_BLOCKS);
+    SampleSubscriber *subscribers[SAMPLE_BROKER_MAX_SUBSCRIBERS];
+    for (size_t s = 0; s < num_subscribers; s++) {
+        subscribers[s] = sample_broker_subscribe(&broker, SUBSCRIBER_DEPTH);
+    }
+
+    uint64_t num_received = 0;
+    bench_start(state);
+    for (uint64_t n = 0; n < state->iterations; n++) {
+        SampleBlock *block = sample_broker_begin_publish(&broker);
+        if (block == NULL) {
+            bench_fail(state, "sample pool exhausted");
+            break;
+        }
+        block->first_sample_index = n * SAMPLE_BLOCK_LENGTH;
+        block->flags = 0;
+        block->length = SAMPLE_BLOCK_LENGTH;
+        memcpy(block->samples, signal_block(n), sizeof(block->samples));
+        sample_broker_publish(&broker);
+
+        for (size_t s = 0; s < num_subscribers; s++) {
+            const SampleBlock *received = sample_subscriber_receive(subscribers[s]);
+            if (received != NULL) {
+                num_received++;
+                sample_block_release(received);
+            }
+        }
+    }
+    bench_stop(state);
+
+    if (! state->failed && num_received != state->iterations * num_subscribers) {
+        bench_fail(state, "%llu of %llu blocks received",
+            (unsigned long long) num_received, (unsigned long long) (state->iterations * num_subscribers));
+    }
+    for (size_t s = 0; s < num_subscribers; s++) {
+        sample_broker_unsubscribe(subscribers[s]);
+    }
+    state->items_per_iteration = SAMPLE_BLOCK_LENGTH;
+}
+
+static void bench_broker_1(BenchState *state) {
+    run_broker(state, 1);
+}
+
+static void bench_broker_4(BenchState *state) {
+    run_broker(state, 4);
+}
+
+static void bench_telemetry_frame(BenchState *state) {
+    static uint8_t frame[TELEMETRY_FRAME_MAX_LENGTH];
+    TelemetrySampleHeader header = {
+        .sample_rate_mhz = (uint32_t) (SIGNAL_RATE * 1000),
+        .vga_gain = 1,
+        .num_samples = TELEMETRY_FRAME_MAX_SAMPLES
+    };
+
+    size_t length = 0;
+    bench_start(state);
+    for (uint64_t n = 0; n < state->iterations; n++) {
+        header.first_sample_index = (n % (SIGNAL_LENGTH / TELEMETRY_FRAME_MAX_SAMPLES)) * TELEMETRY_FRAME_MAX_SAMPLES;
+        length = telemetry_frame_encode_samples(frame, (uint32_t) n, &header, test_signal + header.first_sample_index);
+    }
+    bench_stop(state);
+
+    TelemetryFrame decoded;
+    TelemetrySampleHeader decoded_header;
+    static int32_t samples[TELEMETRY_FRAME_MAX_SAMPLES];
+    if (telemetry_frame_decode(frame, length, &decoded) ||
+        telemetry_frame_decode_samples(&decoded, &decoded_header, samples) ||
+        memcmp(samples, test_signal + header.first_sample_index, sizeof(samples))) {
+        bench_fail(state, "encoded frame does not decode to its samples");
+    }
+    state->items_per_iteration = TELEMETRY_FRAME_MAX_SAMPLES;
+    state->bytes_per_iteration = length;
+}
+
+static void bench_miniseed(BenchState *state) {
+    MiniseedStream stream;
+    miniseed_stream_initialize(&stream, "XX", "IEAR", "00", "GDF");
+    static uint8_t record[MINISEED_RECORD_LENGTH];
+
+    size_t offset = 0;
+    uint64_t num_encoded = 0;
+    bench_start(state);
+    for (uint64_t n = 0; n < state->iterations; n++) {
+        size_t available = SIGNAL_LENGTH - offset;
+        size_t count = available < MINISEED_MAX_RECORD_SAMPLES ? available : MINISEED_MAX_RECORD_SAMPLES;
+        size_t encoded = miniseed_encode_record(
+            &stream, record, test_signal + offset, count, (int64_t) (offset * 1E6 / SIGNAL_RATE), SIGNAL_RATE);
+        if (encoded == 0) {
+            bench_fail(state, "no samples fit a record");
+            break;
+        }
+        num_encoded += encoded;
+        offset += encoded;
+        if (offset == SIGNAL_LENGTH) {
+            offset = 0;
+            miniseed_stream_reset(&stream);
+        }
+    }
+    bench_stop(state);
+
+    state->items_per_iteration = (double) num_encoded / state->iterations;
+    state->bytes_per_iteration = MINISEED_RECORD_LENGTH;
+}
+
+static void bench_cobs(BenchState *state) {
+    static uint8_t frame[TELEMETRY_FRAME_MAX_LENGTH];
+    static uint8_t encoded[TELEMETRY_FRAME_MAX_LENGTH + TELEMETRY_FRAME_MAX_LENGTH / 254 + 2];
+    static uint8_t decoded[TELEMETRY_FRAME_MAX_LENGTH + TELEMETRY_FRAME_MAX_LENGTH / 254 + 2];
+    TelemetrySampleHeader header = {
+        .sample_rate_mhz = (uint32_t) (SIGNAL_RATE * 1000),
+        .num_samples = TELEMETRY_FRAME_MAX_SAMPLES
+    };
+    size_t length = telemetry_frame_encode_samples(frame, 0, &header, test_signal);
+
+    size_t encoded_length = 0;
+    bench_start(state);
+    for (uint64_t n = 0; n < state->iterations; n++) {
+        encoded_length = cobs_encode(encoded, frame, length);
+    }
+    bench_stop(state);
+
+    size_t decoded_length;
+    if (cobs_decode(decoded, encoded, encoded_length, &decoded_length) ||
+        decoded_length != length || memcmp(decoded, frame, length)) {
+        bench_fail(state, "COBS frame does not decode to the telemetry frame");
+    }
+    state->bytes_per_iteration = length;
+}
+
+static void bench_crc32(BenchState *state) {
+    static uint8_t data[TELEMETRY_FRAME_MAX_LENGTH];
+    recording_pack_samples(data, test_signal, TELEMETRY_FRAME_MAX_LENGTH / RECORDING_SAMPLE_WIDTH);
+
+    // Keeps the result live
+    static volatile uint32_t crc;
+    bench_start(state);
+    for (uint64_t n = 0; n < state->iterations; n++) {
+        crc = telemetry_crc32(data, sizeof(data));
+    }
+    bench_stop(state);
+
+    if (crc != telemetry_crc32(data, sizeof(data))) {
+        bench_fail(state, "CRC-32 is not repeatable");
+    }
+    state->bytes_per_iteration = sizeof(data);
+}
+
+static void run_decimator(BenchState *state, double output_rate) {
+    DecimatorCascade cascade;
+    if (decimator_cascade_initialize(&cascade, SIGNAL_RATE, output_rate)) {
+        bench_fail(state, "no cascade from %g to %g samples/s", SIGNAL_RATE, output_rate);
+        return;
+    }
+
+    int32_t samples[SAMPLE_BLOCK_LENGTH];
+    uint64_t num_outputs = 0;
+    bench_start(state);
+    for (uint64_t n = 0; n < state->iterations; n++) {
+        memcpy(samples, signal_block(n), sizeof(samples));
+        num_outputs += decimator_cascade_process(&cascade, samples, SAMPLE_BLOCK_LENGTH);
+    }
+    bench_stop(state);
+
+    double expected = (double) state->iterations * SAMPLE_BLOCK_LENGTH * output_rate / SIGNAL_RATE;
+    if (fabs(num_outputs - expected) > 1) {
+        bench_fail(state, "%llu samples out, %.0f expected", (unsigned long long) num_outputs, expected);
+    }
+    state->items_per_iteration = SAMPLE_BLOCK_LENGTH;
+}
+
+static void bench_decimator_100(BenchState *state) {
+    run_decimator(state, 100);
+}
+
+static void bench_decimator_40(BenchState *state) {
+    run_decimator(state, 40);
+}
+
+static void bench_spectrum(BenchState *state) {
+    static SpectrumAnalyzer analyzer;
+    if (spectrum_analyzer_initialize(&analyzer, SIGNAL_RATE, 1024, 8, SPECTRUM_BANDS_THIRD_OCTAVE)) {
+        bench_fail(state, "failed to set up the spectrum analyzer");
+        return;
+    }
+
+    uint64_t num_estimates = 0;
+    bench_start(state);
+    for (uint64_t n = 0; n < state->iterations; n++) {
+        const int32_t *block = signal_block(n);
+        size_t used = 0;
+        while (used < SAMPLE_BLOCK_LENGTH) {
+            used += spectrum_analyzer_process(&analyzer, block + used, SAMPLE_BLOCK_LENGTH - used, n * SAMPLE_BLOCK_LENGTH + used);
+            if (analyzer.estimate_ready) {
+                num_estimates++;
+                spectrum_analyzer_clear_estimate(&analyzer);
+            }
+        }
+    }
+    bench_stop(state);
+
+    // An estimate takes 4.5 FFT lengths of samples
+    if (state->iterations * SAMPLE_BLOCK_LENGTH >= 5 * 1024 && num_estimates == 0) {
+        bench_fail(state, "no spectrum estimates made");
+    }
+    state->items_per_iteration = SAMPLE_BLOCK_LENGTH;
+}
+
+static void bench_event_detector(BenchState *state) {
+    EventDetectorConfig config = {
+        .sta_length = (unsigned int) SIGNAL_RATE,
+        .lta_length = (unsigned int) (30 * SIGNAL_RATE),
+        .trigger_ratio = 4,
+        .detrigger_ratio = 1.5,
+        .pre_trigger_length = (unsigned int) (2 * SIGNAL_RATE),
+        .post_trigger_length = (unsigned int) (10 * SIGNAL_RATE),
+        .max_event_length = (unsigned int) (60 * SIGNAL_RATE)
+    };
+    static EventDetector detector;
+    if (event_detector_initialize(&detector, &config)) {
+        bench_fail(state, "failed to set up the event detector");
+        return;
+    }
+
+    bench_start(state);
+    for (uint64_t n = 0; n < state->iterations; n++) {
+        const int32_t *block = signal_block(n);
+        for (size_t i = 0; i < SAMPLE_BLOCK_LENGTH; i++) {
+            event_detector_update(&detector, block[i], n * SAMPLE_BLOCK_LENGTH + i);
+        }
+    }
+    bench_stop(state);
+    state->items_per_iteration = SAMPLE_BLOCK_LENGTH;
+}
+
+static void bench_agc(BenchState *state) {
+    AgcSettings settings;
+    agc_default_settings(&settings);
+    Agc agc;
+    agc_initialize(&agc, &settings, 1);
+
+    bench_start(state);
+    for (uint64_t n = 0; n < state->iterations; n++) {
+        agc_update(&agc, signal_block(n), SAMPLE_BLOCK_LENGTH);
+    }
+    bench_stop(state);
+
+    // The test signal peaks between the levels that lower and raise the 
+    // gain, so the gain stays put
+    if (agc.gain != 1) {
+        bench_fail(state, "AGC settled at gain %u", agc.gain);
+    }
+    state->items_per_iteration = SAMPLE_BLOCK_LENGTH;
+}
+
+/**
+ * @brief
+ * Map a gain to its pin levels and drive them onto the mock GPIO, as
+ * set_vga_gain does
+ */
+static void bench_vga_gain(BenchState *state) {
+    static const unsigned int gains[] = {0, 1, 2, 4, 8, 16, 32, 64};
+    static const unsigned int pins[VGA_NUM_GAIN_PINS] = {13, 12, 2};
+    const uint32_t mask = (1u << pins[0]) | (1u << pins[1]) | (1u << pins[2]);
+
+    bench_start(state);
+    for (uint64_t n = 0; n < state->iterations; n++) {
+        int code = vga_gain_code(gains[n % 8]);
+        mock_gpio_write(mask, vga_gain_pin_levels(code, pins));
+    }
+    bench_stop(state);
+
+    // The last gain written set G0, G1 and G2 from its code
+    int code = vga_gain_code(gains[(state->iterations - 1) % 8]);
+    uint32_t out = mock_gpio_read();
+    for (int i = 0; i < VGA_NUM_GAIN_PINS; i++) {
+        if (((out >> pins[i]) & 1) != ((code >> i) & 1)) {
+            bench_fail(state, "G%d is wrong for gain code %d", i, code);
+        }
+    }
+    state->items_per_iteration = 1;
+}
+
+static const Benchmark benchmarks[] = {
+    {"unpack/adc_readout", bench_readout_decode},
+    {"unpack/adc_readout_crc4", bench_readout_decode_crc4},
+    {"unpack/recording", bench_recording_unpack},
+    {"acquire/mock_spi_crc4", bench_acquisition},
+    {"buffer/broker_1_subscriber", bench_broker_1},
+    {"buffer/broker_4_subscribers", bench_broker_4},
+    {"encode/telemetry_frame", bench_telemetry_frame},
+    {"encode/miniseed_steim2", bench_miniseed},
+    {"encode/cobs", bench_cobs},
+    {"encode/crc32", bench_crc32},
+    {"filter/decimate_1000_to_100", bench_decimator_100},
+    {"filter/decimate_1000_to_40", bench_decimator_40},
+    {"filter/spectrum_1024", bench_spectrum},
+    {"filter/event_detector", bench_event_detector},
+    {"gain/agc", bench_agc},
+    {"gain/vga_pins", bench_vga_gain},
+};
+
+/**
+ * @brief
+ * Run a benchmark with more iterations each time until it takes at least
+ * `min_time`, aiming a little past it
+ */
+static BenchState run_benchmark(const Benchmark *benchmark, double min_time) {
+    uint64_t iterations = 1;
+    for ( ;; ) {
+        BenchState state = {
+            .iterations = iterations
+        };
+        benchmark->function(&state);
+        if (state.failed || state.wall >= min_time || iterations >= MAX_ITERATIONS) {
+            return state;
+        }
+
+        double multiplier = state.wall > 0 ? 1.4 * min_time / state.wall : 100;
+        multiplier = multiplier < 2 ? 2 : multiplier > 100 ? 100 : multiplier;
+        iterations = (uint64_t) (iterations * multiplier);
+        iterations = iterations > MAX_ITERATIONS ? MAX_ITERATIONS : iterations;
+    }
+}
+
+static void format_rate(char out[], size_t size, double rate, const char unit[]) {
+    static const char *prefixes[] = {"", "k", "M", "G", "T"};
+    if (rate <= 0) {
+        snprintf(out, size, "-");
+        return;
+    }
+    int p = 0;
+    while (rate >= 1000 && p < 4) {
+        rate /= 1000;
+        p++;
+    }
+    snprintf(out, size, "%.3g %s%s/s", rate, prefixes[p], unit);
+}
+
+static size_t load_baseline(const char path[], BaselineEntry entries[]) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        perror(path);
+        exit(1);
+    }
+
+    size_t num_entries = 0;
+    char line[256];
+    while (num_entries < MAX_BASELINE_ENTRIES && fgets(line, sizeof(line), file) != NULL) {
+        BaselineEntry *entry = &entries[num_entries];
+        unsigned long long iterations;
+        double wall_ns;
+        if (sscanf(line, "%63[^,],%llu,%lf,%lf", entry->name, &iterations, &wall_ns, &entry->cpu_ns) == 4) {
+            num_entries++;
+        }
+    }
+    fclose(file);
+    return num_entries;
+}
+
+static const BaselineEntry *find_baseline(const BaselineEntry entries[], size_t num_entries, const char name[]) {
+    for (size_t i = 0; i < num_entries; i++) {
+        if (! strcmp(entries[i].name, name)) {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: pipeline_bench [-f regex] [-t seconds] [-o results.csv] [-b baseline.csv] [-r ratio]\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    const char *filter = NULL;
+    const char *output_path = NULL;
+    const char *baseline_path = NULL;
+    double min_time = DEFAULT_MIN_TIME;
+    double regression_ratio = DEFAULT_REGRESSION_RATIO;
+
+    int option;
+    while ((option = getopt(argc, argv, "f:t:o:b:r:")) != -1) {
+        switch (option) {
+            case 'f': filter = optarg; break;
+            case 't': min_time = atof(optarg); break;
+            case 'o': output_path = optarg; break;
+            case 'b': baseline_path = optarg; break;
+            case 'r': regression_ratio = atof(optarg); break;
+            default: usage();
+        }
+    }
+    if (optind != argc || min_time < 0 || regression_ratio <= 1) {
+        usage();
+    }
+
+    regex_t filter_regex;
+    if (filter != NULL && regcomp(&filter_regex, filter, REG_EXTENDED | REG_NOSUB)) {
+        fprintf(stderr, "error: invalid filter %s\n", filter);
+        return 1;
+    }
+
+    static BaselineEntry baseline[MAX_BASELINE_ENTRIES];
+    size_t num_baseline = baseline_path != NULL ? load_baseline(baseline_path, baseline) : 0;
+
+    FILE *output = NULL;
+    if (output_path != NULL) {
+        output = fopen(output_path, "w");
+        if (output == NULL) {
+            perror(output_path);
+            return 1;
+        }
+        fprintf(output, "name,iterations,wall_ns,cpu_ns,items_per_second,bytes_per_second\n");
+    }
+
+    generate_test_signal();
+
+    printf("%-30s %12s %12s %12s %16s %16s%s\n",
+        "Benchmark", "Time", "CPU", "Iterations", "Items", "Bytes", baseline_path != NULL ? "   vs baseline" : "");
+    int num_failed = 0;
+    int num_regressions = 0;
+    for (size_t b = 0; b < sizeof(benchmarks) / sizeof(benchmarks[0]); b++) {
+        const Benchmark *benchmark = &benchmarks[b];
+        if (filter != NULL && regexec(&filter_regex, benchmark->name, 0, NULL, 0)) {
+            continue;
+        }
+
+        BenchState state = run_benchmark(benchmark, min_time);
+        if (state.failed) {
+            printf("%-30s FAILED\n", benchmark->name);
+            num_failed++;
+            continue;
+        }
+
+        double wall_ns = state.wall * 1E9 / state.iterations;
+        double cpu_ns = state.cpu * 1E9 / state.iterations;
+        double items_rate = state.cpu > 0 ? state.items_per_iteration * state.iterations / state.cpu : 0;
+        double bytes_rate = state.cpu > 0 ? state.bytes_per_iteration * state.iterations / state.cpu : 0;
+        char items[32];
+        char bytes[32];
+        format_rate(items, sizeof(items), items_rate, "");
+        format_rate(bytes, sizeof(bytes), bytes_rate, "B");
+        printf("%-30s %9.1f ns %9.1f ns %12llu %16s %16s",
+            benchmark->name, wall_ns, cpu_ns, (unsigned long long) state.iterations, items, bytes);
+
+        const BaselineEntry *entry = find_baseline(baseline, num_baseline, benchmark->name);
+        if (entry != NULL && entry->cpu_ns > 0) {
+            double ratio = cpu_ns / entry->cpu_ns;
+            printf("   %+6.1f%%%s", (ratio - 1) * 100, ratio > regression_ratio ? " REGRESSION" : "");
+            num_regressions += ratio > regression_ratio;
+        }
+        printf("\n");
+
+        if (output != NULL) {
+            fprintf(output, "%s,%llu,%.3f,%.3f,%.1f,%.1f\n",
+                benchmark->name, (unsigned long long) state.iterations, wall_ns, cpu_ns, items_rate, bytes_rate);
+        }
+    }
+
+    if (output != NULL) {
+        fclose(output);
+    }
+    if (filter != NULL) {
+        regfree(&filter_regex);
+    }
+    if (num_failed > 0 || num_regressions > 0) {
+        fprintf(stderr, "%d benchmarks failed, %d regressed\n", num_failed, num_regressions);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,687 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "sample_archive.h"
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "Archived samples are read in place, which needs a little-endian host"
+#endif
+
+static void put_u32(uint8_t *destination, uint32_t value) {
+    destination[0] = value;
+    destination[1] = value >> 8;
+    destination[2] = value >> 16;
+    destination[3] = value >> 24;
+}
+
+static void put_u64(uint8_t *destination, uint64_t value) {
+    put_u32(destination, (uint32_t) value);
+    put_u32(destination + 4, (uint32_t) (value >> 32));
+}
+
+static uint32_t get_u32(const uint8_t *source) {
+    return source[0] | ((uint32_t) source[1] << 8) | ((uint32_t) source[2] << 16) | ((uint32_t) source[3] << 24);
+}
+
+static uint64_t get_u64(const uint8_t *source) {
+    return get_u32(source) | ((uint64_t) get_u32(source + 4) << 32);
+}
+
+/**
+ * @brief
+ * The CRC-32 of telemetry frames, eight bytes at a time. The firmware's
+ * nibble table version keeps its flash small but would take most of the
+ * time spent writing an archive.
+ * @param data
+ * @param length
+ * @return CRC of `data`
+ */
+static uint32_t archive_crc32(const uint8_t data[], size_t length) {
+    static uint32_t tables[8][256];
+    static bool have_tables;
+    if (! have_tables) {
+        for (unsigned int i = 0; i < 256; i++) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc >> 1) ^ (crc & 1 ? 0xedb88320 : 0);
+            }
+            tables[0][i] = crc;
+        }
+        for (unsigned int i = 0; i < 256; i++) {
+            for (int t = 1; t < 8; t++) {
+                tables[t][i] = (tables[t - 1][i] >> 8) ^ tables[0][tables[t - 1][i] & 0xff];
+            }
+        }
+        have_tables = true;
+    }
+
+    uint32_t crc = 0xffffffff;
+    size_t i = 0;
+    for ( ; i + 8 <= length; i += 8) {
+        uint32_t low = get_u32(data + i) ^ crc;
+        uint32_t high = get_u32(data + i + 4);
+        crc = tables[7][low & 0xff] ^ tables[6][(low >> 8) & 0xff] ^
+            tables[5][(low >> 16) & 0xff] ^ tables[4][low >> 24] ^
+            tables[3][high & 0xff] ^ tables[2][(high >> 8) & 0xff] ^
+            tables[1][(high >> 16) & 0xff] ^ tables[0][high >> 24];
+    }
+    for ( ; i < length; i++) {
+        crc = (crc >> 8) ^ tables[0][(crc ^ data[i]) & 0xff];
+    }
+    return ~crc;
+}
+
+/**
+ * @brief
+ * @param span
+ * @param offset Number of samples after the span's first
+ * @return Time of the sample, in microseconds since the epoch
+ */
+int64_t sample_archive_sample_time(const SampleArchiveSpan *span, uint64_t offset) {
+    return span->first_time_us + (int64_t) (offset * 1000000000ULL / span->sample_rate_mhz);
+}
+
+/**
+ * @brief
+ * @param span
+ * @return Time after the span's last sample
+ */
+int64_t sample_archive_span_end(const SampleArchiveSpan *span) {
+    return sample_archive_sample_time(span, span->num_samples);
+}
+
+static void encode_header(uint8_t out[SAMPLE_ARCHIVE_HEADER_LENGTH], const SampleArchiveHeader *header) {
+    memset(out, 0, SAMPLE_ARCHIVE_HEADER_LENGTH);
+    put_u32(out, SAMPLE_ARCHIVE_MAGIC);
+    out[4] = SAMPLE_ARCHIVE_VERSION;
+    put_u32(out + 8, header->chunk_samples);
+    put_u64(out + 16, (uint64_t) header->created_us);
+    memcpy(out + 24, header->name, strnlen(header->name, SAMPLE_ARCHIVE_NAME_LENGTH));
+}
+
+static int decode_header(const uint8_t in[SAMPLE_ARCHIVE_HEADER_LENGTH], SampleArchiveHeader *out_header) {
+    if (get_u32(in) != SAMPLE_ARCHIVE_MAGIC || in[4] != SAMPLE_ARCHIVE_VERSION) {
+        return 1;
+    }
+    out_header->chunk_samples = get_u32(in + 8);
+    out_header->created_us = (int64_t) get_u64(in + 16);
+    memcpy(out_header->name, in + 24, SAMPLE_ARCHIVE_NAME_LENGTH);
+    out_header->name[SAMPLE_ARCHIVE_NAME_LENGTH] = '\0';
+    return out_header->chunk_samples == 0;
+}
+
+static void encode_index_header(uint8_t out[SAMPLE_ARCHIVE_INDEX_HEADER_LENGTH]) {
+    memset(out, 0, SAMPLE_ARCHIVE_INDEX_HEADER_LENGTH);
+    put_u32(out, SAMPLE_ARCHIVE_INDEX_MAGIC);
+    out[4] = SAMPLE_ARCHIVE_VERSION;
+}
+
+static int check_index_header(const uint8_t in[SAMPLE_ARCHIVE_INDEX_HEADER_LENGTH]) {
+    return get_u32(in) != SAMPLE_ARCHIVE_INDEX_MAGIC || in[4] != SAMPLE_ARCHIVE_VERSION;
+}
+
+static void encode_chunk_header(uint8_t out[SAMPLE_ARCHIVE_CHUNK_HEADER_LENGTH], const SampleArchiveSpan *chunk) {
+    put_u32(out, SAMPLE_ARCHIVE_CHUNK_MAGIC);
+    put_u32(out + 4, chunk->num_samples);
+    put_u64(out + 8, chunk->first_sample_index);
+    put_u64(out + 16, (uint64_t) chunk->first_time_us);
+    put_u32(out + 24, chunk->sample_rate_mhz);
+    put_u32(out + 28, archive_crc32((const uint8_t *) chunk->samples, chunk->num_samples * SAMPLE_ARCHIVE_SAMPLE_WIDTH));
+}
+
+/**
+ * @brief
+ * Decode a chunk header, leaving the samples and their CRC to the caller
+ * @return 0 if `in` starts a chunk of at most `max_samples` samples
+ */
+static int decode_chunk_header(
+    const uint8_t in[SAMPLE_ARCHIVE_CHUNK_HEADER_LENGTH],
+    uint32_t max_samples,
+    SampleArchiveSpan *out_chunk,
+    uint32_t *out_crc
+) {
+    if (get_u32(in) != SAMPLE_ARCHIVE_CHUNK_MAGIC) {
+        return 1;
+    }
+    out_chunk->num_samples = get_u32(in + 4);
+    out_chunk->first_sample_index = get_u64(in + 8);
+    out_chunk->first_time_us = (int64_t) get_u64(in + 16);
+    out_chunk->sample_rate_mhz = get_u32(in + 24);
+    *out_crc = get_u32(in + 28);
+    return out_chunk->num_samples == 0 || out_chunk->num_samples > max_samples || out_chunk->sample_rate_mhz == 0;
+}
+
+static uint64_t chunk_length(uint32_t num_samples) {
+    return SAMPLE_ARCHIVE_CHUNK_HEADER_LENGTH + (uint64_t) num_samples * SAMPLE_ARCHIVE_SAMPLE_WIDTH;
+}
+
+static char *index_path(const char path[]) {
+    char *result = malloc(strlen(path) + sizeof(SAMPLE_ARCHIVE_INDEX_SUFFIX));
+    if (result != NULL) {
+        strcpy(result, path);
+        strcat(result, SAMPLE_ARCHIVE_INDEX_SUFFIX);
+    }
+    return result;
+}
+
+static int write_all(int fd, const void *data, size_t length, uint64_t offset) {
+    ssize_t written = pwrite(fd, data, length, (off_t) offset);
+    return written < 0 || (size_t) written != length;
+}
+
+static int write_index_entry(SampleArchiveWriter *writer, const SampleArchiveSpan *chunk, uint64_t offset) {
+    int64_t end_us = sample_archive_span_end(chunk);
+    if (writer->num_chunks == 0 || end_us > writer->latest_end_us) {
+        writer->latest_end_us = end_us;
+    }
+
+    uint8_t entry[SAMPLE_ARCHIVE_INDEX_ENTRY_LENGTH] = {0};
+    put_u64(entry, (uint64_t) chunk->first_time_us);
+    put_u64(entry + 8, (uint64_t) writer->latest_end_us);
+    put_u64(entry + 16, offset);
+    put_u32(entry + 24, chunk->num_samples);
+    if (write_all(writer->index_fd, entry, sizeof(entry),
+                  SAMPLE_ARCHIVE_INDEX_HEADER_LENGTH + writer->num_chunks * SAMPLE_ARCHIVE_INDEX_ENTRY_LENGTH)) {
+        return 1;
+    }
+    writer->num_chunks++;
+    writer->last_chunk_time_us = chunk->first_time_us;
+    return 0;
+}
+
+/**
+ * @brief
+ * Index the whole chunks after the last indexed one and cut off what
+ * follows them, which is a chunk that was being written when the writer
+ * stopped
+ * @return 0 if success
+ */
+static int recover_archive(SampleArchiveWriter *writer, uint64_t archive_size, uint64_t index_size) {
+    uint8_t entry[SAMPLE_ARCHIVE_INDEX_ENTRY_LENGTH];
+    uint64_t position = SAMPLE_ARCHIVE_HEADER_LENGTH;
+    uint64_t num_entries = (index_size - SAMPLE_ARCHIVE_INDEX_HEADER_LENGTH) / SAMPLE_ARCHIVE_INDEX_ENTRY_LENGTH;
+    if (num_entries > 0) {
+        if (pread(writer->index_fd, entry, sizeof(entry),
+                  SAMPLE_ARCHIVE_INDEX_HEADER_LENGTH + (num_entries - 1) * SAMPLE_ARCHIVE_INDEX_ENTRY_LENGTH) != sizeof(entry)) {
+            return 1;
+        }
+        writer->num_chunks = num_entries;
+        writer->last_chunk_time_us = (int64_t) get_u64(entry);
+        writer->latest_end_us = (int64_t) get_u64(entry + 8);
+        position = get_u64(entry + 16) + chunk_length(get_u32(entry + 24));
+        if (position > archive_size) {
+            fprintf(stderr, "error: the index points past the end of the archive\n");
+            return 1;
+        }
+    }
+    if (ftruncate(writer->index_fd, SAMPLE_ARCHIVE_INDEX_HEADER_LENGTH + num_entries * SAMPLE_ARCHIVE_INDEX_ENTRY_LENGTH)) {
+        return 1;
+    }
+
+    while (position + SAMPLE_ARCHIVE_CHUNK_HEADER_LENGTH <= archive_size) {
+        uint8_t header[SAMPLE_ARCHIVE_CHUNK_HEADER_LENGTH];
+        SampleArchiveSpan chunk;
+        uint32_t crc;
+        if (pread(writer->archive_fd, header, sizeof(header), (off_t) position) != sizeof(header) ||
+            decode_chunk_header(header, writer->header.chunk_samples, &chunk, &crc) ||
+            position + chunk_length(chunk.num_samples) > archive_size) {
+            break;
+        }
+        size_t samples_length = (size_t) chunk.num_samples * SAMPLE_ARCHIVE_SAMPLE_WIDTH;
+        if (pread(writer->archive_fd, writer->chunk_samples, samples_length, (off_t) (position + sizeof(header))) !=
+                (ssize_t) samples_length ||
+            archive_crc32((const uint8_t *) writer->chunk_samples, samples_length) != crc) {
+            break;
+        }
+        if (write_index_entry(writer, &chunk, position)) {
+            return 1;
+        }
+        writer->chunks_reindexed++;
+        position += chunk_length(chunk.num_samples);
+    }
+
+    if (position < archive_size) {
+        if (ftruncate(writer->archive_fd, (off_t) position)) {
+            return 1;
+        }
+        writer->bytes_truncated = archive_size - position;
+    }
+    writer->archive_length = position;
+    return 0;
+}
+
+static int open_files(SampleArchiveWriter *writer, const char path[], const char name[], uint32_t chunk_samples) {
+    char *path_of_index = index_path(path);
+    if (path_of_index == NULL) {
+        return 1;
+    }
+    writer->archive_fd = open(path, O_RDWR | O_CREAT, 0644);
+    writer->index_fd = open(path_of_index, O_RDWR | O_CREAT, 0644);
+    if (writer->archive_fd == -1 || writer->index_fd == -1) {
+        perror(writer->archive_fd == -1 ? path : path_of_index);
+        free(path_of_index);
+        return 1;
+    }
+    free(path_of_index);
+
+    struct stat archive_stat;
+    struct stat index_stat;
+    if (fstat(writer->archive_fd, &archive_stat) || fstat(writer->index_fd, &index_stat)) {
+        perror(path);
+        return 1;
+    }
+
+    uint8_t header[SAMPLE_ARCHIVE_HEADER_LENGTH];
+    uint8_t index_header[SAMPLE_ARCHIVE_INDEX_HEADER_LENGTH];
+    bool created = archive_stat.st_size == 0;
+    if (created) {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        writer->header = (SampleArchiveHeader) {
+            .chunk_samples = chunk_samples,
+            .created_us = (int64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000
+        };
+        strncpy(writer->header.name, name, SAMPLE_ARCHIVE_NAME_LENGTH);
+        encode_header(header, &writer->header);
+        if (write_all(writer->archive_fd, header, sizeof(header), 0)) {
+            perror(path);
+            return 1;
+        }
+        archive_stat.st_size = sizeof(header);
+    }
+    else if (archive_stat.st_size < SAMPLE_ARCHIVE_HEADER_LENGTH ||
+             pread(writer->archive_fd, header, sizeof(header), 0) != sizeof(header) ||
+             decode_header(header, &writer->header)) {
+        fprintf(stderr, "error: %s is not a sample archive\n", path);
+        return 1;
+    }
+
+    // An index that is missing or not an index is built again
+    if (created || index_stat.st_size < SAMPLE_ARCHIVE_INDEX_HEADER_LENGTH ||
+        pread(writer->index_fd, index_header, sizeof(index_header), 0) != sizeof(index_header) ||
+        check_index_header(index_header)) {
+        encode_index_header(index_header);
+        if (ftruncate(writer->index_fd, 0) || write_all(writer->index_fd, index_header, sizeof(index_header), 0)) {
+            perror(path);
+            return 1;
+        }
+        index_stat.st_size = sizeof(index_header);
+    }
+
+    writer->chunk_samples = malloc(writer->header.chunk_samples * sizeof(int32_t));
+    if (writer->chunk_samples == NULL) {
+        return 1;
+    }
+    writer->chunk.samples = writer->chunk_samples;
+    if (recover_archive(writer, archive_stat.st_size, index_stat.st_size)) {
+        perror(path);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief
+ * Open an archive to append to, creating it if it does not exist
+ * @param writer
+ * @param path
+ * @param name Name of the microphone, for a new archive
+ * @param chunk_samples Most samples in a chunk, for a new archive
+ * @return 0 if success
+ */
+int sample_archive_open_writer(SampleArchiveWriter *writer, const char path[], const char name[], uint32_t chunk_samples) {
+    *writer = (SampleArchiveWriter) {
+        .archive_fd = -1,
+        .index_fd = -1
+    };
+    if (chunk_samples == 0 || open_files(writer, path, name, chunk_samples)) {
+        if (writer->archive_fd != -1) {
+            close(writer->archive_fd);
+        }
+        if (writer->index_fd != -1) {
+            close(writer->index_fd);
+        }
+        free(writer->chunk_samples);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief
+ * Write the chunk being filled, even if it is not full. Samples appended
+ * afterwards start a new chunk.
+ * @param writer
+ * @return 0 if success
+ */
+int sample_archive_flush(SampleArchiveWriter *writer) {
+    SampleArchiveSpan *chunk = &writer->chunk;
+    if (chunk->num_samples == 0) {
+        return 0;
+    }
+
+    uint8_t header[SAMPLE_ARCHIVE_CHUNK_HEADER_LENGTH];
+    encode_chunk_header(header, chunk);
+    struct iovec parts[] = {
+        {.iov_base = header, .iov_len = sizeof(header)},
+        {.iov_base = writer->chunk_samples, .iov_len = (size_t) chunk->num_samples * SAMPLE_ARCHIVE_SAMPLE_WIDTH}
+    };
+    uint64_t length = chunk_length(chunk->num_samples);
+    ssize_t written = pwritev(writer->archive_fd, parts, 2, (off_t) writer->archive_length);
+    if (written < 0 || (uint64_t) written != length) {
+        perror("error: could not write archive chunk");
+        return 1;
+    }
+    if (write_index_entry(writer, chunk, writer->archive_length)) {
+        perror("error: could not write archive index");
+        return 1;
+    }
+    writer->archive_length += length;
+    chunk->num_samples = 0;
+    return 0;
+}
+
+/**
+ * @brief
+ * Append contiguous samples. They continue the chunk being filled if they
+ * follow its last sample at its rate and about when it puts them.
+ * @param writer
+ * @param first_sample_index
+ * @param first_time_us Time of the first sample, which may not be earlier
+ * than the start of the last chunk
+ * @param sample_rate_mhz
+ * @param samples
+ * @param num_samples
+ * @return 0 if success
+ */
+int sample_archive_append(
+    SampleArchiveWriter *writer,
+    uint64_t first_sample_index,
+    int64_t first_time_us,
+    uint32_t sample_rate_mhz,
+    const int32_t samples[],
+    size_t num_samples
+) {
+    SampleArchiveSpan *chunk = &writer->chunk;
+    if (sample_rate_mhz == 0) {
+        return 1;
+    }
+
+    while (num_samples > 0) {
+        if (chunk->num_samples > 0) {
+            int64_t expected_us = sample_archive_span_end(chunk);
+            int64_t error_us = first_time_us - expected_us;
+            if (first_sample_index != chunk->first_sample_index + chunk->num_samples ||
+                sample_rate_mhz != chunk->sample_rate_mhz ||
+                error_us > SAMPLE_ARCHIVE_MAX_TIME_ERROR_US || error_us < -SAMPLE_ARCHIVE_MAX_TIME_ERROR_US) {
+                if (sample_archive_flush(writer)) {
+                    return 1;
+                }
+            }
+        }
+        if (chunk->num_samples == 0) {
+            if (writer->num_chunks > 0 && first_time_us < writer->last_chunk_time_us) {
+                fprintf(stderr, "error: samples are earlier than the last chunk of the archive\n");
+                return 1;
+            }
+            chunk->first_sample_index = first_sample_index;
+            chunk->first_time_us = first_time_us;
+            chunk->sample_rate_mhz = sample_rate_mhz;
+        }
+
+        size_t count = writer->header.chunk_samples - chunk->num_samples;
+        if (count > num_samples) {
+            count = num_samples;
+        }
+        memcpy(writer->chunk_samples + chunk->num_samples, samples, count * sizeof(int32_t));
+        chunk->num_samples += count;
+        samples += count;
+        num_samples -= count;
+        first_sample_index += count;
+        first_time_us = sample_archive_span_end(chunk);
+
+        if (chunk->num_samples == writer->header.chunk_samples && sample_archive_flush(writer)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief
+ * Write the chunk being filled and make the archive durable
+ * @param writer
+ * @return 0 if success
+ */
+int sample_archive_close_writer(SampleArchiveWriter *writer) {
+    int result = sample_archive_flush(writer);
+    if (fdatasync(writer->archive_fd) || fdatasync(writer->index_fd)) {
+        perror("error: could not sync archive");
+        result = 1;
+    }
+    close(writer->archive_fd);
+    close(writer->index_fd);
+    free(writer->chunk_samples);
+    writer->chunk_samples = NULL;
+    return result;
+}
+
+static const uint8_t *map_file(const char path[], size_t *out_length) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        perror(path);
+        return NULL;
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat)) {
+        perror(path);
+        close(fd);
+        return NULL;
+    }
+    *out_length = file_stat.st_size;
+    if (*out_length == 0) {
+        close(fd);
+        return NULL;
+    }
+    void *map = mmap(NULL, *out_length, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror(path);
+        return NULL;
+    }
+    return map;
+}
+
+static const uint8_t *index_entry(const SampleArchiveReader *reader, size_t chunk) {
+    return reader->index + SAMPLE_ARCHIVE_INDEX_HEADER_LENGTH + chunk * SAMPLE_ARCHIVE_INDEX_ENTRY_LENGTH;
+}
+
+/**
+ * @brief
+ * Map an archive and its index to read from. Chunks appended by a writer
+ * afterwards are not seen.
+ * @param reader
+ * @param path
+ * @return 0 if success
+ */
+int sample_archive_open_reader(SampleArchiveReader *reader, const char path[]) {
+    *reader = (SampleArchiveReader) {0};
+    char *path_of_index = index_path(path);
+    if (path_of_index == NULL) {
+        return 1;
+    }
+
+    reader->archive = map_file(path, &reader->archive_length);
+    if (reader->archive != NULL) {
+        reader->index = map_file(path_of_index, &reader->index_length);
+    }
+    free(path_of_index);
+    if (reader->archive == NULL || reader->index == NULL) {
+        sample_archive_close_reader(reader);
+        return 1;
+    }
+    if (reader->archive_length < SAMPLE_ARCHIVE_HEADER_LENGTH || decode_header(reader->archive, &reader->header) ||
+        reader->index_length < SAMPLE_ARCHIVE_INDEX_HEADER_LENGTH || check_index_header(reader->index)) {
+        fprintf(stderr, "error: %s is not a sample archive with an index\n", path);
+        sample_archive_close_reader(reader);
+        return 1;
+    }
+
+    // Leave out entries for chunks written after the archive was mapped
+    reader->num_chunks = (reader->index_length - SAMPLE_ARCHIVE_INDEX_HEADER_LENGTH) / SAMPLE_ARCHIVE_INDEX_ENTRY_LENGTH;
+    while (reader->num_chunks > 0) {
+        const uint8_t *entry = index_entry(reader, reader->num_chunks - 1);
+        if (get_u64(entry + 16) + chunk_length(get_u32(entry + 24)) <= reader->archive_length) {
+            break;
+        }
+        reader->num_chunks--;
+    }
+    return 0;
+}
+
+void sample_archive_close_reader(SampleArchiveReader *reader) {
+    if (reader->archive != NULL) {
+        munmap((void *) reader->archive, reader->archive_length);
+    }
+    if (reader->index != NULL) {
+        munmap((void *) reader->index, reader->index_length);
+    }
+    *reader = (SampleArchiveReader) {0};
+}
+
+/**
+ * @brief
+ * Get a chunk without copying its samples
+ * @param reader
+ * @param chunk Chunk number, from 0
+ * @param out_span
+ * @return 0 if success
+ */
+int sample_archive_read_chunk(const SampleArchiveReader *reader, size_t chunk, SampleArchiveSpan *out_span) {
+    if (chunk >= reader->num_chunks) {
+        return 1;
+    }
+    uint64_t offset = get_u64(index_entry(reader, chunk) + 16);
+    uint32_t crc;
+    if (offset + SAMPLE_ARCHIVE_CHUNK_HEADER_LENGTH > reader->archive_length ||
+        decode_chunk_header(reader->archive + offset, reader->header.chunk_samples, out_span, &crc) ||
+        offset + chunk_length(out_span->num_samples) > reader->archive_length) {
+        return 1;
+    }
+    out_span->samples = (const int32_t *) (reader->archive + offset + SAMPLE_ARCHIVE_CHUNK_HEADER_LENGTH);
+    return 0;
+}
+
+/**
+ * @brief
+ * @param reader
+ * @param chunk
+ * @return 0 if the chunk's samples match its CRC
+ */
+int sample_archive_verify_chunk(const SampleArchiveReader *reader, size_t chunk) {
+    SampleArchiveSpan span;
+    if (sample_archive_read_chunk(reader, chunk, &span)) {
+        return 1;
+    }
+    const uint8_t *header = (const uint8_t *) span.samples - SAMPLE_ARCHIVE_CHUNK_HEADER_LENGTH;
+    return archive_crc32((const uint8_t *) span.samples, span.num_samples * SAMPLE_ARCHIVE_SAMPLE_WIDTH) !=
+        get_u32(header + 28);
+}
+
+/**
+ * @brief
+ * Start reading the samples taken from `start_us` up to but not including
+ * `end_us`. The first chunk that could hold any is found by a binary search
+ * of the index.
+ * @param reader
+ * @param start_us
+ * @param end_us
+ * @param out_query
+ */
+void sample_archive_query(
+    const SampleArchiveReader *reader,
+    int64_t start_us,
+    int64_t end_us,
+    SampleArchiveQuery *out_query
+) {
+    // The latest end is never less for a later chunk
+    size_t low = 0;
+    size_t high = reader->num_chunks;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if ((int64_t) get_u64(index_entry(reader, middle) + 8) > start_us) {
+            high = middle;
+        }
+        else {
+            low = middle + 1;
+        }
+    }
+    *out_query = (SampleArchiveQuery) {
+        .reader = reader,
+        .chunk = low,
+        .start_us = start_us,
+        .end_us = end_us
+    };
+}
+
+/**
+ * @brief
+ * @return Offset of the first sample of the span taken at or after `time_us`
+ */
+static uint32_t offset_at(const SampleArchiveSpan *span, int64_t time_us) {
+    if (time_us <= span->first_time_us) {
+        return 0;
+    }
+    double estimate = (double) (time_us - span->first_time_us) * span->sample_rate_mhz / 1E9;
+    uint64_t offset = estimate > span->num_samples ? span->num_samples : (uint64_t) estimate;
+    while (offset < span->num_samples && sample_archive_sample_time(span, offset) < time_us) {
+        offset++;
+    }
+    while (offset > 0 && sample_archive_sample_time(span, offset - 1) >= time_us) {
+        offset--;
+    }
+    return (uint32_t) offset;
+}
+
+/**
+ * @brief
+ * Get the next contiguous run of samples in the query's time range
+ * @param query
+ * @param out_span Points into the archive's mapping
+ * @return false once there are no more
+ */
+bool sample_archive_query_next(SampleArchiveQuery *query, SampleArchiveSpan *out_span) {
+    const SampleArchiveReader *reader = query->reader;
+    while (query->chunk < reader->num_chunks) {
+        // Chunks start in time order
+        if ((int64_t) get_u64(index_entry(reader, query->chunk)) >= query->end_us) {
+            return false;
+        }
+        SampleArchiveSpan chunk;
+        if (sample_archive_read_chunk(reader, query->chunk++, &chunk)) {
+            return false;
+        }
+
+        uint32_t first = offset_at(&chunk, query->start_us);
+        uint32_t end = offset_at(&chunk, query->end_us);
+        if (first < end) {
+            *out_span = (SampleArchiveSpan) {
+                .first_sample_index = chunk.first_sample_index + first,
+                .first_time_us = sample_archive_sample_time(&chunk, first),
+                .sample_rate_mhz = chunk.sample_rate_mhz,
+                .num_samples = end - first,
+                .samples = chunk.samples + first
+            };
+            return true;
+        }
+    }
+    return false;
+}
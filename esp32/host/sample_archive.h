@@ -0,0 +1,158 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * Append-only archive of one microphone's samples, for reading any stretch
+ * of time back quickly from months of them. All fields are little-endian,
+ * unlike telemetry frames, so that samples can be read in place from a
+ * mapping of the file.
+ *
+ * The archive starts with a header:
+ *
+ *   offset  size  field
+ *   0       4     magic "IARC"
+ *   4       1     format version
+ *   5       3     reserved, zero
+ *   8       4     most samples in a chunk
+ *   12      4     reserved, zero
+ *   16      8     time the archive was created, microseconds since the epoch
+ *   24      32    name of the microphone, NUL padded
+ *   56      8     reserved, zero
+ *
+ * followed by chunks of contiguous samples at one rate, each:
+ *
+ *   0       4     magic "ICHK"
+ *   4       4     number of samples, n
+ *   8       8     index of the first sample
+ *   16      8     time of the first sample, microseconds since the epoch
+ *   24      4     sample rate in millihertz
+ *   28      4     CRC-32 of the samples
+ *   32      4n    samples as 32-bit two's complement words
+ *
+ * Sample k of a chunk was taken k / rate after its first. A gap in the
+ * sample index, a change of rate or a jump in time starts a new chunk, and
+ * chunks start in time order.
+ *
+ * The sparse time index, in a file beside the archive named with
+ * SAMPLE_ARCHIVE_INDEX_SUFFIX, has one entry per chunk after its header:
+ *
+ *   0       4     magic "IIDX"
+ *   4       1     format version
+ *   5       11    reserved, zero
+ *
+ *   0       8     time of the chunk's first sample
+ *   8       8     latest end of this or an earlier chunk, where the end of
+ *                 a chunk is the time after its last sample
+ *   16      8     offset of the chunk in the archive
+ *   24      4     number of samples in the chunk
+ *   28      4     reserved, zero
+ *
+ * A chunk is written before its index entry, so the index can always be
+ * brought up to date from the archive. Chunks past the end of the index are
+ * indexed again, and a chunk cut short is dropped, when an archive is next
+ * opened for writing.
+ */
+
+#define SAMPLE_ARCHIVE_MAGIC 0x43524149
+#define SAMPLE_ARCHIVE_CHUNK_MAGIC 0x4b484349
+#define SAMPLE_ARCHIVE_INDEX_MAGIC 0x58444949
+#define SAMPLE_ARCHIVE_VERSION 1
+
+#define SAMPLE_ARCHIVE_HEADER_LENGTH 64
+#define SAMPLE_ARCHIVE_CHUNK_HEADER_LENGTH 32
+#define SAMPLE_ARCHIVE_INDEX_HEADER_LENGTH 16
+#define SAMPLE_ARCHIVE_INDEX_ENTRY_LENGTH 32
+#define SAMPLE_ARCHIVE_SAMPLE_WIDTH 4
+#define SAMPLE_ARCHIVE_NAME_LENGTH 32
+
+#define SAMPLE_ARCHIVE_INDEX_SUFFIX ".idx"
+
+// About 8 s at 1000 samples/s, and 32 KiB
+#define SAMPLE_ARCHIVE_DEFAULT_CHUNK_SAMPLES 8192
+
+// Samples whose given time is further than this from where the chunk being
+// written puts them start a new chunk
+#define SAMPLE_ARCHIVE_MAX_TIME_ERROR_US 100000
+
+/**
+ * @brief
+ * Contiguous samples at one rate. Spans read from an archive point into its
+ * mapping.
+ */
+typedef struct {
+    uint64_t first_sample_index;
+    int64_t first_time_us;
+    uint32_t sample_rate_mhz;
+    uint32_t num_samples;
+    const int32_t *samples;
+} SampleArchiveSpan;
+
+typedef struct {
+    uint32_t chunk_samples;
+    int64_t created_us;
+    char name[SAMPLE_ARCHIVE_NAME_LENGTH + 1];
+} SampleArchiveHeader;
+
+typedef struct {
+    int archive_fd;
+    int index_fd;
+    SampleArchiveHeader header;
+    uint64_t archive_length;
+    uint64_t num_chunks;
+    int64_t last_chunk_time_us;
+    int64_t latest_end_us;
+
+    // Chunk being filled, written when full or flushed
+    SampleArchiveSpan chunk;
+    int32_t *chunk_samples;
+
+    // Repairs made when the archive was opened
+    uint64_t chunks_reindexed;
+    uint64_t bytes_truncated;
+} SampleArchiveWriter;
+
+typedef struct {
+    SampleArchiveHeader header;
+    const uint8_t *archive;
+    size_t archive_length;
+    const uint8_t *index;
+    size_t index_length;
+    size_t num_chunks;
+} SampleArchiveReader;
+
+typedef struct {
+    const SampleArchiveReader *reader;
+    size_t chunk;
+    int64_t start_us;
+    int64_t end_us;
+} SampleArchiveQuery;
+
+int64_t sample_archive_sample_time(const SampleArchiveSpan *span, uint64_t offset);
+int64_t sample_archive_span_end(const SampleArchiveSpan *span);
+
+int sample_archive_open_writer(SampleArchiveWriter *writer, const char path[], const char name[], uint32_t chunk_samples);
+int sample_archive_append(
+    SampleArchiveWriter *writer,
+    uint64_t first_sample_index,
+    int64_t first_time_us,
+    uint32_t sample_rate_mhz,
+    const int32_t samples[],
+    size_t num_samples
+);
+int sample_archive_flush(SampleArchiveWriter *writer);
+int sample_archive_close_writer(SampleArchiveWriter *writer);
+
+int sample_archive_open_reader(SampleArchiveReader *reader, const char path[]);
+void sample_archive_close_reader(SampleArchiveReader *reader);
+int sample_archive_read_chunk(const SampleArchiveReader *reader, size_t chunk, SampleArchiveSpan *out_span);
+int sample_archive_verify_chunk(const SampleArchiveReader *reader, size_t chunk);
+void sample_archive_query(
+    const SampleArchiveReader *reader,
+    int64_t start_us,
+    int64_t end_us,
+    SampleArchiveQuery *out_query
+);
+bool sample_archive_query_next(SampleArchiveQuery *query, SampleArchiveSpan *out_span);
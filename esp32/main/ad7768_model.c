@@ -0,0 +1,194 @@
+#include <string.h>
+
+#include "ad7768_model.h"
+#include "adc_profile.h"
+
+#define CONVERSION_RESULT_REGISTER 0x2c
+
+// The first bit of the command byte is zero and the second selects a read
+#define READ_COMMAND 0x40
+#define ADDRESS_MASK 0x3f
+
+#define INTERFACE_FORMAT_CONTINUOUS_READ 0x01
+#define INTERFACE_FORMAT_CRC_SELECT_SHIFT 2
+#define INTERFACE_FORMAT_STATUS_ENABLE 0x10
+#define SYNC_RESET_SPI_SYNC 0x80
+
+#define CRC_POLYNOMIAL 0x07
+#define CRC_SEED 0xFF
+
+// At power on the model converts with a sinc5 filter decimating by 1024
+// from MCLK / 16
+#define RESET_DIGITAL_FILTER 0x07
+
+static void synchronize(Ad7768Model *model);
+
+/**
+ * @brief
+ * @param model
+ * @param signal Waveform the model converts
+ * @param mclk_frequency MCLK supplied to the model, in Hz
+ */
+void ad7768_model_initialize(Ad7768Model *model, const WaveformSettings *signal, double mclk_frequency) {
+    *model = (Ad7768Model) {
+        .mclk_frequency = mclk_frequency,
+        .crc = CRC_SEED
+    };
+    model->registers[ADC_DIGITAL_FILTER_REGISTER] = RESET_DIGITAL_FILTER;
+    waveform_initialize(&model->waveform, signal, 1);
+    synchronize(model);
+    model->num_syncs = 0;
+}
+
+/**
+ * @brief
+ * Change the MCLK, which changes the output data rate at once, as a trim of
+ * the clock does on the chip
+ */
+void ad7768_model_set_mclk(Ad7768Model *model, double mclk_frequency) {
+    model->mclk_frequency = mclk_frequency;
+    waveform_set_sample_rate(&model->waveform, ad7768_model_output_data_rate(model));
+}
+
+/**
+ * @brief
+ * @return Conversions per second
+ */
+double ad7768_model_output_data_rate(const Ad7768Model *model) {
+    return model->mclk_frequency / model->mclk_division / model->decimation_rate;
+}
+
+static bool status_enabled(const Ad7768Model *model) {
+    return model->registers[ADC_INTERFACE_FORMAT_REGISTER] & INTERFACE_FORMAT_STATUS_ENABLE;
+}
+
+/**
+ * @brief
+ * @return Conversions per CRC byte, or 0 for no CRC
+ */
+static unsigned int crc_interval(const Ad7768Model *model) {
+    switch ((model->registers[ADC_INTERFACE_FORMAT_REGISTER] >> INTERFACE_FORMAT_CRC_SELECT_SHIFT) & 0b11) {
+        case 0b01: return 4;
+        case 0b10: return 16;
+        default: return 0;
+    }
+}
+
+static uint8_t crc8(uint8_t crc, const uint8_t bytes[], size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        crc ^= bytes[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = crc & 0x80 ? (crc << 1) ^ CRC_POLYNOMIAL : crc << 1;
+        }
+    }
+    return crc;
+}
+
+static void restart_crc(Ad7768Model *model) {
+    model->crc_conversions = 0;
+    model->crc = CRC_SEED;
+}
+
+/**
+ * @brief
+ * Restart the digital filter with the power mode and decimation rate in
+ * the registers
+ */
+static void synchronize(Ad7768Model *model) {
+    switch ((model->registers[ADC_POWER_CLOCK_REGISTER] >> 4) & 0b11) {
+        case 0b11: model->mclk_division = 2; break;
+        case 0b10: model->mclk_division = 4; break;
+        case 0b01: model->mclk_division = 8; break;
+        default: model->mclk_division = 16;
+    }
+    unsigned int decimation_code = model->registers[ADC_DIGITAL_FILTER_REGISTER] & 0b111;
+    model->decimation_rate = decimation_code >= 5 ? 1024 : 32u << decimation_code;
+
+    waveform_set_sample_rate(&model->waveform, ad7768_model_output_data_rate(model));
+    restart_crc(model);
+    model->num_syncs++;
+}
+
+static void write_register(Ad7768Model *model, uint8_t address, uint8_t value) {
+    uint8_t previous = model->registers[address];
+    model->registers[address] = value;
+
+    if (address == ADC_INTERFACE_FORMAT_REGISTER) {
+        model->continuous_read = value & INTERFACE_FORMAT_CONTINUOUS_READ;
+        restart_crc(model);
+    }
+    else if (address == ADC_SYNC_RESET_REGISTER &&
+             (value & SYNC_RESET_SPI_SYNC) && ! (previous & SYNC_RESET_SPI_SYNC)) {
+        synchronize(model);
+    }
+}
+
+/**
+ * @brief
+ * Make the next conversion from the waveform, replacing the last one, as
+ * the chip does when it raises DRDY
+ */
+void ad7768_model_convert(Ad7768Model *model) {
+    int32_t sample = waveform_next(&model->waveform);
+    model->output[0] = (uint8_t) (sample >> 16);
+    model->output[1] = (uint8_t) (sample >> 8);
+    model->output[2] = (uint8_t) sample;
+    model->output_length = AD7768_MODEL_DATA_BYTES;
+    if (status_enabled(model)) {
+        model->output[model->output_length++] = model->status;
+    }
+
+    unsigned int interval = crc_interval(model);
+    if (interval > 0) {
+        model->crc = crc8(model->crc, model->output, model->output_length);
+        if (++model->crc_conversions == interval) {
+            model->output[model->output_length++] = model->crc;
+            restart_crc(model);
+        }
+    }
+    model->num_conversions++;
+}
+
+/**
+ * @brief
+ * One SPI transaction, chip select to chip select. Outside continuous read
+ * mode the first byte is a command, and a write's second byte the value.
+ * In continuous read mode the latest conversion is shifted out whatever is
+ * sent, unless it is a read of the conversion result register, which leaves
+ * the mode.
+ * @param model
+ * @param tx Bytes sent to the model, or NULL to send zeros
+ * @param rx Receives as many bytes as are sent
+ * @param length
+ */
+void ad7768_model_transfer(Ad7768Model *model, const uint8_t tx[], uint8_t rx[], size_t length) {
+    memset(rx, 0, length);
+    if (length == 0) {
+        return;
+    }
+
+    uint8_t command = tx != NULL ? tx[0] : 0;
+    if (model->continuous_read) {
+        if (command != (READ_COMMAND | CONVERSION_RESULT_REGISTER)) {
+            memcpy(rx, model->output, length < model->output_length ? length : model->output_length);
+            return;
+        }
+        model->continuous_read = false;
+        model->registers[ADC_INTERFACE_FORMAT_REGISTER] &= ~INTERFACE_FORMAT_CONTINUOUS_READ;
+    }
+
+    uint8_t address = command & ADDRESS_MASK;
+    if (command & READ_COMMAND) {
+        if (address == CONVERSION_RESULT_REGISTER) {
+            // The CRC is only given in continuous read mode
+            size_t output_length = AD7768_MODEL_DATA_BYTES + status_enabled(model);
+            memcpy(rx + 1, model->output, length - 1 < output_length ? length - 1 : output_length);
+        }
+        else if (length > 1) {
+            rx[1] = model->registers[address];
+        }
+    }
+    else if (length > 1) {
+        write_register(model, address, tx[1]);
+    }
+}
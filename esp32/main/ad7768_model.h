@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "waveform.h"
+
+// Register addresses are six bits
+#define AD7768_MODEL_NUM_REGISTERS 64
+
+// A conversion is shifted out as three data bytes, the status byte when it
+// is enabled and a CRC byte when one is due
+#define AD7768_MODEL_DATA_BYTES 3
+#define AD7768_MODEL_MAX_OUTPUT_LENGTH 5
+
+/**
+ * @brief
+ * Software model of the AD7768-1 as the firmware drives it, for running the
+ * firmware without the chip. It decodes the SPI command byte, keeps the
+ * register file, converts a synthetic waveform at the output data rate
+ * set by the POWER_CLOCK and DIGITAL_FILTER registers, and shifts
+ * conversions out in command or continuous read mode with the status byte
+ * and CRC-8 the INTERFACE_FORMAT register asks for.
+ *
+ * Like the chip, the model holds only the latest conversion, so one that is
+ * not read before the next is lost, and its CRC window counts conversions
+ * whether or not they were read.
+ */
+typedef struct {
+    uint8_t registers[AD7768_MODEL_NUM_REGISTERS];
+    double mclk_frequency;
+    Waveform waveform;
+
+    // Settings latched by the last SPI_SYNC, which the modulator runs at
+    unsigned int mclk_division;
+    unsigned int decimation_rate;
+
+    bool continuous_read;
+    // The latest conversion as it is shifted out
+    uint8_t output[AD7768_MODEL_MAX_OUTPUT_LENGTH];
+    size_t output_length;
+    // Status byte given with every conversion
+    uint8_t status;
+
+    unsigned int crc_conversions;
+    uint8_t crc;
+
+    uint64_t num_conversions;
+    unsigned long num_syncs;
+} Ad7768Model;
+
+void ad7768_model_initialize(Ad7768Model *model, const WaveformSettings *signal, double mclk_frequency);
+void ad7768_model_set_mclk(Ad7768Model *model, double mclk_frequency);
+double ad7768_model_output_data_rate(const Ad7768Model *model);
+void ad7768_model_convert(Ad7768Model *model);
+void ad7768_model_transfer(Ad7768Model *model, const uint8_t tx[], uint8_t rx[], size_t length);
@@ -1,9 +1,11 @@
-#include <assert.h>
+#include <sys/time.h>
+
 #include "esp_log.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
 
 #include "driver/gpio.h"
 
@@ -17,15 +19,63 @@
 #include "driver/spi_master.h"
 
 #include "esp_intr_alloc.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+
+#include "nvs.h"
 
 #include "adc.h"
+#include "adc_readout.h"
+#include "pipeline_stats.h"
+#include "clock_discipline.h"
+#include "apll.h"
+#include "agc.h"
+#include "vga.h"
+#include "memory_plan.h"
+#ifdef CONFIG_ADC_EMULATED
+#include "adc_emulator.h"
+#endif
 
 #define ADC_CLOCK_PIN GPIO_NUM_0
-
-#define IDEAL_ADC_CLOCK_FREQ 16.384E6
-#define SPI_CLOCK_SPEED 20000000
 #define DATA_READY_PIN GPIO_NUM_34
 
+#define PROFILE_NVS_NAMESPACE "adc"
+#define PROFILE_NVS_KEY "profile"
+#define GAIN_NVS_KEY "gain"
+#define AGC_NVS_KEY "agc"
+#define MAX_PROFILE_NAME_LENGTH 32
+// How long a profile change may take before the caller gives up on it
+#define PROFILE_CHANGE_TIMEOUT_MS 1000
+
+#define CPU_LOAD_WINDOW_US 1000000
+
+#define ACQUISITION_TASK_STACK_SIZE 4096
+#define ACQUISITION_TASK_PRIORITY 22
+#define ACQUISITION_TASK_CORE 1
+
+#define DISCIPLINE_TASK_STACK_SIZE 3072
+#define DISCIPLINE_TASK_PRIORITY 5
+#define DISCIPLINE_QUEUE_LENGTH 4
+
+#ifdef CONFIG_ADC_STATUS_OUTPUT
+#define ADC_STATUS_BYTES 1
+#else
+#define ADC_STATUS_BYTES 0
+#endif
+
+#if defined(CONFIG_ADC_CRC_4_SAMPLES)
+#define ADC_CRC_INTERVAL 4
+#define ADC_CRC_SELECT 0b01
+#elif defined(CONFIG_ADC_CRC_16_SAMPLES)
+#define ADC_CRC_INTERVAL 16
+#define ADC_CRC_SELECT 0b10
+#else
+#define ADC_CRC_INTERVAL 0
+#define ADC_CRC_SELECT 0b00
+#endif
+
 typedef struct {
     unsigned int gpio_num;
     unsigned int iomux_signal;
@@ -73,7 +123,7 @@ const SpiDeviceConfig adc_device_config = {
         .address_bits = 6,
         .dummy_bits = 0,
         .mode = 3,
-        .clock_speed_hz = SPI_CLOCK_SPEED,
+        .clock_speed_hz = 0, // Set by the ADC profile
         .spics_io_num = GPIO_NUM_5,
         .queue_size = 5
     }
@@ -99,19 +149,6 @@ const spi_bus_config_t adc_spi_bus_config = {
 const uint16_t read_command = 0b01;
 const uint16_t write_command = 0b00; 
 
-const uint64_t digital_filter_register = 0x19;
-const uint8_t digital_filter_type = 0b100 << 4;
-const uint8_t digital_filter_decimation_rate = 0b111;
-
-spi_transaction_t set_digital_filter_transaction = {
-    .flags = SPI_TRANS_USE_TXDATA,
-    .cmd = write_command,
-    .addr = digital_filter_register,
-    .length = 8,
-    .rxlength = 8,
-    .tx_data = {digital_filter_type | digital_filter_decimation_rate, 0, 0, 0}
-};
-
 const uint64_t offset_calibration_register = 0x21;
 const int8_t calibration_offset = 0;
 spi_transaction_t set_calibration_transaction = {
@@ -123,55 +160,498 @@ spi_transaction_t set_calibration_transaction = {
     .tx_data = {calibration_offset, 0, 0, 0}
 };
 
+const uint8_t adc_sync_reset_spi_sync = 0b1 << 7;
+
+const uint8_t interface_format_continuous_read = 0b1;
+const uint8_t interface_format_crc_select_shift = 2;
+const uint8_t interface_format_status_enable = 0b1 << 4;
+
 const uint64_t conversion_result_register = 0x2c;
+
+// Conversion results are received by DMA, so the receive buffer must live in 
+// internal memory and be word aligned.
+static WORD_ALIGNED_ATTR DRAM_ATTR uint8_t read_adc_buffer[8];
 spi_transaction_t read_adc_transaction = {
-    .flags = SPI_TRANS_USE_RXDATA,
     .cmd = read_command,
     .addr = conversion_result_register,
     .length = 32,
+    .rxlength = 32,
+    .rx_buffer = read_adc_buffer
+};
+
+// In continuous read mode the ADC shifts out each conversion as soon as it is 
+// selected, so the read has no command or address phase. Its length depends 
+// on whether a CRC byte is due.
+spi_transaction_ext_t continuous_read_transaction = {
+    .base = {
+        .flags = SPI_TRANS_VARIABLE_CMD | SPI_TRANS_VARIABLE_ADDR,
+        .rx_buffer = read_adc_buffer
+    },
+    .command_bits = 0,
+    .address_bits = 0
 };
 
 static const char *TAG = "ADC";
 
 spi_device_handle_t adc_device;
+static TaskHandle_t acquisition_task_handle;
+PLANNED_TASK(acquisition_task_plan, "adc_acquisition", ACQUISITION_TASK_STACK_SIZE);
+
+static const AdcProfile *active_profile;
+static double adc_clock_frequency;
+static double adc_sample_rate;
+static int spi_clock_speed;
+static volatile uint32_t data_ready_cycles;
+
+// Conversions since boot and the esp_timer time of the latest one, written by 
+// the data ready interrupt. Readers must use `read_data_ready`.
+static volatile uint32_t data_ready_count;
+static volatile int64_t data_ready_time_us;
+static portMUX_TYPE data_ready_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// APLL settings and MCLK frequency of the active profile, which the 
+// discipline trims about
+static ApllCoefficients apll_coefficients;
+static double nominal_adc_clock_frequency;
+
+/**
+ * @brief 
+ * A moment at which the UTC time is known, with the conversion count and 
+ * data ready time at that moment. A pulse per second reference is captured 
+ * before its second is known, in which case `utc_time_us` is zero.
+ */
+typedef struct {
+    int64_t utc_time_us;
+    int64_t timer_time_us;
+    uint32_t count;
+    int64_t data_ready_time_us;
+} ClockReference;
+
+// The discipline is updated by its task and read by acquisition and the CLI
+static ClockDiscipline clock_discipline;
+static portMUX_TYPE clock_discipline_lock = portMUX_INITIALIZER_UNLOCKED;
+#ifdef CONFIG_ADC_CLOCK_DISCIPLINE
+static QueueHandle_t clock_references;
+static StaticQueue_t clock_references_buffer;
+static uint8_t clock_references_storage[DISCIPLINE_QUEUE_LENGTH * sizeof(ClockReference)];
+PLANNED_TASK(discipline_task_plan, "adc_clock", DISCIPLINE_TASK_STACK_SIZE);
+#endif
+static volatile bool wall_clock_synchronized;
+
+// Gain is only changed by the acquisition task, between blocks, so that each 
+// block is sampled at one gain. A manual gain waits in `requested_vga_gain`.
+// `agc` belongs to the acquisition task, which restarts it when `agc_restart` 
+// is set and copies it to `agc_status` under `agc_lock` for other tasks.
+static Agc agc;
+static Agc agc_status;
+static atomic_bool agc_restart;
+static volatile bool agc_enabled;
+static portMUX_TYPE agc_lock = portMUX_INITIALIZER_UNLOCKED;
+static atomic_int requested_vga_gain = -1;
+static bool vga_gain_changed;
+
+// A profile change is handed to the acquisition task, which makes it between 
+// conversions and gives `profile_changed` when done
+static const AdcProfile *volatile requested_profile;
+static volatile int profile_change_result;
+static SemaphoreHandle_t profile_changed;
+static StaticSemaphore_t profile_changed_buffer;
+
+// Another sample source can take the broker over from acquisition, which 
+// then stops reading the ADC. The handover is made by the acquisition task 
+// between conversions, like a profile change, and the sample index runs on 
+// across it in `handover_sample_index`.
+static volatile int requested_pause = -1;
+static bool acquisition_paused;
+static volatile uint64_t handover_sample_index;
+static SemaphoreHandle_t pause_changed;
+static StaticSemaphore_t pause_changed_buffer;
+
+// Share of its core used by the acquisition task over the last window
+static volatile float acquisition_cpu_load;
+
+// Decodes conversions. Whether the continuous readout is known to be in 
+// step with the ADC's CRC window is kept in `readout.synchronized`; it is 
+// not after a missed conversion or a failed read.
+static AdcReadout readout;
+
+extern PipelineStats pipeline_stats;
 
 void start_adc_clock(void);
+static int set_adc_clock(double frequency);
+static void trim_adc_clock(double correction_ppm);
+static int configure_adc_interface(void);
+static const AdcProfile *load_adc_profile(void);
+static void load_gain_settings(void);
+static void save_gain_settings(unsigned int gain, bool automatic);
+static void enable_automatic_gain(bool enabled);
+static int apply_adc_profile(const AdcProfile *profile);
+static int write_adc_register(uint8_t address, uint8_t value);
+static int transfer(spi_transaction_t *transaction);
+static esp_err_t polling_transmit(spi_transaction_t *transaction);
 int initialize_spi_bus(const SpiBusConfig *bus_config);
 int initialize_device_spi(SpiDeviceConfig device_config, spi_device_handle_t *device);
 void initialize_iomux_pin(IoMuxPinConfig pin_config);
-void data_ready_isr(void *adc_samples);
-int start_collecting_samples(QueueHandle_t *adc_samples);
+void data_ready_isr(void *acquisition_task);
+void acquisition_task(void *sample_broker);
+static int start_clock_discipline(void);
+static int attach_pps_interrupt(void);
+static void read_data_ready(uint32_t *out_count, int64_t *out_time_us);
+static int64_t conversion_utc_time_us(uint32_t count, int64_t time_us, uint32_t *flags);
+static void reset_clock_discipline(double nominal_rate);
+int start_collecting_samples(SampleBroker *sample_broker);
 
 /**
  * @brief
- * Initialize the external ADC and begin collecting samples. Sample data is stored in a queue.
- * @param adc_samples Queue of `int` to store samples in. 
+ * Initialize the external ADC and begin collecting samples. Sample blocks are published to a broker.
+ * @param sample_broker Broker to publish blocks of samples to. The ADC is its only producer.
  * @return 0 if success
  */
-int initialize_adc(QueueHandle_t *adc_samples) {
+int initialize_adc(SampleBroker *sample_broker) {
+    const AdcProfile *profile = load_adc_profile();
+    adc_readout_initialize(&readout, ADC_STATUS_BYTES, ADC_CRC_INTERVAL);
+    profile_changed = xSemaphoreCreateBinaryStatic(&profile_changed_buffer);
+    pause_changed = xSemaphoreCreateBinaryStatic(&pause_changed_buffer);
+    if (profile_changed == NULL || pause_changed == NULL) {
+        ESP_LOGE(TAG, "Failed to create ADC profile change semaphores");
+        return 1;
+    }
+
+#ifdef CONFIG_ADC_EMULATED
+    if (initialize_adc_emulator(profile->mclk_frequency)) {
+        return 1;
+    }
+#else
     start_adc_clock();
     if (initialize_spi_bus(adc_device_config.bus_config)) {
         return 1;
     }
-    if (initialize_device_spi(adc_device_config, &adc_device)) {
+    SpiDeviceConfig device_config = adc_device_config;
+    device_config.interface_configuration.clock_speed_hz = profile->spi_clock_speed;
+    if (initialize_device_spi(device_config, &adc_device)) {
         return 1;
     };
+#endif
+    spi_clock_speed = profile->spi_clock_speed;
+
+    // The ADC is not reset with the ESP32, so it may still be in continuous 
+    // read mode, where it ignores register writes. Reading the conversion 
+    // result leaves that mode.
+    if (transfer(&read_adc_transaction)) {
+        ESP_LOGE(TAG, "Failed to read ADC conversion result");
+        return 1;
+    }
+
+    ESP_ERROR_CHECK(polling_transmit(&set_calibration_transaction));
+
+    if (start_clock_discipline()) {
+        return 1;
+    }
 
-    esp_err_t error = spi_device_polling_transmit(adc_device, &set_digital_filter_transaction);
+    if (apply_adc_profile(profile)) {
+        return 1;
+    }
+
+    load_gain_settings();
+    start_collecting_samples(sample_broker);
+    return 0;
+}
+
+/**
+ * @brief 
+ * @return The profile saved in NVS, or the default profile if none was saved 
+ * or the saved one no longer exists
+ */
+static const AdcProfile *load_adc_profile(void) {
+    const AdcProfile *profile = NULL;
+    nvs_handle_t nvs;
+    if (nvs_open(PROFILE_NVS_NAMESPACE, NVS_READONLY, &nvs) == ESP_OK) {
+        char name[MAX_PROFILE_NAME_LENGTH + 1];
+        size_t length = sizeof(name);
+        if (nvs_get_str(nvs, PROFILE_NVS_KEY, name, &length) == ESP_OK) {
+            profile = find_adc_profile(name);
+            if (profile == NULL) {
+                ESP_LOGW(TAG, "Saved ADC profile %s does not exist", name);
+            }
+        }
+        nvs_close(nvs);
+    }
+    return profile != NULL ? profile : find_adc_profile(ADC_DEFAULT_PROFILE_NAME);
+}
+
+static int save_adc_profile(const AdcProfile *profile) {
+    nvs_handle_t nvs;
+    esp_err_t error = nvs_open(PROFILE_NVS_NAMESPACE, NVS_READWRITE, &nvs);
     if (error != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to set ADC digital filter params. details: %s", esp_err_to_name(error));
+        ESP_LOGE(TAG, "Failed to open NVS to save the ADC profile. details: %s", esp_err_to_name(error));
         return 1;
     }
+    error = nvs_set_str(nvs, PROFILE_NVS_KEY, profile->name);
+    if (error == ESP_OK) {
+        error = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    if (error != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to save the ADC profile. details: %s", esp_err_to_name(error));
+        return 1;
+    }
+    return 0;
+}
 
-    ESP_ERROR_CHECK(spi_device_polling_transmit(adc_device, &set_calibration_transaction));
+/**
+ * @brief 
+ * Set the gain and AGC saved in NVS, if any, before the first block
+ */
+static void load_gain_settings(void) {
+    nvs_handle_t nvs;
+    if (nvs_open(PROFILE_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return;
+    }
+    uint8_t gain;
+    if (nvs_get_u8(nvs, GAIN_NVS_KEY, &gain) == ESP_OK && set_vga_gain(gain)) {
+        ESP_LOGW(TAG, "Saved VGA gain %u could not be set", gain);
+    }
+    uint8_t automatic;
+    if (nvs_get_u8(nvs, AGC_NVS_KEY, &automatic) == ESP_OK && automatic) {
+        enable_automatic_gain(true);
+    }
+    nvs_close(nvs);
+}
 
-    error = gpio_install_isr_service(ESP_INTR_FLAG_LOWMED);
+/**
+ * @brief 
+ * Save the gain and AGC used at boot. A failure is logged, as the gain has 
+ * been changed anyway.
+ */
+static void save_gain_settings(unsigned int gain, bool automatic) {
+    nvs_handle_t nvs;
+    esp_err_t error = nvs_open(PROFILE_NVS_NAMESPACE, NVS_READWRITE, &nvs);
     if (error != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to install GPIO ISR Service. details: %s", esp_err_to_name(error));
+        ESP_LOGE(TAG, "Failed to open NVS to save the gain. details: %s", esp_err_to_name(error));
+        return;
+    }
+    error = nvs_set_u8(nvs, GAIN_NVS_KEY, (uint8_t) gain);
+    if (error == ESP_OK) {
+        error = nvs_set_u8(nvs, AGC_NVS_KEY, automatic);
+    }
+    if (error == ESP_OK) {
+        error = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    if (error != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to save the gain. details: %s", esp_err_to_name(error));
+    }
+}
+
+/**
+ * @brief 
+ * Switch the ADC to another profile and save it as the profile used at boot. 
+ * The acquisition task makes the change between conversions, so sampling 
+ * pauses briefly and then continues at the new rate. Anything that depends on 
+ * the sample rate, like telemetry, should be stopped first.
+ * @param profile 
+ * @return 0 if success
+ */
+int set_adc_profile(const AdcProfile *profile) {
+    // Clear a change that completed after its caller timed out
+    xSemaphoreTake(profile_changed, 0);
+
+    requested_profile = profile;
+    xTaskNotifyGive(acquisition_task_handle);
+    if (xSemaphoreTake(profile_changed, pdMS_TO_TICKS(PROFILE_CHANGE_TIMEOUT_MS)) != pdTRUE) {
+        ESP_LOGE(TAG, "Timed out changing the ADC profile");
+        return 1;
+    }
+    if (profile_change_result) {
         return 1;
     }
+    return save_adc_profile(profile);
+}
+
+static int request_pause(bool pause) {
+    xSemaphoreTake(pause_changed, 0);
 
-    start_collecting_samples(adc_samples);
+    requested_pause = pause;
+    xTaskNotifyGive(acquisition_task_handle);
+    if (xSemaphoreTake(pause_changed, pdMS_TO_TICKS(PROFILE_CHANGE_TIMEOUT_MS)) != pdTRUE) {
+        ESP_LOGE(TAG, "Timed out handing the sample broker over");
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 
+ * Stop publishing ADC samples, so that another source can be the broker's 
+ * producer. A partly filled block is published first.
+ * @param out_next_sample_index Index of the first sample the other source 
+ * should publish
+ * @return 0 if success
+ */
+int pause_acquisition(uint64_t *out_next_sample_index) {
+    if (request_pause(true)) {
+        return 1;
+    }
+    *out_next_sample_index = handover_sample_index;
+    return 0;
+}
+
+/**
+ * @brief 
+ * Take the broker back from another source and publish ADC samples again
+ * @param next_sample_index Index of the first sample the other source did 
+ * not publish
+ * @return 0 if success
+ */
+int resume_acquisition(uint64_t next_sample_index) {
+    handover_sample_index = next_sample_index;
+    return request_pause(false);
+}
+
+void get_adc_status(AdcStatus *status) {
+    status->profile = active_profile;
+    status->sample_rate = adc_sample_rate;
+    status->mclk_frequency = adc_clock_frequency;
+    status->cpu_load = acquisition_cpu_load;
+}
+
+static int write_adc_register(uint8_t address, uint8_t value) {
+    spi_transaction_t transaction = {
+        .flags = SPI_TRANS_USE_TXDATA,
+        .cmd = write_command,
+        .addr = address,
+        .length = 8,
+        .rxlength = 8,
+        .tx_data = {value, 0, 0, 0}
+    };
+    esp_err_t error = polling_transmit(&transaction);
+    if (error != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to write ADC register 0x%02x. details: %s", address, esp_err_to_name(error));
+        return 1;
+    }
+    return 0;
+}
+
+static int read_adc_register(uint8_t address, uint8_t *out_value) {
+    spi_transaction_t transaction = {
+        .flags = SPI_TRANS_USE_RXDATA,
+        .cmd = read_command,
+        .addr = address,
+        .length = 8,
+        .rxlength = 8
+    };
+    esp_err_t error = polling_transmit(&transaction);
+    if (error != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to read ADC register 0x%02x. details: %s", address, esp_err_to_name(error));
+        return 1;
+    }
+    *out_value = transaction.rx_data[0];
+    return 0;
+}
+
+/**
+ * @brief 
+ * Write an ADC register and read it back to check that the ADC took the value
+ * @return 0 if success
+ */
+static int write_adc_register_verified(uint8_t address, uint8_t value) {
+    uint8_t read_back;
+    if (write_adc_register(address, value) || read_adc_register(address, &read_back)) {
+        return 1;
+    }
+    if (read_back != value) {
+        ESP_LOGE(TAG, "ADC register 0x%02x reads back 0x%02x after writing 0x%02x", address, read_back, value);
+        return 1;
+    }
+    return 0;
+}
+
+static int set_spi_clock(int clock_speed) {
+#ifndef CONFIG_ADC_EMULATED
+    esp_err_t error = spi_bus_remove_device(adc_device);
+    if (error != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to remove ADC from SPI bus. details: %s", esp_err_to_name(error));
+        return 1;
+    }
+    SpiDeviceConfig device_config = adc_device_config;
+    device_config.interface_configuration.clock_speed_hz = clock_speed;
+    if (initialize_device_spi(device_config, &adc_device)) {
+        return 1;
+    }
+#endif
+    spi_clock_speed = clock_speed;
+    return 0;
+}
+
+/**
+ * @brief 
+ * Program the MCLK frequency, power mode and digital filter of a profile. 
+ * The registers are only writable outside continuous read mode, so it is left 
+ * first and entered again once the filter is restarted.
+ * @param profile 
+ * @return 0 if success
+ */
+static int apply_adc_profile(const AdcProfile *profile) {
+    readout.synchronized = false;
+    if (transfer(&read_adc_transaction)) {
+        ESP_LOGE(TAG, "Failed to leave ADC continuous read mode");
+        return 1;
+    }
+    if (profile->spi_clock_speed != spi_clock_speed && set_spi_clock(profile->spi_clock_speed)) {
+        return 1;
+    }
+
+    if (set_adc_clock(profile->mclk_frequency)) {
+        return 1;
+    }
+    reset_clock_discipline(adc_profile_sample_rate(profile, profile->mclk_frequency));
+    if (write_adc_register_verified(ADC_POWER_CLOCK_REGISTER, adc_profile_power_clock_register(profile)) ||
+        write_adc_register_verified(ADC_DIGITAL_FILTER_REGISTER, adc_profile_digital_filter_register(profile))) {
+        return 1;
+    }
+
+    // Toggling SPI_SYNC restarts the digital filter with the new settings
+    if (write_adc_register(ADC_SYNC_RESET_REGISTER, 0x00) || 
+        write_adc_register(ADC_SYNC_RESET_REGISTER, adc_sync_reset_spi_sync)) {
+        return 1;
+    }
+
+    if (configure_adc_interface()) {
+        return 1;
+    }
+
+    active_profile = profile;
+#ifdef CONFIG_ADC_CLOCK_DISCIPLINE
+    // The discipline steers the ADC to the nominal rate of the profile
+    adc_sample_rate = adc_profile_sample_rate(profile, profile->mclk_frequency);
+#else
+    adc_sample_rate = adc_profile_sample_rate(profile, adc_clock_frequency);
+#endif
+    ESP_LOGI(TAG, "ADC profile %s at %.3f samples/s", profile->name, adc_sample_rate);
+    return 0;
+}
+
+/**
+ * @brief 
+ * Set how conversions are read out: whether the status byte is appended, how 
+ * often a CRC is appended and whether the ADC enters continuous read mode. 
+ * Once it has, the ADC no longer decodes commands until continuous read mode 
+ * is left by reading the conversion result register.
+ * @return 0 if success
+ */
+static int configure_adc_interface(void) {
+    uint8_t interface_format = ADC_CRC_SELECT << interface_format_crc_select_shift;
+    if (ADC_STATUS_BYTES > 0) {
+        interface_format |= interface_format_status_enable;
+    }
+#ifdef CONFIG_ADC_CONTINUOUS_READ
+    interface_format |= interface_format_continuous_read;
+#endif
+    if (write_adc_register(ADC_INTERFACE_FORMAT_REGISTER, interface_format)) {
+        return 1;
+    }
+
+    adc_readout_synchronize(&readout);
     return 0;
 }
 
@@ -189,31 +669,75 @@ void start_adc_clock(void) {
 
     ESP_LOGD(TAG, "Enabling APLL clock");
     rtc_clk_apll_enable(true);
+}
 
-    uint32_t odiv, sdm2, sdm1, sdm0;
-    ESP_LOGD(TAG, "Calculating APLL coefficients");
-    uint32_t actual_adc_clock_frequency = rtc_clk_apll_coeff_calc(
-        (uint32_t) IDEAL_ADC_CLOCK_FREQ, 
-        &odiv, 
-        &sdm0, 
-        &sdm1, 
-        &sdm2
-    );
+/**
+ * @brief 
+ * Set the APLL as close to a frequency as its coefficients allow
+ * @param frequency MCLK frequency in Hz
+ * @return 0 if success
+ */
+static int set_adc_clock(double frequency) {
+    double xtal_frequency = rtc_clk_xtal_freq_get() * 1E6;
+    ApllCoefficients coefficients;
+    if (apll_solve(xtal_frequency, frequency, &coefficients, 1) == 0) {
+        ESP_LOGE(TAG, "The APLL cannot make an MCLK of %.0f Hz", frequency);
+        return 1;
+    }
     ESP_LOGD(TAG, 
-        "Ideal APLL clock frequency: %d\n"
-        "Actual APLL clock frequency: %d\n"
+        "Ideal APLL clock frequency: %.3f\n"
+        "Actual APLL clock frequency: %.3f\n"
         "Calculated APLL coefficients: "
         "sdm0 = %d, sdm1 = %d, sdm2 = %d, odiv = %d",
-        (int) IDEAL_ADC_CLOCK_FREQ,
-        (int) actual_adc_clock_frequency,
-        (int) sdm0,
-        (int) sdm1,
-        (int) sdm2,
-        (int) odiv
+        frequency,
+        apll_frequency(xtal_frequency, &coefficients),
+        (int) coefficients.sdm0,
+        (int) coefficients.sdm1,
+        (int) coefficients.sdm2,
+        (int) coefficients.odiv
+    );
+
+    // The discipline task trims the clock too
+    portENTER_CRITICAL(&clock_discipline_lock);
+    apll_coefficients = coefficients;
+    nominal_adc_clock_frequency = frequency;
+    trim_adc_clock(clock_discipline.correction_ppm);
+    portEXIT_CRITICAL(&clock_discipline_lock);
+    return 0;
+}
+
+/**
+ * @brief 
+ * Move the APLL away from the nominal MCLK frequency by a correction, keeping 
+ * the output divider so that the frequency moves in small steps without 
+ * glitching the clock. Call with `clock_discipline_lock` held.
+ * @param correction_ppm 
+ */
+static void trim_adc_clock(double correction_ppm) {
+    adc_clock_frequency = apll_fine_tune(
+        rtc_clk_xtal_freq_get() * 1E6, 
+        nominal_adc_clock_frequency * (1 + correction_ppm * 1E-6), 
+        &apll_coefficients
+    );
+#ifdef CONFIG_ADC_EMULATED
+    set_emulated_adc_clock(adc_clock_frequency);
+#else
+    rtc_clk_apll_coeff_set(
+        apll_coefficients.odiv, 
+        apll_coefficients.sdm0, 
+        apll_coefficients.sdm1, 
+        apll_coefficients.sdm2
     );
+#endif
+}
 
-    ESP_LOGD(TAG, "Setting APLL coefficients");
-    rtc_clk_apll_coeff_set(odiv, sdm0, sdm1, sdm2);
+/**
+ * @brief 
+ * @return Output data rate of the ADC in samples per second, derived from the 
+ * actual APLL frequency
+ */
+double get_adc_sample_rate(void) {
+    return adc_sample_rate;
 }
 
 /**
@@ -272,9 +796,44 @@ void initialize_iomux_pin(IoMuxPinConfig pin_config) {
     }
 }
 
-int start_collecting_samples(QueueHandle_t *adc_samples) {
+int start_collecting_samples(SampleBroker *sample_broker) {
+    acquisition_task_handle = start_planned_task(
+        &acquisition_task_plan,
+        acquisition_task,
+        sample_broker,
+        ACQUISITION_TASK_PRIORITY,
+        ACQUISITION_TASK_CORE
+    );
+    if (acquisition_task_handle == NULL) {
+        ESP_LOGE(TAG, "Failed to create ADC acquisition task");
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 
+ * Route data ready edges to the calling task. GPIO interrupts are allocated 
+ * on the core that installs the ISR service, so calling this from the 
+ * acquisition task keeps the interrupt and its task on the same core, which 
+ * avoids a cross-core wakeup and lets them share a cycle counter. The 
+ * service and its handlers run from IRAM, so that edges are still counted 
+ * while the flash cache is disabled to write the telemetry spool, and the 
+ * conversions the task could not read then show up as lost.
+ * @return 0 if success
+ */
+static int attach_data_ready_interrupt(void) {
+    esp_err_t error = gpio_install_isr_service(ESP_INTR_FLAG_LOWMED | ESP_INTR_FLAG_IRAM);
+    if (error != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to install GPIO ISR Service. details: %s", esp_err_to_name(error));
+        return 1;
+    }
+
+#ifdef CONFIG_ADC_EMULATED
+    // The emulated ADC raises data ready from a timer instead of the pin
+    return attach_emulated_data_ready(data_ready_isr, xTaskGetCurrentTaskHandle());
+#endif
 
-    esp_err_t error;
     error = gpio_set_direction(DATA_READY_PIN, GPIO_MODE_INPUT);
     if (error != ESP_OK) {
         ESP_LOGE(TAG, "Failed to set ADC data ready pin to input. details: %s", esp_err_to_name(error));
@@ -287,7 +846,7 @@ int start_collecting_samples(QueueHandle_t *adc_samples) {
         return 1;
     }
 
-    error = gpio_isr_handler_add(DATA_READY_PIN, data_ready_isr, adc_samples);
+    error = gpio_isr_handler_add(DATA_READY_PIN, data_ready_isr, xTaskGetCurrentTaskHandle());
     if (error != ESP_OK) {
         ESP_LOGE(TAG, "Failed to attach ADC read ISR handler. details: %s", esp_err_to_name(error));
         return 1;
@@ -301,21 +860,606 @@ int start_collecting_samples(QueueHandle_t *adc_samples) {
     return 0;
 }
 
-void data_ready_isr(void *adc_samples) {
-    spi_device_polling_transmit(adc_device, &read_adc_transaction);
-    uint8_t *adc_bytes = read_adc_transaction.rx_data;
+/**
+ * @brief 
+ * Data ready interrupt. Reading the conversion result is deferred to the 
+ * acquisition task so that no SPI transfer happens in interrupt context.
+ * @param acquisition_task Handle of the task to notify
+ */
+void IRAM_ATTR data_ready_isr(void *acquisition_task) {
+    data_ready_cycles = esp_cpu_get_cycle_count();
+    portENTER_CRITICAL_ISR(&data_ready_lock);
+    data_ready_time_us = esp_timer_get_time();
+    data_ready_count++;
+    portEXIT_CRITICAL_ISR(&data_ready_lock);
+
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    vTaskNotifyGiveFromISR((TaskHandle_t) acquisition_task, &higher_priority_task_woken);
+    portYIELD_FROM_ISR(higher_priority_task_woken);
+}
+
+/**
+ * @brief 
+ * Read the conversion count and the esp_timer time of the latest conversion 
+ * as a consistent pair
+ */
+static void read_data_ready(uint32_t *out_count, int64_t *out_time_us) {
+    portENTER_CRITICAL_SAFE(&data_ready_lock);
+    *out_count = data_ready_count;
+    *out_time_us = data_ready_time_us;
+    portEXIT_CRITICAL_SAFE(&data_ready_lock);
+}
+
+#ifdef CONFIG_ADC_CLOCK_DISCIPLINE
+/**
+ * @brief 
+ * Record where the ADC is now, for a reference whose UTC time is filled in 
+ * by the caller. Safe to call from an interrupt.
+ */
+static void IRAM_ATTR capture_clock_reference(ClockReference *reference) {
+    portENTER_CRITICAL_SAFE(&data_ready_lock);
+    reference->timer_time_us = esp_timer_get_time();
+    reference->count = data_ready_count;
+    reference->data_ready_time_us = data_ready_time_us;
+    portEXIT_CRITICAL_SAFE(&data_ready_lock);
+}
+#endif
 
-    // Need to reverse byte order in sample data because it is big-endian.
-    int32_t sample = 
-        (
-            ((int32_t) adc_bytes[0] << 24) |
-            ((int32_t) adc_bytes[1] << 16) |
-            ((int32_t) adc_bytes[2] << 8)
-        ) >> 8;
+/**
+ * @brief 
+ * Called when SNTP sets the wall clock. Without a pulse per second input, 
+ * each synchronization is a reference for the ADC clock. Between 
+ * synchronizations the wall clock runs from the same crystal as the ADC, so 
+ * only the synchronizations themselves say anything about its rate.
+ * @param time The time the wall clock was set to
+ */
+void adc_clock_time_synchronized(const struct timeval *time) {
+    wall_clock_synchronized = true;
+#if defined(CONFIG_ADC_CLOCK_DISCIPLINE) && CONFIG_ADC_DISCIPLINE_PPS_PIN < 0
+    ClockReference reference = {
+        .utc_time_us = (int64_t) time->tv_sec * 1000000 + time->tv_usec
+    };
+    capture_clock_reference(&reference);
+    if (xQueueSendToBack(clock_references, &reference, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "Dropped an SNTP clock reference");
+    }
+#endif
+}
 
-    int int_sample = (int) sample;
+#if defined(CONFIG_ADC_CLOCK_DISCIPLINE) && CONFIG_ADC_DISCIPLINE_PPS_PIN >= 0
+/**
+ * @brief 
+ * Pulse per second interrupt. The UTC second the pulse starts is found later 
+ * by the discipline task.
+ */
+static void IRAM_ATTR pps_isr(void *context) {
+    ClockReference reference = {
+        .utc_time_us = 0
+    };
+    capture_clock_reference(&reference);
 
-    assert(adc_bytes[3] == 0x0); // Error status bits should be zero
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    xQueueSendToBackFromISR(clock_references, &reference, &higher_priority_task_woken);
+    portYIELD_FROM_ISR(higher_priority_task_woken);
+}
+#endif
 
-    xQueueSendToBackFromISR(*((QueueHandle_t *) adc_samples), &int_sample, NULL);
-}
\ No newline at end of file
+/**
+ * @brief 
+ * Route pulse per second edges to the discipline, if a pin is configured. 
+ * Must be called after the GPIO ISR service is installed.
+ * @return 0 if success
+ */
+static int attach_pps_interrupt(void) {
+#if defined(CONFIG_ADC_CLOCK_DISCIPLINE) && CONFIG_ADC_DISCIPLINE_PPS_PIN >= 0
+    gpio_num_t pps_pin = CONFIG_ADC_DISCIPLINE_PPS_PIN;
+    esp_err_t error = gpio_set_direction(pps_pin, GPIO_MODE_INPUT);
+    if (error != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to set PPS pin to input. details: %s", esp_err_to_name(error));
+        return 1;
+    }
+
+    error = gpio_set_intr_type(pps_pin, GPIO_INTR_POSEDGE);
+    if (error != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to set PPS pin to trigger on positive edge. details: %s", esp_err_to_name(error));
+        return 1;
+    }
+
+    error = gpio_isr_handler_add(pps_pin, pps_isr, NULL);
+    if (error != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to attach PPS ISR handler. details: %s", esp_err_to_name(error));
+        return 1;
+    }
+
+    error = gpio_intr_enable(pps_pin);
+    if (error != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to enable PPS interrupt. details: %s", esp_err_to_name(error));
+        return 1;
+    }
+#endif
+    return 0;
+}
+
+#ifdef CONFIG_ADC_CLOCK_DISCIPLINE
+/**
+ * @brief 
+ * Feeds references to the discipline and trims the ADC clock by its 
+ * corrections.
+ */
+static void clock_discipline_task(void *context) {
+    ClockReference reference;
+    for ( ;; ) {
+        xQueueReceive(clock_references, &reference, portMAX_DELAY);
+
+        if (reference.utc_time_us == 0) {
+            // A pulse starts the UTC second nearest to the wall clock time 
+            // it arrived at
+            if (! wall_clock_synchronized) {
+                continue;
+            }
+            struct timeval now;
+            gettimeofday(&now, NULL);
+            int64_t pulse_time_us = 
+                (int64_t) now.tv_sec * 1000000 + now.tv_usec - (esp_timer_get_time() - reference.timer_time_us);
+            reference.utc_time_us = (pulse_time_us + 500000) / 1000000 * 1000000;
+        }
+
+        double fraction = (reference.timer_time_us - reference.data_ready_time_us) * 1E-6 * adc_sample_rate;
+        portENTER_CRITICAL(&clock_discipline_lock);
+        if (clock_discipline_update(&clock_discipline, reference.utc_time_us, reference.count, fraction)) {
+            trim_adc_clock(clock_discipline.correction_ppm);
+        }
+        portEXIT_CRITICAL(&clock_discipline_lock);
+    }
+}
+#endif
+
+static int start_clock_discipline(void) {
+#ifdef CONFIG_ADC_CLOCK_DISCIPLINE
+    clock_discipline_initialize(
+        &clock_discipline, 
+        0, 
+        CONFIG_ADC_DISCIPLINE_TOLERANCE_PPB * 1E-3, 
+        CONFIG_ADC_DISCIPLINE_TIME_CONSTANT
+    );
+    clock_references = xQueueCreateStatic(
+        DISCIPLINE_QUEUE_LENGTH, 
+        sizeof(ClockReference), 
+        clock_references_storage, 
+        &clock_references_buffer
+    );
+    if (clock_references == NULL) {
+        ESP_LOGE(TAG, "Failed to create clock reference queue");
+        return 1;
+    }
+
+    TaskHandle_t task = start_planned_task(
+        &discipline_task_plan,
+        clock_discipline_task,
+        NULL,
+        DISCIPLINE_TASK_PRIORITY,
+        tskNO_AFFINITY
+    );
+    if (task == NULL) {
+        ESP_LOGE(TAG, "Failed to create ADC clock discipline task");
+        return 1;
+    }
+#endif
+    return 0;
+}
+
+/**
+ * @brief 
+ * Start disciplining afresh at a new sample rate. The conversion count runs 
+ * on across the change at a different rate, so the loop is anchored again at 
+ * the next reference, but the crystal error it has learned still holds.
+ * @param nominal_rate 
+ */
+static void reset_clock_discipline(double nominal_rate) {
+#ifdef CONFIG_ADC_CLOCK_DISCIPLINE
+    portENTER_CRITICAL(&clock_discipline_lock);
+    ClockDiscipline previous = clock_discipline;
+    clock_discipline_initialize(&clock_discipline, nominal_rate, previous.tolerance_ppm, previous.time_constant);
+    clock_discipline.frequency_integral = previous.frequency_integral;
+    clock_discipline.correction_ppm = previous.correction_ppm;
+    clock_discipline.num_updates = previous.num_updates;
+    clock_discipline.num_steps = previous.num_steps;
+    portEXIT_CRITICAL(&clock_discipline_lock);
+#endif
+}
+
+/**
+ * @brief 
+ * @param count Conversion count
+ * @param time_us esp_timer time of the conversion
+ * @param flags Block flags, to which SAMPLE_BLOCK_CLOCK_UNLOCKED is added 
+ * when the discipline is not locked
+ * @return UTC time of a conversion in microseconds since the Unix epoch, 
+ * from the discipline once it has a reference and otherwise from the wall 
+ * clock
+ */
+static int64_t conversion_utc_time_us(uint32_t count, int64_t time_us, uint32_t *flags) {
+#ifdef CONFIG_ADC_CLOCK_DISCIPLINE
+    portENTER_CRITICAL(&clock_discipline_lock);
+    bool have_reference = clock_discipline.have_reference;
+    bool locked = clock_discipline.locked;
+    int64_t utc_time_us = have_reference ? clock_discipline_time_us(&clock_discipline, count) : 0;
+    portEXIT_CRITICAL(&clock_discipline_lock);
+
+    if (! locked) {
+        *flags |= SAMPLE_BLOCK_CLOCK_UNLOCKED;
+    }
+    if (have_reference) {
+        return utc_time_us;
+    }
+#endif
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (int64_t) now.tv_sec * 1000000 + now.tv_usec - (esp_timer_get_time() - time_us);
+}
+
+void get_adc_clock_status(AdcClockStatus *status) {
+    portENTER_CRITICAL(&clock_discipline_lock);
+    status->discipline = clock_discipline;
+    status->apll = apll_coefficients;
+    portEXIT_CRITICAL(&clock_discipline_lock);
+    status->wall_clock_synchronized = wall_clock_synchronized;
+}
+
+/**
+ * @brief 
+ * @param tolerance_ppm Largest mean rate error over a time constant at which 
+ * the ADC clock counts as locked
+ * @return 0 if success
+ */
+int set_adc_clock_tolerance(double tolerance_ppm) {
+    if (tolerance_ppm <= 0) {
+        return 1;
+    }
+    portENTER_CRITICAL(&clock_discipline_lock);
+    clock_discipline.tolerance_ppm = tolerance_ppm;
+    portEXIT_CRITICAL(&clock_discipline_lock);
+    return 0;
+}
+
+static int transfer(spi_transaction_t *transaction) {
+#ifdef CONFIG_ADC_EMULATED
+    emulate_adc_transfer(transaction);
+    return 0;
+#else
+    esp_err_t error = spi_device_queue_trans(adc_device, transaction, portMAX_DELAY);
+    if (error != ESP_OK) {
+        return 1;
+    }
+
+    spi_transaction_t *completed_transaction;
+    error = spi_device_get_trans_result(adc_device, &completed_transaction, portMAX_DELAY);
+    return error != ESP_OK;
+#endif
+}
+
+/**
+ * @brief 
+ * Send a short transaction without queueing it, for register access
+ */
+static esp_err_t polling_transmit(spi_transaction_t *transaction) {
+#ifdef CONFIG_ADC_EMULATED
+    emulate_adc_transfer(transaction);
+    return ESP_OK;
+#else
+    return spi_device_polling_transmit(adc_device, transaction);
+#endif
+}
+
+/**
+ * @brief 
+ * Read one conversion result from the ADC. The transaction is queued and 
+ * completed by DMA, so the calling task sleeps for the duration of the transfer.
+ * 
+ * In continuous read mode, a readout that is out of step with the ADC is put 
+ * back in step by reading the result with a command, which leaves continuous 
+ * read mode, and then entering it again.
+ * @param out_sample 
+ * @param out_flags Set to the SAMPLE_BLOCK_ADC_* errors found in the readout
+ * @return 0 if success
+ */
+static int read_adc_sample(int32_t *out_sample, uint32_t *out_flags) {
+#ifdef CONFIG_ADC_CONTINUOUS_READ
+    if (! readout.synchronized) {
+        // The conversion read with a command comes before the CRC window 
+        // that configuring the interface starts, so it is decoded first
+        if (transfer(&read_adc_transaction)) {
+            return 1;
+        }
+        *out_flags = adc_readout_decode(&readout, read_adc_buffer, out_sample);
+        if (configure_adc_interface()) {
+            return 1;
+        }
+    }
+    else {
+        size_t length = adc_readout_length(&readout);
+        continuous_read_transaction.base.length = 8 * length;
+        continuous_read_transaction.base.rxlength = 8 * length;
+        if (transfer(&continuous_read_transaction.base)) {
+            readout.synchronized = false;
+            return 1;
+        }
+        *out_flags = adc_readout_decode(&readout, read_adc_buffer, out_sample);
+    }
+#else
+    if (transfer(&read_adc_transaction)) {
+        return 1;
+    }
+    *out_flags = adc_readout_decode(&readout, read_adc_buffer, out_sample);
+#endif
+
+    if (*out_flags & SAMPLE_BLOCK_ADC_STATUS_ERROR) {
+        pipeline_stats.counters[STATS_ADC_STATUS_ERRORS]++;
+    }
+    if (*out_flags & SAMPLE_BLOCK_ADC_CRC_ERROR) {
+        pipeline_stats.counters[STATS_ADC_CRC_ERRORS]++;
+    }
+    return 0;
+}
+
+/**
+ * @brief 
+ * Choose the gain for the next block, from a manual request or else from the 
+ * AGC, and switch to it. This runs right after the last conversion of 
+ * `block` is read, so the switch lands before the next conversion completes 
+ * and the next block is the first sampled at the new gain. The ADC's digital 
+ * filter spreads the step over its impulse response.
+ * @param block The block just completed
+ */
+static void control_gain(const SampleBlock *block) {
+    unsigned int gain = get_vga_gain();
+    int requested_gain = atomic_exchange(&requested_vga_gain, -1);
+    if (requested_gain >= 0) {
+        gain = requested_gain;
+    }
+    else if (agc_enabled) {
+        if (atomic_exchange(&agc_restart, false)) {
+            AgcSettings settings;
+            agc_default_settings(&settings);
+            agc_initialize(&agc, &settings, gain);
+        }
+        gain = agc_update(&agc, block->samples, block->length);
+
+        portENTER_CRITICAL(&agc_lock);
+        agc_status = agc;
+        portEXIT_CRITICAL(&agc_lock);
+    }
+
+    if (gain != get_vga_gain() && ! set_vga_gain(gain)) {
+        vga_gain_changed = true;
+    }
+}
+
+/**
+ * @brief 
+ * Set the VGA gain before the next block and stop the AGC. The gain is 
+ * saved as the gain used at boot.
+ * @param gain Zero or a power of two up to 64
+ */
+void set_acquisition_gain(unsigned int gain) {
+    agc_enabled = false;
+    atomic_store(&requested_vga_gain, (int) gain);
+    save_gain_settings(gain, false);
+}
+
+static void enable_automatic_gain(bool enabled) {
+    if (enabled && ! agc_enabled) {
+        // The acquisition task restarts its own AGC before the next update. 
+        // Until then the status shows it as restarted.
+        AgcSettings settings;
+        agc_default_settings(&settings);
+        Agc restarted;
+        agc_initialize(&restarted, &settings, get_vga_gain());
+        portENTER_CRITICAL(&agc_lock);
+        agc_status = restarted;
+        portEXIT_CRITICAL(&agc_lock);
+        atomic_store(&agc_restart, true);
+    }
+    agc_enabled = enabled;
+}
+
+/**
+ * @brief 
+ * Start or stop automatic gain control and save the choice for the next 
+ * boot. The AGC starts from the current gain, which is kept when it stops.
+ * @param enabled 
+ */
+void set_automatic_gain(bool enabled) {
+    enable_automatic_gain(enabled);
+    save_gain_settings(get_vga_gain(), enabled);
+}
+
+void get_gain_status(GainStatus *status) {
+    portENTER_CRITICAL(&agc_lock);
+    status->agc = agc_status;
+    portEXIT_CRITICAL(&agc_lock);
+    status->agc_enabled = agc_enabled;
+    status->gain = get_vga_gain();
+}
+
+/**
+ * @brief 
+ * Adjust the gain after `block`, then publish it and record the time taken 
+ * and any blocks dropped by subscribers since the last one.
+ */
+static void publish_block(SampleBroker *broker, const SampleBlock *block) {
+    static unsigned long blocks_dropped;
+
+    control_gain(block);
+
+    uint32_t start_cycles = esp_cpu_get_cycle_count();
+    sample_broker_publish(broker);
+    stats_histogram_record(
+        &pipeline_stats.histograms[STATS_PUBLISH], esp_cpu_get_cycle_count() - start_cycles);
+
+    unsigned long dropped = atomic_load_explicit(&broker->dropped, memory_order_relaxed);
+    pipeline_stats.counters[STATS_BLOCKS_DROPPED] += dropped - blocks_dropped;
+    blocks_dropped = dropped;
+}
+
+/**
+ * @brief 
+ * Reads a sample for every data ready notification and groups them into 
+ * blocks published to the sample broker. A block is closed early when 
+ * conversions are lost so that every block holds consecutive samples. When 
+ * every block in the pool is still held by subscribers, a block's worth of 
+ * samples is discarded.
+ * @param sample_broker Broker to publish blocks to
+ */
+void acquisition_task(void *sample_broker) {
+    SampleBroker *broker = sample_broker;
+    SampleBlock *block = NULL;
+    unsigned int samples_to_discard = 0;
+    uint64_t sample_index = 0;
+    // Failed reads are counted in the stats and only logged when they start 
+    // and stop, so that a failing ADC does not flood the console
+    unsigned long consecutive_read_errors = 0;
+
+    if (attach_data_ready_interrupt() || attach_pps_interrupt()) {
+        vTaskDelete(NULL);
+    }
+
+    uint32_t load_window_cycles = esp_rom_get_cpu_ticks_per_us() * CPU_LOAD_WINDOW_US;
+    uint32_t load_window_start_cycles = esp_cpu_get_cycle_count();
+    uint32_t busy_cycles = 0;
+    uint32_t wake_cycles = load_window_start_cycles;
+
+    for ( ;; ) {
+        // The busy time includes the SPI transfers the task sleeps through, so 
+        // the load is an upper bound
+        uint32_t sleep_cycles = esp_cpu_get_cycle_count();
+        busy_cycles += sleep_cycles - wake_cycles;
+        if (sleep_cycles - load_window_start_cycles >= load_window_cycles) {
+            acquisition_cpu_load = (float) busy_cycles / (sleep_cycles - load_window_start_cycles);
+            load_window_start_cycles = sleep_cycles;
+            busy_cycles = 0;
+        }
+
+        uint32_t pending_samples = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        wake_cycles = esp_cpu_get_cycle_count();
+        uint32_t conversion_count;
+        int64_t conversion_time_us;
+        read_data_ready(&conversion_count, &conversion_time_us);
+
+        if (requested_profile != NULL) {
+            if (block != NULL) {
+                publish_block(broker, block);
+                block = NULL;
+            }
+            profile_change_result = apply_adc_profile(requested_profile);
+            requested_profile = NULL;
+            xSemaphoreGive(profile_changed);
+
+            // Conversions made during the change are neither read nor lost
+            ulTaskNotifyTake(pdTRUE, 0);
+            continue;
+        }
+
+        if (requested_pause >= 0) {
+            if (requested_pause) {
+                if (block != NULL) {
+                    publish_block(broker, block);
+                    block = NULL;
+                }
+                samples_to_discard = 0;
+                handover_sample_index = sample_index;
+            }
+            else {
+                sample_index = handover_sample_index;
+                // Conversions went unread while paused
+                readout.synchronized = false;
+            }
+            acquisition_paused = requested_pause;
+            requested_pause = -1;
+            xSemaphoreGive(pause_changed);
+            ulTaskNotifyTake(pdTRUE, 0);
+            continue;
+        }
+        if (acquisition_paused) {
+            continue;
+        }
+
+        // The ADC only holds the latest conversion, so any earlier data ready 
+        // edges that were not serviced in time are lost.
+        uint32_t lost_samples = pending_samples - 1;
+
+        // A missed conversion may leave a continuous readout out of step 
+        // with the ADC's CRC window
+        if (lost_samples > 0) {
+            readout.synchronized = false;
+        }
+
+        int32_t sample;
+        uint32_t sample_flags;
+        uint32_t read_start_cycles = esp_cpu_get_cycle_count();
+        if (read_adc_sample(&sample, &sample_flags)) {
+            if (consecutive_read_errors++ == 0) {
+                ESP_LOGE(TAG, "Failed to read ADC conversion result");
+            }
+            pipeline_stats.counters[STATS_READ_ERRORS]++;
+            lost_samples++;
+        }
+        else {
+            if (consecutive_read_errors > 0) {
+                ESP_LOGW(TAG, "ADC reads recovered after %lu failures", consecutive_read_errors);
+                consecutive_read_errors = 0;
+            }
+            uint32_t read_end_cycles = esp_cpu_get_cycle_count();
+            stats_histogram_record(
+                &pipeline_stats.histograms[STATS_ADC_READ], read_end_cycles - read_start_cycles);
+            stats_histogram_record(
+                &pipeline_stats.histograms[STATS_DRDY_TO_READ], read_end_cycles - data_ready_cycles);
+            pipeline_stats.counters[STATS_SAMPLES_ACQUIRED]++;
+        }
+
+        if (lost_samples > 0) {
+            pipeline_stats.counters[STATS_SAMPLES_LOST] += pending_samples - 1;
+            sample_index += lost_samples;
+            if (block != NULL) {
+                publish_block(broker, block);
+                block = NULL;
+            }
+            if (lost_samples == pending_samples) {
+                continue;
+            }
+        }
+
+        if (block == NULL && samples_to_discard == 0) {
+            block = sample_broker_begin_publish(broker);
+            if (block != NULL) {
+                block->first_sample_index = sample_index;
+                block->timestamp_us = esp_timer_get_time();
+                block->flags = 0;
+                block->utc_time_us = conversion_utc_time_us(conversion_count, conversion_time_us, &block->flags);
+                block->vga_gain = get_vga_gain();
+                if (vga_gain_changed) {
+                    block->flags |= SAMPLE_BLOCK_GAIN_CHANGED;
+                    vga_gain_changed = false;
+                }
+                block->length = 0;
+            }
+            else {
+                samples_to_discard = SAMPLE_BLOCK_LENGTH;
+            }
+        }
+
+        if (block != NULL) {
+            block->flags |= sample_flags;
+            block->samples[block->length++] = sample;
+            if (block->length == SAMPLE_BLOCK_LENGTH) {
+                publish_block(broker, block);
+                block = NULL;
+            }
+        }
+        else {
+            pipeline_stats.counters[STATS_SAMPLES_DISCARDED]++;
+            samples_to_discard--;
+        }
+        sample_index++;
+    }
+}
@@ -1,4 +1,44 @@
-#include "freertos/FreeRTOS.h"
-#include "freertos/queue.h"
+#pragma once
 
-int initialize_adc(QueueHandle_t *adc_samples);
\ No newline at end of file
+#include <sys/time.h>
+
+#include "sample_broker.h"
+#include "adc_profile.h"
+#include "clock_discipline.h"
+#include "apll.h"
+#include "agc.h"
+
+// How long consumers sleep before checking an empty sample buffer again
+#define SAMPLE_BUFFER_POLL_PERIOD_MS 10
+
+typedef struct {
+    const AdcProfile *profile;
+    double sample_rate;
+    double mclk_frequency;
+    float cpu_load;
+} AdcStatus;
+
+typedef struct {
+    ClockDiscipline discipline;
+    bool wall_clock_synchronized;
+    ApllCoefficients apll;
+} AdcClockStatus;
+
+typedef struct {
+    unsigned int gain;
+    bool agc_enabled;
+    Agc agc;
+} GainStatus;
+
+int initialize_adc(SampleBroker *sample_broker);
+double get_adc_sample_rate(void);
+int set_adc_profile(const AdcProfile *profile);
+int pause_acquisition(uint64_t *out_next_sample_index);
+int resume_acquisition(uint64_t next_sample_index);
+void get_adc_status(AdcStatus *status);
+void get_adc_clock_status(AdcClockStatus *status);
+int set_adc_clock_tolerance(double tolerance_ppm);
+void adc_clock_time_synchronized(const struct timeval *time);
+void set_acquisition_gain(unsigned int gain);
+void set_automatic_gain(bool enabled);
+void get_gain_status(GainStatus *status);
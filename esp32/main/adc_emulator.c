@@ -0,0 +1,205 @@
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_attr.h"
+
+#include "freertos/FreeRTOS.h"
+
+#include "driver/gptimer.h"
+
+#include "adc_emulator.h"
+
+// Signal converted by the emulated ADC: a tone at a quarter of full scale
+// over a little noise
+#define EMULATED_SIGNAL_FREQUENCY 1.0
+#define EMULATED_SIGNAL_AMPLITUDE (WAVEFORM_FULL_SCALE / 4.0)
+#define EMULATED_SIGNAL_NOISE 256.0
+
+#define TIMER_RESOLUTION_HZ 10000000
+// Alarm times carry a binary fraction of a timer tick, so that the mean
+// conversion rate is exact whatever the period
+#define ALARM_FRACTION_BITS 16
+
+// Command and address byte, then up to the longest conversion readout
+#define MAX_TRANSFER_LENGTH 16
+
+static const char *TAG = "ADC emulator";
+
+// The model is shared by the conversion timer interrupt and the task that
+// reads it
+static Ad7768Model model;
+static portMUX_TYPE model_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static gptimer_handle_t conversion_timer;
+static uint64_t next_alarm;
+static uint64_t alarm_period;
+
+static EmulatedDataReadyHandler data_ready_handler;
+static void *data_ready_context;
+
+/**
+ * @brief
+ * Update the conversion period from the model's output data rate. Call with
+ * `model_lock` held.
+ */
+static void update_alarm_period(void) {
+    alarm_period = (uint64_t) ((double) TIMER_RESOLUTION_HZ * (1 << ALARM_FRACTION_BITS)
+        / ad7768_model_output_data_rate(&model));
+}
+
+/**
+ * @brief
+ * Stand in for the AD7768-1. SPI transactions are answered by a model of
+ * the chip instead of being sent, and `attach_emulated_data_ready` stands
+ * in for the data ready interrupt.
+ * @param mclk_frequency MCLK the model starts at
+ * @return 0 if success
+ */
+int initialize_adc_emulator(double mclk_frequency) {
+    WaveformSettings signal = {
+        .type = WAVEFORM_SINE,
+        .amplitude = EMULATED_SIGNAL_AMPLITUDE,
+        .noise = EMULATED_SIGNAL_NOISE,
+        .frequency = EMULATED_SIGNAL_FREQUENCY
+    };
+    ad7768_model_initialize(&model, &signal, mclk_frequency);
+    update_alarm_period();
+    ESP_LOGW(TAG, "The AD7768-1 is emulated, samples are synthetic");
+    return 0;
+}
+
+/**
+ * @brief
+ * Answer an SPI transaction from the model. The command and address
+ * phases are sent as the first byte, unless the transaction leaves them out.
+ */
+void emulate_adc_transfer(spi_transaction_t *transaction) {
+    uint8_t tx[MAX_TRANSFER_LENGTH] = {0};
+    uint8_t rx[MAX_TRANSFER_LENGTH];
+    size_t command_length = 0;
+
+    bool has_command = ! (transaction->flags & SPI_TRANS_VARIABLE_CMD) ||
+        ((spi_transaction_ext_t *) transaction)->command_bits > 0;
+    if (has_command) {
+        tx[command_length++] = transaction->cmd << 6 | (transaction->addr & 0x3f);
+    }
+
+    size_t data_length = transaction->length / 8;
+    if (command_length + data_length > MAX_TRANSFER_LENGTH) {
+        data_length = MAX_TRANSFER_LENGTH - command_length;
+    }
+    const uint8_t *tx_data = transaction->flags & SPI_TRANS_USE_TXDATA ?
+        transaction->tx_data : transaction->tx_buffer;
+    if (tx_data != NULL) {
+        memcpy(tx + command_length, tx_data, data_length);
+    }
+
+    portENTER_CRITICAL(&model_lock);
+    unsigned long num_syncs = model.num_syncs;
+    ad7768_model_transfer(&model, tx, rx, command_length + data_length);
+    if (model.num_syncs != num_syncs) {
+        update_alarm_period();
+    }
+    portEXIT_CRITICAL(&model_lock);
+
+    uint8_t *rx_data = transaction->flags & SPI_TRANS_USE_RXDATA ?
+        transaction->rx_data : transaction->rx_buffer;
+    if (rx_data != NULL) {
+        size_t rx_length = transaction->rxlength > 0 ? transaction->rxlength / 8 : data_length;
+        memcpy(rx_data, rx + command_length, rx_length < data_length ? rx_length : data_length);
+    }
+}
+
+/**
+ * @brief
+ * Conversion timer alarm. Makes a conversion, raises data ready and sets
+ * the alarm for the next conversion. Conversions whose time has passed
+ * while the interrupt was held off are each made and raised in turn, as
+ * the chip would have made them, so late service shows up as lost samples.
+ */
+static bool on_conversion(gptimer_handle_t timer, const gptimer_alarm_event_data_t *event, void *context) {
+    do {
+        portENTER_CRITICAL_ISR(&model_lock);
+        ad7768_model_convert(&model);
+        next_alarm += alarm_period;
+        portEXIT_CRITICAL_ISR(&model_lock);
+
+        data_ready_handler(data_ready_context);
+    } while (next_alarm >> ALARM_FRACTION_BITS <= event->count_value);
+
+    gptimer_alarm_config_t alarm = {
+        .alarm_count = next_alarm >> ALARM_FRACTION_BITS
+    };
+    gptimer_set_alarm_action(timer, &alarm);
+    return false;
+}
+
+/**
+ * @brief
+ * Raise data ready at the model's output data rate. The timer interrupt is
+ * allocated on the calling core, as a GPIO interrupt would be.
+ * @param handler Called in interrupt context after every conversion
+ * @param context Passed to `handler`
+ * @return 0 if success
+ */
+int attach_emulated_data_ready(EmulatedDataReadyHandler handler, void *context) {
+    data_ready_handler = handler;
+    data_ready_context = context;
+
+    gptimer_config_t timer_config = {
+        .clk_src = GPTIMER_CLK_SRC_DEFAULT,
+        .direction = GPTIMER_COUNT_UP,
+        .resolution_hz = TIMER_RESOLUTION_HZ
+    };
+    esp_err_t error = gptimer_new_timer(&timer_config, &conversion_timer);
+    if (error != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create conversion timer. details: %s", esp_err_to_name(error));
+        return 1;
+    }
+
+    gptimer_event_callbacks_t callbacks = {
+        .on_alarm = on_conversion
+    };
+    error = gptimer_register_event_callbacks(conversion_timer, &callbacks, NULL);
+    if (error != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to attach conversion timer interrupt. details: %s", esp_err_to_name(error));
+        return 1;
+    }
+
+    portENTER_CRITICAL(&model_lock);
+    next_alarm = alarm_period;
+    portEXIT_CRITICAL(&model_lock);
+    gptimer_alarm_config_t alarm = {
+        .alarm_count = next_alarm >> ALARM_FRACTION_BITS
+    };
+    error = gptimer_enable(conversion_timer);
+    if (error == ESP_OK) {
+        error = gptimer_set_alarm_action(conversion_timer, &alarm);
+    }
+    if (error == ESP_OK) {
+        error = gptimer_start(conversion_timer);
+    }
+    if (error != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start conversion timer. details: %s", esp_err_to_name(error));
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief
+ * Set the MCLK of the model, in place of the APLL
+ * @param mclk_frequency
+ */
+void set_emulated_adc_clock(double mclk_frequency) {
+    portENTER_CRITICAL_SAFE(&model_lock);
+    ad7768_model_set_mclk(&model, mclk_frequency);
+    update_alarm_period();
+    portEXIT_CRITICAL_SAFE(&model_lock);
+}
+
+void get_adc_emulator_status(Ad7768Model *out_model) {
+    portENTER_CRITICAL(&model_lock);
+    *out_model = model;
+    portEXIT_CRITICAL(&model_lock);
+}
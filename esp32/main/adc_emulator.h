@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "driver/spi_master.h"
+
+#include "ad7768_model.h"
+
+typedef void (*EmulatedDataReadyHandler)(void *context);
+
+int initialize_adc_emulator(double mclk_frequency);
+void emulate_adc_transfer(spi_transaction_t *transaction);
+int attach_emulated_data_ready(EmulatedDataReadyHandler handler, void *context);
+void set_emulated_adc_clock(double mclk_frequency);
+void get_adc_emulator_status(Ad7768Model *out_model);
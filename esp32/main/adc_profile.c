@@ -0,0 +1,183 @@
+#include <string.h>
+
+#include "adc_profile.h"
+
+#define SPI_CLOCK_SPEED 20000000
+#define LONG_CABLE_SPI_CLOCK_SPEED 2000000
+
+const AdcProfile adc_profiles[] = {
+    {
+        .name = "eco_500",
+        .description = "lowest power, half rate MCLK",
+        .power_mode = ADC_POWER_ECO,
+        .filter = ADC_FILTER_SINC5,
+        .decimation_rate = 1024,
+        .mclk_frequency = 8.192E6,
+        .spi_clock_speed = SPI_CLOCK_SPEED
+    },
+    {
+        .name = "eco_1k",
+        .description = "flat passband to 0.4 of the sample rate",
+        .power_mode = ADC_POWER_ECO,
+        .filter = ADC_FILTER_WIDEBAND,
+        .decimation_rate = 1024,
+        .mclk_frequency = 16.384E6,
+        .spi_clock_speed = SPI_CLOCK_SPEED
+    },
+    {
+        .name = "eco_1k_sinc5",
+        .description = "low latency filter with a drooping passband",
+        .power_mode = ADC_POWER_ECO,
+        .filter = ADC_FILTER_SINC5,
+        .decimation_rate = 1024,
+        .mclk_frequency = 16.384E6,
+        .spi_clock_speed = SPI_CLOCK_SPEED
+    },
+    {
+        .name = "eco_1k_long_cable",
+        .description = "slow SPI clock for long cables to the ADC",
+        .power_mode = ADC_POWER_ECO,
+        .filter = ADC_FILTER_WIDEBAND,
+        .decimation_rate = 1024,
+        .mclk_frequency = 16.384E6,
+        .spi_clock_speed = LONG_CABLE_SPI_CLOCK_SPEED
+    },
+    {
+        .name = "median_4k",
+        .description = "median power for audible band work",
+        .power_mode = ADC_POWER_MEDIAN,
+        .filter = ADC_FILTER_WIDEBAND,
+        .decimation_rate = 1024,
+        .mclk_frequency = 16.384E6,
+        .spi_clock_speed = SPI_CLOCK_SPEED
+    },
+    {
+        .name = "fast_8k",
+        .description = "highest rate and power for continuous use",
+        .power_mode = ADC_POWER_FAST,
+        .filter = ADC_FILTER_WIDEBAND,
+        .decimation_rate = 1024,
+        .mclk_frequency = 16.384E6,
+        .spi_clock_speed = SPI_CLOCK_SPEED
+    },
+    {
+        .name = "fast_16k",
+        .description = "stress rate for finding the acquisition ceiling",
+        .power_mode = ADC_POWER_FAST,
+        .filter = ADC_FILTER_WIDEBAND,
+        .decimation_rate = 512,
+        .mclk_frequency = 16.384E6,
+        .spi_clock_speed = SPI_CLOCK_SPEED
+    },
+    {
+        .name = "fast_32k",
+        .description = "stress rate for finding the acquisition ceiling",
+        .power_mode = ADC_POWER_FAST,
+        .filter = ADC_FILTER_WIDEBAND,
+        .decimation_rate = 256,
+        .mclk_frequency = 16.384E6,
+        .spi_clock_speed = SPI_CLOCK_SPEED
+    },
+    {
+        .name = "fast_64k",
+        .description = "stress rate for finding the acquisition ceiling",
+        .power_mode = ADC_POWER_FAST,
+        .filter = ADC_FILTER_WIDEBAND,
+        .decimation_rate = 128,
+        .mclk_frequency = 16.384E6,
+        .spi_clock_speed = SPI_CLOCK_SPEED
+    }
+};
+
+const size_t num_adc_profiles = sizeof(adc_profiles) / sizeof(adc_profiles[0]);
+
+/**
+ * @brief
+ * @param name
+ * @return The profile with the given name, or NULL if there is none
+ */
+const AdcProfile *find_adc_profile(const char name[]) {
+    for (size_t i = 0; i < num_adc_profiles; i++) {
+        if (! strcmp(adc_profiles[i].name, name)) {
+            return &adc_profiles[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief
+ * @param profile
+ * @return Ratio of MCLK to the modulator clock. Each power mode runs the
+ * modulator from a fixed division of MCLK.
+ */
+unsigned int adc_profile_mclk_division(const AdcProfile *profile) {
+    switch (profile->power_mode) {
+        case ADC_POWER_FAST: return 2;
+        case ADC_POWER_MEDIAN: return 4;
+        default: return 16;
+    }
+}
+
+/**
+ * @brief
+ * @param profile
+ * @param mclk_frequency The MCLK frequency actually supplied, which can
+ * differ slightly from the one asked for by the profile
+ * @return Output data rate in samples per second
+ */
+double adc_profile_sample_rate(const AdcProfile *profile, double mclk_frequency) {
+    return mclk_frequency / adc_profile_mclk_division(profile) / profile->decimation_rate;
+}
+
+/**
+ * @brief
+ * @param profile
+ * @return POWER_CLOCK register value, which sets the power mode and the
+ * matching MCLK division
+ */
+uint8_t adc_profile_power_clock_register(const AdcProfile *profile) {
+    uint8_t mclk_division_code;
+    switch (adc_profile_mclk_division(profile)) {
+        case 2: mclk_division_code = 0b11; break;
+        case 4: mclk_division_code = 0b10; break;
+        case 8: mclk_division_code = 0b01; break;
+        default: mclk_division_code = 0b00;
+    }
+    return mclk_division_code << 4 | profile->power_mode;
+}
+
+/**
+ * @brief
+ * @param profile
+ * @return DIGITAL_FILTER register value. Decimation rates from 32 to 512 are
+ * encoded as their base 2 logarithm less 5. Codes 0b101 to 0b111 all select 
+ * 1024, which is written as 0b111.
+ */
+uint8_t adc_profile_digital_filter_register(const AdcProfile *profile) {
+    uint8_t decimation_code = 0;
+    while ((32u << decimation_code) < profile->decimation_rate && decimation_code < 5) {
+        decimation_code++;
+    }
+    if (decimation_code == 5) {
+        decimation_code = 0b111;
+    }
+    return profile->filter << 4 | decimation_code;
+}
+
+const char *adc_power_mode_name(AdcPowerMode power_mode) {
+    switch (power_mode) {
+        case ADC_POWER_ECO: return "eco";
+        case ADC_POWER_MEDIAN: return "median";
+        case ADC_POWER_FAST: return "fast";
+        default: return "unknown";
+    }
+}
+
+const char *adc_filter_name(AdcFilter filter) {
+    switch (filter) {
+        case ADC_FILTER_SINC5: return "sinc5";
+        case ADC_FILTER_WIDEBAND: return "wideband";
+        default: return "unknown";
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// AD7768-1 register addresses
+#define ADC_INTERFACE_FORMAT_REGISTER 0x14
+#define ADC_POWER_CLOCK_REGISTER 0x15
+#define ADC_DIGITAL_FILTER_REGISTER 0x19
+#define ADC_SYNC_RESET_REGISTER 0x1d
+
+// Power modes, as written to the POWER_CLOCK register
+typedef enum {
+    ADC_POWER_ECO = 0b00,
+    ADC_POWER_MEDIAN = 0b10,
+    ADC_POWER_FAST = 0b11
+} AdcPowerMode;
+
+// Digital filters, as written to the DIGITAL_FILTER register
+typedef enum {
+    ADC_FILTER_SINC5 = 0b000,
+    ADC_FILTER_WIDEBAND = 0b100
+} AdcFilter;
+
+/**
+ * @brief
+ * A named ADC operating point. ADC power rises with the power mode and with
+ * the MCLK frequency, and acquisition CPU load with the output data rate, so
+ * the profiles run from the lowest power to the highest rate.
+ */
+typedef struct {
+    const char *name;
+    const char *description;
+    AdcPowerMode power_mode;
+    AdcFilter filter;
+    unsigned int decimation_rate;
+    double mclk_frequency;
+    int spi_clock_speed;
+} AdcProfile;
+
+#define ADC_DEFAULT_PROFILE_NAME "eco_1k"
+
+extern const AdcProfile adc_profiles[];
+extern const size_t num_adc_profiles;
+
+const AdcProfile *find_adc_profile(const char name[]);
+unsigned int adc_profile_mclk_division(const AdcProfile *profile);
+double adc_profile_sample_rate(const AdcProfile *profile, double mclk_frequency);
+uint8_t adc_profile_power_clock_register(const AdcProfile *profile);
+uint8_t adc_profile_digital_filter_register(const AdcProfile *profile);
+const char *adc_power_mode_name(AdcPowerMode power_mode);
+const char *adc_filter_name(AdcFilter filter);
@@ -0,0 +1,86 @@
+#include "adc_readout.h"
+#include "sample_broker.h"
+
+/**
+ * @brief 
+ * @param readout 
+ * @param status_bytes 1 if the status byte follows every sample, else 0
+ * @param crc_interval Conversions per CRC byte, or 0 for no CRC
+ */
+void adc_readout_initialize(AdcReadout *readout, unsigned int status_bytes, unsigned int crc_interval) {
+    *readout = (AdcReadout) {
+        .status_bytes = status_bytes,
+        .crc_interval = crc_interval
+    };
+}
+
+/**
+ * @brief 
+ * Restart the CRC window, as the ADC does when its interface format is 
+ * written
+ */
+void adc_readout_synchronize(AdcReadout *readout) {
+    readout->synchronized = true;
+    readout->conversions_since_crc = 0;
+    readout->crc = ADC_READOUT_CRC_SEED;
+}
+
+/**
+ * @brief 
+ * @return Bytes to clock out of the ADC for the next conversion in 
+ * continuous read mode
+ */
+size_t adc_readout_length(const AdcReadout *readout) {
+    bool crc_due = readout->synchronized && readout->crc_interval > 0 && 
+        readout->conversions_since_crc == readout->crc_interval - 1;
+    return ADC_READOUT_DATA_BYTES + readout->status_bytes + crc_due;
+}
+
+uint8_t adc_readout_crc8(uint8_t crc, const uint8_t bytes[], size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        crc ^= bytes[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = crc & 0x80 ? (crc << 1) ^ ADC_READOUT_CRC_POLYNOMIAL : crc << 1;
+        }
+    }
+    return crc;
+}
+
+/**
+ * @brief 
+ * Decode one conversion and check its status byte and, while synchronized, 
+ * the CRC window it falls in. A CRC failure leaves the readout 
+ * unsynchronized.
+ * @param readout 
+ * @param bytes `adc_readout_length` bytes as read out, or without the CRC 
+ * byte when read with a command
+ * @param out_sample 
+ * @return The SAMPLE_BLOCK_ADC_* errors found in the readout
+ */
+uint32_t adc_readout_decode(AdcReadout *readout, const uint8_t bytes[], int32_t *out_sample) {
+    // Shift into the top of the word and back to extend the sign
+    *out_sample = (int32_t) (
+        ((uint32_t) bytes[0] << 24) |
+        ((uint32_t) bytes[1] << 16) |
+        ((uint32_t) bytes[2] << 8)
+    ) >> 8;
+
+    uint32_t flags = 0;
+    if (readout->status_bytes > 0 && (bytes[ADC_READOUT_DATA_BYTES] & ADC_READOUT_STATUS_ERROR_MASK)) {
+        flags |= SAMPLE_BLOCK_ADC_STATUS_ERROR;
+    }
+
+    if (readout->crc_interval > 0 && readout->synchronized) {
+        size_t length = ADC_READOUT_DATA_BYTES + readout->status_bytes;
+        readout->crc = adc_readout_crc8(readout->crc, bytes, length);
+        if (++readout->conversions_since_crc == readout->crc_interval) {
+            if (readout->crc != bytes[length]) {
+                flags |= SAMPLE_BLOCK_ADC_CRC_ERROR;
+                readout->synchronized = false;
+            }
+            readout->conversions_since_crc = 0;
+            readout->crc = ADC_READOUT_CRC_SEED;
+        }
+    }
+    return flags;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// A conversion is read out as a 24 bit big-endian sample, then the status 
+// byte when it is enabled and, in continuous read mode, a CRC byte when one 
+// is due
+#define ADC_READOUT_DATA_BYTES 3
+#define ADC_READOUT_MAX_LENGTH 5
+
+// CRC-8 with polynomial x^8 + x^2 + x + 1, restarted after every CRC byte
+#define ADC_READOUT_CRC_POLYNOMIAL 0x07
+#define ADC_READOUT_CRC_SEED 0xFF
+
+// Every bit of the status byte flags a fault
+#define ADC_READOUT_STATUS_ERROR_MASK 0xFF
+
+/**
+ * @brief 
+ * Decoder of AD7768-1 conversion readouts. It knows nothing of how the bytes 
+ * are clocked out, only their layout, and follows the ADC's CRC window, 
+ * which counts every conversion since the interface was configured whether 
+ * it was read or not. A readout that may have fallen out of step with the 
+ * window is marked unsynchronized, and its CRC is not checked until the 
+ * interface is configured again.
+ */
+typedef struct {
+    unsigned int status_bytes;
+    // Conversions per CRC byte, or 0 for no CRC
+    unsigned int crc_interval;
+
+    bool synchronized;
+    unsigned int conversions_since_crc;
+    uint8_t crc;
+} AdcReadout;
+
+void adc_readout_initialize(AdcReadout *readout, unsigned int status_bytes, unsigned int crc_interval);
+void adc_readout_synchronize(AdcReadout *readout);
+size_t adc_readout_length(const AdcReadout *readout);
+uint32_t adc_readout_decode(AdcReadout *readout, const uint8_t bytes[], int32_t *out_sample);
+uint8_t adc_readout_crc8(uint8_t crc, const uint8_t bytes[], size_t length);
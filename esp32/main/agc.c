@@ -0,0 +1,93 @@
+#include <math.h>
+#include <stdlib.h>
+
+#include "agc.h"
+
+// Samples this close to full scale are taken to be clipped
+#define CLIP_FRACTION 0.999
+
+void agc_default_settings(AgcSettings *settings) {
+    *settings = (AgcSettings) {
+        .peak_high = AGC_DEFAULT_PEAK_HIGH,
+        .peak_low = AGC_DEFAULT_PEAK_LOW,
+        .rms_high = AGC_DEFAULT_RMS_HIGH,
+        .hold_blocks = AGC_DEFAULT_HOLD_BLOCKS
+    };
+}
+
+/**
+ * @brief
+ * @param agc
+ * @param settings
+ * @param gain Gain in use, limited to the AGC's range
+ */
+void agc_initialize(Agc *agc, const AgcSettings *settings, unsigned int gain) {
+    if (gain < AGC_MIN_GAIN) {
+        gain = AGC_MIN_GAIN;
+    }
+    else if (gain > AGC_MAX_GAIN) {
+        gain = AGC_MAX_GAIN;
+    }
+    *agc = (Agc) {
+        .settings = *settings,
+        .gain = gain
+    };
+}
+
+/**
+ * @brief
+ * Measure a block sampled at the current gain and choose the gain for the
+ * next. A clipped block lowers the gain by two steps, since its true peak is
+ * unknown.
+ * @param agc
+ * @param samples
+ * @param length
+ * @return Gain for the next block
+ */
+unsigned int agc_update(Agc *agc, const int32_t samples[], size_t length) {
+    if (length == 0) {
+        return agc->gain;
+    }
+
+    // Integer sums, since doubles are emulated on the ESP32. 24 bit samples
+    // leave room for 2^17 squares.
+    int32_t peak = 0;
+    int64_t sum_squares = 0;
+    for (size_t i = 0; i < length; i++) {
+        int32_t magnitude = abs(samples[i]);
+        if (magnitude > peak) {
+            peak = magnitude;
+        }
+        sum_squares += (int64_t) samples[i] * samples[i];
+    }
+    agc->peak = peak / AGC_FULL_SCALE;
+    agc->rms = sqrt((double) sum_squares / length) / AGC_FULL_SCALE;
+
+    const AgcSettings *settings = &agc->settings;
+    if (agc->peak > settings->peak_high || agc->rms > settings->rms_high) {
+        agc->quiet_blocks = 0;
+        bool clipped = agc->peak >= CLIP_FRACTION;
+        agc->num_clipped_blocks += clipped;
+
+        unsigned int gain = agc->gain >> (clipped ? 2 : 1);
+        if (gain < AGC_MIN_GAIN) {
+            gain = AGC_MIN_GAIN;
+        }
+        if (gain != agc->gain) {
+            agc->num_decreases++;
+            agc->gain = gain;
+        }
+        return agc->gain;
+    }
+
+    if (agc->peak >= settings->peak_low) {
+        agc->quiet_blocks = 0;
+        return agc->gain;
+    }
+    if (++agc->quiet_blocks >= settings->hold_blocks && agc->gain < AGC_MAX_GAIN) {
+        agc->quiet_blocks = 0;
+        agc->gain <<= 1;
+        agc->num_increases++;
+    }
+    return agc->gain;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Largest magnitude of a 24 bit sample
+#define AGC_FULL_SCALE 8388607.0
+
+// The AGC steps through the powers of two between these gains
+#define AGC_MIN_GAIN 1
+#define AGC_MAX_GAIN 64
+
+// Gain is lowered as soon as a block peaks above half of full scale or its
+// RMS passes a quarter, and only raised once peaks have stayed below an
+// eighth for the hold time. Doubling the gain from below an eighth leaves
+// the peak below a quarter, so a step up cannot trigger a step down.
+#define AGC_DEFAULT_PEAK_HIGH 0.5
+#define AGC_DEFAULT_PEAK_LOW 0.125
+#define AGC_DEFAULT_RMS_HIGH 0.25
+#define AGC_DEFAULT_HOLD_BLOCKS 40
+
+typedef struct {
+    // Fractions of full scale
+    double peak_high;
+    double peak_low;
+    double rms_high;
+    // Blocks in a row below `peak_low` before the gain is raised
+    unsigned int hold_blocks;
+} AgcSettings;
+
+/**
+ * @brief
+ * Automatic gain control from block peak and RMS levels. It is updated once
+ * per block, so the gain only changes between blocks and every block is
+ * sampled at a single gain.
+ */
+typedef struct {
+    AgcSettings settings;
+    unsigned int gain;
+    unsigned int quiet_blocks;
+
+    // Levels of the last block as fractions of full scale
+    double peak;
+    double rms;
+
+    unsigned long num_increases;
+    unsigned long num_decreases;
+    unsigned long num_clipped_blocks;
+} Agc;
+
+void agc_default_settings(AgcSettings *settings);
+void agc_initialize(Agc *agc, const AgcSettings *settings, unsigned int gain);
+unsigned int agc_update(Agc *agc, const int32_t samples[], size_t length);
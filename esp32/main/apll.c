@@ -0,0 +1,130 @@
+#include <math.h>
+
+#include "apll.h"
+
+// Multipliers are handled as a single fixed point code,
+// sdm2 << 16 | sdm1 << 8 | sdm0
+#define MULTIPLIER_FRACTION_BITS 16
+#define MAX_MULTIPLIER_CODE (((APLL_MAX_SDM2 + 1) << MULTIPLIER_FRACTION_BITS) - 1)
+
+static double output_division(uint32_t odiv) {
+    return 2.0 * (odiv + 2);
+}
+
+static void set_multiplier_code(ApllCoefficients *coefficients, long code) {
+    coefficients->sdm2 = code >> 16;
+    coefficients->sdm1 = (code >> 8) & 0xff;
+    coefficients->sdm0 = code & 0xff;
+}
+
+static double exact_multiplier_code(double xtal_frequency, double vco_frequency) {
+    return (vco_frequency / xtal_frequency - 4) * (1 << MULTIPLIER_FRACTION_BITS);
+}
+
+/**
+ * @brief
+ * @return The multiplier code nearest to `code` at which the VCO is in range
+ */
+static long clamp_multiplier_code(double xtal_frequency, long code) {
+    long min_code = (long) ceil(exact_multiplier_code(xtal_frequency, APLL_MIN_VCO_FREQUENCY));
+    long max_code = (long) floor(exact_multiplier_code(xtal_frequency, APLL_MAX_VCO_FREQUENCY));
+    if (min_code < 0) {
+        min_code = 0;
+    }
+    if (max_code > MAX_MULTIPLIER_CODE) {
+        max_code = MAX_MULTIPLIER_CODE;
+    }
+
+    if (code < min_code) {
+        return min_code;
+    }
+    if (code > max_code) {
+        return max_code;
+    }
+    return code;
+}
+
+double apll_vco_frequency(double xtal_frequency, const ApllCoefficients *coefficients) {
+    double multiplier =
+        4 + coefficients->sdm2 + coefficients->sdm1 / 256.0 + coefficients->sdm0 / 65536.0;
+    return xtal_frequency * multiplier;
+}
+
+double apll_frequency(double xtal_frequency, const ApllCoefficients *coefficients) {
+    return apll_vco_frequency(xtal_frequency, coefficients) / output_division(coefficients->odiv);
+}
+
+/**
+ * @brief
+ * Find the APLL coefficients closest to a frequency. Rather than searching
+ * every combination, each output divider fixes the VCO frequency needed, so
+ * only the multipliers either side of it are tried, and only for dividers
+ * that keep the VCO in range. That is at most 64 candidates.
+ * @param xtal_frequency
+ * @param frequency
+ * @param candidates Filled with the closest coefficients first
+ * @param max_candidates Length of `candidates`
+ * @return Number of candidates found, 0 if the frequency is out of reach
+ */
+size_t apll_solve(
+    double xtal_frequency,
+    double frequency,
+    ApllCoefficients candidates[],
+    size_t max_candidates
+) {
+    size_t num_candidates = 0;
+    for (uint32_t odiv = 0; odiv <= APLL_MAX_ODIV; odiv++) {
+        double vco_frequency = frequency * output_division(odiv);
+        if (vco_frequency < APLL_MIN_VCO_FREQUENCY || vco_frequency > APLL_MAX_VCO_FREQUENCY) {
+            continue;
+        }
+
+        double exact_code = exact_multiplier_code(xtal_frequency, vco_frequency);
+        long codes[2] = {(long) floor(exact_code), (long) ceil(exact_code)};
+        for (int c = 0; c < 2; c++) {
+            if (c == 1 && codes[1] == codes[0]) {
+                break;
+            }
+
+            // Rounding may step just outside the VCO range
+            ApllCoefficients candidate = {.odiv = odiv};
+            set_multiplier_code(&candidate, clamp_multiplier_code(xtal_frequency, codes[c]));
+            double error = fabs(apll_frequency(xtal_frequency, &candidate) - frequency);
+
+            // Insert in order of error, dropping the worst when full
+            size_t position = num_candidates;
+            while (position > 0 &&
+                   fabs(apll_frequency(xtal_frequency, &candidates[position - 1]) - frequency) > error) {
+                if (position < max_candidates) {
+                    candidates[position] = candidates[position - 1];
+                }
+                position--;
+            }
+            if (position < max_candidates) {
+                candidates[position] = candidate;
+                if (num_candidates < max_candidates) {
+                    num_candidates++;
+                }
+            }
+        }
+    }
+    return num_candidates;
+}
+
+/**
+ * @brief
+ * Find the multiplier closest to a frequency without changing the output
+ * divider, so that small corrections move the APLL smoothly. The step is
+ * xtal / 2^16 / (2 * (odiv + 2)), about 1.5 ppm at 16 MHz.
+ * @param xtal_frequency
+ * @param frequency
+ * @param coefficients Coefficients whose divider is kept and whose
+ * multiplier is set
+ * @return The frequency the coefficients give
+ */
+double apll_fine_tune(double xtal_frequency, double frequency, ApllCoefficients *coefficients) {
+    double vco_frequency = frequency * output_division(coefficients->odiv);
+    long code = lround(exact_multiplier_code(xtal_frequency, vco_frequency));
+    set_multiplier_code(coefficients, clamp_multiplier_code(xtal_frequency, code));
+    return apll_frequency(xtal_frequency, coefficients);
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// The APLL only locks with its VCO in this range
+#define APLL_MIN_VCO_FREQUENCY 350E6
+#define APLL_MAX_VCO_FREQUENCY 500E6
+#define APLL_MAX_ODIV 31
+#define APLL_MAX_SDM2 63
+
+/**
+ * @brief
+ * ESP32 APLL settings. The output frequency is
+ *
+ *   xtal * (4 + sdm2 + sdm1 / 2^8 + sdm0 / 2^16) / (2 * (odiv + 2))
+ *
+ * where the numerator is the VCO frequency. Together sdm2, sdm1 and sdm0 form
+ * a 22 bit fixed point multiplier with 16 fractional bits.
+ */
+typedef struct {
+    uint32_t odiv;
+    uint32_t sdm0;
+    uint32_t sdm1;
+    uint32_t sdm2;
+} ApllCoefficients;
+
+double apll_frequency(double xtal_frequency, const ApllCoefficients *coefficients);
+double apll_vco_frequency(double xtal_frequency, const ApllCoefficients *coefficients);
+size_t apll_solve(
+    double xtal_frequency,
+    double frequency,
+    ApllCoefficients candidates[],
+    size_t max_candidates
+);
+double apll_fine_tune(double xtal_frequency, double frequency, ApllCoefficients *coefficients);
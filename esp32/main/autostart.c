@@ -0,0 +1,155 @@
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "nvs.h"
+
+#include "autostart.h"
+
+static const char *TAG = "autostart";
+
+#define AUTOSTART_NVS_NAMESPACE "autostart"
+
+// How often progress is logged while waiting for Wi-Fi
+#define WIFI_WAIT_LOG_PERIOD_MS 10000
+
+// Between attempts to start telemetry, which fail while the destination 
+// cannot be resolved
+#define TELEMETRY_RETRY_PERIOD_MS 1000
+
+// Read at boot, and cleared by saving settings that are not enabled, which 
+// stops a pending autostart
+static AutostartSettings boot_settings;
+static volatile bool autostart_pending;
+
+static void get_string(nvs_handle_t nvs, const char key[], char value[], size_t size) {
+    if (nvs_get_str(nvs, key, value, &size) != ESP_OK) {
+        value[0] = '\0';
+    }
+}
+
+/**
+ * @brief 
+ * @param settings Settings saved in NVS, or disabled and empty if none were
+ */
+void load_autostart_settings(AutostartSettings *settings) {
+    memset(settings, 0, sizeof(*settings));
+    nvs_handle_t nvs;
+    if (nvs_open(AUTOSTART_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return;
+    }
+
+    uint8_t enabled = 0;
+    nvs_get_u8(nvs, "enabled", &enabled);
+    settings->enabled = enabled;
+    get_string(nvs, "ssid", settings->wifi.ssid, sizeof(settings->wifi.ssid));
+    get_string(nvs, "password", settings->wifi.password, sizeof(settings->wifi.password));
+    nvs_get_u32(nvs, "ip", &settings->wifi.ip);
+    nvs_get_u32(nvs, "netmask", &settings->wifi.netmask);
+    nvs_get_u32(nvs, "gateway", &settings->wifi.gateway);
+    get_string(nvs, "host", settings->hostname, sizeof(settings->hostname));
+    get_string(nvs, "service", settings->service, sizeof(settings->service));
+    uint8_t format = TELEMETRY_FORMAT_BINARY;
+    nvs_get_u8(nvs, "format", &format);
+    settings->format = format;
+    nvs_close(nvs);
+}
+
+/**
+ * @brief 
+ * Save the settings used at the next boot
+ * @param settings 
+ * @return 0 if success
+ */
+int save_autostart_settings(const AutostartSettings *settings) {
+    nvs_handle_t nvs;
+    esp_err_t error = nvs_open(AUTOSTART_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (error != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open NVS to save the autostart settings. details: %s", esp_err_to_name(error));
+        return 1;
+    }
+
+    esp_err_t results[] = {
+        nvs_set_u8(nvs, "enabled", settings->enabled),
+        nvs_set_str(nvs, "ssid", settings->wifi.ssid),
+        nvs_set_str(nvs, "password", settings->wifi.password),
+        nvs_set_u32(nvs, "ip", settings->wifi.ip),
+        nvs_set_u32(nvs, "netmask", settings->wifi.netmask),
+        nvs_set_u32(nvs, "gateway", settings->wifi.gateway),
+        nvs_set_str(nvs, "host", settings->hostname),
+        nvs_set_str(nvs, "service", settings->service),
+        nvs_set_u8(nvs, "format", settings->format)
+    };
+    for (size_t i = 0; i < sizeof(results) / sizeof(results[0]) && error == ESP_OK; i++) {
+        error = results[i];
+    }
+    if (error == ESP_OK) {
+        error = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    if (error != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to save the autostart settings. details: %s", esp_err_to_name(error));
+        return 1;
+    }
+
+    if (! settings->enabled) {
+        autostart_pending = false;
+    }
+    return 0;
+}
+
+/**
+ * @brief 
+ * Start Wi-Fi with the saved settings if autostart is enabled. This is 
+ * called as early in boot as it can be, so that association overlaps the 
+ * rest of the setup.
+ */
+void autostart_wifi(void) {
+    load_autostart_settings(&boot_settings);
+    if (! boot_settings.enabled || boot_settings.wifi.ssid[0] == '\0') {
+        ESP_LOGI(TAG, "Autostart is off");
+        return;
+    }
+    autostart_pending = true;
+    start_wifi(&boot_settings.wifi);
+}
+
+/**
+ * @brief 
+ * Once Wi-Fi is up, start telemetry to the saved destination. This blocks 
+ * until telemetry starts, unless it is started by hand or autostart is 
+ * turned off in the meantime.
+ * @param sample_broker Broker telemetry subscribes to
+ */
+void autostart_telemetry(SampleBroker *sample_broker) {
+    if (! autostart_pending || boot_settings.hostname[0] == '\0') {
+        return;
+    }
+
+    while (autostart_pending) {
+        if (wait_for_wifi(pdMS_TO_TICKS(WIFI_WAIT_LOG_PERIOD_MS))) {
+            ESP_LOGI(TAG, "Still waiting for Wi-Fi to connect to \"%s\"", boot_settings.wifi.ssid);
+            continue;
+        }
+
+        TelemetryStatus status;
+        get_telemetry_status(&status);
+        if (status.running) {
+            break;
+        }
+        if (! start_telemetry(
+            boot_settings.hostname, 
+            boot_settings.service, 
+            sample_broker, 
+            0, 
+            boot_settings.format
+        )) {
+            ESP_LOGI(TAG, "Streaming to %s:%s", boot_settings.hostname, boot_settings.service);
+            break;
+        }
+        vTaskDelay(pdMS_TO_TICKS(TELEMETRY_RETRY_PERIOD_MS));
+    }
+    autostart_pending = false;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "sample_broker.h"
+#include "telemetry.h"
+#include "wifi.h"
+
+/**
+ * @brief 
+ * What a node starts at boot without being told. The ADC profile and gain 
+ * are not here, as the ADC keeps its own.
+ */
+typedef struct {
+    bool enabled;
+    WifiSettings wifi;
+    char hostname[TELEMETRY_MAX_HOSTNAME_LENGTH + 1];
+    char service[TELEMETRY_MAX_SERVICE_LENGTH + 1];
+    TelemetryFormat format;
+} AutostartSettings;
+
+void load_autostart_settings(AutostartSettings *settings);
+int save_autostart_settings(const AutostartSettings *settings);
+void autostart_wifi(void);
+void autostart_telemetry(SampleBroker *sample_broker);
@@ -1,19 +1,36 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <math.h>
 
 #include "esp_log.h"
 
 #include "freertos/FreeRTOS.h"
-#include "freertos/queue.h"
+#include "freertos/task.h"
 
 #include "esp_system.h"
 #include "esp_console.h"
+#include "esp_rom_sys.h"
+#include "esp_heap_caps.h"
+
+#include "sdkconfig.h"
 
 #include "cli.h"
-#include "vga.h"
 #include "diagnostic_inputs.h"
+#include "memory_plan.h"
 #include "wifi.h"
 #include "telemetry.h"
+#include "adc.h"
+#include "pipeline_stats.h"
+#include "uart_stream.h"
+#include "autostart.h"
+#include "spool.h"
+#include "signal_source.h"
+#ifdef CONFIG_ADC_EMULATED
+#include "adc_emulator.h"
+#endif
+
+#include "lwip/sockets.h"
 
 static const esp_console_repl_config_t repl_config = {
     .max_history_len = 20,
@@ -54,7 +71,10 @@ static const esp_console_cmd_t read_voltage_command_config = {
 int cli_read_adc(int argc, char *argv[]);
 static const esp_console_cmd_t read_adc_command_config = {
     .command = "read_adc",
-    .help = "usage: read_adc <num_samples>",
+    .help = 
+        "Usage: read_adc <num_samples> [binary [<baud>]]\n"
+        " Print samples one per line, or stream them as COBS framed binary\n"
+        " telemetry frames, optionally at another baud rate, for tools/uart_capture",
     .hint = NULL,
     .argtable = NULL,
     .func = cli_read_adc
@@ -69,18 +89,192 @@ static const esp_console_cmd_t start_wifi_command_config = {
     .func = cli_connect_wifi
 };
 
-int cli_transmit_telemetry(int argc, char *argv[]);
-static const esp_console_cmd_t start_telemetry_command_config = {
-    .command = "transmit_telemetry",
-    .help = "Usage: transmit_telemetry <hostname> <service> <num_samples>",
+int cli_telemetry(int argc, char *argv[]);
+
+#define BINARY_FORMAT_NAME "binary"
+#define MINISEED_FORMAT_NAME "miniseed"
+#define SPECTRUM_FORMAT_NAME "spectrum"
+#define EVENTS_FORMAT_NAME "events"
+static const esp_console_cmd_t telemetry_command_config = {
+    .command = "telemetry",
+    .help = 
+        "Usage: telemetry start <hostname> <service> [format] [num_samples]\n"
+        "       telemetry stop\n"
+        "       telemetry status\n"
+        " Stream telemetry in the background, until num_samples are sent if given.\n"
+        " format can be " BINARY_FORMAT_NAME " (default), " MINISEED_FORMAT_NAME 
+        ", " SPECTRUM_FORMAT_NAME " or " EVENTS_FORMAT_NAME,
+    .hint = NULL,
+    .argtable = NULL,
+    .func = cli_telemetry
+};
+
+static const char *format_names[] = {
+    [TELEMETRY_FORMAT_BINARY] = BINARY_FORMAT_NAME,
+    [TELEMETRY_FORMAT_MINISEED] = MINISEED_FORMAT_NAME,
+    [TELEMETRY_FORMAT_SPECTRUM] = SPECTRUM_FORMAT_NAME,
+    [TELEMETRY_FORMAT_EVENTS] = EVENTS_FORMAT_NAME
+};
+
+int cli_set_decimation(int argc, char *argv[]);
+static const esp_console_cmd_t set_decimation_command_config = {
+    .command = "set_decimation",
+    .help = "Usage: set_decimation <sample_rate>\n Decimate telemetry to sample_rate samples per second, or 0 to disable",
+    .hint = NULL,
+    .argtable = NULL,
+    .func = cli_set_decimation
+};
+
+int cli_set_spectrum(int argc, char *argv[]);
+
+#define NO_BANDS_NAME "none"
+#define OCTAVE_BANDS_NAME "octave"
+#define THIRD_OCTAVE_BANDS_NAME "third_octave"
+static const esp_console_cmd_t set_spectrum_command_config = {
+    .command = "set_spectrum",
+    .help = 
+        "Usage: set_spectrum <fft_length> <interval_seconds> <bands>\n"
+        " Configure spectrum telemetry. bands can be "
+        NO_BANDS_NAME ", " OCTAVE_BANDS_NAME " or " THIRD_OCTAVE_BANDS_NAME,
+    .hint = NULL,
+    .argtable = NULL,
+    .func = cli_set_spectrum
+};
+
+int cli_set_trigger(int argc, char *argv[]);
+static const esp_console_cmd_t set_trigger_command_config = {
+    .command = "set_trigger",
+    .help = 
+        "Usage: set_trigger <sta_seconds> <lta_seconds> <trigger_ratio> <detrigger_ratio> "
+        "<pre_trigger_seconds> <post_trigger_seconds> [heartbeat_seconds]\n"
+        " Configure the STA/LTA trigger for event telemetry",
+    .hint = NULL,
+    .argtable = NULL,
+    .func = cli_set_trigger
+};
+
+int cli_set_stream_id(int argc, char *argv[]);
+static const esp_console_cmd_t set_stream_id_command_config = {
+    .command = "set_stream_id",
+    .help = "Usage: set_stream_id <network> <station> <location> <channel>\n SEED identifiers for miniSEED telemetry",
+    .hint = NULL,
+    .argtable = NULL,
+    .func = cli_set_stream_id
+};
+
+int cli_stats(int argc, char *argv[]);
+static const esp_console_cmd_t stats_command_config = {
+    .command = "stats",
+    .help = 
+        "Usage: stats [reset | interval <seconds>]\n"
+        " Show pipeline counters and timing histograms, clear them, or set how often\n"
+        " they and the diagnostic input health are sent with binary telemetry (0 to stop)",
+    .hint = NULL,
+    .argtable = NULL,
+    .func = cli_stats
+};
+
+int cli_adc_profile(int argc, char *argv[]);
+static const esp_console_cmd_t adc_profile_command_config = {
+    .command = "adc_profile",
+    .help = 
+        "Usage: adc_profile [list | set <name>]\n"
+        " Show the active ADC profile and the CPU load of acquisition, list the\n"
+        " profiles, or switch to a profile and keep it across reboots. Telemetry\n"
+        " must be stopped to switch.",
+    .hint = NULL,
+    .argtable = NULL,
+    .func = cli_adc_profile
+};
+
+int cli_clock(int argc, char *argv[]);
+static const esp_console_cmd_t clock_command_config = {
+    .command = "clock",
+    .help = 
+        "Usage: clock [tolerance <ppm>]\n"
+        " Show how the ADC clock is disciplined to its time reference, or set the\n"
+        " mean rate error within which it counts as locked",
+    .hint = NULL,
+    .argtable = NULL,
+    .func = cli_clock
+};
+
+int cli_health(int argc, char *argv[]);
+static const esp_console_cmd_t health_command_config = {
+    .command = "health",
+    .help = 
+        "Usage: health\n"
+        " Show the amplifier output, virtual ground and reference voltages measured\n"
+        " in the background: the last reading, the mean, minimum and maximum over the\n"
+        " last 60 readings, the noise of a reading and the drift over the last hour",
+    .hint = NULL,
+    .argtable = NULL,
+    .func = cli_health
+};
+
+int cli_mem(int argc, char *argv[]);
+static const esp_console_cmd_t mem_command_config = {
+    .command = "mem",
+    .help = 
+        "Usage: mem\n"
+        " Show the use of the sample block pool and subscriber slots, the free heap\n"
+        " with its low water mark and largest free block, and the least free stack\n"
+        " each task has had",
+    .hint = NULL,
+    .argtable = NULL,
+    .func = cli_mem
+};
+
+int cli_agc(int argc, char *argv[]);
+static const esp_console_cmd_t agc_command_config = {
+    .command = "agc",
+    .help = 
+        "Usage: agc [on | off]\n"
+        " Show the automatic gain control, or start or stop it. It starts from the\n"
+        " current gain, and setting a gain by hand stops it",
     .hint = NULL,
     .argtable = NULL,
-    .func = cli_transmit_telemetry
+    .func = cli_agc
+};
+
+int cli_source(int argc, char *argv[]);
+static const esp_console_cmd_t source_command_config = {
+    .command = "source",
+    .help = 
+        "Usage: source [adc | replay] [fast]\n"
+        "       source sine <hz> <amplitude> [fast]\n"
+        "       source chirp <start_hz> <end_hz> <seconds> <amplitude> [fast]\n"
+        "       source noise <rms> [fast]\n"
+        " Show where samples come from, or publish a synthetic waveform or the\n"
+        " recording in the replay partition in place of the ADC, at the ADC's sample\n"
+        " rate or, with fast, as fast as subscribers take them. Amplitudes are in\n"
+        " counts. Telemetry must be stopped to switch.",
+    .hint = NULL,
+    .argtable = NULL,
+    .func = cli_source
+};
+
+int cli_autostart(int argc, char *argv[]);
+static const esp_console_cmd_t autostart_command_config = {
+    .command = "autostart",
+    .help = 
+        "Usage: autostart [on | off]\n"
+        "       autostart wifi <ssid> <password>\n"
+        "       autostart address <ip> <netmask> <gateway>\n"
+        "       autostart address dhcp\n"
+        "       autostart telemetry <hostname> <service> [format]\n"
+        " Show or change what starts at boot, and show how long the last boot took to\n"
+        " stream. When on, Wi-Fi and then telemetry start without a command. A static\n"
+        " address skips DHCP. The ADC profile and gain are saved whenever they are set",
+    .hint = NULL,
+    .argtable = NULL,
+    .func = cli_autostart
 };
 
 static esp_console_repl_t *repl;
 
-extern QueueHandle_t adc_samples;
+extern SampleBroker sample_broker;
+extern PipelineStats pipeline_stats;
 
 
 int start_cli(void) {
@@ -92,7 +286,19 @@ int start_cli(void) {
     ESP_ERROR_CHECK(esp_console_cmd_register(&read_voltage_command_config));
     ESP_ERROR_CHECK(esp_console_cmd_register(&read_adc_command_config));
     ESP_ERROR_CHECK(esp_console_cmd_register(&start_wifi_command_config));
-    ESP_ERROR_CHECK(esp_console_cmd_register(&start_telemetry_command_config));
+    ESP_ERROR_CHECK(esp_console_cmd_register(&telemetry_command_config));
+    ESP_ERROR_CHECK(esp_console_cmd_register(&set_stream_id_command_config));
+    ESP_ERROR_CHECK(esp_console_cmd_register(&set_decimation_command_config));
+    ESP_ERROR_CHECK(esp_console_cmd_register(&set_spectrum_command_config));
+    ESP_ERROR_CHECK(esp_console_cmd_register(&set_trigger_command_config));
+    ESP_ERROR_CHECK(esp_console_cmd_register(&stats_command_config));
+    ESP_ERROR_CHECK(esp_console_cmd_register(&adc_profile_command_config));
+    ESP_ERROR_CHECK(esp_console_cmd_register(&clock_command_config));
+    ESP_ERROR_CHECK(esp_console_cmd_register(&agc_command_config));
+    ESP_ERROR_CHECK(esp_console_cmd_register(&health_command_config));
+    ESP_ERROR_CHECK(esp_console_cmd_register(&mem_command_config));
+    ESP_ERROR_CHECK(esp_console_cmd_register(&autostart_command_config));
+    ESP_ERROR_CHECK(esp_console_cmd_register(&source_command_config));
 
     ESP_ERROR_CHECK(esp_console_start_repl(repl));
 
@@ -113,7 +319,13 @@ int cli_set_vga_gain(int argc, char *argv[]) {
         return 1;
     }
 
-    return set_vga_gain((unsigned int) gain);
+    GainStatus status;
+    get_gain_status(&status);
+    if (status.agc_enabled) {
+        printf("automatic gain control stopped\n");
+    }
+    set_acquisition_gain((unsigned int) gain);
+    return 0;
 }
 
 int cli_voltage(int argc, char *argv[]) {
@@ -140,26 +352,60 @@ int cli_voltage(int argc, char *argv[]) {
     }
     
     if (error_code != 0) {
-        printf("%f\n", voltage);
-        return 0;
+        fprintf(stderr, "error: could not read %s, the ADC may be in use by Wi-Fi\n", input);
+        return 1;
     }
 
-    return 1;
+    printf("%f\n", voltage);
+    return 0;
 }
 
 int cli_read_adc(int argc, char *argv[]) {
-    if (argc != 2) {
-        fprintf(stderr, "error: expecting 1 argument, %d passed instead\n", argc - 1);
+    if (argc < 2 || argc > 4 || (argc > 2 && strcmp(argv[2], "binary"))) {
+        fprintf(stderr, "error: expecting <num_samples> [binary [<baud>]]\n");
         return 1;
     }
 
     long num_samples = atol(argv[1]);
+    if (argc > 2) {
+        long baud_rate = argc == 4 ? atol(argv[3]) : 0;
+        if (argc == 4 && (baud_rate < UART_STREAM_MIN_BAUD_RATE || baud_rate > UART_STREAM_MAX_BAUD_RATE)) {
+            fprintf(
+                stderr, 
+                "error: baud rate must be from %d to %d\n", 
+                UART_STREAM_MIN_BAUD_RATE, 
+                UART_STREAM_MAX_BAUD_RATE
+            );
+            return 1;
+        }
+        if (stream_samples_over_uart(&sample_broker, num_samples, baud_rate)) {
+            fprintf(stderr, "error: failed to stream samples\n");
+            return 1;
+        }
+        return 0;
+    }
+
+    SampleSubscriber *subscriber = sample_broker_subscribe(&sample_broker, CONFIG_SAMPLE_SUBSCRIBER_DEPTH);
+    if (subscriber == NULL) {
+        fprintf(stderr, "error: too many sample subscribers\n");
+        return 1;
+    }
+
+    long samples_printed = 0;
+    while (samples_printed < num_samples) {
+        const SampleBlock *block = sample_subscriber_receive(subscriber);
+        if (block == NULL) {
+            vTaskDelay(pdMS_TO_TICKS(SAMPLE_BUFFER_POLL_PERIOD_MS));
+            continue;
+        }
 
-    for (int i = 0; i < num_samples; i++) {
-        int sample;
-        xQueueReceive(adc_samples, &sample, portMAX_DELAY);
-        printf("%d\n", sample);
+        for (int i = 0; i < block->length && samples_printed < num_samples; i++) {
+            printf("%ld\n", (long) block->samples[i]);
+            samples_printed++;
+        }
+        sample_block_release(block);
     }
+    sample_broker_unsubscribe(subscriber);
     return 0;
 }
 
@@ -176,15 +422,778 @@ int cli_connect_wifi(int argc, char *argv[]) {
     return 0;
 }
 
-int cli_transmit_telemetry(int argc, char *argv[]) {
+static int parse_format(const char name[], TelemetryFormat *format) {
+    for (size_t f = 0; f < sizeof(format_names) / sizeof(format_names[0]); f++) {
+        if (! strcmp(name, format_names[f])) {
+            *format = f;
+            return 0;
+        }
+    }
+    fprintf(stderr, "error: invalid format %s\n", name);
+    return 1;
+}
+
+static int cli_start_telemetry(int argc, char *argv[]) {
+    if (argc < 4 || argc > 6) {
+        fprintf(stderr, "error: expecting 2 to 4 arguments to start, %d passed instead\n", argc - 2);
+        return 1;
+    }
+
+    char *hostname = argv[2];
+    char *service = argv[3];
+
+    TelemetryFormat format = TELEMETRY_FORMAT_BINARY;
+    if (argc >= 5 && parse_format(argv[4], &format)) {
+        return 1;
+    }
+
+    long long num_samples = argc == 6 ? atoll(argv[5]) : 0;
+    if (num_samples < 0) {
+        fprintf(stderr, "error: number of samples %s is negative\n", argv[5]);
+        return 1;
+    }
+
+    return start_telemetry(hostname, service, &sample_broker, (uint64_t) num_samples, format);
+}
+
+static int cli_telemetry_status(void) {
+    TelemetryStatus status;
+    get_telemetry_status(&status);
+
+    printf("state: %s\n", status.running ? "running" : "stopped");
+    if (status.hostname[0] == '\0') {
+        return 0;
+    }
+    printf("destination: %s:%s, format %s\n", status.hostname, status.service, format_names[status.format]);
+
+    double elapsed = status.elapsed > 0 ? status.elapsed : 1;
+    printf("elapsed: %.1f s\n", status.elapsed);
+    printf(
+        "samples: %llu (%.1f samples/s)\n", 
+        (unsigned long long) status.samples_consumed, 
+        status.samples_consumed / elapsed
+    );
+    printf(
+        "datagrams: %lu, %llu bytes (%.0f bytes/s)\n", 
+        status.datagrams_sent, 
+        (unsigned long long) status.bytes_sent, 
+        status.bytes_sent / elapsed
+    );
+    printf("send errors: %lu\n", status.send_errors);
+
+    SpoolStatus spool;
+    get_spool_status(&spool);
+    if (spool.medium != SPOOL_NONE) {
+        printf(
+            "spool: %s, %u datagrams in %u of %u KiB, %lu spooled, %lu backfilled, %lu dropped\n",
+            spool_medium_name(spool.medium),
+            (unsigned int) spool.num_datagrams,
+            (unsigned int) (spool.bytes_used / 1024),
+            (unsigned int) (spool.capacity / 1024),
+            spool.datagrams_spooled,
+            spool.datagrams_backfilled,
+            spool.datagrams_dropped
+        );
+    }
+    if (status.running) {
+        printf(
+            "queue: %u blocks, %u at most, %lu dropped\n", 
+            (unsigned int) status.queue_depth, 
+            (unsigned int) status.queue_high_water, 
+            status.blocks_dropped
+        );
+    }
+    return 0;
+}
+
+int cli_telemetry(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "error: expecting a subcommand\n");
+        return 1;
+    }
+
+    if (! strcmp(argv[1], "start")) {
+        return cli_start_telemetry(argc, argv);
+    }
+    if (argc != 2) {
+        fprintf(stderr, "error: %s takes no arguments\n", argv[1]);
+        return 1;
+    }
+    if (! strcmp(argv[1], "stop")) {
+        return stop_telemetry();
+    }
+    if (! strcmp(argv[1], "status")) {
+        return cli_telemetry_status();
+    }
+
+    fprintf(stderr, "error: invalid subcommand %s\n", argv[1]);
+    return 1;
+}
+
+int cli_set_stream_id(int argc, char *argv[]) {
+    if (argc != 5) {
+        fprintf(stderr, "error: expecting 4 arguments, %d passed instead\n", argc - 1);
+        return 1;
+    }
+
+    TelemetryStatus telemetry_status;
+    get_telemetry_status(&telemetry_status);
+    if (telemetry_status.running) {
+        fprintf(stderr, "error: stop telemetry before changing the stream ID\n");
+        return 1;
+    }
+
+    if (set_telemetry_stream_id(argv[1], argv[2], argv[3], argv[4])) {
+        fprintf(stderr, "error: SEED codes are limited to 2, 5, 2 and 3 characters\n");
+        return 1;
+    }
+    return 0;
+}
+
+int cli_set_decimation(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "error: expecting 1 argument, %d passed instead\n", argc - 1);
+        return 1;
+    }
+
+    double sample_rate = atof(argv[1]);
+    if (sample_rate < 0) {
+        fprintf(stderr, "error: sample rate %s is negative\n", argv[1]);
+        return 1;
+    }
+
+    TelemetryStatus telemetry_status;
+    get_telemetry_status(&telemetry_status);
+    if (telemetry_status.running) {
+        fprintf(stderr, "error: stop telemetry before changing the decimation\n");
+        return 1;
+    }
+
+    if (set_telemetry_decimation(sample_rate)) {
+        fprintf(stderr, "error: sample rate %s is not an integer fraction of the ADC rate\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}
+
+int cli_set_spectrum(int argc, char *argv[]) {
     if (argc != 4) {
-        fprintf(stderr, "error: expecting 3 argument, %d passed instead\n", argc - 1);
+        fprintf(stderr, "error: expecting 3 arguments, %d passed instead\n", argc - 1);
         return 1;
     }
 
-    char *hostname = argv[1];
-    char *service = argv[2];
-    int num_samples = (int) atol(argv[3]);
+    SpectrumBandType band_type;
+    if (! strcmp(argv[3], NO_BANDS_NAME)) {
+        band_type = SPECTRUM_BANDS_NONE;
+    }
+    else if (! strcmp(argv[3], OCTAVE_BANDS_NAME)) {
+        band_type = SPECTRUM_BANDS_OCTAVE;
+    }
+    else if (! strcmp(argv[3], THIRD_OCTAVE_BANDS_NAME)) {
+        band_type = SPECTRUM_BANDS_THIRD_OCTAVE;
+    }
+    else {
+        fprintf(stderr, "error: invalid bands %s\n", argv[3]);
+        return 1;
+    }
 
-    return start_telemetry(hostname, service, adc_samples, num_samples);
+    if (set_telemetry_spectrum((unsigned int) atol(argv[1]), atof(argv[2]), band_type)) {
+        fprintf(
+            stderr, 
+            "error: FFT length must be a power of two from %d to %d and the interval positive\n",
+            SPECTRUM_MIN_FFT_LENGTH,
+            SPECTRUM_MAX_FFT_LENGTH
+        );
+        return 1;
+    }
+    return 0;
+}
+
+int cli_set_trigger(int argc, char *argv[]) {
+    if (argc != 7 && argc != 8) {
+        fprintf(stderr, "error: expecting 6 or 7 arguments, %d passed instead\n", argc - 1);
+        return 1;
+    }
+
+    double heartbeat_interval = argc == 8 ? atof(argv[7]) : 30.0;
+    if (set_telemetry_trigger(
+            atof(argv[1]), 
+            atof(argv[2]), 
+            atof(argv[3]), 
+            atof(argv[4]), 
+            atof(argv[5]), 
+            atof(argv[6]), 
+            heartbeat_interval)) {
+        fprintf(
+            stderr, 
+            "error: the LTA must be longer than the STA, the trigger ratio greater than the "
+            "detrigger ratio, and all times positive\n"
+        );
+        return 1;
+    }
+    return 0;
+}
+
+static void print_stats(const PipelineStats *stats) {
+    for (int c = 0; c < STATS_NUM_COUNTERS; c++) {
+        printf("%-20s %lu\n", stats_counter_name(c), (unsigned long) stats->counters[c]);
+    }
+
+    // Cycle counts are shown in microseconds like the other latencies
+    double cycles_per_us = esp_rom_get_cpu_ticks_per_us();
+    printf(
+        "\n%-20s %10s %10s %10s %10s %10s %10s\n", 
+        "latency (us)", "count", "min", "mean", "p50", "p99", "max"
+    );
+    for (int h = 0; h < STATS_NUM_HISTOGRAMS; h++) {
+        const StatsHistogram *histogram = &stats->histograms[h];
+        double scale = stats_histogram_unit(h) == STATS_UNIT_CYCLES ? 1 / cycles_per_us : 1;
+        double mean = histogram->count > 0 ? (double) histogram->total / histogram->count : 0;
+        printf(
+            "%-20s %10lu %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+            stats_histogram_name(h),
+            (unsigned long) histogram->count,
+            histogram->min * scale,
+            mean * scale,
+            stats_histogram_percentile(histogram, 0.5) * scale,
+            stats_histogram_percentile(histogram, 0.99) * scale,
+            histogram->max * scale
+        );
+    }
+}
+
+int cli_stats(int argc, char *argv[]) {
+    if (argc == 1) {
+        print_stats(&pipeline_stats);
+        return 0;
+    }
+    if (argc == 2 && ! strcmp(argv[1], "reset")) {
+        pipeline_stats_reset(&pipeline_stats);
+        return 0;
+    }
+    if (argc == 3 && ! strcmp(argv[1], "interval")) {
+        if (set_telemetry_stats_interval(atof(argv[2]))) {
+            fprintf(stderr, "error: interval %s is negative\n", argv[2]);
+            return 1;
+        }
+        return 0;
+    }
+
+    fprintf(stderr, "error: expecting no arguments, reset, or interval <seconds>\n");
+    return 1;
+}
+
+static void list_adc_profiles(const AdcProfile *active_profile) {
+    printf(
+        "  %-18s %10s %7s %9s %9s %8s  %s\n", 
+        "name", "samples/s", "power", "filter", "MCLK MHz", "SPI MHz", "description"
+    );
+    for (size_t p = 0; p < num_adc_profiles; p++) {
+        const AdcProfile *profile = &adc_profiles[p];
+        printf(
+            "%c %-18s %10g %7s %9s %9.3f %8.1f  %s\n",
+            profile == active_profile ? '*' : ' ',
+            profile->name,
+            adc_profile_sample_rate(profile, profile->mclk_frequency),
+            adc_power_mode_name(profile->power_mode),
+            adc_filter_name(profile->filter),
+            profile->mclk_frequency / 1E6,
+            profile->spi_clock_speed / 1E6,
+            profile->description
+        );
+    }
+}
+
+int cli_adc_profile(int argc, char *argv[]) {
+    AdcStatus status;
+    get_adc_status(&status);
+
+    if (argc == 1) {
+        printf("profile      %s\n", status.profile != NULL ? status.profile->name : "none");
+        printf("sample rate  %.3f samples/s\n", status.sample_rate);
+        printf("MCLK         %.0f Hz\n", status.mclk_frequency);
+        printf("CPU load     %.2f%% of the acquisition core\n", status.cpu_load * 100);
+#ifdef CONFIG_ADC_EMULATED
+        Ad7768Model model;
+        get_adc_emulator_status(&model);
+        printf(
+            "emulated     %llu conversions at %.3f samples/s\n", 
+            (unsigned long long) model.num_conversions, 
+            ad7768_model_output_data_rate(&model)
+        );
+#endif
+        return 0;
+    }
+    if (argc == 2 && ! strcmp(argv[1], "list")) {
+        list_adc_profiles(status.profile);
+        return 0;
+    }
+    if (argc == 3 && ! strcmp(argv[1], "set")) {
+        const AdcProfile *profile = find_adc_profile(argv[2]);
+        if (profile == NULL) {
+            fprintf(stderr, "error: no ADC profile named %s\n", argv[2]);
+            return 1;
+        }
+
+        TelemetryStatus telemetry_status;
+        get_telemetry_status(&telemetry_status);
+        if (telemetry_status.running) {
+            fprintf(stderr, "error: stop telemetry before changing the ADC profile\n");
+            return 1;
+        }
+
+        if (set_adc_profile(profile)) {
+            fprintf(stderr, "error: failed to switch to ADC profile %s\n", profile->name);
+            return 1;
+        }
+        return 0;
+    }
+
+    fprintf(stderr, "error: expecting no arguments, list, or set <name>\n");
+    return 1;
+}
+
+#ifdef CONFIG_ADC_CLOCK_DISCIPLINE
+static void print_clock_status(const AdcClockStatus *status) {
+    const ClockDiscipline *discipline = &status->discipline;
+#if CONFIG_ADC_DISCIPLINE_PPS_PIN >= 0
+    printf("reference     PPS on GPIO %d\n", CONFIG_ADC_DISCIPLINE_PPS_PIN);
+#else
+    printf("reference     SNTP every %d s\n", CONFIG_ADC_DISCIPLINE_SNTP_INTERVAL);
+#endif
+    printf("wall clock    %s\n", status->wall_clock_synchronized ? "synchronized" : "not synchronized");
+    printf("state         %s\n", discipline->locked ? "locked" : discipline->have_reference ? "tracking" : "waiting");
+    printf("tolerance     %g ppm over %g s\n", discipline->tolerance_ppm, discipline->time_constant);
+    printf("phase error   %.3f ms\n", discipline->filtered_phase_error * 1E3);
+    printf("correction    %+.3f ppm\n", discipline->correction_ppm);
+    printf("updates       %lu, %lu reference steps\n", discipline->num_updates, discipline->num_steps);
+    printf(
+        "APLL          odiv %lu, sdm2 %lu, sdm1 %lu, sdm0 %lu\n",
+        (unsigned long) status->apll.odiv,
+        (unsigned long) status->apll.sdm2,
+        (unsigned long) status->apll.sdm1,
+        (unsigned long) status->apll.sdm0
+    );
+}
+#endif
+
+int cli_clock(int argc, char *argv[]) {
+#ifdef CONFIG_ADC_CLOCK_DISCIPLINE
+    if (argc == 1) {
+        AdcClockStatus status;
+        get_adc_clock_status(&status);
+        print_clock_status(&status);
+        return 0;
+    }
+    if (argc == 3 && ! strcmp(argv[1], "tolerance")) {
+        if (set_adc_clock_tolerance(atof(argv[2]))) {
+            fprintf(stderr, "error: tolerance %s is not positive\n", argv[2]);
+            return 1;
+        }
+        return 0;
+    }
+
+    fprintf(stderr, "error: expecting no arguments, or tolerance <ppm>\n");
+    return 1;
+#else
+    fprintf(stderr, "error: ADC clock discipline is not enabled in this build\n");
+    return 1;
+#endif
+}
+
+int cli_agc(int argc, char *argv[]) {
+    if (argc == 1) {
+        GainStatus status;
+        get_gain_status(&status);
+        const Agc *agc = &status.agc;
+        printf("state         %s\n", status.agc_enabled ? "on" : "off");
+        printf("gain          %u\n", status.gain);
+        printf("last block    peak %.1f%%, rms %.1f%% of full scale\n", agc->peak * 100, agc->rms * 100);
+        printf(
+            "thresholds    down above peak %.1f%% or rms %.1f%%, up below peak %.1f%% for %u blocks\n",
+            agc->settings.peak_high * 100,
+            agc->settings.rms_high * 100,
+            agc->settings.peak_low * 100,
+            agc->settings.hold_blocks
+        );
+        printf(
+            "changes       %lu up, %lu down, %lu clipped blocks\n",
+            agc->num_increases,
+            agc->num_decreases,
+            agc->num_clipped_blocks
+        );
+        return 0;
+    }
+    if (argc == 2 && (! strcmp(argv[1], "on") || ! strcmp(argv[1], "off"))) {
+        set_automatic_gain(! strcmp(argv[1], "on"));
+        return 0;
+    }
+
+    fprintf(stderr, "error: expecting no arguments, on, or off\n");
+    return 1;
+}
+
+int cli_health(int argc, char *argv[]) {
+    if (argc != 1) {
+        fprintf(stderr, "error: expecting no arguments\n");
+        return 1;
+    }
+
+    InputHealthSummary inputs[DIAGNOSTIC_NUM_INPUTS];
+    get_input_health(inputs);
+
+    printf(
+        "%-18s %9s %9s %9s %9s %9s %10s %9s %7s\n", 
+        "input (V)", "last", "mean", "min", "max", "noise", "drift/h", "readings", "missed"
+    );
+    for (int i = 0; i < DIAGNOSTIC_NUM_INPUTS; i++) {
+        const InputHealthSummary *input = &inputs[i];
+        char drift[16] = "-";
+        if (! isnan(input->drift)) {
+            snprintf(drift, sizeof(drift), "%+.5f", input->drift);
+        }
+        printf(
+            "%-18s %9.5f %9.5f %9.5f %9.5f %9.5f %10s %9lu %7lu\n",
+            diagnostic_input_name(i),
+            input->last,
+            input->mean,
+            input->min,
+            input->max,
+            input->noise,
+            drift,
+            (unsigned long) input->num_readings,
+            (unsigned long) input->num_missed
+        );
+    }
+    printf("every %g s, %d conversions per reading\n", health_reading_period(), CONFIG_DIAGNOSTIC_OVERSAMPLING);
+    return 0;
+}
+
+static void print_pools(SampleBroker *broker) {
+    printf("%-20s %8s %8s %10s\n", "pool", "used", "total", "bytes");
+    printf(
+        "%-20s %8u %8u %10u\n",
+        "sample blocks",
+        (unsigned) sample_broker_blocks_in_use(broker),
+        (unsigned) broker->num_blocks,
+        (unsigned) (broker->num_blocks * sizeof(SampleBlock))
+    );
+
+    unsigned int active_subscribers = 0;
+    for (size_t i = 0; i < SAMPLE_BROKER_MAX_SUBSCRIBERS; i++) {
+        active_subscribers += atomic_load(&broker->subscribers[i].state) == SAMPLE_SUBSCRIBER_ACTIVE;
+    }
+    printf("%-20s %8u %8u\n", "subscribers", active_subscribers, (unsigned) SAMPLE_BROKER_MAX_SUBSCRIBERS);
+    for (size_t i = 0; i < SAMPLE_BROKER_MAX_SUBSCRIBERS; i++) {
+        SampleSubscriber *subscriber = &broker->subscribers[i];
+        if (atomic_load(&subscriber->state) != SAMPLE_SUBSCRIBER_ACTIVE) {
+            continue;
+        }
+        printf(
+            "  subscriber %u      %8u %8u   high water %u\n",
+            (unsigned) i,
+            (unsigned) sample_subscriber_count(subscriber),
+            (unsigned) subscriber->depth,
+            (unsigned) atomic_load(&subscriber->high_water)
+        );
+    }
+    printf("pool empty %lu times\n", (unsigned long) atomic_load(&broker->pool_exhausted));
+}
+
+static void print_heap(void) {
+    static const struct {
+        const char *name;
+        uint32_t caps;
+    } heaps[] = {
+        {"8-bit", MALLOC_CAP_8BIT},
+        {"DMA", MALLOC_CAP_DMA}
+    };
+
+    printf("\n%-20s %10s %10s %10s %10s\n", "heap", "free", "low water", "largest", "total");
+    for (size_t h = 0; h < sizeof(heaps) / sizeof(heaps[0]); h++) {
+        printf(
+            "%-20s %10u %10u %10u %10u\n",
+            heaps[h].name,
+            (unsigned) heap_caps_get_free_size(heaps[h].caps),
+            (unsigned) heap_caps_get_minimum_free_size(heaps[h].caps),
+            (unsigned) heap_caps_get_largest_free_block(heaps[h].caps),
+            (unsigned) heap_caps_get_total_size(heaps[h].caps)
+        );
+    }
+}
+
+static void print_task_stacks(void) {
+    // Tasks that ESP-IDF and the REPL start, whose stacks are not planned here
+    static const char *system_tasks[] = {"main", "console_repl", "tiT", "wifi", "sys_evt", "esp_timer"};
+
+    printf("\n%-20s %10s %10s\n", "task stack", "bytes", "least free");
+    const PlannedTask *tasks[MEMORY_PLAN_MAX_TASKS];
+    size_t num_tasks = get_planned_tasks(tasks, MEMORY_PLAN_MAX_TASKS);
+    uint32_t planned_bytes = 0;
+    for (size_t t = 0; t < num_tasks; t++) {
+        printf(
+            "%-20s %10lu %10u\n",
+            tasks[t]->name,
+            (unsigned long) tasks[t]->stack_size,
+            (unsigned) uxTaskGetStackHighWaterMark(tasks[t]->handle)
+        );
+        planned_bytes += tasks[t]->stack_size;
+    }
+    for (size_t t = 0; t < sizeof(system_tasks) / sizeof(system_tasks[0]); t++) {
+        TaskHandle_t handle = xTaskGetHandle(system_tasks[t]);
+        if (handle != NULL) {
+            printf("%-20s %10s %10u\n", system_tasks[t], "-", (unsigned) uxTaskGetStackHighWaterMark(handle));
+        }
+    }
+    printf("%lu bytes of planned stacks in use\n", (unsigned long) planned_bytes);
+}
+
+int cli_mem(int argc, char *argv[]) {
+    if (argc != 1) {
+        fprintf(stderr, "error: expecting no arguments\n");
+        return 1;
+    }
+
+    print_pools(&sample_broker);
+    print_heap();
+    print_task_stacks();
+    return 0;
+}
+
+static void print_address(const char label[], uint32_t address) {
+    char text[INET_ADDRSTRLEN];
+    struct in_addr in_address = {.s_addr = address};
+    printf("%-14s%s\n", label, inet_ntop(AF_INET, &in_address, text, sizeof(text)));
+}
+
+static void print_boot_time(const char label[], int64_t time_us) {
+    if (time_us == 0) {
+        printf("%-14s-\n", label);
+        return;
+    }
+    printf("%-14s%lld ms\n", label, (long long) (time_us / 1000));
+}
+
+static int print_autostart(void) {
+    AutostartSettings settings;
+    load_autostart_settings(&settings);
+
+    printf("state         %s\n", settings.enabled ? "on" : "off");
+    printf("ssid          %s\n", settings.wifi.ssid);
+    printf("password      %s\n", settings.wifi.password[0] != '\0' ? "(set)" : "(none)");
+    if (settings.wifi.ip == 0) {
+        printf("address       dhcp\n");
+    }
+    else {
+        print_address("address", settings.wifi.ip);
+        print_address("netmask", settings.wifi.netmask);
+        print_address("gateway", settings.wifi.gateway);
+    }
+    if (settings.hostname[0] != '\0') {
+        printf(
+            "telemetry     %s:%s, format %s\n", 
+            settings.hostname, 
+            settings.service, 
+            format_names[settings.format]
+        );
+    }
+    else {
+        printf("telemetry     none\n");
+    }
+
+    WifiTiming timing;
+    get_wifi_timing(&timing);
+    TelemetryStatus status;
+    get_telemetry_status(&status);
+    printf("\nsince boot\n");
+    print_boot_time("wifi started", timing.start_us);
+    print_boot_time("associated", timing.connected_us);
+    print_boot_time("address", timing.got_ip_us);
+    print_boot_time("first packet", status.first_datagram_time_us);
+    if (timing.connected_us != 0) {
+        printf("access point  %s\n", timing.used_cached_ap ? "cached" : "scanned");
+    }
+    return 0;
+}
+
+static int parse_address(const char text[], uint32_t *address) {
+    struct in_addr in_address;
+    if (inet_pton(AF_INET, text, &in_address) != 1) {
+        fprintf(stderr, "error: invalid address %s\n", text);
+        return 1;
+    }
+    *address = in_address.s_addr;
+    return 0;
+}
+
+int cli_autostart(int argc, char *argv[]) {
+    if (argc == 1) {
+        return print_autostart();
+    }
+
+    AutostartSettings settings;
+    load_autostart_settings(&settings);
+
+    if (argc == 2 && (! strcmp(argv[1], "on") || ! strcmp(argv[1], "off"))) {
+        settings.enabled = ! strcmp(argv[1], "on");
+        if (settings.enabled && settings.wifi.ssid[0] == '\0') {
+            fprintf(stderr, "error: set the Wi-Fi network first\n");
+            return 1;
+        }
+    }
+    else if (argc == 4 && ! strcmp(argv[1], "wifi")) {
+        if (strlen(argv[2]) > WIFI_MAX_SSID_LENGTH || strlen(argv[3]) > WIFI_MAX_PASSWORD_LENGTH) {
+            fprintf(stderr, "error: SSID or password is too long\n");
+            return 1;
+        }
+        strcpy(settings.wifi.ssid, argv[2]);
+        strcpy(settings.wifi.password, argv[3]);
+    }
+    else if (argc == 3 && ! strcmp(argv[1], "address") && ! strcmp(argv[2], "dhcp")) {
+        settings.wifi.ip = settings.wifi.netmask = settings.wifi.gateway = 0;
+    }
+    else if (argc == 5 && ! strcmp(argv[1], "address")) {
+        if (parse_address(argv[2], &settings.wifi.ip) 
+            || parse_address(argv[3], &settings.wifi.netmask) 
+            || parse_address(argv[4], &settings.wifi.gateway)) {
+            return 1;
+        }
+    }
+    else if ((argc == 4 || argc == 5) && ! strcmp(argv[1], "telemetry")) {
+        if (strlen(argv[2]) > TELEMETRY_MAX_HOSTNAME_LENGTH || strlen(argv[3]) > TELEMETRY_MAX_SERVICE_LENGTH) {
+            fprintf(stderr, "error: hostname or service is too long\n");
+            return 1;
+        }
+        settings.format = TELEMETRY_FORMAT_BINARY;
+        if (argc == 5 && parse_format(argv[4], &settings.format)) {
+            return 1;
+        }
+        strcpy(settings.hostname, argv[2]);
+        strcpy(settings.service, argv[3]);
+    }
+    else {
+        fprintf(stderr, "error: invalid arguments, see help autostart\n");
+        return 1;
+    }
+
+    return save_autostart_settings(&settings);
+}
+
+static void print_source_status(void) {
+    SignalSourceStatus status;
+    get_signal_source_status(&status);
+
+    const SignalSourceSettings *settings = &status.settings;
+    if (settings->type == SIGNAL_SOURCE_ADC) {
+        printf("source     adc\n");
+        return;
+    }
+    if (settings->type == SIGNAL_SOURCE_WAVEFORM) {
+        const WaveformSettings *waveform = &settings->waveform;
+        printf("source     %s", waveform_type_name(waveform->type));
+        if (waveform->type == WAVEFORM_SINE) {
+            printf(" at %g Hz, amplitude %g", waveform->frequency, waveform->amplitude);
+        }
+        else if (waveform->type == WAVEFORM_CHIRP) {
+            printf(
+                " from %g to %g Hz every %g s, amplitude %g", 
+                waveform->frequency, 
+                waveform->end_frequency, 
+                waveform->sweep_period, 
+                waveform->amplitude
+            );
+        }
+        else {
+            printf(", RMS %g", waveform->amplitude);
+        }
+        printf("\n");
+    }
+    else {
+        printf(
+            "source     replay of %lu samples recorded at %.3f samples/s, played %lu times\n", 
+            (unsigned long) status.recording.num_samples, 
+            status.recording.sample_rate_mhz / 1000.0, 
+            status.replay_loops
+        );
+    }
+
+    double elapsed = status.elapsed_us / 1E6;
+    printf("rate       %s\n", settings->as_fast_as_possible ? "as fast as possible" : "ADC sample rate");
+    printf("state      %s for %.1f s\n", status.running ? "running" : "stopped", elapsed);
+    printf(
+        "published  %llu samples, %.1f samples/s\n", 
+        (unsigned long long) status.samples_published, 
+        elapsed > 0 ? status.samples_published / elapsed : 0.0
+    );
+    printf("discarded  %lu blocks\n", status.blocks_discarded);
+}
+
+int cli_source(int argc, char *argv[]) {
+    if (argc == 1) {
+        print_source_status();
+        return 0;
+    }
+
+    SignalSourceSettings settings = {
+        .as_fast_as_possible = ! strcmp(argv[argc - 1], "fast")
+    };
+    int num_arguments = argc - 1 - settings.as_fast_as_possible;
+    const char *name = argv[1];
+    WaveformSettings *waveform = &settings.waveform;
+
+    if (num_arguments == 1 && ! strcmp(name, "adc")) {
+        settings.type = SIGNAL_SOURCE_ADC;
+    }
+    else if (num_arguments == 1 && ! strcmp(name, "replay")) {
+        settings.type = SIGNAL_SOURCE_REPLAY;
+    }
+    else if (num_arguments == 3 && ! strcmp(name, "sine")) {
+        settings.type = SIGNAL_SOURCE_WAVEFORM;
+        waveform->type = WAVEFORM_SINE;
+        waveform->frequency = atof(argv[2]);
+        waveform->amplitude = atof(argv[3]);
+    }
+    else if (num_arguments == 5 && ! strcmp(name, "chirp")) {
+        settings.type = SIGNAL_SOURCE_WAVEFORM;
+        waveform->type = WAVEFORM_CHIRP;
+        waveform->frequency = atof(argv[2]);
+        waveform->end_frequency = atof(argv[3]);
+        waveform->sweep_period = atof(argv[4]);
+        waveform->amplitude = atof(argv[5]);
+        if (waveform->sweep_period <= 0) {
+            fprintf(stderr, "error: the sweep must take a positive time\n");
+            return 1;
+        }
+    }
+    else if (num_arguments == 2 && ! strcmp(name, "noise")) {
+        settings.type = SIGNAL_SOURCE_WAVEFORM;
+        waveform->type = WAVEFORM_NOISE;
+        waveform->amplitude = atof(argv[2]);
+    }
+    else {
+        fprintf(stderr, "error: invalid arguments, see help source\n");
+        return 1;
+    }
+
+    if (settings.type == SIGNAL_SOURCE_ADC && settings.as_fast_as_possible) {
+        fprintf(stderr, "error: the ADC can only run at its sample rate\n");
+        return 1;
+    }
+    if (waveform->amplitude < 0 || waveform->amplitude > WAVEFORM_FULL_SCALE) {
+        fprintf(stderr, "error: the amplitude must be from 0 to %d counts\n", WAVEFORM_FULL_SCALE);
+        return 1;
+    }
+
+    TelemetryStatus telemetry_status;
+    get_telemetry_status(&telemetry_status);
+    if (telemetry_status.running) {
+        fprintf(stderr, "error: stop telemetry before changing the source\n");
+        return 1;
+    }
+
+    if (start_signal_source(&sample_broker, &settings)) {
+        fprintf(stderr, "error: failed to switch to the %s source\n", name);
+        return 1;
+    }
+    return 0;
 }
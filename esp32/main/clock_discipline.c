@@ -0,0 +1,139 @@
+#include <math.h>
+
+#include "clock_discipline.h"
+
+// Phase errors are smoothed over this fraction of the time constant
+#define PHASE_FILTER_FRACTION 0.25
+#define DAMPING 1.0
+
+/**
+ * @brief
+ * @param discipline
+ * @param nominal_rate Sample rate to hold, in samples per second
+ * @param tolerance_ppm Largest mean rate error over a time constant at which 
+ * the clock counts as locked
+ * @param time_constant Loop time constant in seconds
+ */
+void clock_discipline_initialize(
+    ClockDiscipline *discipline, 
+    double nominal_rate, 
+    double tolerance_ppm, 
+    double time_constant
+) {
+    *discipline = (ClockDiscipline) {
+        .nominal_rate = nominal_rate,
+        .tolerance_ppm = tolerance_ppm,
+        .time_constant = time_constant
+    };
+}
+
+static void anchor(ClockDiscipline *discipline) {
+    discipline->anchor_time_us = discipline->reference_time_us;
+    discipline->anchor_position = discipline->position;
+    discipline->phase_error = 0;
+    discipline->filtered_phase_error = 0;
+}
+
+/**
+ * @brief
+ * Measure the phase error at a reference and steer the frequency correction. 
+ * The reference becomes the point conversions are mapped to time from.
+ * @param discipline
+ * @param reference_time_us Reference time, in microseconds since the Unix epoch
+ * @param count Conversion count at the reference time
+ * @param fraction Sample periods elapsed since conversion `count`, from 0 to 1
+ * @return true if the correction was updated, in which case the new 
+ * correction should be applied to the clock
+ */
+bool clock_discipline_update(
+    ClockDiscipline *discipline,
+    int64_t reference_time_us,
+    uint32_t count,
+    double fraction
+) {
+    if (! discipline->have_reference) {
+        discipline->have_reference = true;
+        discipline->reference_time_us = reference_time_us;
+        discipline->reference_count = count;
+        discipline->reference_fraction = fraction;
+        anchor(discipline);
+        return false;
+    }
+
+    double elapsed = (reference_time_us - discipline->reference_time_us) * 1E-6;
+    discipline->position += 
+        (double) (uint32_t) (count - discipline->reference_count) + fraction - discipline->reference_fraction;
+    discipline->reference_time_us = reference_time_us;
+    discipline->reference_count = count;
+    discipline->reference_fraction = fraction;
+
+    double phase_error = 
+        (discipline->position - discipline->anchor_position) / discipline->nominal_rate - 
+        (reference_time_us - discipline->anchor_time_us) * 1E-6;
+    if (elapsed <= 0 || fabs(phase_error - discipline->phase_error) > CLOCK_DISCIPLINE_MAX_STEP_US * 1E-6) {
+        // Follow the step and keep the frequency learned so far
+        anchor(discipline);
+        discipline->num_steps++;
+        discipline->updates_in_tolerance = 0;
+        discipline->locked = false;
+        return false;
+    }
+    discipline->phase_error = phase_error;
+
+    double weight = elapsed / (PHASE_FILTER_FRACTION * discipline->time_constant);
+    if (weight > 1) {
+        weight = 1;
+    }
+    discipline->filtered_phase_error += weight * (phase_error - discipline->filtered_phase_error);
+
+    double time_constant = discipline->time_constant;
+    double max_correction = CLOCK_DISCIPLINE_MAX_CORRECTION_PPM * 1E-6;
+    discipline->frequency_integral += discipline->filtered_phase_error * elapsed / (time_constant * time_constant);
+    if (discipline->frequency_integral > max_correction) {
+        discipline->frequency_integral = max_correction;
+    }
+    else if (discipline->frequency_integral < -max_correction) {
+        discipline->frequency_integral = -max_correction;
+    }
+
+    double correction = 
+        -(2 * DAMPING * discipline->filtered_phase_error / time_constant + discipline->frequency_integral);
+    if (correction > max_correction) {
+        correction = max_correction;
+    }
+    else if (correction < -max_correction) {
+        correction = -max_correction;
+    }
+    discipline->correction_ppm = correction * 1E6;
+
+    // The phase error starts from zero at the anchor, so it only shows the 
+    // rate error once the loop has run for a time constant
+    bool settled = (reference_time_us - discipline->anchor_time_us) * 1E-6 >= time_constant;
+    if (settled && fabs(discipline->filtered_phase_error) <= discipline->tolerance_ppm * 1E-6 * time_constant) {
+        if (discipline->updates_in_tolerance < CLOCK_DISCIPLINE_LOCK_UPDATES) {
+            discipline->updates_in_tolerance++;
+        }
+    }
+    else {
+        discipline->updates_in_tolerance = 0;
+    }
+    discipline->locked = discipline->updates_in_tolerance == CLOCK_DISCIPLINE_LOCK_UPDATES;
+    discipline->num_updates++;
+    return true;
+}
+
+/**
+ * @brief
+ * Map a conversion to reference time. Conversions are spaced at the nominal 
+ * rate from the anchor, less the smoothed phase error.
+ * @param discipline A discipline with a reference
+ * @param count Conversion count, within 2^31 conversions of the last reference
+ * @return Reference time of the conversion, in microseconds since the Unix epoch
+ */
+int64_t clock_discipline_time_us(const ClockDiscipline *discipline, uint32_t count) {
+    double position = 
+        discipline->position + (double) (int32_t) (count - discipline->reference_count) - discipline->reference_fraction;
+    double seconds = 
+        (position - discipline->anchor_position) / discipline->nominal_rate - discipline->filtered_phase_error;
+    return discipline->anchor_time_us + (int64_t) llround(seconds * 1E6);
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// A jump in phase error beyond this between references is taken to be a step 
+// of the reference time, which the loop follows rather than steers out
+#define CLOCK_DISCIPLINE_MAX_STEP_US 128000
+#define CLOCK_DISCIPLINE_MAX_CORRECTION_PPM 200.0
+// Updates in a row within tolerance before the clock counts as locked
+#define CLOCK_DISCIPLINE_LOCK_UPDATES 3
+
+/**
+ * @brief
+ * Phase locked loop that steers the ADC clock so that conversions keep pace 
+ * with a time reference, and a model that maps conversions to reference time.
+ * 
+ * The phase error is the time by which the ADC leads the reference: the time 
+ * its samples say has passed since the loop was anchored, at the nominal rate, 
+ * less the time the reference says has passed. It is smoothed and fed to a 
+ * proportional-integral controller with critical damping at the given time 
+ * constant. The time constant must be several times the interval between 
+ * references and long enough to average out the reference jitter: the rate 
+ * error it allows is roughly jitter / time constant.
+ *
+ * Sample positions are given as a free running 32 bit count of conversions 
+ * plus the fraction of a sample period since the last one, so intervals 
+ * between references must be shorter than 2^31 conversions.
+ */
+typedef struct {
+    double nominal_rate;
+    double tolerance_ppm;
+    double time_constant;
+
+    bool have_reference;
+    int64_t reference_time_us;
+    uint32_t reference_count;
+    double reference_fraction;
+    // Conversions since the first reference
+    double position;
+
+    // Time and position the phase error is measured from
+    int64_t anchor_time_us;
+    double anchor_position;
+
+    double phase_error;
+    double filtered_phase_error;
+    double frequency_integral;
+    double correction_ppm;
+    unsigned int updates_in_tolerance;
+    bool locked;
+    unsigned long num_updates;
+    unsigned long num_steps;
+} ClockDiscipline;
+
+void clock_discipline_initialize(
+    ClockDiscipline *discipline, 
+    double nominal_rate, 
+    double tolerance_ppm, 
+    double time_constant
+);
+bool clock_discipline_update(
+    ClockDiscipline *discipline,
+    int64_t reference_time_us,
+    uint32_t count,
+    double fraction
+);
+int64_t clock_discipline_time_us(const ClockDiscipline *discipline, uint32_t count);
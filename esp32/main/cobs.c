@@ -0,0 +1,68 @@
+#include "cobs.h"
+
+/**
+ * @brief 
+ * Consistent overhead byte stuffing. Zero bytes are removed by splitting the 
+ * data into runs of at most 254 nonzero bytes, each led by a code byte of 
+ * one more than its length, so that zero is free to delimit frames. A code 
+ * below 0xFF stands for its run followed by a zero, except for the last run.
+ * @param out At least COBS_MAX_ENCODED_LENGTH(length) bytes
+ * @param in 
+ * @param length 
+ * @return Length of the encoding, which does not include a delimiter
+ */
+size_t cobs_encode(uint8_t out[], const uint8_t in[], size_t length) {
+    size_t code_position = 0;
+    size_t out_position = 1;
+    uint8_t code = 1;
+
+    for (size_t i = 0; i < length; i++) {
+        if (in[i] == 0) {
+            out[code_position] = code;
+            code_position = out_position++;
+            code = 1;
+            continue;
+        }
+
+        out[out_position++] = in[i];
+        if (++code == 0xFF) {
+            out[code_position] = code;
+            code_position = out_position++;
+            code = 1;
+        }
+    }
+    out[code_position] = code;
+    return out_position;
+}
+
+/**
+ * @brief 
+ * Undo `cobs_encode`. Decoding can be done in place.
+ * @param out At least `length` bytes
+ * @param in Encoded frame without its delimiter
+ * @param length 
+ * @param out_length Length of the decoded data
+ * @return 0 if success, 1 if the frame is malformed
+ */
+int cobs_decode(uint8_t out[], const uint8_t in[], size_t length, size_t *out_length) {
+    size_t in_position = 0;
+    size_t out_position = 0;
+
+    while (in_position < length) {
+        uint8_t code = in[in_position++];
+        if (code == 0 || in_position + code - 1 > length) {
+            return 1;
+        }
+        for (int i = 1; i < code; i++) {
+            if (in[in_position] == 0) {
+                return 1;
+            }
+            out[out_position++] = in[in_position++];
+        }
+        if (code < 0xFF && in_position < length) {
+            out[out_position++] = 0;
+        }
+    }
+    *out_length = out_position;
+    return 0;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Longest encoding of `length` bytes, not counting the frame delimiter
+#define COBS_MAX_ENCODED_LENGTH(length) ((length) + (length) / 254 + 1)
+
+// Ends every COBS frame. It never appears in an encoded frame.
+#define COBS_DELIMITER 0x00
+
+size_t cobs_encode(uint8_t out[], const uint8_t in[], size_t length);
+int cobs_decode(uint8_t out[], const uint8_t in[], size_t length, size_t *out_length);
@@ -0,0 +1,280 @@
+#include <string.h>
+
+#include "datagram_log.h"
+
+#define ERASED_LENGTH 0xFFFF
+
+static size_t record_size(size_t length) {
+    return DATAGRAM_LOG_RECORD_HEADER_LENGTH + ((length + 3) & ~(size_t) 3);
+}
+
+static size_t sector_offset(const DatagramLog *log, size_t offset) {
+    return offset % log->storage.sector_size;
+}
+
+static size_t next_sector(const DatagramLog *log, size_t offset) {
+    size_t start = offset - sector_offset(log, offset) + log->storage.sector_size;
+    return start % log->storage.size;
+}
+
+/**
+ * @brief
+ * @param log
+ * @param storage Storage to keep the log in. Its contents are discarded.
+ * @return 0 if success
+ */
+int datagram_log_initialize(DatagramLog *log, const DatagramLogStorage *storage) {
+    if (storage->sector_size < 2 * DATAGRAM_LOG_RECORD_HEADER_LENGTH ||
+        storage->sector_size % 4 != 0 ||
+        storage->size % storage->sector_size != 0 ||
+        storage->size < 2 * storage->sector_size) {
+        return 1;
+    }
+
+    memset(log, 0, sizeof(*log));
+    log->storage = *storage;
+    if (log->storage.erase(log->storage.context, 0, log->storage.sector_size)) {
+        return 1;
+    }
+    log->head_ready = true;
+    return 0;
+}
+
+/**
+ * @brief
+ * @return Longest datagram a record can hold
+ */
+size_t datagram_log_max_length(const DatagramLog *log) {
+    size_t length = log->storage.sector_size - DATAGRAM_LOG_RECORD_HEADER_LENGTH;
+    return length < ERASED_LENGTH ? length : ERASED_LENGTH - 1;
+}
+
+bool datagram_log_is_empty(const DatagramLog *log) {
+    return log->num_records == 0;
+}
+
+/**
+ * @brief
+ * @return Bytes of storage between the oldest record and the next, 
+ * including the unused ends of sectors
+ */
+size_t datagram_log_bytes_used(const DatagramLog *log) {
+    if (log->num_records == 0) {
+        return 0;
+    }
+    return (log->head + log->storage.size - log->tail) % log->storage.size;
+}
+
+static int read_record_length(DatagramLog *log, size_t offset, size_t *out_length) {
+    uint8_t header[DATAGRAM_LOG_RECORD_HEADER_LENGTH];
+    if (log->storage.read(log->storage.context, offset, header, sizeof(header))) {
+        log->storage_errors++;
+        return 1;
+    }
+    uint16_t length = header[0] | header[1] << 8;
+    uint16_t check = header[2] | header[3] << 8;
+    if (length != ERASED_LENGTH && (length ^ check) != 0xFFFF) {
+        log->storage_errors++;
+        return 1;
+    }
+    *out_length = length;
+    return 0;
+}
+
+/**
+ * @brief
+ * Drop every record, after storage failed under them
+ */
+static void discard_records(DatagramLog *log) {
+    log->records_dropped += log->num_records;
+    log->num_records = 0;
+    log->tail = log->head;
+}
+
+/**
+ * @brief
+ * Erase the sector starting at `start` for the head to enter, first 
+ * dropping the oldest records if the tail is in it
+ * @return 0 if success
+ */
+static int prepare_sector(DatagramLog *log, size_t start) {
+    if (log->num_records > 0 && log->tail - sector_offset(log, log->tail) == start) {
+        while (log->num_records > 0 && 
+               log->tail - start + DATAGRAM_LOG_RECORD_HEADER_LENGTH <= log->storage.sector_size) {
+            size_t length;
+            if (read_record_length(log, log->tail, &length)) {
+                discard_records(log);
+                break;
+            }
+            if (length == ERASED_LENGTH) {
+                break;
+            }
+            log->tail += record_size(length);
+            log->num_records--;
+            log->records_dropped++;
+        }
+        log->tail = log->num_records > 0 ? next_sector(log, start) : start;
+    }
+
+    if (log->storage.erase(log->storage.context, start, log->storage.sector_size)) {
+        log->storage_errors++;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief
+ * Add a datagram after the newest, dropping the oldest if there is no room
+ * @return 0 if success
+ */
+int datagram_log_append(DatagramLog *log, const uint8_t datagram[], size_t length) {
+    if (length == 0 || length > datagram_log_max_length(log)) {
+        return 1;
+    }
+
+    size_t size = record_size(length);
+    if (sector_offset(log, log->head) + size > log->storage.sector_size) {
+        log->head = next_sector(log, log->head);
+        log->head_ready = false;
+    }
+    if (! log->head_ready) {
+        if (prepare_sector(log, log->head)) {
+            return 1;
+        }
+        log->head_ready = true;
+    }
+    if (log->num_records == 0) {
+        log->tail = log->head;
+    }
+
+    uint8_t header[DATAGRAM_LOG_RECORD_HEADER_LENGTH] = {
+        length & 0xFF,
+        length >> 8,
+        ~length & 0xFF,
+        (~length >> 8) & 0xFF
+    };
+    if (log->storage.write(log->storage.context, log->head, header, sizeof(header)) ||
+        log->storage.write(log->storage.context, log->head + sizeof(header), datagram, length)) {
+        // The sector may now hold a partial record, so it is not written again 
+        // until it is erased
+        log->storage_errors++;
+        log->head = next_sector(log, log->head);
+        log->head_ready = false;
+        return 1;
+    }
+
+    log->head += size;
+    if (sector_offset(log, log->head) == 0) {
+        log->head %= log->storage.size;
+        log->head_ready = false;
+    }
+    log->num_records++;
+    log->records_written++;
+    return 0;
+}
+
+/**
+ * @brief
+ * Read the oldest datagram without removing it
+ * @param log
+ * @param out_datagram Buffer of at least `datagram_log_max_length` bytes
+ * @param out_length
+ * @return 0 if success, 1 if the log is empty or storage failed
+ */
+int datagram_log_peek(DatagramLog *log, uint8_t out_datagram[], size_t *out_length) {
+    if (log->num_records == 0) {
+        return 1;
+    }
+
+    size_t length;
+    if (sector_offset(log, log->tail) + DATAGRAM_LOG_RECORD_HEADER_LENGTH > log->storage.sector_size) {
+        log->tail = next_sector(log, log->tail);
+    }
+    if (read_record_length(log, log->tail, &length)) {
+        discard_records(log);
+        return 1;
+    }
+    // The rest of a sector too short for the next record is left erased
+    if (length == ERASED_LENGTH) {
+        log->tail = next_sector(log, log->tail);
+        if (read_record_length(log, log->tail, &length) || length == ERASED_LENGTH) {
+            discard_records(log);
+            return 1;
+        }
+    }
+    if (log->storage.read(
+        log->storage.context, log->tail + DATAGRAM_LOG_RECORD_HEADER_LENGTH, out_datagram, length)) {
+        log->storage_errors++;
+        discard_records(log);
+        return 1;
+    }
+
+    log->peeked_length = length;
+    *out_length = length;
+    return 0;
+}
+
+/**
+ * @brief
+ * Remove the datagram `datagram_log_peek` last returned
+ */
+void datagram_log_pop(DatagramLog *log) {
+    if (log->num_records == 0) {
+        return;
+    }
+    log->tail += record_size(log->peeked_length);
+    if (sector_offset(log, log->tail) == 0) {
+        log->tail %= log->storage.size;
+    }
+    log->num_records--;
+    log->records_read++;
+    if (log->num_records == 0) {
+        log->tail = log->head;
+    }
+}
+
+static int ram_read(void *context, size_t offset, void *data, size_t length) {
+    memcpy(data, (uint8_t *) context + offset, length);
+    return 0;
+}
+
+// Writes can only clear bits, as in flash, so that a write to storage that 
+// was not erased shows up as corruption
+static int ram_write(void *context, size_t offset, const void *data, size_t length) {
+    uint8_t *memory = (uint8_t *) context + offset;
+    const uint8_t *bytes = data;
+    for (size_t i = 0; i < length; i++) {
+        memory[i] &= bytes[i];
+    }
+    return 0;
+}
+
+static int ram_erase(void *context, size_t offset, size_t length) {
+    memset((uint8_t *) context + offset, 0xFF, length);
+    return 0;
+}
+
+/**
+ * @brief
+ * Describe a buffer in RAM as log storage
+ * @param storage
+ * @param memory
+ * @param size Bytes of `memory`, a multiple of the sector size
+ * @param sector_size Size of the units the log drops when full
+ * @return 0 if success
+ */
+int datagram_log_ram_storage(DatagramLogStorage *storage, uint8_t memory[], size_t size, size_t sector_size) {
+    if (sector_size == 0 || size % sector_size != 0 || size < 2 * sector_size) {
+        return 1;
+    }
+    *storage = (DatagramLogStorage) {
+        .read = ram_read,
+        .write = ram_write,
+        .erase = ram_erase,
+        .context = memory,
+        .size = size,
+        .sector_size = sector_size
+    };
+    return 0;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Bytes ahead of every record: its length and the length's complement
+#define DATAGRAM_LOG_RECORD_HEADER_LENGTH 4
+
+/**
+ * @brief
+ * Storage with the semantics of NOR flash: erasing sets every byte of a
+ * sector to 0xFF, and a write may only follow an erase. Each function
+ * returns 0 if success.
+ */
+typedef struct {
+    int (*read)(void *context, size_t offset, void *data, size_t length);
+    int (*write)(void *context, size_t offset, const void *data, size_t length);
+    int (*erase)(void *context, size_t offset, size_t length);
+    void *context;
+    // A multiple of the sector size, at least two sectors
+    size_t size;
+    size_t sector_size;
+} DatagramLogStorage;
+
+/**
+ * @brief
+ * First in, first out log of datagrams kept in a circle of erase sectors.
+ * Records never straddle a sector, so when the log is full the oldest
+ * sector is erased and its records dropped to make room. Records are
+ * aligned to four bytes, as flash writes are.
+ */
+typedef struct {
+    DatagramLogStorage storage;
+    // Offset the next record is written at
+    size_t head;
+    // Offset of the oldest record
+    size_t tail;
+    // Whether the sector `head` is in has been erased for it
+    bool head_ready;
+    size_t num_records;
+    // Length of the datagram last peeked at, which `datagram_log_pop` drops
+    size_t peeked_length;
+
+    unsigned long records_written;
+    unsigned long records_read;
+    unsigned long records_dropped;
+    unsigned long storage_errors;
+} DatagramLog;
+
+int datagram_log_initialize(DatagramLog *log, const DatagramLogStorage *storage);
+size_t datagram_log_max_length(const DatagramLog *log);
+int datagram_log_append(DatagramLog *log, const uint8_t datagram[], size_t length);
+int datagram_log_peek(DatagramLog *log, uint8_t out_datagram[], size_t *out_length);
+void datagram_log_pop(DatagramLog *log);
+bool datagram_log_is_empty(const DatagramLog *log);
+size_t datagram_log_bytes_used(const DatagramLog *log);
+
+int datagram_log_ram_storage(DatagramLogStorage *storage, uint8_t memory[], size_t size, size_t sector_size);
@@ -0,0 +1,240 @@
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#include "decimator.h"
+
+// Passband edge as a fraction of the final output rate
+#define PASSBAND_FRACTION 0.4
+#define STOPBAND_ATTENUATION_DB 90.0
+
+#define SAMPLE_MAX ((1 << 23) - 1)
+#define SAMPLE_MIN (-(1 << 23))
+
+static const unsigned int supported_factors[] = {7, 5, 3, 2};
+
+static double bessel_i0(double x) {
+    double sum = 1;
+    double term = 1;
+    for (int k = 1; k < 50; k++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+        if (term < 1E-12 * sum) {
+            break;
+        }
+    }
+    return sum;
+}
+
+/**
+ * @brief 
+ * Design a Kaiser windowed sinc low pass filter for one stage
+ * @param stage 
+ * @param input_rate Sample rate going into the stage
+ * @param passband_edge Highest frequency that has to survive the whole cascade
+ * @return 0 if success
+ */
+static int design_stage(DecimatorStage *stage, double input_rate, double passband_edge) {
+    double output_rate = input_rate / stage->factor;
+
+    // Only energy that aliases into the passband matters, so the stopband 
+    // starts at the first frequency that folds onto the passband edge.
+    double stopband_edge = output_rate - passband_edge;
+    double cutoff = output_rate / 2 / input_rate;
+    double transition_width = (stopband_edge - passband_edge) / input_rate;
+    assert(transition_width > 0);
+
+    double beta = 0.1102 * (STOPBAND_ATTENUATION_DB - 8.7);
+    unsigned int num_taps = (unsigned int) ceil(
+        (STOPBAND_ATTENUATION_DB - 7.95) / (14.36 * transition_width)) + 1;
+    num_taps |= 1;
+    if (stage->factor == 2) {
+        // Half-band filters have 4k - 1 taps, so both end taps are non-zero
+        num_taps = ((num_taps + 1 + 3) / 4) * 4 - 1;
+    }
+    if (num_taps > DECIMATOR_MAX_TAPS) {
+        return 1;
+    }
+
+    stage->num_taps = num_taps;
+    stage->is_half_band = stage->factor == 2;
+
+    double taps[DECIMATOR_MAX_TAPS];
+    double sum = 0;
+    int center = num_taps / 2;
+    for (int n = 0; n < (int) num_taps; n++) {
+        int offset = n - center;
+        double sinc = offset == 0 ? 
+            2 * cutoff : 
+            sin(2 * M_PI * cutoff * offset) / (M_PI * offset);
+        double window_position = (double) offset / center;
+        double window = bessel_i0(beta * sqrt(1 - window_position * window_position)) / bessel_i0(beta);
+        taps[n] = sinc * window;
+        if (stage->is_half_band && offset != 0 && offset % 2 == 0) {
+            taps[n] = 0;
+        }
+        sum += taps[n];
+    }
+
+    // Normalize for unity DC gain, putting the rounding error in the center tap
+    int64_t quantized_sum = 0;
+    for (unsigned int n = 0; n < num_taps; n++) {
+        stage->coefficients[n] = (int32_t) lround(
+            taps[n] / sum * ((int64_t) 1 << DECIMATOR_COEFFICIENT_SHIFT));
+        quantized_sum += stage->coefficients[n];
+    }
+    stage->coefficients[center] += ((int64_t) 1 << DECIMATOR_COEFFICIENT_SHIFT) - quantized_sum;
+    return 0;
+}
+
+/**
+ * @brief 
+ * Set up a cascade that reduces `input_rate` to `output_rate`. The overall 
+ * factor has to be an integer made of small primes. Larger factors go first 
+ * and half-band stages last, where the sample rate is lowest.
+ * @param cascade 
+ * @param input_rate 
+ * @param output_rate 
+ * @return 0 if success
+ */
+int decimator_cascade_initialize(DecimatorCascade *cascade, double input_rate, double output_rate) {
+    memset(cascade, 0, sizeof(DecimatorCascade));
+
+    double exact_factor = input_rate / output_rate;
+    unsigned int factor = (unsigned int) lround(exact_factor);
+    if (factor < 1 || fabs(exact_factor - factor) > 1E-6 * factor) {
+        return 1;
+    }
+
+    cascade->factor = factor;
+    cascade->input_rate = input_rate;
+    cascade->output_rate = input_rate / factor;
+
+    unsigned int remaining_factor = factor;
+    for (size_t f = 0; f < sizeof(supported_factors) / sizeof(unsigned int); f++) {
+        while (remaining_factor % supported_factors[f] == 0) {
+            if (cascade->num_stages == DECIMATOR_MAX_STAGES) {
+                return 1;
+            }
+            cascade->stages[cascade->num_stages++].factor = supported_factors[f];
+            remaining_factor /= supported_factors[f];
+        }
+    }
+    if (remaining_factor != 1) {
+        return 1;
+    }
+
+    double passband_edge = PASSBAND_FRACTION * cascade->output_rate;
+    double stage_rate = input_rate;
+    for (unsigned int s = 0; s < cascade->num_stages; s++) {
+        if (design_stage(&cascade->stages[s], stage_rate, passband_edge)) {
+            return 1;
+        }
+        stage_rate /= cascade->stages[s].factor;
+    }
+
+    decimator_cascade_reset(cascade, 0);
+    return 0;
+}
+
+/**
+ * @brief 
+ * Clear the filter history, for example after a gap in the input. Outputs are 
+ * aligned so that output `k` is computed when input sample `k * factor + factor - 1` 
+ * arrives, wherever the input resumes.
+ * @param cascade 
+ * @param input_sample_index Index of the next input sample
+ */
+void decimator_cascade_reset(DecimatorCascade *cascade, uint64_t input_sample_index) {
+    uint64_t phase = input_sample_index % cascade->factor;
+    for (unsigned int s = 0; s < cascade->num_stages; s++) {
+        DecimatorStage *stage = &cascade->stages[s];
+        stage->phase = phase % stage->factor;
+        phase /= stage->factor;
+        stage->history_index = 0;
+        memset(stage->history, 0, sizeof(stage->history));
+    }
+}
+
+static int32_t clamp_sample(int64_t sample) {
+    if (sample > SAMPLE_MAX) {
+        return SAMPLE_MAX;
+    }
+    if (sample < SAMPLE_MIN) {
+        return SAMPLE_MIN;
+    }
+    return (int32_t) sample;
+}
+
+/**
+ * @brief 
+ * Compute one output from the filter window, folding the symmetric taps
+ * @param stage 
+ * @param window Oldest sample first
+ * @return Filtered sample
+ */
+static int32_t filter_window(const DecimatorStage *stage, const int32_t window[]) {
+    unsigned int center = stage->num_taps / 2;
+    unsigned int step = stage->is_half_band ? 2 : 1;
+    // Non-zero half-band taps sit at odd offsets from the center
+    unsigned int first_tap = stage->is_half_band ? (center + 1) % 2 : 0;
+
+    int64_t accumulator = (int64_t) stage->coefficients[center] * window[center];
+    for (unsigned int n = first_tap; n < center; n += step) {
+        accumulator += (int64_t) stage->coefficients[n] * 
+            ((int64_t) window[n] + window[stage->num_taps - 1 - n]);
+    }
+
+    int64_t rounding = (int64_t) 1 << (DECIMATOR_COEFFICIENT_SHIFT - 1);
+    return clamp_sample((accumulator + rounding) >> DECIMATOR_COEFFICIENT_SHIFT);
+}
+
+static size_t process_stage(DecimatorStage *stage, int32_t samples[], size_t num_samples) {
+    size_t num_outputs = 0;
+    for (size_t i = 0; i < num_samples; i++) {
+        stage->history[stage->history_index] = samples[i];
+        stage->history[stage->history_index + stage->num_taps] = samples[i];
+        stage->history_index++;
+        if (stage->history_index == stage->num_taps) {
+            stage->history_index = 0;
+        }
+
+        stage->phase++;
+        if (stage->phase == stage->factor) {
+            stage->phase = 0;
+            // Outputs never overtake inputs, so the samples can be overwritten in place
+            samples[num_outputs++] = filter_window(stage, &stage->history[stage->history_index]);
+        }
+    }
+    return num_outputs;
+}
+
+/**
+ * @brief 
+ * Decimate consecutive samples in place
+ * @param cascade 
+ * @param samples Input samples, replaced by the output samples
+ * @param num_samples 
+ * @return Number of output samples
+ */
+size_t decimator_cascade_process(DecimatorCascade *cascade, int32_t samples[], size_t num_samples) {
+    for (unsigned int s = 0; s < cascade->num_stages; s++) {
+        num_samples = process_stage(&cascade->stages[s], samples, num_samples);
+    }
+    return num_samples;
+}
+
+/**
+ * @brief 
+ * @param cascade 
+ * @return Group delay of the cascade in input samples
+ */
+double decimator_cascade_delay(const DecimatorCascade *cascade) {
+    double delay = 0;
+    unsigned int stage_factor = 1;
+    for (unsigned int s = 0; s < cascade->num_stages; s++) {
+        delay += (cascade->stages[s].num_taps - 1) / 2.0 * stage_factor;
+        stage_factor *= cascade->stages[s].factor;
+    }
+    return delay;
+}
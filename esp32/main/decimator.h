@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Enough for the fastest ADC profile, 64 kHz, down to 40 Hz in 5x5x2x2x2x2x2x2
+#define DECIMATOR_MAX_STAGES 8
+#define DECIMATOR_MAX_TAPS 191
+
+// Coefficients are Q30 fixed point
+#define DECIMATOR_COEFFICIENT_SHIFT 30
+
+/**
+ * @brief 
+ * One linear phase FIR low pass filter that keeps every `factor`th output. 
+ * Only the kept outputs are computed. Half-band stages skip their zero taps.
+ */
+typedef struct {
+    unsigned int factor;
+    unsigned int num_taps;
+    unsigned int phase;
+    unsigned int history_index;
+    int is_half_band;
+    int32_t coefficients[DECIMATOR_MAX_TAPS];
+    // Each sample is stored twice so the filter window is always contiguous
+    int32_t history[2 * DECIMATOR_MAX_TAPS];
+} DecimatorStage;
+
+typedef struct {
+    unsigned int num_stages;
+    unsigned int factor;
+    double input_rate;
+    double output_rate;
+    DecimatorStage stages[DECIMATOR_MAX_STAGES];
+} DecimatorCascade;
+
+int decimator_cascade_initialize(DecimatorCascade *cascade, double input_rate, double output_rate);
+void decimator_cascade_reset(DecimatorCascade *cascade, uint64_t input_sample_index);
+size_t decimator_cascade_process(DecimatorCascade *cascade, int32_t samples[], size_t num_samples);
+double decimator_cascade_delay(const DecimatorCascade *cascade);
@@ -1,16 +1,31 @@
 
 #include <stdio.h>
 #include <assert.h>  
+#include <math.h>
+#include <limits.h>
 
 #include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "driver/gpio.h"
 #include "esp_adc/adc_oneshot.h"
 #include "esp_adc/adc_cali.h"
+#include "sdkconfig.h"
 
 #include "diagnostic_inputs.h"
+#include "memory_plan.h"
 
 #define ADC_CHANNEL_ATTENUATION ADC_ATTEN_DB_12
 
+// Conversions averaged into each reading
+#define DIAGNOSTIC_OVERSAMPLING CONFIG_DIAGNOSTIC_OVERSAMPLING
+#define HEALTH_READING_PERIOD_MS CONFIG_DIAGNOSTIC_HEALTH_PERIOD_MS
+
+#define MONITOR_TASK_STACK_SIZE 3072
+#define MONITOR_TASK_PRIORITY 2
+#define MONITOR_TASK_CORE 0
+
 
 typedef struct {
     adc_oneshot_unit_handle_t adc_unit;
@@ -88,18 +103,45 @@ static const DiagnosticInput reference_input = {
     .adc = &adc_2
 };
 
-static const DiagnosticInput *diagnostic_inputs[] = {
-    &amp_out_input,
-    &vgnd_input,
-    &reference_input
+static const DiagnosticInput *diagnostic_inputs[DIAGNOSTIC_NUM_INPUTS] = {
+    [DIAGNOSTIC_AMP_OUT] = &amp_out_input,
+    [DIAGNOSTIC_VIRTUAL_GROUND] = &vgnd_input,
+    [DIAGNOSTIC_REFERENCE] = &reference_input
 };
 
+/**
+ * @brief 
+ * Average of a burst of conversions, in volts
+ */
+typedef struct {
+    float mean;
+    float min;
+    float max;
+    float noise;
+} OversampledReading;
+
 static const char *TAG = "diagnostic_inputs";
 
+// The one-shot driver is not thread safe, so the monitor and reads from the 
+// CLI take turns
+static SemaphoreHandle_t adc_mutex;
+static StaticSemaphore_t adc_mutex_buffer;
+
+PLANNED_TASK(monitor_task_plan, "health_monitor", MONITOR_TASK_STACK_SIZE);
+
+static InputHealth input_health[DIAGNOSTIC_NUM_INPUTS];
+static portMUX_TYPE health_lock = portMUX_INITIALIZER_UNLOCKED;
+
 int read_voltage(const DiagnosticInput *input, float *out_voltage);
 
 int initialize_diagnostic_inputs(void) {
 
+    adc_mutex = xSemaphoreCreateMutexStatic(&adc_mutex_buffer);
+    if (adc_mutex == NULL) {
+        ESP_LOGE(TAG, "Failed to create ADC mutex");
+        return 1;
+    }
+
     ESP_LOGD(TAG, "Initializing ADCs");
     for (int i = 0; i < sizeof(adcs) / sizeof(const Adc *); i++) {
         Adc *adc = adcs[i];
@@ -160,36 +202,111 @@ int initialize_diagnostic_inputs(void) {
     return 0;
 }
 
-int read_voltage(const DiagnosticInput *input, float *out_voltage) {
-    ESP_LOGD(TAG, "Reading voltage from input %s", input->input_description);
-
-    int raw_reading;
-    esp_err_t error;
-    error = adc_oneshot_read(input->adc->adc_unit, input->adc_channel, &raw_reading);
-    if (error != ESP_OK) {
-        ESP_LOGE(
-            TAG, 
-            "Failed to read from input %s: details: %s", 
-            input->input_description, 
-            esp_err_to_name(error)
-        );
-        return 1;
+/**
+ * @brief 
+ * Convert a raw reading to volts. Averages fall between raw codes, so the 
+ * calibration is interpolated between the codes either side.
+ * @param adc 
+ * @param raw_reading 
+ * @param out_voltage 
+ * @return 0 if success
+ */
+static int calibrate_reading(const Adc *adc, float raw_reading, float *out_voltage) {
+    int below = (int) floorf(raw_reading);
+    int millivolts_below;
+    int millivolts_above;
+    esp_err_t error = adc_cali_raw_to_voltage(adc->calibration, below, &millivolts_below);
+    if (error == ESP_OK) {
+        error = adc_cali_raw_to_voltage(adc->calibration, below + 1, &millivolts_above);
     }
-
-    int voltage_millivolts;
-    error = adc_cali_raw_to_voltage(input->adc->calibration, raw_reading, &voltage_millivolts);
     if (error != ESP_OK) {
         ESP_LOGE(
             TAG,
             "Failed to apply calibration to reading from ADC %s. details: %s",
-            input->adc->description,
+            adc->description,
             esp_err_to_name(error)
         );
         return 1;
     }
 
-    *out_voltage = (float) voltage_millivolts / 1000.0;
-    return 1;
+    float fraction = raw_reading - below;
+    *out_voltage = (millivolts_below + fraction * (millivolts_above - millivolts_below)) / 1000.0f;
+    return 0;
+}
+
+/**
+ * @brief 
+ * Average a burst of conversions of an input. The inputs are on ADC2, which 
+ * Wi-Fi also uses. While Wi-Fi holds it, conversions fail with 
+ * ESP_ERR_TIMEOUT and the burst is abandoned without logging an error.
+ * @param input 
+ * @param num_conversions 
+ * @param out_reading 
+ * @return 0 if success
+ */
+static int oversample(const DiagnosticInput *input, unsigned int num_conversions, OversampledReading *out_reading) {
+    int32_t sum = 0;
+    int64_t sum_squares = 0;
+    int min = INT_MAX;
+    int max = INT_MIN;
+
+    xSemaphoreTake(adc_mutex, portMAX_DELAY);
+    for (unsigned int i = 0; i < num_conversions; i++) {
+        int raw_reading;
+        esp_err_t error = adc_oneshot_read(input->adc->adc_unit, input->adc_channel, &raw_reading);
+        if (error != ESP_OK) {
+            xSemaphoreGive(adc_mutex);
+            if (error != ESP_ERR_TIMEOUT) {
+                ESP_LOGE(
+                    TAG, 
+                    "Failed to read from input %s: details: %s", 
+                    input->input_description, 
+                    esp_err_to_name(error)
+                );
+            }
+            return 1;
+        }
+        sum += raw_reading;
+        sum_squares += raw_reading * raw_reading;
+        if (raw_reading < min) {
+            min = raw_reading;
+        }
+        if (raw_reading > max) {
+            max = raw_reading;
+        }
+    }
+    xSemaphoreGive(adc_mutex);
+
+    float mean = (float) sum / num_conversions;
+    float variance = (float) sum_squares / num_conversions - mean * mean;
+    float mean_above;
+    if (calibrate_reading(input->adc, mean, &out_reading->mean) || 
+        calibrate_reading(input->adc, mean + 1, &mean_above) ||
+        calibrate_reading(input->adc, min, &out_reading->min) || 
+        calibrate_reading(input->adc, max, &out_reading->max)) {
+        return 1;
+    }
+    // Scaled by the volts per code around the mean
+    out_reading->noise = sqrtf(variance > 0 ? variance : 0) * (mean_above - out_reading->mean);
+    return 0;
+}
+
+/**
+ * @brief 
+ * Read an input now, averaging as many conversions as the monitor does
+ * @param input 
+ * @param out_voltage 
+ * @return 0 if success
+ */
+int read_voltage(const DiagnosticInput *input, float *out_voltage) {
+    ESP_LOGD(TAG, "Reading voltage from input %s", input->input_description);
+
+    OversampledReading reading;
+    if (oversample(input, DIAGNOSTIC_OVERSAMPLING, &reading)) {
+        return 1;
+    }
+    *out_voltage = reading.mean;
+    return 0;
 }
 
 int read_vgnd_voltage(float *out_voltage) {
@@ -203,3 +320,80 @@ int read_amp_out_voltage(float *out_voltage) {
 int read_reference_voltage(float *out_voltage) {
     return read_voltage(&reference_input, out_voltage);
 }
+
+const char *diagnostic_input_name(DiagnosticInputId id) {
+    return diagnostic_inputs[id]->input_description;
+}
+
+/**
+ * @brief 
+ * Take a reading of every input once a period, for as long as the firmware 
+ * runs. Readings that Wi-Fi blocks are counted as missed.
+ */
+static void health_monitor_task(void *parameters) {
+    TickType_t last_wake_time = xTaskGetTickCount();
+    while (true) {
+        for (int i = 0; i < DIAGNOSTIC_NUM_INPUTS; i++) {
+            OversampledReading reading;
+            int error = oversample(diagnostic_inputs[i], DIAGNOSTIC_OVERSAMPLING, &reading);
+
+            portENTER_CRITICAL(&health_lock);
+            if (error) {
+                input_health_record_missed(&input_health[i]);
+            }
+            else {
+                input_health_record(&input_health[i], reading.mean, reading.min, reading.max, reading.noise);
+            }
+            portEXIT_CRITICAL(&health_lock);
+        }
+        vTaskDelayUntil(&last_wake_time, pdMS_TO_TICKS(HEALTH_READING_PERIOD_MS));
+    }
+}
+
+/**
+ * @brief 
+ * Start reading the diagnostic inputs in the background. Runs on the core 
+ * that acquisition leaves free, below the network tasks.
+ * @return 0 if success
+ */
+int start_health_monitor(void) {
+    for (int i = 0; i < DIAGNOSTIC_NUM_INPUTS; i++) {
+        input_health_initialize(&input_health[i]);
+    }
+
+    TaskHandle_t task = start_planned_task(
+        &monitor_task_plan,
+        health_monitor_task,
+        NULL,
+        MONITOR_TASK_PRIORITY,
+        MONITOR_TASK_CORE
+    );
+    if (task == NULL) {
+        ESP_LOGE(TAG, "Failed to create health monitor task");
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 
+ * @return Seconds between the monitor's readings
+ */
+double health_reading_period(void) {
+    return HEALTH_READING_PERIOD_MS / 1000.0;
+}
+
+/**
+ * @brief 
+ * Summarize the health of every input
+ * @param out_summaries Indexed by DiagnosticInputId
+ */
+void get_input_health(InputHealthSummary out_summaries[DIAGNOSTIC_NUM_INPUTS]) {
+    for (int i = 0; i < DIAGNOSTIC_NUM_INPUTS; i++) {
+        InputHealth health;
+        portENTER_CRITICAL(&health_lock);
+        health = input_health[i];
+        portEXIT_CRITICAL(&health_lock);
+        input_health_summarize(&health, health_reading_period(), &out_summaries[i]);
+    }
+}
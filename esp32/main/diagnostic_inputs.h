@@ -1,6 +1,20 @@
+#pragma once
+#include "input_health.h"
+
+typedef enum {
+    DIAGNOSTIC_AMP_OUT,
+    DIAGNOSTIC_VIRTUAL_GROUND,
+    DIAGNOSTIC_REFERENCE,
+    DIAGNOSTIC_NUM_INPUTS
+} DiagnosticInputId;
 
 int initialize_diagnostic_inputs(void);
 
 int read_vgnd_voltage(float *out_voltage);
 int read_amp_out_voltage(float *out_voltage);
-int read_reference_voltage(float *out_voltage);
\ No newline at end of file
+int read_reference_voltage(float *out_voltage);
+
+const char *diagnostic_input_name(DiagnosticInputId id);
+int start_health_monitor(void);
+double health_reading_period(void);
+void get_input_health(InputHealthSummary out_summaries[DIAGNOSTIC_NUM_INPUTS]);
@@ -0,0 +1,161 @@
+#include <string.h>
+
+#include "event_detector.h"
+
+/**
+ * @brief 
+ * Set up a detector
+ * @param detector 
+ * @param config Window lengths are in samples. The pre-trigger length is 
+ * limited to `EVENT_MAX_PRE_TRIGGER_LENGTH`.
+ * @return 0 if success
+ */
+int event_detector_initialize(EventDetector *detector, const EventDetectorConfig *config) {
+    if (config->sta_length == 0 || 
+        config->lta_length <= config->sta_length ||
+        config->trigger_ratio <= config->detrigger_ratio ||
+        config->detrigger_ratio <= 0 ||
+        config->pre_trigger_length > EVENT_MAX_PRE_TRIGGER_LENGTH ||
+        config->max_event_length == 0) {
+        return 1;
+    }
+
+    detector->config = *config;
+    detector->num_events = 0;
+    event_detector_reset(detector);
+    return 0;
+}
+
+/**
+ * @brief 
+ * Restart the averages, for example after a gap in the input. An event in 
+ * progress is abandoned.
+ * @param detector 
+ */
+void event_detector_reset(EventDetector *detector) {
+    detector->mean = 0;
+    detector->sta = 0;
+    detector->lta = 0;
+    detector->ratio = 0;
+    detector->samples_seen = 0;
+    detector->in_event = false;
+    detector->pre_trigger_index = 0;
+    detector->pre_trigger_fill = 0;
+}
+
+/**
+ * @brief 
+ * @param detector 
+ * @return Whether the LTA window has not filled yet, during which no events trigger
+ */
+bool event_detector_is_warming_up(const EventDetector *detector) {
+    return detector->samples_seen < detector->config.lta_length;
+}
+
+static void remember_sample(EventDetector *detector, int32_t sample) {
+    if (detector->config.pre_trigger_length == 0) {
+        return;
+    }
+    detector->pre_trigger[detector->pre_trigger_index++] = sample;
+    if (detector->pre_trigger_index == detector->config.pre_trigger_length) {
+        detector->pre_trigger_index = 0;
+    }
+    if (detector->pre_trigger_fill < detector->config.pre_trigger_length) {
+        detector->pre_trigger_fill++;
+    }
+}
+
+/**
+ * @brief 
+ * Feed one sample to the detector
+ * @param detector 
+ * @param sample 
+ * @param sample_index Index of `sample` in the input stream
+ * @return What `sample` is to the event capture. On `EVENT_TRIGGERED`, the 
+ * samples before the trigger can be read with `event_detector_pre_trigger`.
+ */
+EventDetectorResult event_detector_update(EventDetector *detector, int32_t sample, uint64_t sample_index) {
+    const EventDetectorConfig *config = &detector->config;
+
+    // Warm up with plain averages so the first STA and LTA are not biased 
+    // towards zero
+    detector->samples_seen++;
+    float sta_weight = detector->samples_seen < config->sta_length ? 
+        1.0f / detector->samples_seen : 
+        1.0f / config->sta_length;
+    float lta_weight = detector->samples_seen < config->lta_length ? 
+        1.0f / detector->samples_seen : 
+        1.0f / config->lta_length;
+
+    // The offset is tracked over the STA window, which removes drift that 
+    // would otherwise dominate the LTA but keeps everything the STA can resolve
+    detector->mean += (sample - detector->mean) * sta_weight;
+    float deviation = sample - detector->mean;
+    float characteristic = deviation * deviation;
+
+    detector->sta += (characteristic - detector->sta) * sta_weight;
+    if (! detector->in_event) {
+        detector->lta += (characteristic - detector->lta) * lta_weight;
+    }
+    detector->ratio = detector->lta > 0 ? detector->sta / detector->lta : 0;
+
+    if (! detector->in_event) {
+        if (event_detector_is_warming_up(detector) || detector->ratio < config->trigger_ratio) {
+            remember_sample(detector, sample);
+            return EVENT_NONE;
+        }
+
+        detector->in_event = true;
+        detector->detriggered = false;
+        detector->event_length = detector->pre_trigger_fill + 1;
+        detector->trigger_sample_index = sample_index;
+        detector->peak_ratio = detector->ratio;
+        detector->num_events++;
+        return EVENT_TRIGGERED;
+    }
+
+    detector->event_length++;
+    if (detector->ratio > detector->peak_ratio) {
+        detector->peak_ratio = detector->ratio;
+    }
+
+    if (! detector->detriggered && detector->ratio < config->detrigger_ratio) {
+        detector->detriggered = true;
+        detector->post_trigger_remaining = config->post_trigger_length;
+    }
+
+    bool finished = detector->event_length >= config->max_event_length;
+    if (detector->detriggered) {
+        finished = finished || detector->post_trigger_remaining == 0;
+        if (detector->post_trigger_remaining > 0) {
+            detector->post_trigger_remaining--;
+        }
+    }
+
+    if (finished) {
+        detector->in_event = false;
+        detector->pre_trigger_index = 0;
+        detector->pre_trigger_fill = 0;
+        return EVENT_FINISHED;
+    }
+    return EVENT_CONTINUING;
+}
+
+/**
+ * @brief 
+ * Copy out the samples that preceded the trigger, oldest first
+ * @param detector 
+ * @param out_samples Room for the configured pre-trigger length
+ * @return Number of samples copied
+ */
+size_t event_detector_pre_trigger(const EventDetector *detector, int32_t out_samples[]) {
+    unsigned int length = detector->config.pre_trigger_length;
+    unsigned int fill = detector->pre_trigger_fill;
+    unsigned int oldest = fill < length ? 0 : detector->pre_trigger_index;
+
+    for (unsigned int i = 0; i < fill; i++) {
+        unsigned int index = oldest + i;
+        out_samples[i] = detector->pre_trigger[index >= length ? index - length : index];
+    }
+    return fill;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define EVENT_MAX_PRE_TRIGGER_LENGTH 2048
+
+typedef enum {
+    EVENT_NONE,
+    EVENT_TRIGGERED,
+    EVENT_CONTINUING,
+    EVENT_FINISHED
+} EventDetectorResult;
+
+typedef struct {
+    unsigned int sta_length;
+    unsigned int lta_length;
+    float trigger_ratio;
+    float detrigger_ratio;
+    unsigned int pre_trigger_length;
+    unsigned int post_trigger_length;
+    unsigned int max_event_length;
+} EventDetectorConfig;
+
+/**
+ * @brief 
+ * Recursive STA/LTA detector. The characteristic function is the squared 
+ * deviation from a running mean, so DC offsets do not trigger it. The LTA is 
+ * frozen during an event so the event does not raise its own threshold. The 
+ * most recent samples are kept so that an event can start before its trigger.
+ */
+typedef struct {
+    EventDetectorConfig config;
+
+    float mean;
+    float sta;
+    float lta;
+    float ratio;
+    uint64_t samples_seen;
+
+    bool in_event;
+    bool detriggered;
+    unsigned int post_trigger_remaining;
+    unsigned int event_length;
+    uint64_t trigger_sample_index;
+    float peak_ratio;
+    uint32_t num_events;
+
+    int32_t pre_trigger[EVENT_MAX_PRE_TRIGGER_LENGTH];
+    unsigned int pre_trigger_index;
+    unsigned int pre_trigger_fill;
+} EventDetector;
+
+int event_detector_initialize(EventDetector *detector, const EventDetectorConfig *config);
+void event_detector_reset(EventDetector *detector);
+EventDetectorResult event_detector_update(EventDetector *detector, int32_t sample, uint64_t sample_index);
+size_t event_detector_pre_trigger(const EventDetector *detector, int32_t out_samples[]);
+bool event_detector_is_warming_up(const EventDetector *detector);
@@ -0,0 +1,107 @@
+#include <string.h>
+#include <math.h>
+
+#include "input_health.h"
+
+void input_health_initialize(InputHealth *health) {
+    memset(health, 0, sizeof(*health));
+}
+
+/**
+ * @brief
+ * Add an averaged reading
+ * @param health
+ * @param mean Average of the conversions in the reading
+ * @param min Smallest conversion in the reading
+ * @param max Largest conversion in the reading
+ * @param noise RMS spread of the conversions about their average
+ */
+void input_health_record(InputHealth *health, float mean, float min, float max, float noise) {
+    health->window_means[health->next_reading] = mean;
+    health->window_mins[health->next_reading] = min;
+    health->window_maxes[health->next_reading] = max;
+    health->next_reading = (health->next_reading + 1) % INPUT_HEALTH_WINDOW_LENGTH;
+    if (health->window_length < INPUT_HEALTH_WINDOW_LENGTH) {
+        health->window_length++;
+    }
+
+    health->history_sum += mean;
+    if (++health->readings_since_history == INPUT_HEALTH_WINDOW_LENGTH) {
+        health->history[health->next_history] = health->history_sum / INPUT_HEALTH_WINDOW_LENGTH;
+        health->next_history = (health->next_history + 1) % INPUT_HEALTH_HISTORY_LENGTH;
+        if (health->history_length < INPUT_HEALTH_HISTORY_LENGTH) {
+            health->history_length++;
+        }
+        health->readings_since_history = 0;
+        health->history_sum = 0;
+    }
+
+    health->last = mean;
+    health->noise = noise;
+    health->num_readings++;
+}
+
+/**
+ * @brief
+ * Count a reading that could not be taken
+ */
+void input_health_record_missed(InputHealth *health) {
+    health->num_missed++;
+}
+
+/**
+ * @brief
+ * Least squares slope of the window means, oldest first
+ * @return Change per window
+ */
+static double history_slope(const InputHealth *health) {
+    size_t length = health->history_length;
+    size_t oldest = (health->next_history + INPUT_HEALTH_HISTORY_LENGTH - length) % INPUT_HEALTH_HISTORY_LENGTH;
+    double mean_x = (length - 1) / 2.0;
+    double mean_y = 0;
+    for (size_t i = 0; i < length; i++) {
+        mean_y += health->history[(oldest + i) % INPUT_HEALTH_HISTORY_LENGTH];
+    }
+    mean_y /= length;
+
+    double covariance = 0;
+    double variance = 0;
+    for (size_t i = 0; i < length; i++) {
+        double dx = i - mean_x;
+        covariance += dx * (health->history[(oldest + i) % INPUT_HEALTH_HISTORY_LENGTH] - mean_y);
+        variance += dx * dx;
+    }
+    return covariance / variance;
+}
+
+/**
+ * @brief
+ * @param health
+ * @param reading_period Seconds between readings, to scale the drift
+ * @param summary
+ */
+void input_health_summarize(const InputHealth *health, double reading_period, InputHealthSummary *summary) {
+    summary->num_readings = health->num_readings;
+    summary->num_missed = health->num_missed;
+    summary->last = health->last;
+    summary->noise = health->noise;
+
+    summary->mean = summary->min = summary->max = 0;
+    if (health->window_length > 0) {
+        double sum = 0;
+        summary->min = health->window_mins[0];
+        summary->max = health->window_maxes[0];
+        for (size_t i = 0; i < health->window_length; i++) {
+            sum += health->window_means[i];
+            summary->min = fminf(summary->min, health->window_mins[i]);
+            summary->max = fmaxf(summary->max, health->window_maxes[i]);
+        }
+        summary->mean = sum / health->window_length;
+    }
+
+    summary->drift = NAN;
+    if (health->history_length >= 2) {
+        double window_hours = INPUT_HEALTH_WINDOW_LENGTH * reading_period / 3600;
+        summary->drift = history_slope(health) / window_hours;
+    }
+}
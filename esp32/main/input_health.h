@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Readings in the rolling window that the minimum, maximum and mean cover
+#define INPUT_HEALTH_WINDOW_LENGTH 60
+
+// Window means kept for the drift, which is fitted to all of them
+#define INPUT_HEALTH_HISTORY_LENGTH 60
+
+/**
+ * @brief
+ * Rolling statistics of the averaged readings of one diagnostic input.
+ * Recording a reading takes constant time; the work of the statistics is
+ * left to `input_health_summarize`, which is called far less often.
+ */
+typedef struct {
+    float window_means[INPUT_HEALTH_WINDOW_LENGTH];
+    float window_mins[INPUT_HEALTH_WINDOW_LENGTH];
+    float window_maxes[INPUT_HEALTH_WINDOW_LENGTH];
+    size_t window_length;
+    size_t next_reading;
+
+    // Each time the window fills with new readings, its mean is kept here
+    float history[INPUT_HEALTH_HISTORY_LENGTH];
+    size_t history_length;
+    size_t next_history;
+    size_t readings_since_history;
+    double history_sum;
+
+    float last;
+    float noise;
+    uint32_t num_readings;
+    uint32_t num_missed;
+} InputHealth;
+
+/**
+ * @brief
+ * Statistics of an input in volts. The minimum and maximum are of the single
+ * conversions, so that a saturated amplifier shows even when its average
+ * does not. Noise is the RMS spread of the conversions in the last reading.
+ */
+typedef struct {
+    uint32_t num_readings;
+    uint32_t num_missed;
+    float last;
+    float mean;
+    float min;
+    float max;
+    float noise;
+    // Volts per hour, NAN until two windows have been seen
+    float drift;
+} InputHealthSummary;
+
+void input_health_initialize(InputHealth *health);
+void input_health_record(InputHealth *health, float mean, float min, float max, float noise);
+void input_health_record_missed(InputHealth *health);
+void input_health_summarize(const InputHealth *health, double reading_period, InputHealthSummary *summary);
@@ -7,14 +7,21 @@
 #include "freertos/task.h"
 #include "freertos/semphr.h"
 
+#include "sdkconfig.h"
+
 #include "cli.h"
 #include "adc.h"
+#include "sample_broker.h"
+#include "pipeline_stats.h"
 #include "wifi.h"
 #include "nvs_flash.h"
 #include "diagnostic_inputs.h"
+#include "vga.h"
+#include "autostart.h"
 
-#define SAMPLE_QUEUE_LENGTH 100
-QueueHandle_t adc_samples;
+static SampleBlock sample_blocks[CONFIG_SAMPLE_POOL_BLOCKS];
+SampleBroker sample_broker;
+PipelineStats pipeline_stats;
 bool wifi_is_connected;
 
 
@@ -22,12 +29,30 @@ void app_main(void)
 {
     ESP_ERROR_CHECK(esp_event_loop_create_default());
 
-    initialize_diagnostic_inputs();
+    esp_err_t error = nvs_flash_init();
+    if (error == ESP_ERR_NVS_NO_FREE_PAGES || error == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        error = nvs_flash_init();
+    }
+    ESP_ERROR_CHECK(error);
+
+#ifdef CONFIG_ETH_USE_OPENETH
+    // Under QEMU there is no Wi-Fi, only the emulated Ethernet MAC
+    start_ethernet();
+#else
+    autostart_wifi();
+#endif
+
+    if (! initialize_diagnostic_inputs()) {
+        start_health_monitor();
+    }
+    initialize_vga();
 
-    adc_samples = xQueueCreate(SAMPLE_QUEUE_LENGTH, sizeof(int));
-    initialize_adc(&adc_samples);
+    sample_broker_initialize(&sample_broker, sample_blocks, CONFIG_SAMPLE_POOL_BLOCKS);
+    initialize_adc(&sample_broker);
 
     start_cli();
+    autostart_telemetry(&sample_broker);
 
 
     for ( ;; ) {
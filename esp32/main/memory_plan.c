@@ -0,0 +1,79 @@
+#include <stdbool.h>
+
+#include "esp_log.h"
+
+#include "memory_plan.h"
+
+static const char *TAG = "memory_plan";
+
+static const PlannedTask *planned_tasks[MEMORY_PLAN_MAX_TASKS];
+static size_t num_planned_tasks;
+static portMUX_TYPE planned_tasks_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief 
+ * Start a task on its reserved stack. A planned task may only be started 
+ * once.
+ * @param task 
+ * @param function 
+ * @param parameters 
+ * @param priority 
+ * @param core Core to pin the task to, or tskNO_AFFINITY
+ * @return The task's handle, or NULL if it could not be started
+ */
+TaskHandle_t start_planned_task(
+    PlannedTask *task, 
+    TaskFunction_t function, 
+    void *parameters, 
+    UBaseType_t priority, 
+    BaseType_t core
+) {
+    if (task->handle != NULL) {
+        ESP_LOGE(TAG, "Task %s is already running", task->name);
+        return NULL;
+    }
+
+    task->handle = xTaskCreateStaticPinnedToCore(
+        function, 
+        task->name, 
+        task->stack_size, 
+        parameters, 
+        priority, 
+        task->stack, 
+        task->control_block, 
+        core
+    );
+    if (task->handle == NULL) {
+        ESP_LOGE(TAG, "Failed to start task %s", task->name);
+        return NULL;
+    }
+
+    // Logging is not allowed with interrupts disabled, so it waits until the 
+    // lock is released
+    portENTER_CRITICAL(&planned_tasks_lock);
+    bool recorded = num_planned_tasks < MEMORY_PLAN_MAX_TASKS;
+    if (recorded) {
+        planned_tasks[num_planned_tasks++] = task;
+    }
+    portEXIT_CRITICAL(&planned_tasks_lock);
+    if (! recorded) {
+        ESP_LOGW(TAG, "Task %s is running but will not be reported", task->name);
+    }
+    return task->handle;
+}
+
+/**
+ * @brief 
+ * @param out_tasks Filled with the planned tasks started so far
+ * @param max_tasks Length of `out_tasks`
+ * @return Number of tasks in `out_tasks`
+ */
+size_t get_planned_tasks(const PlannedTask *out_tasks[], size_t max_tasks) {
+    portENTER_CRITICAL(&planned_tasks_lock);
+    size_t num_tasks = num_planned_tasks < max_tasks ? num_planned_tasks : max_tasks;
+    for (size_t i = 0; i < num_tasks; i++) {
+        out_tasks[i] = planned_tasks[i];
+    }
+    portEXIT_CRITICAL(&planned_tasks_lock);
+    return num_tasks;
+}
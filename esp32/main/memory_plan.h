@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define MEMORY_PLAN_MAX_TASKS 8
+
+/**
+ * @brief 
+ * A task whose stack and control block are reserved at build time, so that 
+ * starting it cannot fail for want of heap, and whose stack use `mem` reports.
+ */
+typedef struct {
+    const char *name;
+    // In bytes, which is also the unit of StackType_t on the ESP32
+    uint32_t stack_size;
+    StackType_t *stack;
+    StaticTask_t *control_block;
+    TaskHandle_t handle;
+} PlannedTask;
+
+/**
+ * @brief 
+ * Define a planned task named `variable` with a static stack of 
+ * `stack_size` bytes
+ */
+#define PLANNED_TASK(variable, task_name, stack_size_bytes) \
+    static StackType_t variable##_stack[stack_size_bytes]; \
+    static StaticTask_t variable##_control_block; \
+    static PlannedTask variable = { \
+        .name = task_name, \
+        .stack_size = stack_size_bytes, \
+        .stack = variable##_stack, \
+        .control_block = &variable##_control_block \
+    }
+
+TaskHandle_t start_planned_task(
+    PlannedTask *task, 
+    TaskFunction_t function, 
+    void *parameters, 
+    UBaseType_t priority, 
+    BaseType_t core
+);
+
+size_t get_planned_tasks(const PlannedTask *out_tasks[], size_t max_tasks);
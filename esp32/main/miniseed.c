@@ -0,0 +1,295 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+#include "miniseed.h"
+
+#define HEADER_LENGTH 64
+#define FRAME_LENGTH 64
+#define WORDS_PER_FRAME 16
+
+#define BLOCKETTE_1000_OFFSET 48
+#define BLOCKETTE_1001_OFFSET 56
+
+#define STEIM2_ENCODING 11
+#define BIG_ENDIAN_WORD_ORDER 1
+#define RECORD_LENGTH_EXPONENT 9
+
+typedef struct {
+    unsigned int count;
+    unsigned int bits;
+    uint32_t nibble;
+    uint32_t dnib;
+} Steim2Packing;
+
+// Tried in order, so the packing holding the most differences wins
+static const Steim2Packing steim2_packings[] = {
+    {.count = 7, .bits = 4, .nibble = 3, .dnib = 2},
+    {.count = 6, .bits = 5, .nibble = 3, .dnib = 1},
+    {.count = 5, .bits = 6, .nibble = 3, .dnib = 0},
+    {.count = 4, .bits = 8, .nibble = 1, .dnib = 0},
+    {.count = 3, .bits = 10, .nibble = 2, .dnib = 3},
+    {.count = 2, .bits = 15, .nibble = 2, .dnib = 2},
+    {.count = 1, .bits = 30, .nibble = 2, .dnib = 1}
+};
+
+static void put_u16(uint8_t *destination, uint16_t value) {
+    destination[0] = value >> 8;
+    destination[1] = value;
+}
+
+static void put_u32(uint8_t *destination, uint32_t value) {
+    put_u16(destination, value >> 16);
+    put_u16(destination + 2, value);
+}
+
+static void put_code(uint8_t *destination, const char code[], size_t width) {
+    size_t length = strlen(code);
+    for (size_t i = 0; i < width; i++) {
+        destination[i] = i < length ? code[i] : ' ';
+    }
+}
+
+static int set_code(char destination[], size_t size, const char code[]) {
+    if (strlen(code) >= size) {
+        return 1;
+    }
+    strcpy(destination, code);
+    return 0;
+}
+
+/**
+ * @brief 
+ * Initialize a stream with its SEED identifiers
+ * @param stream 
+ * @param network Up to 2 characters
+ * @param station Up to 5 characters
+ * @param location Up to 2 characters, may be empty
+ * @param channel Up to 3 characters
+ * @return 0 if success
+ */
+int miniseed_stream_initialize(
+    MiniseedStream *stream, 
+    const char network[], 
+    const char station[], 
+    const char location[], 
+    const char channel[]
+) {
+    if (set_code(stream->network, sizeof(stream->network), network) ||
+        set_code(stream->station, sizeof(stream->station), station) ||
+        set_code(stream->location, sizeof(stream->location), location) ||
+        set_code(stream->channel, sizeof(stream->channel), channel)) {
+        return 1;
+    }
+    stream->sequence_number = 1;
+    miniseed_stream_reset(stream);
+    return 0;
+}
+
+/**
+ * @brief 
+ * Mark a break in the stream so the next record does not difference against 
+ * the previous one.
+ * @param stream 
+ */
+void miniseed_stream_reset(MiniseedStream *stream) {
+    stream->have_last_sample = false;
+}
+
+static bool fits(int32_t value, unsigned int bits) {
+    int32_t limit = (int32_t) 1 << (bits - 1);
+    return value >= -limit && value < limit;
+}
+
+/**
+ * @brief 
+ * Pack differences into one Steim2 data word
+ * @param differences 
+ * @param num_differences Number of differences still to be packed
+ * @param out_word 
+ * @param out_nibble Control nibble describing the word
+ * @return Number of differences packed into the word
+ */
+static unsigned int pack_steim2_word(
+    const int32_t differences[], 
+    size_t num_differences, 
+    uint32_t *out_word, 
+    uint32_t *out_nibble
+) {
+    for (size_t p = 0; p < sizeof(steim2_packings) / sizeof(Steim2Packing); p++) {
+        const Steim2Packing *packing = &steim2_packings[p];
+        if (packing->count > num_differences) {
+            continue;
+        }
+
+        bool all_fit = true;
+        for (unsigned int i = 0; i < packing->count && all_fit; i++) {
+            all_fit = fits(differences[i], packing->bits);
+        }
+        if (! all_fit) {
+            continue;
+        }
+
+        uint32_t mask = ((uint32_t) 1 << packing->bits) - 1;
+        uint32_t word = 0;
+        for (unsigned int i = 0; i < packing->count; i++) {
+            word = (word << packing->bits) | ((uint32_t) differences[i] & mask);
+        }
+        if (packing->nibble != 1) {
+            word |= packing->dnib << 30;
+        }
+        *out_word = word;
+        *out_nibble = packing->nibble;
+        return packing->count;
+    }
+
+    // 24-bit samples never differ by more than 30 bits, but should a wider
+    // difference get here it is clipped into a one difference word rather
+    // than packing nothing and never advancing
+    const Steim2Packing *widest = &steim2_packings[sizeof(steim2_packings) / sizeof(Steim2Packing) - 1];
+    int32_t limit = (int32_t) 1 << (widest->bits - 1);
+    int32_t difference = differences[0] < -limit ? -limit : differences[0] >= limit ? limit - 1 : differences[0];
+    *out_word = ((uint32_t) difference & (((uint32_t) 1 << widest->bits) - 1)) | widest->dnib << 30;
+    *out_nibble = widest->nibble;
+    return widest->count;
+}
+
+static void put_start_time(uint8_t *destination, int64_t start_time_us, int8_t *out_microseconds) {
+    int64_t seconds = start_time_us / 1000000;
+    int64_t microseconds = start_time_us % 1000000;
+    if (microseconds < 0) {
+        seconds--;
+        microseconds += 1000000;
+    }
+
+    time_t calendar_seconds = (time_t) seconds;
+    struct tm calendar_time;
+    gmtime_r(&calendar_seconds, &calendar_time);
+
+    put_u16(destination, calendar_time.tm_year + 1900);
+    put_u16(destination + 2, calendar_time.tm_yday + 1);
+    destination[4] = calendar_time.tm_hour;
+    destination[5] = calendar_time.tm_min;
+    destination[6] = calendar_time.tm_sec;
+    destination[7] = 0;
+    put_u16(destination + 8, microseconds / 100);
+    *out_microseconds = microseconds % 100;
+}
+
+static void put_sample_rate(uint8_t *destination, double sample_rate) {
+    int16_t factor;
+    if (sample_rate >= 1) {
+        factor = (int16_t) lround(sample_rate);
+    }
+    else {
+        // Negative factors are sample periods in seconds
+        factor = (int16_t) -lround(1 / sample_rate);
+    }
+    put_u16(destination, (uint16_t) factor);
+    put_u16(destination + 2, 1);
+}
+
+/**
+ * @brief 
+ * Encode as many samples as fit into one Steim2 compressed 512 byte miniSEED 
+ * record with blockettes 1000 and 1001.
+ * @param stream 
+ * @param record 
+ * @param samples Consecutive samples. At most `MINISEED_MAX_RECORD_SAMPLES` are used.
+ * @param num_samples Must be at least one
+ * @param start_time_us Time of the first sample in microseconds since the Unix epoch
+ * @param sample_rate Samples per second
+ * @return Number of samples encoded
+ */
+size_t miniseed_encode_record(
+    MiniseedStream *stream,
+    uint8_t record[MINISEED_RECORD_LENGTH],
+    const int32_t samples[],
+    size_t num_samples,
+    int64_t start_time_us,
+    double sample_rate
+) {
+    assert(num_samples > 0);
+    if (num_samples > MINISEED_MAX_RECORD_SAMPLES) {
+        num_samples = MINISEED_MAX_RECORD_SAMPLES;
+    }
+
+    int32_t differences[MINISEED_MAX_RECORD_SAMPLES];
+    differences[0] = stream->have_last_sample ? samples[0] - stream->last_sample : 0;
+    for (size_t i = 1; i < num_samples; i++) {
+        differences[i] = samples[i] - samples[i - 1];
+    }
+
+    memset(record, 0, MINISEED_RECORD_LENGTH);
+
+    size_t samples_encoded = 0;
+    unsigned int frames_used = 0;
+    for (unsigned int f = 0; f < MINISEED_FRAMES_PER_RECORD && samples_encoded < num_samples; f++) {
+        uint8_t *frame = record + HEADER_LENGTH + f * FRAME_LENGTH;
+        uint32_t control_word = 0;
+
+        // Words 1 and 2 of the first frame hold the first and last sample
+        unsigned int first_data_word = f == 0 ? 3 : 1;
+        for (unsigned int w = first_data_word; w < WORDS_PER_FRAME && samples_encoded < num_samples; w++) {
+            uint32_t word = 0;
+            uint32_t nibble = 0;
+            samples_encoded += pack_steim2_word(
+                differences + samples_encoded, 
+                num_samples - samples_encoded, 
+                &word, 
+                &nibble
+            );
+            put_u32(frame + 4 * w, word);
+            control_word |= nibble << (2 * (WORDS_PER_FRAME - 1 - w));
+        }
+        put_u32(frame, control_word);
+        frames_used++;
+    }
+
+    uint8_t *first_frame = record + HEADER_LENGTH;
+    put_u32(first_frame + 4, (uint32_t) samples[0]);
+    put_u32(first_frame + 8, (uint32_t) samples[samples_encoded - 1]);
+
+    stream->last_sample = samples[samples_encoded - 1];
+    stream->have_last_sample = true;
+
+    // Fixed section of the data header
+    char sequence_number[7];
+    snprintf(sequence_number, sizeof(sequence_number), "%06u", (unsigned int) stream->sequence_number);
+    memcpy(record, sequence_number, 6);
+    stream->sequence_number = stream->sequence_number % 999999 + 1;
+
+    record[6] = 'D';
+    record[7] = ' ';
+    put_code(record + 8, stream->station, 5);
+    put_code(record + 13, stream->location, 2);
+    put_code(record + 15, stream->channel, 3);
+    put_code(record + 18, stream->network, 2);
+
+    int8_t start_time_microseconds;
+    put_start_time(record + 20, start_time_us, &start_time_microseconds);
+    put_u16(record + 30, samples_encoded);
+    put_sample_rate(record + 32, sample_rate);
+    record[39] = 2;
+    put_u16(record + 44, HEADER_LENGTH);
+    put_u16(record + 46, BLOCKETTE_1000_OFFSET);
+
+    // Blockette 1000: data only SEED
+    uint8_t *blockette = record + BLOCKETTE_1000_OFFSET;
+    put_u16(blockette, 1000);
+    put_u16(blockette + 2, BLOCKETTE_1001_OFFSET);
+    blockette[4] = STEIM2_ENCODING;
+    blockette[5] = BIG_ENDIAN_WORD_ORDER;
+    blockette[6] = RECORD_LENGTH_EXPONENT;
+
+    // Blockette 1001: data extension, for microsecond start times
+    blockette = record + BLOCKETTE_1001_OFFSET;
+    put_u16(blockette, 1001);
+    put_u16(blockette + 2, 0);
+    blockette[5] = (uint8_t) start_time_microseconds;
+    blockette[7] = frames_used;
+
+    return samples_encoded;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define MINISEED_RECORD_LENGTH 512
+
+// Seven 64 byte Steim frames follow the 64 byte header. The first frame gives 
+// up two words to the integration constants, leaving 103 data words of at most 
+// seven differences each.
+#define MINISEED_FRAMES_PER_RECORD 7
+#define MINISEED_MAX_RECORD_SAMPLES (103 * 7)
+
+/**
+ * @brief 
+ * State of one SEED channel. Consecutive records of a stream are linked by 
+ * their sequence number and by the first difference of each record, which is 
+ * taken against the last sample of the previous record.
+ */
+typedef struct {
+    char network[3];
+    char station[6];
+    char location[3];
+    char channel[4];
+    uint32_t sequence_number;
+    int32_t last_sample;
+    bool have_last_sample;
+} MiniseedStream;
+
+int miniseed_stream_initialize(
+    MiniseedStream *stream, 
+    const char network[], 
+    const char station[], 
+    const char location[], 
+    const char channel[]
+);
+void miniseed_stream_reset(MiniseedStream *stream);
+
+size_t miniseed_encode_record(
+    MiniseedStream *stream,
+    uint8_t record[MINISEED_RECORD_LENGTH],
+    const int32_t samples[],
+    size_t num_samples,
+    int64_t start_time_us,
+    double sample_rate
+);
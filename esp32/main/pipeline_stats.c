@@ -0,0 +1,108 @@
+#include <string.h>
+
+#include "pipeline_stats.h"
+
+static const char *histogram_names[STATS_NUM_HISTOGRAMS] = {
+    [STATS_DRDY_TO_READ] = "drdy_to_read",
+    [STATS_ADC_READ] = "adc_read",
+    [STATS_PUBLISH] = "publish",
+    [STATS_DECIMATION] = "decimation",
+    [STATS_PROCESSING] = "processing",
+    [STATS_SEND] = "send",
+    [STATS_SAMPLE_TO_PACKET] = "sample_to_packet"
+};
+
+static const char *counter_names[STATS_NUM_COUNTERS] = {
+    [STATS_SAMPLES_ACQUIRED] = "samples_acquired",
+    [STATS_SAMPLES_LOST] = "samples_lost",
+    [STATS_READ_ERRORS] = "read_errors",
+    [STATS_SAMPLES_DISCARDED] = "samples_discarded",
+    [STATS_BLOCKS_DROPPED] = "blocks_dropped",
+    [STATS_DATAGRAMS_SENT] = "datagrams_sent",
+    [STATS_SEND_ERRORS] = "send_errors",
+    [STATS_ADC_STATUS_ERRORS] = "adc_status_errors",
+    [STATS_ADC_CRC_ERRORS] = "adc_crc_errors",
+    [STATS_DATAGRAMS_SPOOLED] = "datagrams_spooled",
+    [STATS_DATAGRAMS_BACKFILLED] = "datagrams_backfilled",
+    [STATS_SPOOL_DROPPED] = "spool_dropped"
+};
+
+/**
+ * @brief 
+ * Clear every histogram and counter. Updates made by writers while this runs
+ * may be lost or half applied.
+ * @param stats 
+ */
+void pipeline_stats_reset(PipelineStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+}
+
+/**
+ * @brief 
+ * Add a value to a histogram. Only the histogram's writer may call this.
+ * @param histogram 
+ * @param value 
+ */
+void stats_histogram_record(StatsHistogram *histogram, uint32_t value) {
+    unsigned int bucket = value == 0 ? 0 : 32 - __builtin_clz(value);
+    if (bucket >= STATS_HISTOGRAM_BUCKETS) {
+        bucket = STATS_HISTOGRAM_BUCKETS - 1;
+    }
+    histogram->buckets[bucket]++;
+
+    if (histogram->count == 0 || value < histogram->min) {
+        histogram->min = value;
+    }
+    if (value > histogram->max) {
+        histogram->max = value;
+    }
+    histogram->total += value;
+    histogram->count++;
+}
+
+/**
+ * @brief 
+ * Estimate a percentile from the buckets
+ * @param histogram 
+ * @param fraction Fraction of values, from 0 to 1, to be at or below the result
+ * @return Upper edge of the bucket the percentile falls in, limited to the 
+ * largest value recorded
+ */
+uint32_t stats_histogram_percentile(const StatsHistogram *histogram, double fraction) {
+    if (histogram->count == 0) {
+        return 0;
+    }
+
+    uint64_t target = (uint64_t) (fraction * histogram->count + 0.5);
+    if (target == 0) {
+        target = 1;
+    }
+
+    uint64_t seen = 0;
+    for (unsigned int bucket = 0; bucket < STATS_HISTOGRAM_BUCKETS; bucket++) {
+        seen += histogram->buckets[bucket];
+        if (seen >= target) {
+            uint32_t upper_edge = bucket == 0 ? 0 : (uint32_t) ((1ULL << bucket) - 1);
+            return upper_edge < histogram->max ? upper_edge : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+const char *stats_histogram_name(StatsHistogramId id) {
+    return histogram_names[id];
+}
+
+/**
+ * @brief 
+ * @param id 
+ * @return Unit of the values recorded in a histogram. Latencies that cross 
+ * cores are in microseconds because each core has its own cycle counter.
+ */
+StatsUnit stats_histogram_unit(StatsHistogramId id) {
+    return id == STATS_SAMPLE_TO_PACKET ? STATS_UNIT_MICROSECONDS : STATS_UNIT_CYCLES;
+}
+
+const char *stats_counter_name(StatsCounterId id) {
+    return counter_names[id];
+}
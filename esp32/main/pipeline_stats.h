@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// One bucket per power of two, so bucket i counts values from 2^(i-1) up to 
+// but not including 2^i, and bucket 0 counts zeros.
+#define STATS_HISTOGRAM_BUCKETS 32
+
+typedef enum {
+    STATS_UNIT_CYCLES = 0,
+    STATS_UNIT_MICROSECONDS = 1
+} StatsUnit;
+
+/**
+ * @brief 
+ * Log2 histogram, cheap enough to update for every sample. Each histogram 
+ * has a single writer, so no locking is done and a reader may see an update 
+ * half applied.
+ */
+typedef struct {
+    uint32_t buckets[STATS_HISTOGRAM_BUCKETS];
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t total;
+} StatsHistogram;
+
+typedef enum {
+    STATS_DRDY_TO_READ,
+    STATS_ADC_READ,
+    STATS_PUBLISH,
+    STATS_DECIMATION,
+    STATS_PROCESSING,
+    STATS_SEND,
+    STATS_SAMPLE_TO_PACKET,
+    STATS_NUM_HISTOGRAMS
+} StatsHistogramId;
+
+typedef enum {
+    STATS_SAMPLES_ACQUIRED,
+    STATS_SAMPLES_LOST,
+    STATS_READ_ERRORS,
+    STATS_SAMPLES_DISCARDED,
+    STATS_BLOCKS_DROPPED,
+    STATS_DATAGRAMS_SENT,
+    STATS_SEND_ERRORS,
+    STATS_ADC_STATUS_ERRORS,
+    STATS_ADC_CRC_ERRORS,
+    STATS_DATAGRAMS_SPOOLED,
+    STATS_DATAGRAMS_BACKFILLED,
+    STATS_SPOOL_DROPPED,
+    STATS_NUM_COUNTERS
+} StatsCounterId;
+
+/**
+ * @brief 
+ * Timing histograms and event counters for the sample pipeline. Like the 
+ * histograms, every counter has a single writer.
+ */
+typedef struct {
+    StatsHistogram histograms[STATS_NUM_HISTOGRAMS];
+    uint32_t counters[STATS_NUM_COUNTERS];
+} PipelineStats;
+
+void pipeline_stats_reset(PipelineStats *stats);
+void stats_histogram_record(StatsHistogram *histogram, uint32_t value);
+uint32_t stats_histogram_percentile(const StatsHistogram *histogram, double fraction);
+
+const char *stats_histogram_name(StatsHistogramId id);
+StatsUnit stats_histogram_unit(StatsHistogramId id);
+const char *stats_counter_name(StatsCounterId id);
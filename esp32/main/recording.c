@@ -0,0 +1,56 @@
+#include <string.h>
+
+#include "recording.h"
+
+static void put_u32(uint8_t *destination, uint32_t value) {
+    destination[0] = value >> 24;
+    destination[1] = value >> 16;
+    destination[2] = value >> 8;
+    destination[3] = value;
+}
+
+static uint32_t get_u32(const uint8_t *source) {
+    return ((uint32_t) source[0] << 24) | ((uint32_t) source[1] << 16) | ((uint32_t) source[2] << 8) | source[3];
+}
+
+void recording_encode_header(uint8_t out[RECORDING_HEADER_LENGTH], const RecordingHeader *header) {
+    memset(out, 0, RECORDING_HEADER_LENGTH);
+    put_u32(out, RECORDING_MAGIC);
+    out[4] = RECORDING_VERSION;
+    put_u32(out + 8, header->sample_rate_mhz);
+    put_u32(out + 12, header->num_samples);
+}
+
+/**
+ * @brief 
+ * @param in 
+ * @param out_header 
+ * @return 0 if `in` starts a recording of a known version with samples
+ */
+int recording_decode_header(const uint8_t in[RECORDING_HEADER_LENGTH], RecordingHeader *out_header) {
+    if (get_u32(in) != RECORDING_MAGIC || in[4] != RECORDING_VERSION) {
+        return 1;
+    }
+    out_header->sample_rate_mhz = get_u32(in + 8);
+    out_header->num_samples = get_u32(in + 12);
+    if (out_header->num_samples == 0 || out_header->sample_rate_mhz == 0) {
+        return 1;
+    }
+    return 0;
+}
+
+void recording_pack_samples(uint8_t out[], const int32_t samples[], size_t num_samples) {
+    for (size_t i = 0; i < num_samples; i++) {
+        out[RECORDING_SAMPLE_WIDTH * i] = samples[i] >> 16;
+        out[RECORDING_SAMPLE_WIDTH * i + 1] = samples[i] >> 8;
+        out[RECORDING_SAMPLE_WIDTH * i + 2] = samples[i];
+    }
+}
+
+void recording_unpack_samples(int32_t out_samples[], const uint8_t in[], size_t num_samples) {
+    for (size_t i = 0; i < num_samples; i++) {
+        const uint8_t *word = in + RECORDING_SAMPLE_WIDTH * i;
+        // Shift into the top of the word and back to extend the sign
+        out_samples[i] = (int32_t) (((uint32_t) word[0] << 24) | ((uint32_t) word[1] << 16) | ((uint32_t) word[2] << 8)) >> 8;
+    }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Recording replayed by the replay sample source from its flash partition. 
+ * All fields are big-endian, like telemetry frames:
+ *
+ *   offset  size  field
+ *   0       4     magic "IREC"
+ *   4       1     format version
+ *   5       3     reserved, zero
+ *   8       4     sample rate in millihertz it was recorded at
+ *   12      4     number of samples, n
+ *   16      3n    samples as 24-bit two's complement words
+ */
+
+#define RECORDING_MAGIC 0x49524543
+#define RECORDING_VERSION 1
+
+#define RECORDING_HEADER_LENGTH 16
+#define RECORDING_SAMPLE_WIDTH 3
+
+// Label of the flash partition recordings are replayed from
+#define RECORDING_PARTITION_LABEL "replay"
+
+typedef struct {
+    uint32_t sample_rate_mhz;
+    uint32_t num_samples;
+} RecordingHeader;
+
+void recording_encode_header(uint8_t out[RECORDING_HEADER_LENGTH], const RecordingHeader *header);
+int recording_decode_header(const uint8_t in[RECORDING_HEADER_LENGTH], RecordingHeader *out_header);
+void recording_pack_samples(uint8_t out[], const int32_t samples[], size_t num_samples);
+void recording_unpack_samples(int32_t out_samples[], const uint8_t in[], size_t num_samples);
@@ -0,0 +1,235 @@
+#include <assert.h>
+
+#include "sample_broker.h"
+
+/**
+ * @brief 
+ * Initialize a broker with no subscribers
+ * @param broker 
+ * @param blocks Pool of blocks to publish from
+ * @param num_blocks 
+ */
+void sample_broker_initialize(SampleBroker *broker, SampleBlock blocks[], size_t num_blocks) {
+    assert(num_blocks >= 1);
+
+    broker->blocks = blocks;
+    broker->num_blocks = num_blocks;
+    broker->next_block = 0;
+    broker->writing = NULL;
+    for (size_t i = 0; i < num_blocks; i++) {
+        atomic_init(&blocks[i].references, 0);
+    }
+    for (size_t i = 0; i < SAMPLE_BROKER_MAX_SUBSCRIBERS; i++) {
+        atomic_init(&broker->subscribers[i].state, SAMPLE_SUBSCRIBER_FREE);
+    }
+    atomic_init(&broker->published, 0);
+    atomic_init(&broker->pool_exhausted, 0);
+    atomic_init(&broker->dropped, 0);
+}
+
+/**
+ * @brief 
+ * Get a free block for the producer to fill. Only the producer may call this.
+ * @param broker 
+ * @return The block to fill, or NULL if every block is still held by a 
+ * subscriber. An empty pool is counted.
+ */
+SampleBlock *sample_broker_begin_publish(SampleBroker *broker) {
+    for (size_t i = 0; i < broker->num_blocks; i++) {
+        SampleBlock *block = &broker->blocks[broker->next_block];
+        broker->next_block = broker->next_block + 1 == broker->num_blocks ? 0 : broker->next_block + 1;
+
+        // Pairs with the release in `sample_block_release`, so the last 
+        // reader is done with the samples before they are overwritten.
+        if (atomic_load_explicit(&block->references, memory_order_acquire) == 0) {
+            atomic_store_explicit(&block->references, 1, memory_order_relaxed);
+            broker->writing = block;
+            return block;
+        }
+    }
+
+    atomic_fetch_add_explicit(&broker->pool_exhausted, 1, memory_order_relaxed);
+    return NULL;
+}
+
+static const SampleBlock *pop_block(SampleSubscriber *subscriber) {
+    size_t tail = atomic_load_explicit(&subscriber->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&subscriber->head, memory_order_acquire);
+    if (tail == head) {
+        return NULL;
+    }
+
+    SampleBlock *block = subscriber->ring[tail % SAMPLE_BROKER_MAX_DEPTH];
+    atomic_store_explicit(&subscriber->tail, tail + 1, memory_order_release);
+    return block;
+}
+
+static void deliver_block(SampleBroker *broker, SampleSubscriber *subscriber, SampleBlock *block) {
+    size_t head = atomic_load_explicit(&subscriber->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&subscriber->tail, memory_order_acquire);
+    size_t queued = head - tail;
+
+    if (queued >= subscriber->depth) {
+        atomic_fetch_add_explicit(&subscriber->dropped, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&broker->dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    atomic_fetch_add_explicit(&block->references, 1, memory_order_relaxed);
+    subscriber->ring[head % SAMPLE_BROKER_MAX_DEPTH] = block;
+    atomic_store_explicit(&subscriber->head, head + 1, memory_order_release);
+
+    atomic_fetch_add_explicit(&subscriber->delivered, 1, memory_order_relaxed);
+    if (queued + 1 > atomic_load_explicit(&subscriber->high_water, memory_order_relaxed)) {
+        atomic_store_explicit(&subscriber->high_water, queued + 1, memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief 
+ * Deliver the block returned by `sample_broker_begin_publish` to every 
+ * subscriber with room for it. Also finishes closing unsubscribed subscribers.
+ * @param broker 
+ */
+void sample_broker_publish(SampleBroker *broker) {
+    SampleBlock *block = broker->writing;
+    broker->writing = NULL;
+
+    for (size_t i = 0; i < SAMPLE_BROKER_MAX_SUBSCRIBERS; i++) {
+        SampleSubscriber *subscriber = &broker->subscribers[i];
+        int state = atomic_load_explicit(&subscriber->state, memory_order_acquire);
+
+        if (state == SAMPLE_SUBSCRIBER_ACTIVE) {
+            deliver_block(broker, subscriber, block);
+        }
+        else if (state == SAMPLE_SUBSCRIBER_CLOSING) {
+            // The subscriber has stopped reading, so the broker can take over 
+            // as consumer and release what was delivered after it drained.
+            const SampleBlock *queued;
+            while ((queued = pop_block(subscriber)) != NULL) {
+                sample_block_release(queued);
+            }
+            atomic_store_explicit(&subscriber->state, SAMPLE_SUBSCRIBER_FREE, memory_order_release);
+        }
+    }
+
+    atomic_fetch_add_explicit(&broker->published, 1, memory_order_relaxed);
+    sample_block_release(block);
+}
+
+/**
+ * @brief 
+ * Start receiving published blocks. Safe to call while the producer is running.
+ * @param broker 
+ * @param depth Most blocks to queue for this subscriber before dropping, up 
+ * to `SAMPLE_BROKER_MAX_DEPTH`
+ * @return The subscriber, or NULL if there is no free subscriber slot or 
+ * `depth` is out of range
+ */
+SampleSubscriber *sample_broker_subscribe(SampleBroker *broker, size_t depth) {
+    if (depth == 0 || depth > SAMPLE_BROKER_MAX_DEPTH) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < SAMPLE_BROKER_MAX_SUBSCRIBERS; i++) {
+        SampleSubscriber *subscriber = &broker->subscribers[i];
+        int expected = SAMPLE_SUBSCRIBER_FREE;
+        if (! atomic_compare_exchange_strong(&subscriber->state, &expected, SAMPLE_SUBSCRIBER_CLAIMED)) {
+            continue;
+        }
+
+        subscriber->depth = depth;
+        atomic_store_explicit(&subscriber->head, 0, memory_order_relaxed);
+        atomic_store_explicit(&subscriber->tail, 0, memory_order_relaxed);
+        atomic_store_explicit(&subscriber->delivered, 0, memory_order_relaxed);
+        atomic_store_explicit(&subscriber->dropped, 0, memory_order_relaxed);
+        atomic_store_explicit(&subscriber->high_water, 0, memory_order_relaxed);
+        atomic_store_explicit(&subscriber->state, SAMPLE_SUBSCRIBER_ACTIVE, memory_order_release);
+        return subscriber;
+    }
+    return NULL;
+}
+
+/**
+ * @brief 
+ * Stop receiving blocks and release the ones still queued. Blocks taken with 
+ * `sample_subscriber_receive` must be released separately. Blocks delivered 
+ * while this runs are released by the producer on its next publish, which 
+ * also frees the subscriber slot.
+ * @param subscriber 
+ */
+void sample_broker_unsubscribe(SampleSubscriber *subscriber) {
+    const SampleBlock *block;
+    while ((block = pop_block(subscriber)) != NULL) {
+        sample_block_release(block);
+    }
+    atomic_store_explicit(&subscriber->state, SAMPLE_SUBSCRIBER_CLOSING, memory_order_release);
+}
+
+/**
+ * @brief 
+ * Count the blocks held by the producer or any subscriber. Blocks are taken 
+ * and released while this runs, so the count is only a snapshot.
+ * @param broker 
+ * @return Number of blocks not free for the producer to fill
+ */
+size_t sample_broker_blocks_in_use(SampleBroker *broker) {
+    size_t in_use = 0;
+    for (size_t i = 0; i < broker->num_blocks; i++) {
+        if (atomic_load_explicit(&broker->blocks[i].references, memory_order_relaxed) != 0) {
+            in_use++;
+        }
+    }
+    return in_use;
+}
+
+/**
+ * @brief 
+ * Whether a block published now would reach every subscriber. A producer 
+ * that can wait, unlike the ADC, uses this to publish no faster than the 
+ * slowest subscriber consumes.
+ * @param broker 
+ * @return true if no active subscriber has a full queue
+ */
+bool sample_broker_has_room(SampleBroker *broker) {
+    for (size_t i = 0; i < SAMPLE_BROKER_MAX_SUBSCRIBERS; i++) {
+        SampleSubscriber *subscriber = &broker->subscribers[i];
+        if (atomic_load_explicit(&subscriber->state, memory_order_acquire) == SAMPLE_SUBSCRIBER_ACTIVE &&
+            sample_subscriber_count(subscriber) >= subscriber->depth) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief 
+ * Take the oldest block delivered to a subscriber. Only the subscribing task 
+ * may call this.
+ * @param subscriber 
+ * @return The block, which must be released with `sample_block_release`, or 
+ * NULL if none is queued
+ */
+const SampleBlock *sample_subscriber_receive(SampleSubscriber *subscriber) {
+    return pop_block(subscriber);
+}
+
+/**
+ * @brief 
+ * @param subscriber 
+ * @return Number of blocks waiting to be received
+ */
+size_t sample_subscriber_count(SampleSubscriber *subscriber) {
+    size_t head = atomic_load_explicit(&subscriber->head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&subscriber->tail, memory_order_acquire);
+    return head - tail;
+}
+
+/**
+ * @brief 
+ * Give up a received block. The block is reused once every holder has released it.
+ * @param block 
+ */
+void sample_block_release(const SampleBlock *block) {
+    atomic_fetch_sub_explicit(&((SampleBlock *) block)->references, 1, memory_order_release);
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#define SAMPLE_BLOCK_LENGTH CONFIG_SAMPLE_BLOCK_LENGTH
+#else
+#define SAMPLE_BLOCK_LENGTH 128
+#endif
+
+#define SAMPLE_BROKER_MAX_SUBSCRIBERS 8
+
+// Block flags. They are carried into telemetry frames, so they must fit in 
+// a byte.
+// The ADC status byte reported a fault for a sample in the block
+#define SAMPLE_BLOCK_ADC_STATUS_ERROR 0x01
+// A CRC check of the ADC readout failed on a sample in the block
+#define SAMPLE_BLOCK_ADC_CRC_ERROR 0x02
+// The ADC clock was not locked to its time reference when the block was 
+// sampled, so its sample rate and time are less certain
+#define SAMPLE_BLOCK_CLOCK_UNLOCKED 0x04
+// The VGA gain changed just before the block's first sample
+#define SAMPLE_BLOCK_GAIN_CHANGED 0x08
+// The samples came from a synthetic or replay source, not the ADC
+#define SAMPLE_BLOCK_SYNTHETIC 0x10
+
+// Most blocks a subscriber can have queued. A power of two so the ring 
+// indexes can run freely.
+#define SAMPLE_BROKER_MAX_DEPTH 64
+
+/**
+ * @brief 
+ * A run of consecutive ADC samples. `first_sample_index` counts every 
+ * conversion since acquisition started, including ones that were lost, so a 
+ * gap between blocks shows up as a jump in the index.
+ */
+typedef struct {
+    uint64_t first_sample_index;
+    // esp_timer time of the first sample
+    int64_t timestamp_us;
+    // UTC time of the first sample, in microseconds since the Unix epoch
+    int64_t utc_time_us;
+    uint32_t flags;
+    // VGA gain every sample in the block was taken at
+    uint32_t vga_gain;
+    uint32_t length;
+    int32_t samples[SAMPLE_BLOCK_LENGTH];
+
+    // Number of holders of a published block. Managed by the broker.
+    atomic_uint references;
+} SampleBlock;
+
+typedef enum {
+    SAMPLE_SUBSCRIBER_FREE,
+    SAMPLE_SUBSCRIBER_CLAIMED,
+    SAMPLE_SUBSCRIBER_ACTIVE,
+    SAMPLE_SUBSCRIBER_CLOSING
+} SampleSubscriberState;
+
+/**
+ * @brief 
+ * A consumer of published blocks. The broker is the producer of its ring of 
+ * block pointers and the subscribing task the consumer. When the ring holds 
+ * `depth` blocks, further blocks are dropped for this subscriber only.
+ */
+typedef struct {
+    atomic_int state;
+    size_t depth;
+    SampleBlock *ring[SAMPLE_BROKER_MAX_DEPTH];
+    atomic_size_t head;
+    atomic_size_t tail;
+    atomic_ulong delivered;
+    atomic_ulong dropped;
+    atomic_size_t high_water;
+} SampleSubscriber;
+
+/**
+ * @brief 
+ * Fans blocks from a single producer out to any number of subscribers without 
+ * copying them. Blocks come from a fixed pool and are reference counted, so a 
+ * block is reused once every subscriber it was delivered to has released it. 
+ * Publishing never waits on a subscriber.
+ */
+typedef struct {
+    SampleBlock *blocks;
+    size_t num_blocks;
+    size_t next_block;
+    SampleBlock *writing;
+    SampleSubscriber subscribers[SAMPLE_BROKER_MAX_SUBSCRIBERS];
+    atomic_ulong published;
+    atomic_ulong pool_exhausted;
+    atomic_ulong dropped;
+} SampleBroker;
+
+void sample_broker_initialize(SampleBroker *broker, SampleBlock blocks[], size_t num_blocks);
+
+SampleBlock *sample_broker_begin_publish(SampleBroker *broker);
+void sample_broker_publish(SampleBroker *broker);
+
+SampleSubscriber *sample_broker_subscribe(SampleBroker *broker, size_t depth);
+void sample_broker_unsubscribe(SampleSubscriber *subscriber);
+
+size_t sample_broker_blocks_in_use(SampleBroker *broker);
+bool sample_broker_has_room(SampleBroker *broker);
+
+const SampleBlock *sample_subscriber_receive(SampleSubscriber *subscriber);
+size_t sample_subscriber_count(SampleSubscriber *subscriber);
+void sample_block_release(const SampleBlock *block);
@@ -0,0 +1,67 @@
+#include <math.h>
+
+#include "sample_framer.h"
+
+/**
+ * @brief 
+ * @param framer 
+ * @param send Called with each frame once it is full or ended early
+ * @param context Passed to `send`
+ */
+void sample_framer_initialize(SampleFramer *framer, SampleFrameSender send, void *context) {
+    framer->header = (TelemetrySampleHeader) {
+        .num_samples = 0
+    };
+    framer->send = send;
+    framer->context = context;
+}
+
+/**
+ * @brief 
+ * Send the samples gathered so far, if any, as a frame
+ */
+void sample_framer_flush(SampleFramer *framer) {
+    if (framer->header.num_samples == 0) {
+        return;
+    }
+    framer->send(framer->context, &framer->header, framer->samples);
+    framer->header.num_samples = 0;
+}
+
+/**
+ * @brief 
+ * Add the samples of a block, sending each frame as it fills
+ * @param framer 
+ * @param block 
+ * @param max_samples Most samples to take from the block
+ * @param sample_rate Samples per second of the block
+ * @return Number of samples taken
+ */
+size_t sample_framer_add_block(SampleFramer *framer, const SampleBlock *block, uint64_t max_samples, double sample_rate) {
+    TelemetrySampleHeader *header = &framer->header;
+    // A frame only holds consecutive samples at one gain, so a gap in the 
+    // sample index or a gain change ends the frame early.
+    if (header->num_samples > 0 && 
+        (header->first_sample_index + header->num_samples != block->first_sample_index ||
+         header->vga_gain != block->vga_gain)) {
+        sample_framer_flush(framer);
+    }
+
+    size_t num_samples = block->length < max_samples ? block->length : (size_t) max_samples;
+    for (size_t i = 0; i < num_samples; i++) {
+        if (header->num_samples == 0) {
+            header->first_sample_index = block->first_sample_index + i;
+            header->sample_rate_mhz = (uint32_t) lround(sample_rate * 1000);
+            header->vga_gain = block->vga_gain;
+            header->flags = 0;
+        }
+        // Only the frame holding the first sample at a new gain marks it
+        header->flags |= i == 0 ? block->flags : block->flags & ~SAMPLE_BLOCK_GAIN_CHANGED;
+        framer->samples[header->num_samples++] = block->samples[i];
+
+        if (header->num_samples == TELEMETRY_FRAME_MAX_SAMPLES) {
+            sample_framer_flush(framer);
+        }
+    }
+    return num_samples;
+}
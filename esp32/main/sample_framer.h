@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "sample_broker.h"
+#include "telemetry_frame.h"
+
+/**
+ * @brief 
+ * Sends one frame's worth of samples, however the frame travels
+ * @return 0 if success
+ */
+typedef int (*SampleFrameSender)(void *context, const TelemetrySampleHeader *header, const int32_t samples[]);
+
+/**
+ * @brief 
+ * Gathers samples from blocks into telemetry sample frames, the same way 
+ * for every link they are sent over. A frame only holds consecutive samples 
+ * at one gain, so a gap in the sample index or a gain change ends the frame 
+ * early.
+ */
+typedef struct {
+    TelemetrySampleHeader header;
+    int32_t samples[TELEMETRY_FRAME_MAX_SAMPLES];
+    SampleFrameSender send;
+    void *context;
+} SampleFramer;
+
+void sample_framer_initialize(SampleFramer *framer, SampleFrameSender send, void *context);
+size_t sample_framer_add_block(SampleFramer *framer, const SampleBlock *block, uint64_t max_samples, double sample_rate);
+void sample_framer_flush(SampleFramer *framer);
@@ -0,0 +1,346 @@
+#include <math.h>
+#include <sys/time.h>
+#include <stdatomic.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_partition.h"
+
+#include "adc.h"
+#include "vga.h"
+#include "memory_plan.h"
+#include "signal_source.h"
+
+static const char *TAG = "signal source";
+
+#define SOURCE_TASK_STACK_SIZE 3072
+// Below telemetry, and on the acquisition core, which is idle while a
+// source stands in for the ADC
+#define SOURCE_TASK_PRIORITY 4
+#define SOURCE_TASK_CORE 1
+
+// A source publishing as fast as it can still gives up its core this often,
+// so that the idle task can feed the watchdog
+#define FAST_YIELD_PERIOD_MS 100
+
+#define STOP_POLL_PERIOD_MS 10
+
+static TaskHandle_t source_task_handle;
+PLANNED_TASK(source_task_plan, "signal_source", SOURCE_TASK_STACK_SIZE);
+
+static SignalSourceSettings source_settings = {
+    .type = SIGNAL_SOURCE_ADC
+};
+static SampleBroker *source_broker;
+static atomic_bool source_running;
+static atomic_bool stop_requested;
+
+// Index of the next sample to publish, handed over between the source and
+// acquisition so that the index runs on when the source changes
+static uint64_t next_sample_index;
+
+static Waveform waveform;
+static const esp_partition_t *replay_partition;
+static RecordingHeader recording;
+static uint32_t replay_position;
+
+static int64_t source_start_us;
+static atomic_llong source_stop_us;
+static atomic_ullong samples_published;
+static atomic_ulong blocks_discarded;
+static atomic_ulong replay_loops;
+
+const char *signal_source_type_name(SignalSourceType type) {
+    switch (type) {
+        case SIGNAL_SOURCE_ADC: return "adc";
+        case SIGNAL_SOURCE_WAVEFORM: return "waveform";
+        case SIGNAL_SOURCE_REPLAY: return "replay";
+        default: return "unknown";
+    }
+}
+
+/**
+ * @brief
+ * Find the replay partition and check that it holds a whole recording
+ * @return 0 if success
+ */
+static int open_recording(void) {
+    replay_partition = esp_partition_find_first(
+        ESP_PARTITION_TYPE_DATA,
+        ESP_PARTITION_SUBTYPE_ANY,
+        RECORDING_PARTITION_LABEL
+    );
+    if (replay_partition == NULL) {
+        ESP_LOGE(TAG, "There is no \"%s\" partition", RECORDING_PARTITION_LABEL);
+        return 1;
+    }
+
+    uint8_t header[RECORDING_HEADER_LENGTH];
+    esp_err_t error = esp_partition_read(replay_partition, 0, header, sizeof(header));
+    if (error != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to read recording header. details: %s", esp_err_to_name(error));
+        return 1;
+    }
+    if (recording_decode_header(header, &recording)) {
+        ESP_LOGE(TAG, "The \"%s\" partition does not hold a recording", RECORDING_PARTITION_LABEL);
+        return 1;
+    }
+    if (recording.num_samples > (replay_partition->size - RECORDING_HEADER_LENGTH) / RECORDING_SAMPLE_WIDTH) {
+        ESP_LOGE(TAG, "The recording of %lu samples is longer than its partition",
+            (unsigned long) recording.num_samples);
+        return 1;
+    }
+
+    double recorded_rate = recording.sample_rate_mhz / 1000.0;
+    if (fabs(recorded_rate - get_adc_sample_rate()) > 0.001 * recorded_rate) {
+        ESP_LOGW(TAG, "The recording was made at %.3f samples/s but is replayed at %.3f samples/s",
+            recorded_rate, get_adc_sample_rate());
+    }
+    return 0;
+}
+
+/**
+ * @brief
+ * Read the next samples of the recording, starting it again after its end
+ * @param samples
+ * @param num_samples At most SAMPLE_BLOCK_LENGTH
+ * @return 0 if success
+ */
+static int read_recording(int32_t samples[], size_t num_samples) {
+    static uint8_t packed[SAMPLE_BLOCK_LENGTH * RECORDING_SAMPLE_WIDTH];
+
+    size_t num_read = 0;
+    while (num_read < num_samples) {
+        size_t count = num_samples - num_read;
+        if (count > recording.num_samples - replay_position) {
+            count = recording.num_samples - replay_position;
+        }
+        esp_err_t error = esp_partition_read(
+            replay_partition,
+            RECORDING_HEADER_LENGTH + (size_t) replay_position * RECORDING_SAMPLE_WIDTH,
+            packed,
+            count * RECORDING_SAMPLE_WIDTH
+        );
+        if (error != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to read recording. details: %s", esp_err_to_name(error));
+            return 1;
+        }
+        recording_unpack_samples(samples + num_read, packed, count);
+        num_read += count;
+
+        replay_position += count;
+        if (replay_position == recording.num_samples) {
+            replay_position = 0;
+            atomic_fetch_add(&replay_loops, 1);
+        }
+    }
+    return 0;
+}
+
+static int generate_samples(int32_t samples[], size_t num_samples) {
+    if (source_settings.type == SIGNAL_SOURCE_REPLAY) {
+        return read_recording(samples, num_samples);
+    }
+    waveform_generate(&waveform, samples, num_samples);
+    return 0;
+}
+
+/**
+ * @brief
+ * Publish blocks until told to stop. Blocks are stamped on a timeline that
+ * starts when the source does and advances at the ADC's sample rate, so
+ * a source running faster than real time runs ahead of the clock. At the
+ * real rate a block is published once its last sample would have been
+ * converted, and is discarded, as acquisition would, when the pool is
+ * empty. As fast as possible, a block is published whenever every
+ * subscriber has room for it.
+ * @return 0 if stopped, 1 if the source failed
+ */
+static int run_source(void) {
+    static int32_t discarded_samples[SAMPLE_BLOCK_LENGTH];
+
+    double sample_rate = get_adc_sample_rate();
+    if (source_settings.type == SIGNAL_SOURCE_WAVEFORM) {
+        waveform_initialize(&waveform, &source_settings.waveform, sample_rate);
+    }
+    replay_position = 0;
+
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    int64_t start_utc_us = (int64_t) now.tv_sec * 1000000 + now.tv_usec;
+    uint64_t first_sample_index = next_sample_index;
+    TickType_t last_yield = xTaskGetTickCount();
+
+    while (! atomic_load(&stop_requested)) {
+        uint64_t samples_since_start = next_sample_index - first_sample_index;
+        int64_t offset_us = (int64_t) (samples_since_start * 1e6 / sample_rate);
+
+        if (! source_settings.as_fast_as_possible) {
+            int64_t due_us = source_start_us +
+                (int64_t) ((samples_since_start + SAMPLE_BLOCK_LENGTH) * 1e6 / sample_rate);
+            int64_t wait_us = due_us - esp_timer_get_time();
+            if (wait_us > 0) {
+                vTaskDelay((wait_us + portTICK_PERIOD_MS * 1000 - 1) / (portTICK_PERIOD_MS * 1000));
+                continue;
+            }
+        }
+        else if (xTaskGetTickCount() - last_yield >= pdMS_TO_TICKS(FAST_YIELD_PERIOD_MS)) {
+            vTaskDelay(1);
+            last_yield = xTaskGetTickCount();
+        }
+
+        SampleBlock *block = NULL;
+        if (! source_settings.as_fast_as_possible || sample_broker_has_room(source_broker)) {
+            block = sample_broker_begin_publish(source_broker);
+        }
+        if (block == NULL) {
+            if (source_settings.as_fast_as_possible) {
+                vTaskDelay(1);
+                last_yield = xTaskGetTickCount();
+                continue;
+            }
+            // Keep the signal continuous across the gap
+            if (generate_samples(discarded_samples, SAMPLE_BLOCK_LENGTH)) {
+                return 1;
+            }
+            atomic_fetch_add(&blocks_discarded, 1);
+            next_sample_index += SAMPLE_BLOCK_LENGTH;
+            continue;
+        }
+
+        if (generate_samples(block->samples, SAMPLE_BLOCK_LENGTH)) {
+            // The block is published empty, as nothing else can return it
+            // to the pool
+            block->length = 0;
+            sample_broker_publish(source_broker);
+            return 1;
+        }
+        block->first_sample_index = next_sample_index;
+        block->timestamp_us = source_start_us + offset_us;
+        block->utc_time_us = start_utc_us + offset_us;
+        block->flags = SAMPLE_BLOCK_SYNTHETIC;
+        block->vga_gain = get_vga_gain();
+        block->length = SAMPLE_BLOCK_LENGTH;
+        sample_broker_publish(source_broker);
+
+        next_sample_index += SAMPLE_BLOCK_LENGTH;
+        atomic_fetch_add(&samples_published, SAMPLE_BLOCK_LENGTH);
+    }
+    return 0;
+}
+
+/**
+ * @brief
+ * Runs the selected source each time it is notified. A source that fails 
+ * gives the broker back to acquisition, so that samples keep coming.
+ */
+static void source_task(void *context) {
+    for ( ;; ) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (run_source()) {
+            ESP_LOGE(TAG, "The %s source failed, switching back to the ADC",
+                signal_source_type_name(source_settings.type));
+            source_settings.type = SIGNAL_SOURCE_ADC;
+            if (resume_acquisition(next_sample_index)) {
+                ESP_LOGE(TAG, "Failed to resume acquisition");
+            }
+        }
+        atomic_store(&source_stop_us, esp_timer_get_time());
+        atomic_store(&source_running, false);
+    }
+}
+
+/**
+ * @brief
+ * Stop the running source, if any, and wait for it to finish its block
+ */
+static void stop_source(void) {
+    atomic_store(&stop_requested, true);
+    while (atomic_load(&source_running)) {
+        vTaskDelay(pdMS_TO_TICKS(STOP_POLL_PERIOD_MS));
+    }
+}
+
+/**
+ * @brief
+ * Choose where published samples come from. A synthetic or replay source
+ * takes the place of acquisition as the broker's producer and publishes
+ * blocks like it, flagged SAMPLE_BLOCK_SYNTHETIC. Choosing the ADC again
+ * gives the broker back to acquisition. Sample indexes carry on across a
+ * change of source.
+ * @param broker Broker acquisition publishes to
+ * @param settings
+ * @return 0 if success
+ */
+int start_signal_source(SampleBroker *broker, const SignalSourceSettings *settings) {
+    if (source_task_handle == NULL && settings->type != SIGNAL_SOURCE_ADC) {
+        source_task_handle = start_planned_task(
+            &source_task_plan,
+            source_task,
+            NULL,
+            SOURCE_TASK_PRIORITY,
+            SOURCE_TASK_CORE
+        );
+        if (source_task_handle == NULL) {
+            ESP_LOGE(TAG, "Failed to create signal source task");
+            return 1;
+        }
+    }
+
+    if (source_settings.type != SIGNAL_SOURCE_ADC) {
+        stop_source();
+    }
+    // A source that failed has given the broker back to acquisition by the 
+    // time it stops
+    if (source_settings.type == SIGNAL_SOURCE_ADC) {
+        if (pause_acquisition(&next_sample_index)) {
+            return 1;
+        }
+    }
+
+    // The recording is only opened once the source that may be reading it 
+    // has stopped. Acquisition takes over again if it cannot be.
+    source_broker = broker;
+    if (settings->type == SIGNAL_SOURCE_REPLAY && open_recording()) {
+        source_settings.type = SIGNAL_SOURCE_ADC;
+        resume_acquisition(next_sample_index);
+        return 1;
+    }
+
+    source_settings = *settings;
+    if (settings->type == SIGNAL_SOURCE_ADC) {
+        return resume_acquisition(next_sample_index);
+    }
+
+    source_start_us = esp_timer_get_time();
+    atomic_store(&samples_published, 0);
+    atomic_store(&blocks_discarded, 0);
+    atomic_store(&replay_loops, 0);
+    atomic_store(&stop_requested, false);
+    atomic_store(&source_running, true);
+
+    xTaskNotifyGive(source_task_handle);
+    return 0;
+}
+
+/**
+ * @brief
+ * Get the selected source and the progress of the current or last
+ * synthetic or replay source
+ * @param status
+ */
+void get_signal_source_status(SignalSourceStatus *status) {
+    bool running = atomic_load(&source_running);
+    *status = (SignalSourceStatus) {
+        .settings = source_settings,
+        .running = running,
+        .samples_published = atomic_load(&samples_published),
+        .blocks_discarded = atomic_load(&blocks_discarded),
+        .elapsed_us = (running ? esp_timer_get_time() : atomic_load(&source_stop_us)) - source_start_us,
+        .recording = recording,
+        .replay_loops = atomic_load(&replay_loops)
+    };
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sample_broker.h"
+#include "waveform.h"
+#include "recording.h"
+
+typedef enum {
+    // Samples are acquired from the ADC
+    SIGNAL_SOURCE_ADC,
+    // A synthetic sine, chirp or noise waveform
+    SIGNAL_SOURCE_WAVEFORM,
+    // The recording in the replay partition, looped
+    SIGNAL_SOURCE_REPLAY
+} SignalSourceType;
+
+typedef struct {
+    SignalSourceType type;
+    // Waveform generated by a SIGNAL_SOURCE_WAVEFORM source
+    WaveformSettings waveform;
+    // Publish as fast as subscribers take blocks instead of at the ADC's
+    // sample rate
+    bool as_fast_as_possible;
+} SignalSourceSettings;
+
+typedef struct {
+    SignalSourceSettings settings;
+    // Whether a synthetic or replay source is publishing. A source stops
+    // by itself only if its recording cannot be read.
+    bool running;
+    uint64_t samples_published;
+    // Blocks not published because every block in the pool was held by
+    // subscribers
+    unsigned long blocks_discarded;
+    // Time the source has been running, or ran for
+    int64_t elapsed_us;
+    // Recording being replayed, and how many times it has been played through
+    RecordingHeader recording;
+    unsigned long replay_loops;
+} SignalSourceStatus;
+
+int start_signal_source(SampleBroker *broker, const SignalSourceSettings *settings);
+void get_signal_source_status(SignalSourceStatus *status);
+const char *signal_source_type_name(SignalSourceType type);
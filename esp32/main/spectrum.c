@@ -0,0 +1,293 @@
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#include "spectrum.h"
+
+#define BAND_REFERENCE_FREQUENCY 1000.0
+
+static void initialize_bands(SpectrumAnalyzer *analyzer) {
+    analyzer->num_bands = 0;
+    if (analyzer->band_type == SPECTRUM_BANDS_NONE) {
+        return;
+    }
+
+    // Base two band centers, 1000 * 2^(n / b), for b bands per octave
+    double bands_per_octave = analyzer->band_type;
+    double half_band_ratio = pow(2, 0.5 / bands_per_octave);
+    double bin_width = analyzer->sample_rate / analyzer->fft_length;
+    double nyquist = analyzer->sample_rate / 2;
+
+    int n = (int) ceil(bands_per_octave * log2(bin_width * half_band_ratio / BAND_REFERENCE_FREQUENCY));
+    for ( ; analyzer->num_bands < SPECTRUM_MAX_BANDS; n++) {
+        double center = BAND_REFERENCE_FREQUENCY * pow(2, n / bands_per_octave);
+        double upper = center * half_band_ratio;
+        if (upper > nyquist) {
+            break;
+        }
+
+        SpectrumBand *band = &analyzer->bands[analyzer->num_bands++];
+        band->center_frequency = center;
+        band->lower_frequency = center / half_band_ratio;
+        band->upper_frequency = upper;
+        band->power = 0;
+    }
+}
+
+/**
+ * @brief 
+ * Set up an analyzer
+ * @param analyzer 
+ * @param sample_rate Samples per second of the input
+ * @param fft_length Segment length, a power of two
+ * @param num_averages Segments averaged into each estimate
+ * @param band_type Fractional octave bands to sum the estimate into
+ * @return 0 if success
+ */
+int spectrum_analyzer_initialize(
+    SpectrumAnalyzer *analyzer, 
+    double sample_rate, 
+    unsigned int fft_length, 
+    unsigned int num_averages, 
+    SpectrumBandType band_type
+) {
+    if (fft_length < SPECTRUM_MIN_FFT_LENGTH || 
+        fft_length > SPECTRUM_MAX_FFT_LENGTH || 
+        (fft_length & (fft_length - 1)) != 0 ||
+        num_averages == 0) {
+        return 1;
+    }
+
+    analyzer->fft_length = fft_length;
+    analyzer->hop_length = fft_length / 2;
+    analyzer->num_averages = num_averages;
+    analyzer->sample_rate = sample_rate;
+    analyzer->band_type = band_type;
+
+    double window_power = 0;
+    for (unsigned int n = 0; n < fft_length; n++) {
+        analyzer->window[n] = 0.5 - 0.5 * cos(2 * M_PI * n / fft_length);
+        window_power += analyzer->window[n] * analyzer->window[n];
+    }
+    analyzer->window_power = window_power;
+
+    // exp(-2 pi i k / N) for k < N / 2
+    for (unsigned int k = 0; k < fft_length / 2; k++) {
+        analyzer->twiddles[2 * k] = cos(2 * M_PI * k / fft_length);
+        analyzer->twiddles[2 * k + 1] = -sin(2 * M_PI * k / fft_length);
+    }
+
+    initialize_bands(analyzer);
+    spectrum_analyzer_reset(analyzer);
+    return 0;
+}
+
+/**
+ * @brief 
+ * Discard any partial segment and estimate, for example after a gap in the input
+ * @param analyzer 
+ */
+void spectrum_analyzer_reset(SpectrumAnalyzer *analyzer) {
+    analyzer->segment_fill = 0;
+    spectrum_analyzer_clear_estimate(analyzer);
+}
+
+/**
+ * @brief 
+ * Start a new estimate after a finished one has been used
+ * @param analyzer 
+ */
+void spectrum_analyzer_clear_estimate(SpectrumAnalyzer *analyzer) {
+    analyzer->segments_averaged = 0;
+    analyzer->estimate_ready = false;
+    memset(analyzer->power_sum, 0, sizeof(analyzer->power_sum));
+}
+
+/**
+ * @brief 
+ * In place radix-2 decimation in time FFT
+ * @param analyzer Supplies the twiddle factors for twice the transform length
+ * @param data Interleaved complex values
+ * @param length Number of complex values
+ */
+static void complex_fft(const SpectrumAnalyzer *analyzer, float data[], unsigned int length) {
+    for (unsigned int i = 1, j = 0; i < length; i++) {
+        unsigned int bit = length >> 1;
+        for ( ; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j) {
+            float real = data[2 * i];
+            float imaginary = data[2 * i + 1];
+            data[2 * i] = data[2 * j];
+            data[2 * i + 1] = data[2 * j + 1];
+            data[2 * j] = real;
+            data[2 * j + 1] = imaginary;
+        }
+    }
+
+    for (unsigned int span = 2; span <= length; span <<= 1) {
+        unsigned int half_span = span / 2;
+        // The table is for 2 * length points, so step twice as far through it
+        unsigned int twiddle_step = 2 * (length / span);
+        for (unsigned int start = 0; start < length; start += span) {
+            for (unsigned int k = 0; k < half_span; k++) {
+                float twiddle_real = analyzer->twiddles[2 * k * twiddle_step];
+                float twiddle_imaginary = analyzer->twiddles[2 * k * twiddle_step + 1];
+                float *even = &data[2 * (start + k)];
+                float *odd = &data[2 * (start + k + half_span)];
+
+                float odd_real = odd[0] * twiddle_real - odd[1] * twiddle_imaginary;
+                float odd_imaginary = odd[0] * twiddle_imaginary + odd[1] * twiddle_real;
+                odd[0] = even[0] - odd_real;
+                odd[1] = even[1] - odd_imaginary;
+                even[0] += odd_real;
+                even[1] += odd_imaginary;
+            }
+        }
+    }
+}
+
+/**
+ * @brief 
+ * FFT of a real sequence, computed as a complex FFT of half the length
+ * @param analyzer 
+ * @param input `fft_length` real values
+ * @param output May be the same buffer as `input`, with room for two more values. `fft_length / 2 + 1` interleaved complex bins, from DC to Nyquist
+ */
+void spectrum_real_fft(const SpectrumAnalyzer *analyzer, const float input[], float output[]) {
+    unsigned int half_length = analyzer->fft_length / 2;
+
+    // Even samples become the real parts and odd samples the imaginary parts
+    float *packed = output;
+    if (packed != input) {
+        memcpy(packed, input, analyzer->fft_length * sizeof(float));
+    }
+    complex_fft(analyzer, packed, half_length);
+
+    float dc_real = packed[0];
+    float dc_imaginary = packed[1];
+
+    // Bins k and N/2 - k are untangled from the same pair of values, so walk 
+    // both ends towards the middle to work in place.
+    for (unsigned int k = 1; k <= half_length / 2; k++) {
+        unsigned int mirror = half_length - k;
+        float z_real = packed[2 * k];
+        float z_imaginary = packed[2 * k + 1];
+        float mirror_real = packed[2 * mirror];
+        float mirror_imaginary = packed[2 * mirror + 1];
+
+        for (int pass = 0; pass < 2; pass++) {
+            unsigned int bin = pass == 0 ? k : mirror;
+            float a_real = pass == 0 ? z_real : mirror_real;
+            float a_imaginary = pass == 0 ? z_imaginary : mirror_imaginary;
+            float b_real = pass == 0 ? mirror_real : z_real;
+            float b_imaginary = pass == 0 ? -mirror_imaginary : -z_imaginary;
+
+            // Even part (a + conj(b)) / 2, odd part (a - conj(b)) / 2i
+            float even_real = (a_real + b_real) / 2;
+            float even_imaginary = (a_imaginary + b_imaginary) / 2;
+            float odd_real = (a_imaginary - b_imaginary) / 2;
+            float odd_imaginary = -(a_real - b_real) / 2;
+
+            float twiddle_real = analyzer->twiddles[2 * bin];
+            float twiddle_imaginary = analyzer->twiddles[2 * bin + 1];
+            output[2 * bin] = even_real + odd_real * twiddle_real - odd_imaginary * twiddle_imaginary;
+            output[2 * bin + 1] = even_imaginary + odd_real * twiddle_imaginary + odd_imaginary * twiddle_real;
+            if (mirror == k) {
+                break;
+            }
+        }
+    }
+
+    output[0] = dc_real + dc_imaginary;
+    output[1] = 0;
+    output[2 * half_length] = dc_real - dc_imaginary;
+    output[2 * half_length + 1] = 0;
+}
+
+static void finish_estimate(SpectrumAnalyzer *analyzer) {
+    unsigned int num_bins = analyzer->fft_length / 2 + 1;
+    float bin_width = analyzer->sample_rate / analyzer->fft_length;
+
+    for (unsigned int k = 0; k < num_bins; k++) {
+        analyzer->psd[k] = analyzer->power_sum[k] / analyzer->segments_averaged;
+    }
+
+    for (unsigned int b = 0; b < analyzer->num_bands; b++) {
+        SpectrumBand *band = &analyzer->bands[b];
+        band->power = 0;
+        unsigned int first_bin = (unsigned int) ceil(band->lower_frequency / bin_width);
+        for (unsigned int k = first_bin; k < num_bins && k * bin_width < band->upper_frequency; k++) {
+            band->power += analyzer->psd[k] * bin_width;
+        }
+    }
+    analyzer->estimate_ready = true;
+}
+
+static void process_segment(SpectrumAnalyzer *analyzer) {
+    unsigned int num_bins = analyzer->fft_length / 2 + 1;
+    float *windowed = analyzer->fft_buffer;
+    for (unsigned int n = 0; n < analyzer->fft_length; n++) {
+        windowed[n] = analyzer->segment[n] * analyzer->window[n];
+    }
+    spectrum_real_fft(analyzer, windowed, analyzer->fft_buffer);
+
+    // One sided density, so every bin but DC and Nyquist counts twice
+    float scale = 1 / (analyzer->sample_rate * analyzer->window_power);
+    for (unsigned int k = 0; k < num_bins; k++) {
+        float real = analyzer->fft_buffer[2 * k];
+        float imaginary = analyzer->fft_buffer[2 * k + 1];
+        float bin_scale = k == 0 || k == num_bins - 1 ? scale : 2 * scale;
+        analyzer->power_sum[k] += (real * real + imaginary * imaginary) * bin_scale;
+    }
+
+    if (analyzer->segments_averaged == 0) {
+        analyzer->estimate_first_sample_index = analyzer->segment_first_sample_index;
+    }
+    analyzer->segments_averaged++;
+    if (analyzer->segments_averaged == analyzer->num_averages) {
+        finish_estimate(analyzer);
+    }
+
+    // Keep the second half of the segment as the start of the next one
+    memmove(
+        analyzer->segment, 
+        analyzer->segment + analyzer->hop_length, 
+        (analyzer->fft_length - analyzer->hop_length) * sizeof(float)
+    );
+    analyzer->segment_fill -= analyzer->hop_length;
+    analyzer->segment_first_sample_index += analyzer->hop_length;
+}
+
+/**
+ * @brief 
+ * Feed consecutive samples to the analyzer. Processing stops as soon as an 
+ * estimate is ready, so that it can be used before it is overwritten.
+ * @param analyzer 
+ * @param samples 
+ * @param num_samples 
+ * @param first_sample_index Index of `samples[0]` in the input stream
+ * @return Number of samples consumed
+ */
+size_t spectrum_analyzer_process(
+    SpectrumAnalyzer *analyzer, 
+    const int32_t samples[], 
+    size_t num_samples, 
+    uint64_t first_sample_index
+) {
+    assert(! analyzer->estimate_ready);
+
+    size_t consumed = 0;
+    while (consumed < num_samples && ! analyzer->estimate_ready) {
+        if (analyzer->segment_fill == 0) {
+            analyzer->segment_first_sample_index = first_sample_index + consumed;
+        }
+        analyzer->segment[analyzer->segment_fill++] = samples[consumed++];
+        if (analyzer->segment_fill == analyzer->fft_length) {
+            process_segment(analyzer);
+        }
+    }
+    return consumed;
+}
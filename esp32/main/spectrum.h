@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define SPECTRUM_MAX_FFT_LENGTH 1024
+#define SPECTRUM_MIN_FFT_LENGTH 16
+#define SPECTRUM_MAX_BINS (SPECTRUM_MAX_FFT_LENGTH / 2 + 1)
+#define SPECTRUM_MAX_BANDS 32
+
+typedef enum {
+    SPECTRUM_BANDS_NONE = 0,
+    SPECTRUM_BANDS_OCTAVE = 1,
+    SPECTRUM_BANDS_THIRD_OCTAVE = 3
+} SpectrumBandType;
+
+typedef struct {
+    float center_frequency;
+    float lower_frequency;
+    float upper_frequency;
+    float power;
+} SpectrumBand;
+
+/**
+ * @brief 
+ * Streaming Welch power spectral density estimator. Hann windowed segments 
+ * overlapping by half are transformed and their power averaged until 
+ * `num_averages` segments make up one estimate.
+ */
+typedef struct {
+    unsigned int fft_length;
+    unsigned int hop_length;
+    unsigned int num_averages;
+    double sample_rate;
+    SpectrumBandType band_type;
+    unsigned int num_bands;
+    SpectrumBand bands[SPECTRUM_MAX_BANDS];
+
+    unsigned int segment_fill;
+    unsigned int segments_averaged;
+    uint64_t segment_first_sample_index;
+    uint64_t estimate_first_sample_index;
+    bool estimate_ready;
+
+    float window_power;
+    float window[SPECTRUM_MAX_FFT_LENGTH];
+    float segment[SPECTRUM_MAX_FFT_LENGTH];
+    // Complex values are stored as interleaved real and imaginary parts
+    float twiddles[SPECTRUM_MAX_FFT_LENGTH];
+    float fft_buffer[SPECTRUM_MAX_FFT_LENGTH + 2];
+    float power_sum[SPECTRUM_MAX_BINS];
+    float psd[SPECTRUM_MAX_BINS];
+} SpectrumAnalyzer;
+
+int spectrum_analyzer_initialize(
+    SpectrumAnalyzer *analyzer, 
+    double sample_rate, 
+    unsigned int fft_length, 
+    unsigned int num_averages, 
+    SpectrumBandType band_type
+);
+void spectrum_analyzer_reset(SpectrumAnalyzer *analyzer);
+size_t spectrum_analyzer_process(
+    SpectrumAnalyzer *analyzer, 
+    const int32_t samples[], 
+    size_t num_samples, 
+    uint64_t first_sample_index
+);
+void spectrum_analyzer_clear_estimate(SpectrumAnalyzer *analyzer);
+
+void spectrum_real_fft(const SpectrumAnalyzer *analyzer, const float input[], float output[]);
@@ -0,0 +1,244 @@
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_heap_caps.h"
+
+#include "sdkconfig.h"
+
+#include "spool.h"
+
+static const char *TAG = "spool";
+
+// Unit the log drops when full in PSRAM. Records do not straddle these, so 
+// they are much longer than a datagram to waste little at their ends; the 
+// flash spool has to use the 4 KiB erase sectors.
+#define PSRAM_SPOOL_SECTOR_SIZE 32768
+
+// Sectors of the staging log in front of a flash spool, as long as a flash 
+// erase sector so that they hold any datagram the flash spool does
+#define STAGING_SECTOR_SIZE 4096
+
+// Only the telemetry task spools and backfills datagrams. Status readers 
+// may see a count half updated.
+static DatagramLog spool;
+static SpoolMedium spool_medium = SPOOL_NONE;
+
+// Newest datagrams spooled to flash, collected in RAM and moved to `spool` 
+// in one burst when about full, so that the flash writes and erases that 
+// stall acquisition come together rather than with every datagram. Every 
+// datagram in `spool` is older than every datagram in here.
+static DatagramLog staging;
+static bool staging_enabled;
+// Log the datagram last peeked at came from
+static DatagramLog *peeked_log;
+// Datagrams moved from staging to `spool`, to count each datagram once
+static unsigned long datagrams_unstaged;
+
+static int partition_read(void *partition, size_t offset, void *data, size_t length) {
+    return esp_partition_read(partition, offset, data, length) != ESP_OK;
+}
+
+static int partition_write(void *partition, size_t offset, const void *data, size_t length) {
+    return esp_partition_write(partition, offset, data, length) != ESP_OK;
+}
+
+static int partition_erase(void *partition, size_t offset, size_t length) {
+    return esp_partition_erase_range(partition, offset, length) != ESP_OK;
+}
+
+static int open_psram_storage(DatagramLogStorage *storage) {
+#if defined(CONFIG_SPIRAM) && CONFIG_TELEMETRY_SPOOL_PSRAM_KB > 0
+    size_t size = CONFIG_TELEMETRY_SPOOL_PSRAM_KB * 1024;
+    uint8_t *memory = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    if (memory == NULL) {
+        ESP_LOGW(TAG, "No PSRAM for a %u KiB spool", (unsigned) (size / 1024));
+        return 1;
+    }
+    return datagram_log_ram_storage(storage, memory, size, PSRAM_SPOOL_SECTOR_SIZE);
+#else
+    return 1;
+#endif
+}
+
+static int open_partition_storage(DatagramLogStorage *storage) {
+    const esp_partition_t *partition = esp_partition_find_first(
+        ESP_PARTITION_TYPE_DATA, 
+        ESP_PARTITION_SUBTYPE_ANY, 
+        SPOOL_PARTITION_LABEL
+    );
+    if (partition == NULL) {
+        return 1;
+    }
+    *storage = (DatagramLogStorage) {
+        .read = partition_read,
+        .write = partition_write,
+        .erase = partition_erase,
+        .context = (void *) partition,
+        .size = partition->size - partition->size % partition->erase_size,
+        .sector_size = partition->erase_size
+    };
+    return 0;
+}
+
+/**
+ * @brief 
+ * Put a RAM log in front of the flash spool
+ * @return 0 if success
+ */
+static int open_staging(void) {
+    size_t size = CONFIG_TELEMETRY_SPOOL_STAGING_KB * 1024;
+    size -= size % STAGING_SECTOR_SIZE;
+    uint8_t *memory = heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (memory == NULL) {
+        ESP_LOGW(TAG, "No RAM for %u KiB of staging, so every datagram spooled stalls acquisition", 
+            (unsigned) (size / 1024));
+        return 1;
+    }
+
+    DatagramLogStorage storage;
+    if (datagram_log_ram_storage(&storage, memory, size, STAGING_SECTOR_SIZE) ||
+        datagram_log_initialize(&staging, &storage)) {
+        heap_caps_free(memory);
+        return 1;
+    }
+    staging_enabled = true;
+    return 0;
+}
+
+/**
+ * @brief 
+ * Move every staged datagram to the flash spool, oldest first
+ */
+static void unstage_datagrams(void) {
+    static uint8_t datagram[STAGING_SECTOR_SIZE];
+
+    size_t length;
+    while (datagram_log_peek(&staging, datagram, &length) == 0) {
+        datagram_log_append(&spool, datagram, length);
+        datagram_log_pop(&staging);
+        datagrams_unstaged++;
+    }
+}
+
+/**
+ * @brief 
+ * Set up the spool in PSRAM if it is fitted, or else in the spool flash 
+ * partition behind a staging log in internal RAM. PSRAM comes first as it 
+ * does not wear, and writing it does not stall both cores the way a flash 
+ * write or erase does. The spool starts empty, as sample indexes restart at 
+ * boot.
+ * @return 0 if success, 1 if there is nowhere to spool
+ */
+int initialize_spool(void) {
+    if (spool_medium != SPOOL_NONE) {
+        return 0;
+    }
+
+    DatagramLogStorage storage;
+    SpoolMedium medium = SPOOL_PSRAM;
+    if (open_psram_storage(&storage)) {
+        medium = SPOOL_FLASH;
+        if (open_partition_storage(&storage)) {
+            ESP_LOGW(TAG, "No PSRAM and no \"%s\" partition, so datagrams are lost while the link is down", 
+                SPOOL_PARTITION_LABEL);
+            return 1;
+        }
+    }
+    if (datagram_log_initialize(&spool, &storage)) {
+        ESP_LOGE(TAG, "Failed to initialize the spool in %s", spool_medium_name(medium));
+        return 1;
+    }
+    if (medium == SPOOL_FLASH) {
+        open_staging();
+    }
+    spool_medium = medium;
+    ESP_LOGI(TAG, "Spooling up to %u KiB to %s", (unsigned) (storage.size / 1024), spool_medium_name(medium));
+    return 0;
+}
+
+bool spool_is_empty(void) {
+    return spool_medium == SPOOL_NONE || 
+        (datagram_log_is_empty(&spool) && (! staging_enabled || datagram_log_is_empty(&staging)));
+}
+
+/**
+ * @brief 
+ * Keep a datagram that could not be sent. Once the spool is full, the 
+ * oldest datagrams are dropped.
+ * @return 0 if success
+ */
+int spool_datagram(const uint8_t datagram[], size_t length) {
+    if (spool_medium == SPOOL_NONE) {
+        return 1;
+    }
+    if (! staging_enabled) {
+        return datagram_log_append(&spool, datagram, length);
+    }
+
+    // Staging never drops its oldest datagrams: it is emptied while its head 
+    // is still at least a sector short of its tail
+    if (datagram_log_bytes_used(&staging) > staging.storage.size - 2 * STAGING_SECTOR_SIZE) {
+        unstage_datagrams();
+    }
+    return datagram_log_append(&staging, datagram, length);
+}
+
+/**
+ * @brief 
+ * Read the oldest spooled datagram, to remove with `pop_spooled_datagram` 
+ * once it is sent
+ * @param out_datagram Buffer of at least TELEMETRY_FRAME_MAX_LENGTH bytes
+ * @param out_length 
+ * @return 0 if success, 1 if there is none
+ */
+int peek_spooled_datagram(uint8_t out_datagram[], size_t *out_length) {
+    if (spool_medium == SPOOL_NONE) {
+        return 1;
+    }
+    peeked_log = staging_enabled && datagram_log_is_empty(&spool) ? &staging : &spool;
+    return datagram_log_peek(peeked_log, out_datagram, out_length);
+}
+
+void pop_spooled_datagram(void) {
+    if (peeked_log != NULL) {
+        datagram_log_pop(peeked_log);
+    }
+}
+
+void get_spool_status(SpoolStatus *status) {
+    *status = (SpoolStatus) {
+        .medium = spool_medium
+    };
+    if (spool_medium == SPOOL_NONE) {
+        return;
+    }
+    status->capacity = spool.storage.size;
+    status->bytes_used = datagram_log_bytes_used(&spool);
+    status->num_datagrams = spool.num_records;
+    status->datagrams_spooled = spool.records_written;
+    status->datagrams_backfilled = spool.records_read;
+    status->datagrams_dropped = spool.records_dropped;
+    status->storage_errors = spool.storage_errors;
+    if (! staging_enabled) {
+        return;
+    }
+
+    // Datagrams are spooled into staging, and read back from either log
+    status->capacity += staging.storage.size;
+    status->bytes_used += datagram_log_bytes_used(&staging);
+    status->num_datagrams += staging.num_records;
+    status->datagrams_spooled = staging.records_written;
+    status->datagrams_backfilled += staging.records_read - datagrams_unstaged;
+    status->datagrams_dropped += staging.records_dropped + (datagrams_unstaged - spool.records_written);
+    status->storage_errors += staging.storage_errors;
+}
+
+const char *spool_medium_name(SpoolMedium medium) {
+    switch (medium) {
+        case SPOOL_PSRAM:
+            return "PSRAM";
+        case SPOOL_FLASH:
+            return "flash";
+        default:
+            return "none";
+    }
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "datagram_log.h"
+
+// Label of the flash partition datagrams are spooled to
+#define SPOOL_PARTITION_LABEL "spool"
+
+typedef enum {
+    SPOOL_NONE,
+    SPOOL_PSRAM,
+    SPOOL_FLASH
+} SpoolMedium;
+
+typedef struct {
+    SpoolMedium medium;
+    size_t capacity;
+    size_t bytes_used;
+    size_t num_datagrams;
+    unsigned long datagrams_spooled;
+    unsigned long datagrams_backfilled;
+    unsigned long datagrams_dropped;
+    unsigned long storage_errors;
+} SpoolStatus;
+
+int initialize_spool(void);
+bool spool_is_empty(void);
+int spool_datagram(const uint8_t datagram[], size_t length);
+int peek_spooled_datagram(uint8_t out_datagram[], size_t *out_length);
+void pop_spooled_datagram(void);
+void get_spool_status(SpoolStatus *status);
+const char *spool_medium_name(SpoolMedium medium);
@@ -1,31 +1,220 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdatomic.h>
 
 #include "lwip/netdb.h"
 #include "lwip/sockets.h"
 
 #include "freertos/FreeRTOS.h"
-#include "freertos/queue.h"
+#include "freertos/task.h"
 #include "freertos/semphr.h"
 
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+
+#include "adc.h"
+#include "vga.h"
+#include "telemetry.h"
+#include "telemetry_frame.h"
+#include "sample_framer.h"
+#include "miniseed.h"
+#include "decimator.h"
+#include "spectrum.h"
+#include "event_detector.h"
+#include "pipeline_stats.h"
+#include "diagnostic_inputs.h"
+#include "memory_plan.h"
+#include "spool.h"
+#include "sdkconfig.h"
 
 static const char* TAG = "telemetry";
 extern bool wifi_is_connected;
+extern PipelineStats pipeline_stats;
+
+#define DEFAULT_SEED_NETWORK "XX"
+#define DEFAULT_SEED_STATION "IEAR"
+#define DEFAULT_SEED_LOCATION "00"
+#define DEFAULT_SEED_CHANNEL "GDF"
+
+#define TELEMETRY_TASK_STACK_SIZE 8192
+#define TELEMETRY_TASK_PRIORITY 5
+#define TELEMETRY_TASK_CORE 0
+
+typedef struct {
+    int sd;
+    int family;
+    struct sockaddr_storage address;
+    socklen_t address_length;
+} TelemetryDestination;
+
+typedef struct {
+    SampleBroker *sample_broker;
+    uint64_t num_readings;
+    TelemetryFormat format;
+} TelemetrySession;
+
+static TaskHandle_t telemetry_task_handle;
+PLANNED_TASK(telemetry_task_plan, "telemetry", TELEMETRY_TASK_STACK_SIZE);
+static TelemetrySession session;
+static atomic_bool telemetry_running;
+static atomic_bool stop_requested;
+static SampleSubscriber *session_subscriber;
+
+// The resolved destination and its socket are kept between sessions, so 
+// restarting telemetry to the same host needs no DNS lookup.
+static TelemetryDestination destination = {
+    .sd = -1
+};
+static char destination_hostname[TELEMETRY_MAX_HOSTNAME_LENGTH + 1];
+static char destination_service[TELEMETRY_MAX_SERVICE_LENGTH + 1];
+
+static int64_t session_start_us;
+static atomic_ullong samples_consumed;
+static atomic_ulong datagrams_sent;
+static atomic_ullong bytes_sent;
+static atomic_ulong send_errors;
+
+// Microseconds since boot at which the first datagram since boot was sent, 
+// which is how long an unattended node takes to come back after a reset
+static int64_t first_datagram_time_us;
+
+// Spooled datagrams are backfilled at CONFIG_TELEMETRY_BACKFILL_RATE, 
+// alongside live ones, from a budget that builds up for at most a second
+static double backfill_budget;
+static int64_t last_backfill_time_us;
+static uint8_t backfill_datagram[TELEMETRY_FRAME_MAX_LENGTH];
+
+#define DEFAULT_STATS_INTERVAL 60.0
+
+static double stats_interval = DEFAULT_STATS_INTERVAL;
+static int64_t last_stats_time_us;
+
+// Timing of the block currently being processed, for the pipeline stats
+static uint32_t block_start_cycles;
+static uint32_t block_send_cycles;
+static int64_t newest_sample_time_us;
+
+static uint32_t frame_sequence;
+static MiniseedStream miniseed_stream;
+static bool miniseed_stream_initialized;
+
+// Requested rate, or 0 to not decimate. The cascade is built for it from 
+// the ADC rate when each session starts, as the ADC profile may change.
+static double decimation_output_rate;
+static DecimatorCascade decimator;
+static bool decimation_enabled;
+static SampleBlock decimated_block;
+static uint64_t next_input_sample_index;
+
+#define DEFAULT_SPECTRUM_FFT_LENGTH 1024
+#define DEFAULT_SPECTRUM_INTERVAL 60.0
+
+static SpectrumAnalyzer spectrum_analyzer;
+static unsigned int spectrum_fft_length = DEFAULT_SPECTRUM_FFT_LENGTH;
+static double spectrum_interval = DEFAULT_SPECTRUM_INTERVAL;
+static SpectrumBandType spectrum_band_type = SPECTRUM_BANDS_THIRD_OCTAVE;
 
-#define TELEMETRY_MAX_MESSAGE_LENGTH 100
+#define DEFAULT_TRIGGER_STA 1.0
+#define DEFAULT_TRIGGER_LTA 30.0
+#define DEFAULT_TRIGGER_RATIO 4.0
+#define DEFAULT_DETRIGGER_RATIO 1.5
+#define DEFAULT_PRE_TRIGGER 2.0
+#define DEFAULT_POST_TRIGGER 10.0
+#define DEFAULT_HEARTBEAT_INTERVAL 30.0
 
-int start_telemetry(char hostname[], char service[], QueueHandle_t adc_samples, int num_readings) {
+// Events longer than this are cut off, so a persistent disturbance cannot 
+// turn event telemetry into continuous telemetry.
+#define MAX_EVENT_DURATION 120.0
+
+typedef struct {
+    double sta;
+    double lta;
+    double trigger_ratio;
+    double detrigger_ratio;
+    double pre_trigger;
+    double post_trigger;
+    double heartbeat_interval;
+} TriggerSettings;
+
+static EventDetector event_detector;
+static TriggerSettings trigger_settings = {
+    .sta = DEFAULT_TRIGGER_STA,
+    .lta = DEFAULT_TRIGGER_LTA,
+    .trigger_ratio = DEFAULT_TRIGGER_RATIO,
+    .detrigger_ratio = DEFAULT_DETRIGGER_RATIO,
+    .pre_trigger = DEFAULT_PRE_TRIGGER,
+    .post_trigger = DEFAULT_POST_TRIGGER,
+    .heartbeat_interval = DEFAULT_HEARTBEAT_INTERVAL
+};
+
+static void transmit_sample_frames(TelemetryDestination *destination, SampleSubscriber *subscriber, uint64_t num_readings);
+static void transmit_miniseed_records(TelemetryDestination *destination, SampleSubscriber *subscriber, uint64_t num_readings);
+static void transmit_spectra(TelemetryDestination *destination, SampleSubscriber *subscriber, uint64_t num_readings);
+static void transmit_events(TelemetryDestination *destination, SampleSubscriber *subscriber, uint64_t num_readings);
+static int send_sample_frame(void *context, const TelemetrySampleHeader *header, const int32_t samples[]);
+static int send_datagram(TelemetryDestination *destination, const uint8_t datagram[], size_t length);
+static int send_stats(TelemetryDestination *destination);
+static int send_health(TelemetryDestination *destination);
+static void backfill_datagrams(TelemetryDestination *destination);
+static int initialize_decimation(void);
+
+/**
+ * @brief 
+ * Fill in the address of a destination given as a numeric IPv4 or IPv6 
+ * address and port, which needs no lookup and so no heap
+ * @return 0 if the destination is numeric
+ */
+static int parse_numeric_destination(
+    const char hostname[], 
+    const char service[], 
+    struct sockaddr_storage *out_address, 
+    socklen_t *out_address_length
+) {
+    char *end;
+    long port = strtol(service, &end, 10);
+    if (*service == '\0' || *end != '\0' || port < 0 || port > UINT16_MAX) {
+        return 1;
+    }
+
+    memset(out_address, 0, sizeof(*out_address));
+    struct sockaddr_in *ipv4 = (struct sockaddr_in *) out_address;
+    if (inet_pton(AF_INET, hostname, &ipv4->sin_addr) == 1) {
+        ipv4->sin_family = AF_INET;
+        ipv4->sin_port = htons(port);
+        *out_address_length = sizeof(*ipv4);
+        return 0;
+    }
+    struct sockaddr_in6 *ipv6 = (struct sockaddr_in6 *) out_address;
+    if (inet_pton(AF_INET6, hostname, &ipv6->sin6_addr) == 1) {
+        ipv6->sin6_family = AF_INET6;
+        ipv6->sin6_port = htons(port);
+        *out_address_length = sizeof(*ipv6);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief 
+ * Look up a destination by name. getaddrinfo allocates its results, so this 
+ * is only done when the destination changes.
+ * @return 0 if success
+ */
+static int lookup_destination(
+    const char hostname[], 
+    const char service[], 
+    struct sockaddr_storage *out_address, 
+    socklen_t *out_address_length
+) {
     struct addrinfo hints = {
         .ai_family = AF_UNSPEC,
         .ai_socktype = SOCK_DGRAM,
         .ai_flags = AI_PASSIVE
     };
-
-    if (! wifi_is_connected) {
-        fprintf(stderr, "error: Wifi is not connected. Aborting.\n");
-        return 1;
-    }
-
     struct addrinfo *servinfo;
 
     ESP_LOGI(TAG, "Requesting address info for %s", hostname);
@@ -37,42 +226,950 @@ int start_telemetry(char hostname[], char service[], QueueHandle_t adc_samples,
             hostname,
             error
         );
+        return 1;
+    }
+
+    memcpy(out_address, servinfo->ai_addr, servinfo->ai_addrlen);
+    *out_address_length = servinfo->ai_addrlen;
+    freeaddrinfo(servinfo);
+    return 0;
+}
+
+/**
+ * @brief 
+ * Find the destination's address and open a socket to it, unless it is the 
+ * destination of the previous session
+ * @return 0 if success
+ */
+static int resolve_destination(const char hostname[], const char service[]) {
+    if (strlen(hostname) > TELEMETRY_MAX_HOSTNAME_LENGTH || strlen(service) > TELEMETRY_MAX_SERVICE_LENGTH) {
+        ESP_LOGE(TAG, "Telemetry hostname or service is too long");
+        return 1;
+    }
+    if (destination.sd >= 0 && 
+        ! strcmp(hostname, destination_hostname) && 
+        ! strcmp(service, destination_service)) {
+        ESP_LOGI(TAG, "Reusing the telemetry socket to %s", hostname);
+        return 0;
+    }
+
+    struct sockaddr_storage address;
+    socklen_t address_length;
+    if (parse_numeric_destination(hostname, service, &address, &address_length) &&
+        lookup_destination(hostname, service, &address, &address_length)) {
+        return 1;
+    }
+
+    if (destination.sd >= 0 && destination.family != address.ss_family) {
+        close(destination.sd);
+        destination.sd = -1;
+    }
+    if (destination.sd < 0) {
+        ESP_LOGI(TAG, "Opening a UDP telemetry socket to %s", hostname);
+        destination.sd = socket(address.ss_family, SOCK_DGRAM, IPPROTO_UDP);
+        if (destination.sd < 0) {
+            ESP_LOGE(TAG, "Failed to open a telemetry socket");
             return 1;
+        }
+        destination.family = address.ss_family;
     }
 
-    ESP_LOGI(TAG, "Opening a UDP telemetry socket to %s", hostname);
-    int telemetry_sd = socket(
-        servinfo->ai_family, 
-        servinfo->ai_socktype, 
-        servinfo->ai_protocol
-    );
+    destination.address = address;
+    destination.address_length = address_length;
+
+    strcpy(destination_hostname, hostname);
+    strcpy(destination_service, service);
+    return 0;
+}
+
+static void run_telemetry_session(void) {
+    SampleSubscriber *subscriber = sample_broker_subscribe(session.sample_broker, CONFIG_SAMPLE_SUBSCRIBER_DEPTH);
+    if (subscriber == NULL) {
+        ESP_LOGE(TAG, "Failed to subscribe to samples");
+        return;
+    }
+    session_subscriber = subscriber;
 
     ESP_LOGI(TAG, "Beginning transmission of telemetry data");
-    for (int i = 0; i < num_readings; i++) {
-        int sample;
-        xQueueReceive(adc_samples, &sample, portMAX_DELAY);
-        char reading_data[TELEMETRY_MAX_MESSAGE_LENGTH];
-        int message_length = snprintf(reading_data, TELEMETRY_MAX_MESSAGE_LENGTH, "adcReading:%d", sample);
-
-        assert(message_length <= TELEMETRY_MAX_MESSAGE_LENGTH);
-
-        ESP_LOGD(TAG, "Sending telemetry reading packet: \"%s\"", reading_data);
-        int bytes_sent = sendto(
-            telemetry_sd, 
-            reading_data, 
-            message_length, 
+    switch (session.format) {
+        case TELEMETRY_FORMAT_BINARY:
+            transmit_sample_frames(&destination, subscriber, session.num_readings);
+            break;
+        case TELEMETRY_FORMAT_MINISEED:
+            transmit_miniseed_records(&destination, subscriber, session.num_readings);
+            break;
+        case TELEMETRY_FORMAT_SPECTRUM:
+            transmit_spectra(&destination, subscriber, session.num_readings);
+            break;
+        case TELEMETRY_FORMAT_EVENTS:
+            transmit_events(&destination, subscriber, session.num_readings);
+            break;
+    }
+
+    ESP_LOGI(
+        TAG, 
+        "Telemetry finished. %lu blocks delivered, %lu dropped",
+        (unsigned long) atomic_load(&subscriber->delivered),
+        (unsigned long) atomic_load(&subscriber->dropped)
+    );
+    session_subscriber = NULL;
+    sample_broker_unsubscribe(subscriber);
+}
+
+/**
+ * @brief 
+ * Runs one telemetry session each time it is notified
+ */
+static void telemetry_task(void *context) {
+    for ( ;; ) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        run_telemetry_session();
+        atomic_store(&telemetry_running, false);
+    }
+}
+
+static bool session_active(uint64_t readings_used, uint64_t num_readings) {
+    return readings_used < num_readings && ! atomic_load(&stop_requested);
+}
+
+/**
+ * @brief 
+ * Start streaming samples to a UDP destination in the background
+ * @param hostname 
+ * @param service Port or service name
+ * @param sample_broker Broker to subscribe to for samples
+ * @param num_readings Number of samples to send, or 0 to stream until stopped
+ * @param format Encoding of the datagrams
+ * @return 0 if success
+ */
+int start_telemetry(
+    const char hostname[], 
+    const char service[], 
+    SampleBroker *sample_broker, 
+    uint64_t num_readings, 
+    TelemetryFormat format
+) {
+    if (atomic_load(&telemetry_running)) {
+        fprintf(stderr, "error: Telemetry is already running.\n");
+        return 1;
+    }
+    if (! wifi_is_connected) {
+        fprintf(stderr, "error: Wifi is not connected. Aborting.\n");
+        return 1;
+    }
+    if (resolve_destination(hostname, service)) {
+        return 1;
+    }
+    if (initialize_decimation()) {
+        fprintf(stderr, "error: cannot decimate to %f samples per second at the current ADC rate\n", decimation_output_rate);
+        return 1;
+    }
+
+    if (telemetry_task_handle == NULL) {
+        initialize_spool();
+        telemetry_task_handle = start_planned_task(
+            &telemetry_task_plan,
+            telemetry_task,
+            NULL,
+            TELEMETRY_TASK_PRIORITY,
+            TELEMETRY_TASK_CORE
+        );
+        if (telemetry_task_handle == NULL) {
+            ESP_LOGE(TAG, "Failed to create telemetry task");
+            return 1;
+        }
+    }
+
+    session = (TelemetrySession) {
+        .sample_broker = sample_broker,
+        .num_readings = num_readings == 0 ? UINT64_MAX : num_readings,
+        .format = format
+    };
+    session_start_us = esp_timer_get_time();
+    last_stats_time_us = session_start_us;
+    atomic_store(&samples_consumed, 0);
+    atomic_store(&datagrams_sent, 0);
+    atomic_store(&bytes_sent, 0);
+    atomic_store(&send_errors, 0);
+    atomic_store(&stop_requested, false);
+    atomic_store(&telemetry_running, true);
+
+    xTaskNotifyGive(telemetry_task_handle);
+    return 0;
+}
+
+/**
+ * @brief 
+ * Stop the telemetry session and wait for it to flush what it has buffered
+ * @return 0 if success
+ */
+int stop_telemetry(void) {
+    if (! atomic_load(&telemetry_running)) {
+        fprintf(stderr, "error: Telemetry is not running.\n");
+        return 1;
+    }
+
+    atomic_store(&stop_requested, true);
+    while (atomic_load(&telemetry_running)) {
+        vTaskDelay(pdMS_TO_TICKS(SAMPLE_BUFFER_POLL_PERIOD_MS));
+    }
+    return 0;
+}
+
+/**
+ * @brief 
+ * Get the progress of the current or last telemetry session
+ * @param status 
+ */
+void get_telemetry_status(TelemetryStatus *status) {
+    *status = (TelemetryStatus) {
+        .running = atomic_load(&telemetry_running),
+        .format = session.format,
+        .elapsed = (esp_timer_get_time() - session_start_us) / 1E6,
+        .samples_consumed = atomic_load(&samples_consumed),
+        .datagrams_sent = atomic_load(&datagrams_sent),
+        .bytes_sent = atomic_load(&bytes_sent),
+        .send_errors = atomic_load(&send_errors),
+        .first_datagram_time_us = first_datagram_time_us
+    };
+    strcpy(status->hostname, destination_hostname);
+    strcpy(status->service, destination_service);
+
+    // The subscriber is only valid while the session holds it
+    SampleSubscriber *subscriber = session_subscriber;
+    if (status->running && subscriber != NULL) {
+        status->queue_depth = sample_subscriber_count(subscriber);
+        status->queue_high_water = atomic_load(&subscriber->high_water);
+        status->blocks_dropped = atomic_load(&subscriber->dropped);
+    }
+}
+
+/**
+ * @brief 
+ * Set the SEED identifiers used for miniSEED telemetry. Refused while 
+ * telemetry is running, as the session encodes with the stream.
+ * @return 0 if success
+ */
+int set_telemetry_stream_id(
+    const char network[], 
+    const char station[], 
+    const char location[], 
+    const char channel[]
+) {
+    if (atomic_load(&telemetry_running)) {
+        ESP_LOGE(TAG, "Cannot change the stream ID while telemetry is running");
+        return 1;
+    }
+    if (miniseed_stream_initialize(&miniseed_stream, network, station, location, channel)) {
+        return 1;
+    }
+    miniseed_stream_initialized = true;
+    return 0;
+}
+
+/**
+ * @brief 
+ * @param block 
+ * @return UTC time of the first sample of `block`, in microseconds since the Unix epoch
+ */
+static int64_t block_utc_time_us(const SampleBlock *block) {
+    return block->utc_time_us;
+}
+
+/**
+ * @brief 
+ * Build the decimator for the requested rate from the current ADC rate
+ * @return 0 if success
+ */
+static int initialize_decimation(void) {
+    if (decimation_output_rate == 0) {
+        decimation_enabled = false;
+        return 0;
+    }
+
+    if (decimator_cascade_initialize(&decimator, get_adc_sample_rate(), decimation_output_rate)) {
+        ESP_LOGE(TAG, "Cannot decimate %f samples per second to %f", get_adc_sample_rate(), decimation_output_rate);
+        decimation_enabled = false;
+        return 1;
+    }
+    ESP_LOGI(TAG, "Decimating by %u in %u stages", decimator.factor, decimator.num_stages);
+    decimation_enabled = true;
+    next_input_sample_index = UINT64_MAX;
+    return 0;
+}
+
+/**
+ * @brief 
+ * Decimate telemetry to a lower sample rate. Refused while telemetry is 
+ * running, as the session filters with the decimator.
+ * @param output_rate Samples per second, or 0 to send samples at the ADC rate
+ * @return 0 if success
+ */
+int set_telemetry_decimation(double output_rate) {
+    if (atomic_load(&telemetry_running)) {
+        ESP_LOGE(TAG, "Cannot change the decimation while telemetry is running");
+        return 1;
+    }
+
+    double previous_rate = decimation_output_rate;
+    decimation_output_rate = output_rate;
+    if (initialize_decimation()) {
+        decimation_output_rate = previous_rate;
+        return 1;
+    }
+    return 0;
+}
+
+static double telemetry_sample_rate(void) {
+    return decimation_enabled ? decimator.output_rate : get_adc_sample_rate();
+}
+
+/**
+ * @brief 
+ * Get the next block of samples to transmit, decimated if enabled. Sample 
+ * indexes and timestamps of decimated blocks are in terms of the output rate.
+ * @param subscriber 
+ * @return Block to release with `release_telemetry_block`, or NULL if none is ready
+ */
+static const SampleBlock *acquire_telemetry_block(SampleSubscriber *subscriber) {
+    // Only sample frame telemetry carries stats and health frames, so that 
+    // miniSEED stays pure records and the spectrum and event modes send only 
+    // their summaries
+    if (session.format == TELEMETRY_FORMAT_BINARY && stats_interval > 0 && 
+        esp_timer_get_time() - last_stats_time_us >= stats_interval * 1E6) {
+        last_stats_time_us = esp_timer_get_time();
+        send_stats(&destination);
+        send_health(&destination);
+    }
+    backfill_datagrams(&destination);
+
+    const SampleBlock *block = sample_subscriber_receive(subscriber);
+    if (block == NULL) {
+        return NULL;
+    }
+    atomic_fetch_add(&samples_consumed, block->length);
+    block_start_cycles = esp_cpu_get_cycle_count();
+    block_send_cycles = 0;
+    newest_sample_time_us = block->timestamp_us + 
+        (int64_t) ((block->length - 1) * 1E6 / get_adc_sample_rate());
+
+    if (! decimation_enabled) {
+        return block;
+    }
+
+    if (block->first_sample_index != next_input_sample_index) {
+        decimator_cascade_reset(&decimator, block->first_sample_index);
+    }
+    next_input_sample_index = block->first_sample_index + block->length;
+
+    // The first output of this block is computed from input sample 
+    // `first_output * factor + factor - 1`
+    uint64_t first_output = block->first_sample_index / decimator.factor;
+    double first_output_input_index = (double) first_output * decimator.factor + decimator.factor - 1;
+    double output_offset = first_output_input_index - block->first_sample_index - decimator_cascade_delay(&decimator);
+
+    memcpy(decimated_block.samples, block->samples, block->length * sizeof(int32_t));
+    decimated_block.length = decimator_cascade_process(&decimator, decimated_block.samples, block->length);
+    stats_histogram_record(
+        &pipeline_stats.histograms[STATS_DECIMATION], esp_cpu_get_cycle_count() - block_start_cycles);
+    decimated_block.first_sample_index = first_output;
+    decimated_block.timestamp_us = block->timestamp_us + (int64_t) (output_offset * 1E6 / get_adc_sample_rate());
+    decimated_block.utc_time_us = block->utc_time_us + (int64_t) (output_offset * 1E6 / get_adc_sample_rate());
+    decimated_block.flags = block->flags;
+    decimated_block.vga_gain = block->vga_gain;
+
+    sample_block_release(block);
+    return &decimated_block;
+}
+
+/**
+ * @brief 
+ * Finish with a block from `acquire_telemetry_block`. The time since it was 
+ * acquired, less the time spent sending, is recorded as processing time.
+ */
+static void release_telemetry_block(const SampleBlock *block) {
+    if (block != &decimated_block) {
+        sample_block_release(block);
+    }
+    uint32_t block_cycles = esp_cpu_get_cycle_count() - block_start_cycles;
+    stats_histogram_record(&pipeline_stats.histograms[STATS_PROCESSING], block_cycles - block_send_cycles);
+}
+
+static void transmit_sample_frames(TelemetryDestination *destination, SampleSubscriber *subscriber, uint64_t num_readings) {
+    static SampleFramer framer;
+    sample_framer_initialize(&framer, send_sample_frame, destination);
+
+    uint64_t readings_sent = 0;
+    while (session_active(readings_sent, num_readings)) {
+        const SampleBlock *block = acquire_telemetry_block(subscriber);
+        if (block == NULL) {
+            vTaskDelay(pdMS_TO_TICKS(SAMPLE_BUFFER_POLL_PERIOD_MS));
+            continue;
+        }
+        readings_sent += sample_framer_add_block(&framer, block, num_readings - readings_sent, telemetry_sample_rate());
+        release_telemetry_block(block);
+    }
+    sample_framer_flush(&framer);
+}
+
+/**
+ * @brief 
+ * Encode and send records until fewer than `min_samples` samples are pending. 
+ * Each record starts at the time of its first sample, taken from the block 
+ * it came in, so that records follow corrections to the clock rather than 
+ * running on from the first.
+ * @param pending_times_us UTC time of each pending sample
+ * @return Number of samples still pending
+ */
+static size_t send_miniseed_records(
+    TelemetryDestination *destination,
+    int32_t pending_samples[],
+    int64_t pending_times_us[],
+    size_t num_pending,
+    size_t min_samples
+) {
+    double sample_rate = telemetry_sample_rate();
+    size_t samples_sent = 0;
+    while (num_pending - samples_sent >= min_samples && num_pending > samples_sent) {
+        uint8_t record[MINISEED_RECORD_LENGTH];
+        size_t encoded = miniseed_encode_record(
+            &miniseed_stream, 
+            record, 
+            pending_samples + samples_sent, 
+            num_pending - samples_sent, 
+            pending_times_us[samples_sent], 
+            sample_rate
+        );
+        send_datagram(destination, record, MINISEED_RECORD_LENGTH);
+
+        samples_sent += encoded;
+    }
+
+    memmove(pending_samples, pending_samples + samples_sent, (num_pending - samples_sent) * sizeof(int32_t));
+    memmove(pending_times_us, pending_times_us + samples_sent, (num_pending - samples_sent) * sizeof(int64_t));
+    return num_pending - samples_sent;
+}
+
+static void transmit_miniseed_records(TelemetryDestination *destination, SampleSubscriber *subscriber, uint64_t num_readings) {
+    if (! miniseed_stream_initialized) {
+        set_telemetry_stream_id(
+            DEFAULT_SEED_NETWORK, 
+            DEFAULT_SEED_STATION, 
+            DEFAULT_SEED_LOCATION, 
+            DEFAULT_SEED_CHANNEL
+        );
+    }
+    miniseed_stream_reset(&miniseed_stream);
+
+    // Samples are held back until a full record's worth is available, so that 
+    // records are only sent part filled at gaps and at the end of the stream.
+    static int32_t pending_samples[MINISEED_MAX_RECORD_SAMPLES + SAMPLE_BLOCK_LENGTH];
+    static int64_t pending_times_us[MINISEED_MAX_RECORD_SAMPLES + SAMPLE_BLOCK_LENGTH];
+    size_t num_pending = 0;
+    uint64_t next_sample_index = 0;
+    double sample_rate = telemetry_sample_rate();
+
+    uint64_t readings_sent = 0;
+    while (session_active(readings_sent, num_readings)) {
+        const SampleBlock *block = acquire_telemetry_block(subscriber);
+        if (block == NULL) {
+            vTaskDelay(pdMS_TO_TICKS(SAMPLE_BUFFER_POLL_PERIOD_MS));
+            continue;
+        }
+
+        if (num_pending > 0 && block->first_sample_index != next_sample_index) {
+            num_pending = send_miniseed_records(destination, pending_samples, pending_times_us, num_pending, 1);
+            miniseed_stream_reset(&miniseed_stream);
+        }
+
+        uint64_t block_readings = block->length;
+        if (block_readings > num_readings - readings_sent) {
+            block_readings = num_readings - readings_sent;
+        }
+        memcpy(pending_samples + num_pending, block->samples, block_readings * sizeof(int32_t));
+        int64_t block_time_us = block_utc_time_us(block);
+        for (uint64_t i = 0; i < block_readings; i++) {
+            pending_times_us[num_pending + i] = block_time_us + (int64_t) (i * 1E6 / sample_rate);
+        }
+        num_pending += block_readings;
+        readings_sent += block_readings;
+        next_sample_index = block->first_sample_index + block->length;
+        release_telemetry_block(block);
+
+        num_pending = send_miniseed_records(
+            destination, 
+            pending_samples, 
+            pending_times_us, 
+            num_pending, 
+            MINISEED_MAX_RECORD_SAMPLES
+        );
+    }
+    send_miniseed_records(destination, pending_samples, pending_times_us, num_pending, 1);
+}
+
+/**
+ * @brief 
+ * Configure the spectra sent in spectrum telemetry
+ * @param fft_length Welch segment length, a power of two
+ * @param interval Seconds of samples averaged into each spectrum
+ * @param band_type Fractional octave band powers to include
+ * @return 0 if success
+ */
+int set_telemetry_spectrum(unsigned int fft_length, double interval, SpectrumBandType band_type) {
+    if (fft_length < SPECTRUM_MIN_FFT_LENGTH || 
+        fft_length > SPECTRUM_MAX_FFT_LENGTH || 
+        (fft_length & (fft_length - 1)) != 0 ||
+        interval <= 0) {
+        return 1;
+    }
+    spectrum_fft_length = fft_length;
+    spectrum_interval = interval;
+    spectrum_band_type = band_type;
+    return 0;
+}
+
+static int send_spectrum(TelemetryDestination *destination, const SpectrumAnalyzer *analyzer) {
+    TelemetrySpectrumHeader header = {
+        .first_sample_index = analyzer->estimate_first_sample_index,
+        .sample_rate_mhz = (uint32_t) lround(analyzer->sample_rate * 1000),
+        .vga_gain = get_vga_gain(),
+        .bands_per_octave = analyzer->band_type,
+        .fft_length = analyzer->fft_length,
+        .num_averages = analyzer->num_averages,
+        .num_bins = analyzer->fft_length / 2 + 1,
+        .num_bands = analyzer->num_bands
+    };
+
+    float band_centers[SPECTRUM_MAX_BANDS];
+    float band_powers[SPECTRUM_MAX_BANDS];
+    for (unsigned int b = 0; b < analyzer->num_bands; b++) {
+        band_centers[b] = analyzer->bands[b].center_frequency;
+        band_powers[b] = analyzer->bands[b].power;
+    }
+
+    uint8_t frame[TELEMETRY_FRAME_MAX_LENGTH];
+    size_t frame_length = telemetry_frame_encode_spectrum(
+        frame, frame_sequence++, &header, analyzer->psd, band_centers, band_powers);
+    return send_datagram(destination, frame, frame_length);
+}
+
+/**
+ * @brief 
+ * Send Welch spectra of the samples instead of the samples themselves
+ */
+static void transmit_spectra(TelemetryDestination *destination, SampleSubscriber *subscriber, uint64_t num_readings) {
+    double sample_rate = telemetry_sample_rate();
+    unsigned int hop_length = spectrum_fft_length / 2;
+    double interval_samples = spectrum_interval * sample_rate;
+    unsigned int num_averages = 1;
+    if (interval_samples > spectrum_fft_length) {
+        num_averages = (unsigned int) ((interval_samples - spectrum_fft_length) / hop_length) + 1;
+    }
+
+    if (spectrum_analyzer_initialize(
+            &spectrum_analyzer, sample_rate, spectrum_fft_length, num_averages, spectrum_band_type)) {
+        ESP_LOGE(TAG, "Failed to set up the spectrum analyzer");
+        return;
+    }
+    ESP_LOGI(TAG, "Sending spectra of %u averaged segments", num_averages);
+
+    uint64_t next_sample_index = 0;
+    uint64_t readings_used = 0;
+    while (session_active(readings_used, num_readings)) {
+        const SampleBlock *block = acquire_telemetry_block(subscriber);
+        if (block == NULL) {
+            vTaskDelay(pdMS_TO_TICKS(SAMPLE_BUFFER_POLL_PERIOD_MS));
+            continue;
+        }
+
+        if (block->first_sample_index != next_sample_index) {
+            spectrum_analyzer_reset(&spectrum_analyzer);
+        }
+        next_sample_index = block->first_sample_index + block->length;
+
+        size_t consumed = 0;
+        while (consumed < block->length) {
+            consumed += spectrum_analyzer_process(
+                &spectrum_analyzer, 
+                block->samples + consumed, 
+                block->length - consumed, 
+                block->first_sample_index + consumed
+            );
+            if (spectrum_analyzer.estimate_ready) {
+                send_spectrum(destination, &spectrum_analyzer);
+                spectrum_analyzer_clear_estimate(&spectrum_analyzer);
+            }
+        }
+        readings_used += block->length;
+        release_telemetry_block(block);
+    }
+}
+
+/**
+ * @brief 
+ * Configure the STA/LTA trigger used by event telemetry. Times are in seconds.
+ * @param sta Short term average window
+ * @param lta Long term average window, longer than `sta`
+ * @param trigger_ratio STA/LTA ratio that starts an event
+ * @param detrigger_ratio STA/LTA ratio below which an event starts to end
+ * @param pre_trigger Samples kept from before the trigger
+ * @param post_trigger Samples kept after the ratio falls below `detrigger_ratio`
+ * @param heartbeat_interval Time between heartbeats while no event is in progress
+ * @return 0 if success
+ */
+int set_telemetry_trigger(
+    double sta, 
+    double lta, 
+    double trigger_ratio, 
+    double detrigger_ratio, 
+    double pre_trigger, 
+    double post_trigger,
+    double heartbeat_interval
+) {
+    if (sta <= 0 || lta <= sta || 
+        detrigger_ratio <= 0 || trigger_ratio <= detrigger_ratio ||
+        pre_trigger < 0 || post_trigger < 0 || heartbeat_interval <= 0) {
+        return 1;
+    }
+    trigger_settings = (TriggerSettings) {
+        .sta = sta,
+        .lta = lta,
+        .trigger_ratio = trigger_ratio,
+        .detrigger_ratio = detrigger_ratio,
+        .pre_trigger = pre_trigger,
+        .post_trigger = post_trigger,
+        .heartbeat_interval = heartbeat_interval
+    };
+    return 0;
+}
+
+typedef struct {
+    TelemetryEventHeader header;
+    int32_t samples[TELEMETRY_EVENT_MAX_SAMPLES];
+} EventChunk;
+
+static int send_event_chunk(TelemetryDestination *destination, EventChunk *chunk, bool last) {
+    chunk->header.flags = 
+        (chunk->header.chunk_number == 0 ? TELEMETRY_EVENT_FIRST_CHUNK : 0) | 
+        (last ? TELEMETRY_EVENT_LAST_CHUNK : 0);
+    chunk->header.peak_ratio = event_detector.peak_ratio;
+
+    uint8_t frame[TELEMETRY_FRAME_MAX_LENGTH];
+    size_t frame_length = telemetry_frame_encode_event(frame, frame_sequence++, &chunk->header, chunk->samples);
+    chunk->header.chunk_number++;
+    chunk->header.num_samples = 0;
+
+    return send_datagram(destination, frame, frame_length);
+}
+
+/**
+ * @brief 
+ * Add a sample to the current event chunk. A full chunk is sent before the 
+ * sample is added, so there is always a sample left for the last chunk.
+ */
+static void append_event_sample(
+    TelemetryDestination *destination, 
+    EventChunk *chunk, 
+    int32_t sample, 
+    uint64_t sample_index
+) {
+    if (chunk->header.num_samples == TELEMETRY_EVENT_MAX_SAMPLES) {
+        send_event_chunk(destination, chunk, false);
+    }
+    if (chunk->header.num_samples == 0) {
+        chunk->header.first_sample_index = sample_index;
+    }
+    chunk->samples[chunk->header.num_samples++] = sample;
+}
+
+static void begin_event(
+    TelemetryDestination *destination, 
+    EventChunk *chunk, 
+    double sample_rate,
+    uint64_t trigger_sample_index
+) {
+    static int32_t pre_trigger_samples[EVENT_MAX_PRE_TRIGGER_LENGTH];
+
+    chunk->header = (TelemetryEventHeader) {
+        .event_number = event_detector.num_events,
+        .chunk_number = 0,
+        .vga_gain = get_vga_gain(),
+        .trigger_sample_index = trigger_sample_index,
+        .sample_rate_mhz = (uint32_t) lround(sample_rate * 1000),
+        .num_samples = 0
+    };
+    ESP_LOGI(TAG, "Event %lu triggered at sample %llu", 
+        (unsigned long) chunk->header.event_number, (unsigned long long) trigger_sample_index);
+
+    size_t num_pre_trigger = event_detector_pre_trigger(&event_detector, pre_trigger_samples);
+    for (size_t i = 0; i < num_pre_trigger; i++) {
+        append_event_sample(
+            destination, chunk, pre_trigger_samples[i], trigger_sample_index - num_pre_trigger + i);
+    }
+}
+
+static int send_heartbeat(TelemetryDestination *destination, double sample_rate, uint64_t last_sample_index) {
+    TelemetryHeartbeat heartbeat = {
+        .last_sample_index = last_sample_index,
+        .sample_rate_mhz = (uint32_t) lround(sample_rate * 1000),
+        .vga_gain = get_vga_gain(),
+        .detector_state = event_detector.in_event ? TELEMETRY_DETECTOR_IN_EVENT :
+            event_detector_is_warming_up(&event_detector) ? TELEMETRY_DETECTOR_WARMING_UP : 
+            TELEMETRY_DETECTOR_IDLE,
+        .sta = event_detector.sta,
+        .lta = event_detector.lta,
+        .num_events = event_detector.num_events
+    };
+
+    uint8_t frame[TELEMETRY_FRAME_MAX_LENGTH];
+    size_t frame_length = telemetry_frame_encode_heartbeat(frame, frame_sequence++, &heartbeat);
+    return send_datagram(destination, frame, frame_length);
+}
+
+/**
+ * @brief 
+ * Only send samples around events found by the STA/LTA trigger, with 
+ * periodic heartbeats in between so the receiver knows the node is alive.
+ */
+static void transmit_events(TelemetryDestination *destination, SampleSubscriber *subscriber, uint64_t num_readings) {
+    double sample_rate = telemetry_sample_rate();
+    EventDetectorConfig config = {
+        .sta_length = (unsigned int) lround(trigger_settings.sta * sample_rate),
+        .lta_length = (unsigned int) lround(trigger_settings.lta * sample_rate),
+        .trigger_ratio = trigger_settings.trigger_ratio,
+        .detrigger_ratio = trigger_settings.detrigger_ratio,
+        .pre_trigger_length = (unsigned int) lround(trigger_settings.pre_trigger * sample_rate),
+        .post_trigger_length = (unsigned int) lround(trigger_settings.post_trigger * sample_rate),
+        .max_event_length = (unsigned int) lround(MAX_EVENT_DURATION * sample_rate)
+    };
+    if (config.pre_trigger_length > EVENT_MAX_PRE_TRIGGER_LENGTH) {
+        ESP_LOGW(TAG, "Pre-trigger limited to %d samples", EVENT_MAX_PRE_TRIGGER_LENGTH);
+        config.pre_trigger_length = EVENT_MAX_PRE_TRIGGER_LENGTH;
+    }
+    if (event_detector_initialize(&event_detector, &config)) {
+        ESP_LOGE(TAG, "Invalid trigger settings for %f samples per second", sample_rate);
+        return;
+    }
+
+    static EventChunk chunk;
+    uint64_t heartbeat_length = (uint64_t) (trigger_settings.heartbeat_interval * sample_rate);
+    uint64_t samples_since_heartbeat = 0;
+    uint64_t next_sample_index = 0;
+    uint64_t readings_used = 0;
+    while (session_active(readings_used, num_readings)) {
+        const SampleBlock *block = acquire_telemetry_block(subscriber);
+        if (block == NULL) {
+            vTaskDelay(pdMS_TO_TICKS(SAMPLE_BUFFER_POLL_PERIOD_MS));
+            continue;
+        }
+
+        // The averages and the pre-trigger samples are only meaningful over 
+        // consecutive samples, so a gap ends any event and restarts the detector.
+        if (block->first_sample_index != next_sample_index) {
+            if (event_detector.in_event) {
+                send_event_chunk(destination, &chunk, true);
+            }
+            event_detector_reset(&event_detector);
+        }
+        next_sample_index = block->first_sample_index + block->length;
+
+        for (int i = 0; i < block->length; i++) {
+            uint64_t sample_index = block->first_sample_index + i;
+            int32_t sample = block->samples[i];
+            switch (event_detector_update(&event_detector, sample, sample_index)) {
+                case EVENT_NONE:
+                    break;
+                case EVENT_TRIGGERED:
+                    begin_event(destination, &chunk, sample_rate, sample_index);
+                    append_event_sample(destination, &chunk, sample, sample_index);
+                    break;
+                case EVENT_CONTINUING:
+                    append_event_sample(destination, &chunk, sample, sample_index);
+                    break;
+                case EVENT_FINISHED:
+                    append_event_sample(destination, &chunk, sample, sample_index);
+                    send_event_chunk(destination, &chunk, true);
+                    break;
+            }
+
+            if (++samples_since_heartbeat >= heartbeat_length && ! event_detector.in_event) {
+                send_heartbeat(destination, sample_rate, sample_index);
+                samples_since_heartbeat = 0;
+            }
+        }
+        readings_used += block->length;
+        release_telemetry_block(block);
+    }
+    if (event_detector.in_event) {
+        send_event_chunk(destination, &chunk, true);
+    }
+}
+
+/**
+ * @brief 
+ * Pack samples into a frame and send it to the destination `context`
+ * @return 0 if success
+ */
+static int send_sample_frame(void *context, const TelemetrySampleHeader *header, const int32_t samples[]) {
+    uint8_t frame[TELEMETRY_FRAME_MAX_LENGTH];
+    size_t frame_length = telemetry_frame_encode_samples(frame, frame_sequence++, header, samples);
+    return send_datagram(context, frame, frame_length);
+}
+
+/**
+ * @brief 
+ * Keep a datagram that could not be sent, to backfill once the link is back
+ * @return 0 if spooled
+ */
+static int spool_unsent_datagram(const uint8_t datagram[], size_t length) {
+    if (spool_datagram(datagram, length)) {
+        return 1;
+    }
+    SpoolStatus status;
+    get_spool_status(&status);
+    pipeline_stats.counters[STATS_DATAGRAMS_SPOOLED]++;
+    pipeline_stats.counters[STATS_SPOOL_DROPPED] = status.datagrams_dropped;
+    return 0;
+}
+
+/**
+ * @brief 
+ * Send spooled datagrams, oldest first, as far as the backfill budget 
+ * allows. Telemetry frames are flagged as backfilled; miniSEED records carry 
+ * their own start times and are sent unchanged.
+ */
+static void backfill_datagrams(TelemetryDestination *destination) {
+    int64_t now_us = esp_timer_get_time();
+    backfill_budget += (now_us - last_backfill_time_us) * CONFIG_TELEMETRY_BACKFILL_RATE / 1E6;
+    if (backfill_budget > CONFIG_TELEMETRY_BACKFILL_RATE) {
+        backfill_budget = CONFIG_TELEMETRY_BACKFILL_RATE;
+    }
+    last_backfill_time_us = now_us;
+
+    while (wifi_is_connected && backfill_budget >= 1 && ! spool_is_empty()) {
+        size_t length;
+        if (peek_spooled_datagram(backfill_datagram, &length)) {
+            return;
+        }
+        telemetry_frame_set_flags(backfill_datagram, length, TELEMETRY_FRAME_BACKFILLED);
+        int result = sendto(
+            destination->sd, 
+            backfill_datagram, 
+            length, 
             0, 
-            servinfo->ai_addr,
-            sizeof(struct sockaddr_storage)
+            (const struct sockaddr *) &destination->address,
+            destination->address_length
         );
-        if (bytes_sent == -1) {
-            ESP_LOGE(TAG, "Failed to send a telemetry reading packet!");
+        if (result == -1) {
+            return;
         }
+        pop_spooled_datagram();
+        backfill_budget -= 1;
+        pipeline_stats.counters[STATS_DATAGRAMS_BACKFILLED]++;
     }
+}
 
-    close(telemetry_sd);
-    freeaddrinfo(servinfo);
+/**
+ * @brief 
+ * Send a datagram now, or spool it if the link is down or the send fails
+ * @return 0 if sent
+ */
+static int send_datagram(TelemetryDestination *destination, const uint8_t datagram[], size_t length) {
+    // Offline, a datagram the spool cannot keep is lost rather than sent
+    if (! wifi_is_connected) {
+        spool_unsent_datagram(datagram, length);
+        return 1;
+    }
+
+    ESP_LOGD(TAG, "Sending telemetry datagram of %u bytes", (unsigned int) length);
+    uint32_t start_cycles = esp_cpu_get_cycle_count();
+    int result = sendto(
+        destination->sd, 
+        datagram, 
+        length, 
+        0, 
+        (const struct sockaddr *) &destination->address,
+        destination->address_length
+    );
+    uint32_t send_cycles = esp_cpu_get_cycle_count() - start_cycles;
+    block_send_cycles += send_cycles;
+    stats_histogram_record(&pipeline_stats.histograms[STATS_SEND], send_cycles);
+
+    if (result == -1) {
+        pipeline_stats.counters[STATS_SEND_ERRORS]++;
+        // Sends fail continuously while Wi-Fi is down, so only log as the 
+        // error count passes each power of two.
+        unsigned long errors = atomic_fetch_add(&send_errors, 1) + 1;
+        if ((errors & (errors - 1)) == 0) {
+            ESP_LOGE(TAG, "Failed to send a telemetry datagram! %lu failures so far", errors);
+        }
+        spool_unsent_datagram(datagram, length);
+        return 1;
+    }
+    if (first_datagram_time_us == 0) {
+        first_datagram_time_us = esp_timer_get_time();
+        ESP_LOGI(TAG, "First telemetry datagram sent %lld ms after boot", (long long) (first_datagram_time_us / 1000));
+    }
+    atomic_fetch_add(&datagrams_sent, 1);
+    atomic_fetch_add(&bytes_sent, length);
+    pipeline_stats.counters[STATS_DATAGRAMS_SENT]++;
 
+    int64_t sample_age_us = esp_timer_get_time() - newest_sample_time_us;
+    stats_histogram_record(
+        &pipeline_stats.histograms[STATS_SAMPLE_TO_PACKET], 
+        sample_age_us > 0 ? (uint32_t) sample_age_us : 0
+    );
     return 0;
 }
 
+/**
+ * @brief 
+ * Send a snapshot of the pipeline stats
+ * @return 0 if success
+ */
+static int send_stats(TelemetryDestination *destination) {
+    uint8_t frame[TELEMETRY_FRAME_MAX_LENGTH];
+    size_t frame_length = telemetry_frame_encode_stats(
+        frame, 
+        frame_sequence++, 
+        esp_timer_get_time(), 
+        esp_rom_get_cpu_ticks_per_us() * 1000000, 
+        &pipeline_stats
+    );
+    return send_datagram(destination, frame, frame_length);
+}
+
+/**
+ * @brief 
+ * Send the health of the diagnostic inputs
+ * @return 0 if success
+ */
+static int send_health(TelemetryDestination *destination) {
+    InputHealthSummary inputs[DIAGNOSTIC_NUM_INPUTS];
+    get_input_health(inputs);
+
+    TelemetryHealthHeader header = {
+        .uptime_us = esp_timer_get_time(),
+        .reading_period = health_reading_period(),
+        .oversampling = CONFIG_DIAGNOSTIC_OVERSAMPLING,
+        .num_inputs = DIAGNOSTIC_NUM_INPUTS
+    };
+    uint8_t frame[TELEMETRY_FRAME_MAX_LENGTH];
+    size_t frame_length = telemetry_frame_encode_health(frame, frame_sequence++, &header, inputs);
+    return send_datagram(destination, frame, frame_length);
+}
+
+/**
+ * @brief 
+ * Set how often pipeline stats and input health records are sent while 
+ * binary telemetry runs
+ * @param interval Seconds between records, or 0 to stop sending them
+ * @return 0 if success
+ */
+int set_telemetry_stats_interval(double interval) {
+    if (interval < 0) {
+        return 1;
+    }
+    stats_interval = interval;
+    return 0;
+}
@@ -1,4 +1,62 @@
-#include "freertos/FreeRTOS.h"
-#include "freertos/queue.h"
+#pragma once
 
-int start_telemetry(char hostname[], char service[], QueueHandle_t adc_samples, int num_readings);
\ No newline at end of file
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sample_broker.h"
+#include "spectrum.h"
+
+#define TELEMETRY_MAX_HOSTNAME_LENGTH 128
+#define TELEMETRY_MAX_SERVICE_LENGTH 16
+
+typedef enum {
+    TELEMETRY_FORMAT_BINARY,
+    TELEMETRY_FORMAT_MINISEED,
+    TELEMETRY_FORMAT_SPECTRUM,
+    TELEMETRY_FORMAT_EVENTS
+} TelemetryFormat;
+
+typedef struct {
+    bool running;
+    TelemetryFormat format;
+    char hostname[TELEMETRY_MAX_HOSTNAME_LENGTH + 1];
+    char service[TELEMETRY_MAX_SERVICE_LENGTH + 1];
+    double elapsed;
+    uint64_t samples_consumed;
+    unsigned long datagrams_sent;
+    uint64_t bytes_sent;
+    unsigned long send_errors;
+    // Microseconds since boot of the first datagram sent since boot, 0 if none
+    int64_t first_datagram_time_us;
+    size_t queue_depth;
+    size_t queue_high_water;
+    unsigned long blocks_dropped;
+} TelemetryStatus;
+
+int start_telemetry(
+    const char hostname[], 
+    const char service[], 
+    SampleBroker *sample_broker, 
+    uint64_t num_readings, 
+    TelemetryFormat format
+);
+int stop_telemetry(void);
+void get_telemetry_status(TelemetryStatus *status);
+int set_telemetry_stream_id(
+    const char network[], 
+    const char station[], 
+    const char location[], 
+    const char channel[]
+);
+int set_telemetry_decimation(double output_rate);
+int set_telemetry_spectrum(unsigned int fft_length, double interval, SpectrumBandType band_type);
+int set_telemetry_trigger(
+    double sta, 
+    double lta, 
+    double trigger_ratio, 
+    double detrigger_ratio, 
+    double pre_trigger, 
+    double post_trigger,
+    double heartbeat_interval
+);
+int set_telemetry_stats_interval(double interval);
\ No newline at end of file
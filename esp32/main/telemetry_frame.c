@@ -0,0 +1,651 @@
+#include <assert.h>
+#include <string.h>
+#include <math.h>
+
+#include "telemetry_frame.h"
+
+static void put_u16(uint8_t *destination, uint16_t value) {
+    destination[0] = value >> 8;
+    destination[1] = value;
+}
+
+static void put_u32(uint8_t *destination, uint32_t value) {
+    put_u16(destination, value >> 16);
+    put_u16(destination + 2, value);
+}
+
+static void put_u64(uint8_t *destination, uint64_t value) {
+    put_u32(destination, value >> 32);
+    put_u32(destination + 4, value);
+}
+
+static uint16_t get_u16(const uint8_t *source) {
+    return ((uint16_t) source[0] << 8) | source[1];
+}
+
+static uint32_t get_u32(const uint8_t *source) {
+    return ((uint32_t) get_u16(source) << 16) | get_u16(source + 2);
+}
+
+static uint64_t get_u64(const uint8_t *source) {
+    return ((uint64_t) get_u32(source) << 32) | get_u32(source + 4);
+}
+
+static void put_float(uint8_t *destination, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    put_u32(destination, bits);
+}
+
+static float get_float(const uint8_t *source) {
+    uint32_t bits = get_u32(source);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/**
+ * @brief 
+ * CRC-32 as used by Ethernet and zlib, computed a nibble at a time to keep the 
+ * lookup table small.
+ * @param data 
+ * @param length 
+ * @return CRC of `data`
+ */
+uint32_t telemetry_crc32(const uint8_t data[], size_t length) {
+    static const uint32_t nibble_table[16] = {
+        0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac,
+        0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+        0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+        0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+    };
+
+    uint32_t crc = 0xffffffff;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ nibble_table[crc & 0xf];
+        crc = (crc >> 4) ^ nibble_table[crc & 0xf];
+    }
+    return ~crc;
+}
+
+static uint8_t *begin_frame(uint8_t frame[], TelemetryFrameType type, uint32_t sequence) {
+    put_u16(frame, TELEMETRY_FRAME_MAGIC);
+    frame[2] = TELEMETRY_FRAME_VERSION;
+    frame[3] = type;
+    put_u32(frame + 4, sequence);
+    frame[10] = 0;
+    frame[11] = 0;
+    return frame + TELEMETRY_FRAME_HEADER_LENGTH;
+}
+
+static size_t finish_frame(uint8_t frame[], size_t payload_length) {
+    assert(payload_length <= TELEMETRY_FRAME_MAX_PAYLOAD_LENGTH);
+
+    put_u16(frame + 8, payload_length);
+    size_t crc_offset = TELEMETRY_FRAME_HEADER_LENGTH + payload_length;
+    put_u32(frame + crc_offset, telemetry_crc32(frame, crc_offset));
+    return crc_offset + TELEMETRY_FRAME_CRC_LENGTH;
+}
+
+static void pack_samples(uint8_t *destination, const int32_t samples[], size_t num_samples) {
+    for (size_t i = 0; i < num_samples; i++) {
+        uint32_t sample = (uint32_t) samples[i];
+        destination[0] = sample >> 16;
+        destination[1] = sample >> 8;
+        destination[2] = sample;
+        destination += TELEMETRY_SAMPLE_WIDTH;
+    }
+}
+
+static void unpack_samples(int32_t out_samples[], const uint8_t *source, size_t num_samples) {
+    for (size_t i = 0; i < num_samples; i++) {
+        out_samples[i] = 
+            (
+                ((int32_t) source[0] << 24) |
+                ((int32_t) source[1] << 16) |
+                ((int32_t) source[2] << 8)
+            ) >> 8;
+        source += TELEMETRY_SAMPLE_WIDTH;
+    }
+}
+
+/**
+ * @brief 
+ * Build a sample frame
+ * @param frame Buffer to build the frame in
+ * @param sequence Frame sequence number
+ * @param header Sample metadata. `num_samples` must not exceed `TELEMETRY_FRAME_MAX_SAMPLES`.
+ * @param samples Samples to pack. Only the low 24 bits of each sample are sent.
+ * @return Length of the frame in bytes
+ */
+size_t telemetry_frame_encode_samples(
+    uint8_t frame[TELEMETRY_FRAME_MAX_LENGTH],
+    uint32_t sequence,
+    const TelemetrySampleHeader *header,
+    const int32_t samples[]
+) {
+    assert(header->num_samples <= TELEMETRY_FRAME_MAX_SAMPLES);
+
+    uint8_t *payload = begin_frame(frame, TELEMETRY_FRAME_SAMPLES, sequence);
+    put_u64(payload, header->first_sample_index);
+    put_u32(payload + 8, header->sample_rate_mhz);
+    payload[12] = header->vga_gain;
+    payload[13] = header->flags;
+    put_u16(payload + 14, header->num_samples);
+
+    pack_samples(payload + TELEMETRY_SAMPLE_HEADER_LENGTH, samples, header->num_samples);
+
+    return finish_frame(
+        frame, 
+        TELEMETRY_SAMPLE_HEADER_LENGTH + header->num_samples * TELEMETRY_SAMPLE_WIDTH
+    );
+}
+
+/**
+ * @brief 
+ * Build a spectrum frame
+ * @param frame Buffer to build the frame in
+ * @param sequence Frame sequence number
+ * @param header Spectrum metadata. The bins and bands have to fit in one frame.
+ * @param psd Power spectral density bins in counts^2 / Hz
+ * @param band_centers Band center frequencies in Hz
+ * @param band_powers Band powers in counts^2
+ * @return Length of the frame in bytes
+ */
+size_t telemetry_frame_encode_spectrum(
+    uint8_t frame[TELEMETRY_FRAME_MAX_LENGTH],
+    uint32_t sequence,
+    const TelemetrySpectrumHeader *header,
+    const float psd[],
+    const float band_centers[],
+    const float band_powers[]
+) {
+    size_t payload_length = TELEMETRY_SPECTRUM_HEADER_LENGTH + 
+        header->num_bins * TELEMETRY_SPECTRUM_BIN_WIDTH + 
+        header->num_bands * TELEMETRY_SPECTRUM_BAND_WIDTH;
+    assert(payload_length <= TELEMETRY_FRAME_MAX_PAYLOAD_LENGTH);
+
+    uint8_t *payload = begin_frame(frame, TELEMETRY_FRAME_SPECTRUM, sequence);
+    put_u64(payload, header->first_sample_index);
+    put_u32(payload + 8, header->sample_rate_mhz);
+    payload[12] = header->vga_gain;
+    payload[13] = header->bands_per_octave;
+    put_u16(payload + 14, header->fft_length);
+    put_u16(payload + 16, header->num_averages);
+    put_u16(payload + 18, header->num_bins);
+    put_u16(payload + 20, header->num_bands);
+    put_u16(payload + 22, 0);
+
+    uint8_t *bins = payload + TELEMETRY_SPECTRUM_HEADER_LENGTH;
+    for (size_t k = 0; k < header->num_bins; k++) {
+        int16_t centibels = INT16_MIN;
+        if (psd[k] > 0) {
+            float level = 1000 * log10f(psd[k]);
+            level = level > INT16_MAX ? INT16_MAX : level;
+            level = level < INT16_MIN + 1 ? INT16_MIN + 1 : level;
+            centibels = (int16_t) lroundf(level);
+        }
+        put_u16(bins + k * TELEMETRY_SPECTRUM_BIN_WIDTH, (uint16_t) centibels);
+    }
+
+    uint8_t *bands = bins + header->num_bins * TELEMETRY_SPECTRUM_BIN_WIDTH;
+    for (size_t b = 0; b < header->num_bands; b++) {
+        put_float(bands + b * TELEMETRY_SPECTRUM_BAND_WIDTH, band_centers[b]);
+        put_float(bands + b * TELEMETRY_SPECTRUM_BAND_WIDTH + 4, band_powers[b]);
+    }
+
+    return finish_frame(frame, payload_length);
+}
+
+/**
+ * @brief 
+ * Build one chunk of an event
+ * @param frame Buffer to build the frame in
+ * @param sequence Frame sequence number
+ * @param header Event metadata. `num_samples` must not exceed `TELEMETRY_EVENT_MAX_SAMPLES`.
+ * @param samples Samples to pack. Only the low 24 bits of each sample are sent.
+ * @return Length of the frame in bytes
+ */
+size_t telemetry_frame_encode_event(
+    uint8_t frame[TELEMETRY_FRAME_MAX_LENGTH],
+    uint32_t sequence,
+    const TelemetryEventHeader *header,
+    const int32_t samples[]
+) {
+    assert(header->num_samples <= TELEMETRY_EVENT_MAX_SAMPLES);
+
+    uint8_t *payload = begin_frame(frame, TELEMETRY_FRAME_EVENT, sequence);
+    put_u32(payload, header->event_number);
+    put_u16(payload + 4, header->chunk_number);
+    payload[6] = header->vga_gain;
+    payload[7] = header->flags;
+    put_u64(payload + 8, header->trigger_sample_index);
+    put_u64(payload + 16, header->first_sample_index);
+    put_u32(payload + 24, header->sample_rate_mhz);
+    put_float(payload + 28, header->peak_ratio);
+    put_u16(payload + 32, header->num_samples);
+    put_u16(payload + 34, 0);
+    pack_samples(payload + TELEMETRY_EVENT_HEADER_LENGTH, samples, header->num_samples);
+
+    return finish_frame(
+        frame, 
+        TELEMETRY_EVENT_HEADER_LENGTH + header->num_samples * TELEMETRY_SAMPLE_WIDTH
+    );
+}
+
+/**
+ * @brief 
+ * Build a detector heartbeat frame
+ * @param frame Buffer to build the frame in
+ * @param sequence Frame sequence number
+ * @param heartbeat 
+ * @return Length of the frame in bytes
+ */
+size_t telemetry_frame_encode_heartbeat(
+    uint8_t frame[TELEMETRY_FRAME_MAX_LENGTH],
+    uint32_t sequence,
+    const TelemetryHeartbeat *heartbeat
+) {
+    uint8_t *payload = begin_frame(frame, TELEMETRY_FRAME_HEARTBEAT, sequence);
+    put_u64(payload, heartbeat->last_sample_index);
+    put_u32(payload + 8, heartbeat->sample_rate_mhz);
+    payload[12] = heartbeat->vga_gain;
+    payload[13] = heartbeat->detector_state;
+    put_u16(payload + 14, 0);
+    put_float(payload + 16, heartbeat->sta);
+    put_float(payload + 20, heartbeat->lta);
+    put_u32(payload + 24, heartbeat->num_events);
+
+    return finish_frame(frame, TELEMETRY_HEARTBEAT_LENGTH);
+}
+
+/**
+ * @brief 
+ * Build a pipeline statistics frame
+ * @param frame Buffer to build the frame in
+ * @param sequence Frame sequence number
+ * @param uptime_us Time since boot
+ * @param cpu_frequency CPU clock in hertz
+ * @param stats 
+ * @return Length of the frame in bytes
+ */
+size_t telemetry_frame_encode_stats(
+    uint8_t frame[TELEMETRY_FRAME_MAX_LENGTH],
+    uint32_t sequence,
+    uint64_t uptime_us,
+    uint32_t cpu_frequency,
+    const PipelineStats *stats
+) {
+    uint8_t *payload = begin_frame(frame, TELEMETRY_FRAME_STATS, sequence);
+    put_u64(payload, uptime_us);
+    put_u32(payload + 8, cpu_frequency);
+    payload[12] = STATS_NUM_COUNTERS;
+    payload[13] = STATS_NUM_HISTOGRAMS;
+    payload[14] = STATS_HISTOGRAM_BUCKETS;
+    payload[15] = 0;
+
+    uint8_t *field = payload + TELEMETRY_STATS_HEADER_LENGTH;
+    for (unsigned int c = 0; c < STATS_NUM_COUNTERS; c++) {
+        put_u32(field, stats->counters[c]);
+        field += 4;
+    }
+    for (unsigned int h = 0; h < STATS_NUM_HISTOGRAMS; h++) {
+        const StatsHistogram *histogram = &stats->histograms[h];
+        field[0] = stats_histogram_unit(h);
+        field[1] = field[2] = field[3] = 0;
+        put_u32(field + 4, histogram->count);
+        put_u32(field + 8, histogram->min);
+        put_u32(field + 12, histogram->max);
+        put_u64(field + 16, histogram->total);
+        field += TELEMETRY_STATS_HISTOGRAM_HEADER_LENGTH;
+        for (unsigned int b = 0; b < STATS_HISTOGRAM_BUCKETS; b++) {
+            put_u32(field, histogram->buckets[b]);
+            field += 4;
+        }
+    }
+
+    return finish_frame(frame, field - payload);
+}
+
+/**
+ * @brief 
+ * Build a diagnostic input health frame
+ * @param frame Buffer to build the frame in
+ * @param sequence Frame sequence number
+ * @param header 
+ * @param inputs `header->num_inputs` summaries, at most 
+ * TELEMETRY_HEALTH_MAX_INPUTS
+ * @return Length of the frame in bytes
+ */
+size_t telemetry_frame_encode_health(
+    uint8_t frame[TELEMETRY_FRAME_MAX_LENGTH],
+    uint32_t sequence,
+    const TelemetryHealthHeader *header,
+    const InputHealthSummary inputs[]
+) {
+    assert(header->num_inputs <= TELEMETRY_HEALTH_MAX_INPUTS);
+
+    uint8_t *payload = begin_frame(frame, TELEMETRY_FRAME_HEALTH, sequence);
+    put_u64(payload, header->uptime_us);
+    put_float(payload + 8, header->reading_period);
+    put_u16(payload + 12, header->oversampling);
+    payload[14] = header->num_inputs;
+    payload[15] = 0;
+
+    uint8_t *field = payload + TELEMETRY_HEALTH_HEADER_LENGTH;
+    for (unsigned int i = 0; i < header->num_inputs; i++) {
+        const InputHealthSummary *input = &inputs[i];
+        put_u32(field, input->num_readings);
+        put_u32(field + 4, input->num_missed);
+        put_float(field + 8, input->last);
+        put_float(field + 12, input->mean);
+        put_float(field + 16, input->min);
+        put_float(field + 20, input->max);
+        put_float(field + 24, input->noise);
+        put_float(field + 28, input->drift);
+        field += TELEMETRY_HEALTH_INPUT_LENGTH;
+    }
+
+    return finish_frame(frame, field - payload);
+}
+
+/**
+ * @brief 
+ * Check the framing and CRC of a received frame and parse its common header
+ * @param frame 
+ * @param length Length of the received datagram
+ * @param out_frame Parsed header. The payload points into `frame`.
+ * @return 0 if success
+ */
+int telemetry_frame_decode(const uint8_t frame[], size_t length, TelemetryFrame *out_frame) {
+    if (length < TELEMETRY_FRAME_HEADER_LENGTH + TELEMETRY_FRAME_CRC_LENGTH) {
+        return 1;
+    }
+    if (get_u16(frame) != TELEMETRY_FRAME_MAGIC || frame[2] != TELEMETRY_FRAME_VERSION) {
+        return 1;
+    }
+
+    uint16_t payload_length = get_u16(frame + 8);
+    size_t crc_offset = TELEMETRY_FRAME_HEADER_LENGTH + payload_length;
+    if (crc_offset + TELEMETRY_FRAME_CRC_LENGTH != length) {
+        return 1;
+    }
+    if (get_u32(frame + crc_offset) != telemetry_crc32(frame, crc_offset)) {
+        return 1;
+    }
+
+    out_frame->version = frame[2];
+    out_frame->type = frame[3];
+    out_frame->flags = frame[10];
+    out_frame->sequence = get_u32(frame + 4);
+    out_frame->payload_length = payload_length;
+    out_frame->payload = frame + TELEMETRY_FRAME_HEADER_LENGTH;
+    return 0;
+}
+
+/**
+ * @brief 
+ * Set frame flags of an encoded frame and update its CRC
+ * @param frame 
+ * @param length 
+ * @param flags TELEMETRY_FRAME_* flags to set
+ * @return 0 if success, 1 if `frame` is not a valid frame
+ */
+int telemetry_frame_set_flags(uint8_t frame[], size_t length, uint8_t flags) {
+    TelemetryFrame decoded;
+    if (telemetry_frame_decode(frame, length, &decoded)) {
+        return 1;
+    }
+    frame[10] |= flags;
+    size_t crc_offset = length - TELEMETRY_FRAME_CRC_LENGTH;
+    put_u32(frame + crc_offset, telemetry_crc32(frame, crc_offset));
+    return 0;
+}
+
+/**
+ * @brief 
+ * Unpack the payload of a sample frame
+ * @param frame Frame parsed by `telemetry_frame_decode`
+ * @param out_header 
+ * @param out_samples Sign extended samples
+ * @return 0 if success
+ */
+int telemetry_frame_decode_samples(
+    const TelemetryFrame *frame, 
+    TelemetrySampleHeader *out_header, 
+    int32_t out_samples[TELEMETRY_FRAME_MAX_SAMPLES]
+) {
+    if (frame->type != TELEMETRY_FRAME_SAMPLES || frame->payload_length < TELEMETRY_SAMPLE_HEADER_LENGTH) {
+        return 1;
+    }
+
+    const uint8_t *payload = frame->payload;
+    out_header->first_sample_index = get_u64(payload);
+    out_header->sample_rate_mhz = get_u32(payload + 8);
+    out_header->vga_gain = payload[12];
+    out_header->flags = payload[13];
+    out_header->num_samples = get_u16(payload + 14);
+
+    if (out_header->num_samples > TELEMETRY_FRAME_MAX_SAMPLES ||
+        frame->payload_length != 
+            TELEMETRY_SAMPLE_HEADER_LENGTH + out_header->num_samples * TELEMETRY_SAMPLE_WIDTH) {
+        return 1;
+    }
+
+    unpack_samples(out_samples, payload + TELEMETRY_SAMPLE_HEADER_LENGTH, out_header->num_samples);
+    return 0;
+}
+
+/**
+ * @brief 
+ * Unpack the payload of a spectrum frame
+ * @param frame Frame parsed by `telemetry_frame_decode`
+ * @param out_header 
+ * @param out_psd Room for the maximum number of bins that fit in a frame
+ * @param out_band_centers Room for the maximum number of bands that fit in a frame
+ * @param out_band_powers 
+ * @return 0 if success
+ */
+int telemetry_frame_decode_spectrum(
+    const TelemetryFrame *frame,
+    TelemetrySpectrumHeader *out_header,
+    float out_psd[],
+    float out_band_centers[],
+    float out_band_powers[]
+) {
+    if (frame->type != TELEMETRY_FRAME_SPECTRUM || frame->payload_length < TELEMETRY_SPECTRUM_HEADER_LENGTH) {
+        return 1;
+    }
+
+    const uint8_t *payload = frame->payload;
+    out_header->first_sample_index = get_u64(payload);
+    out_header->sample_rate_mhz = get_u32(payload + 8);
+    out_header->vga_gain = payload[12];
+    out_header->bands_per_octave = payload[13];
+    out_header->fft_length = get_u16(payload + 14);
+    out_header->num_averages = get_u16(payload + 16);
+    out_header->num_bins = get_u16(payload + 18);
+    out_header->num_bands = get_u16(payload + 20);
+
+    if (frame->payload_length != TELEMETRY_SPECTRUM_HEADER_LENGTH + 
+            out_header->num_bins * TELEMETRY_SPECTRUM_BIN_WIDTH + 
+            out_header->num_bands * TELEMETRY_SPECTRUM_BAND_WIDTH) {
+        return 1;
+    }
+
+    const uint8_t *bins = payload + TELEMETRY_SPECTRUM_HEADER_LENGTH;
+    for (size_t k = 0; k < out_header->num_bins; k++) {
+        int16_t centibels = (int16_t) get_u16(bins + k * TELEMETRY_SPECTRUM_BIN_WIDTH);
+        out_psd[k] = centibels == INT16_MIN ? 0 : powf(10, centibels / 1000.0f);
+    }
+
+    const uint8_t *bands = bins + out_header->num_bins * TELEMETRY_SPECTRUM_BIN_WIDTH;
+    for (size_t b = 0; b < out_header->num_bands; b++) {
+        out_band_centers[b] = get_float(bands + b * TELEMETRY_SPECTRUM_BAND_WIDTH);
+        out_band_powers[b] = get_float(bands + b * TELEMETRY_SPECTRUM_BAND_WIDTH + 4);
+    }
+    return 0;
+}
+
+/**
+ * @brief 
+ * Unpack the payload of an event frame
+ * @param frame Frame parsed by `telemetry_frame_decode`
+ * @param out_header 
+ * @param out_samples Sign extended samples
+ * @return 0 if success
+ */
+int telemetry_frame_decode_event(
+    const TelemetryFrame *frame,
+    TelemetryEventHeader *out_header,
+    int32_t out_samples[TELEMETRY_EVENT_MAX_SAMPLES]
+) {
+    if (frame->type != TELEMETRY_FRAME_EVENT || frame->payload_length < TELEMETRY_EVENT_HEADER_LENGTH) {
+        return 1;
+    }
+
+    const uint8_t *payload = frame->payload;
+    out_header->event_number = get_u32(payload);
+    out_header->chunk_number = get_u16(payload + 4);
+    out_header->vga_gain = payload[6];
+    out_header->flags = payload[7];
+    out_header->trigger_sample_index = get_u64(payload + 8);
+    out_header->first_sample_index = get_u64(payload + 16);
+    out_header->sample_rate_mhz = get_u32(payload + 24);
+    out_header->peak_ratio = get_float(payload + 28);
+    out_header->num_samples = get_u16(payload + 32);
+
+    if (out_header->num_samples > TELEMETRY_EVENT_MAX_SAMPLES ||
+        frame->payload_length != 
+            TELEMETRY_EVENT_HEADER_LENGTH + out_header->num_samples * TELEMETRY_SAMPLE_WIDTH) {
+        return 1;
+    }
+
+    unpack_samples(out_samples, payload + TELEMETRY_EVENT_HEADER_LENGTH, out_header->num_samples);
+    return 0;
+}
+
+/**
+ * @brief 
+ * Unpack the payload of a heartbeat frame
+ * @param frame Frame parsed by `telemetry_frame_decode`
+ * @param out_heartbeat 
+ * @return 0 if success
+ */
+int telemetry_frame_decode_heartbeat(const TelemetryFrame *frame, TelemetryHeartbeat *out_heartbeat) {
+    if (frame->type != TELEMETRY_FRAME_HEARTBEAT || frame->payload_length != TELEMETRY_HEARTBEAT_LENGTH) {
+        return 1;
+    }
+
+    const uint8_t *payload = frame->payload;
+    out_heartbeat->last_sample_index = get_u64(payload);
+    out_heartbeat->sample_rate_mhz = get_u32(payload + 8);
+    out_heartbeat->vga_gain = payload[12];
+    out_heartbeat->detector_state = payload[13];
+    out_heartbeat->sta = get_float(payload + 16);
+    out_heartbeat->lta = get_float(payload + 20);
+    out_heartbeat->num_events = get_u32(payload + 24);
+    return 0;
+}
+
+/**
+ * @brief 
+ * Unpack the payload of a stats frame. Counters and histograms missing from 
+ * the frame are left zero.
+ * @param frame Frame parsed by `telemetry_frame_decode`
+ * @param out_uptime_us 
+ * @param out_cpu_frequency 
+ * @param out_stats 
+ * @return 0 if success
+ */
+int telemetry_frame_decode_stats(
+    const TelemetryFrame *frame,
+    uint64_t *out_uptime_us,
+    uint32_t *out_cpu_frequency,
+    PipelineStats *out_stats
+) {
+    if (frame->type != TELEMETRY_FRAME_STATS || frame->payload_length < TELEMETRY_STATS_HEADER_LENGTH) {
+        return 1;
+    }
+
+    const uint8_t *payload = frame->payload;
+    unsigned int num_counters = payload[12];
+    unsigned int num_histograms = payload[13];
+    unsigned int num_buckets = payload[14];
+    if (num_counters > STATS_NUM_COUNTERS || 
+        num_histograms > STATS_NUM_HISTOGRAMS || 
+        num_buckets > STATS_HISTOGRAM_BUCKETS ||
+        frame->payload_length != TELEMETRY_STATS_HEADER_LENGTH + 4 * num_counters + 
+            num_histograms * (TELEMETRY_STATS_HISTOGRAM_HEADER_LENGTH + 4 * num_buckets)) {
+        return 1;
+    }
+
+    *out_uptime_us = get_u64(payload);
+    *out_cpu_frequency = get_u32(payload + 8);
+    pipeline_stats_reset(out_stats);
+
+    const uint8_t *field = payload + TELEMETRY_STATS_HEADER_LENGTH;
+    for (unsigned int c = 0; c < num_counters; c++) {
+        out_stats->counters[c] = get_u32(field);
+        field += 4;
+    }
+    for (unsigned int h = 0; h < num_histograms; h++) {
+        StatsHistogram *histogram = &out_stats->histograms[h];
+        histogram->count = get_u32(field + 4);
+        histogram->min = get_u32(field + 8);
+        histogram->max = get_u32(field + 12);
+        histogram->total = get_u64(field + 16);
+        field += TELEMETRY_STATS_HISTOGRAM_HEADER_LENGTH;
+        for (unsigned int b = 0; b < num_buckets; b++) {
+            histogram->buckets[b] = get_u32(field);
+            field += 4;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief 
+ * Unpack the payload of a health frame
+ * @param frame Frame parsed by `telemetry_frame_decode`
+ * @param out_header 
+ * @param out_inputs 
+ * @return 0 if success
+ */
+int telemetry_frame_decode_health(
+    const TelemetryFrame *frame,
+    TelemetryHealthHeader *out_header,
+    InputHealthSummary out_inputs[TELEMETRY_HEALTH_MAX_INPUTS]
+) {
+    if (frame->type != TELEMETRY_FRAME_HEALTH || frame->payload_length < TELEMETRY_HEALTH_HEADER_LENGTH) {
+        return 1;
+    }
+
+    const uint8_t *payload = frame->payload;
+    unsigned int num_inputs = payload[14];
+    if (num_inputs > TELEMETRY_HEALTH_MAX_INPUTS ||
+        frame->payload_length != TELEMETRY_HEALTH_HEADER_LENGTH + num_inputs * TELEMETRY_HEALTH_INPUT_LENGTH) {
+        return 1;
+    }
+
+    out_header->uptime_us = get_u64(payload);
+    out_header->reading_period = get_float(payload + 8);
+    out_header->oversampling = get_u16(payload + 12);
+    out_header->num_inputs = num_inputs;
+
+    const uint8_t *field = payload + TELEMETRY_HEALTH_HEADER_LENGTH;
+    for (unsigned int i = 0; i < num_inputs; i++) {
+        InputHealthSummary *input = &out_inputs[i];
+        input->num_readings = get_u32(field);
+        input->num_missed = get_u32(field + 4);
+        input->last = get_float(field + 8);
+        input->mean = get_float(field + 12);
+        input->min = get_float(field + 16);
+        input->max = get_float(field + 20);
+        input->noise = get_float(field + 24);
+        input->drift = get_float(field + 28);
+        field += TELEMETRY_HEALTH_INPUT_LENGTH;
+    }
+    return 0;
+}
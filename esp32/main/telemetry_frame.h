@@ -0,0 +1,307 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "pipeline_stats.h"
+#include "input_health.h"
+
+/*
+ * Binary telemetry frame, one per UDP datagram. All fields are big-endian.
+ *
+ *   offset  size  field
+ *   0       2     magic "IE"
+ *   2       1     format version
+ *   3       1     frame type
+ *   4       4     sequence number, incremented for every frame sent
+ *   8       2     payload length
+ *   10      1     frame flags
+ *   11      1     reserved, zero
+ *   12      n     payload
+ *   12 + n  4     CRC-32 (IEEE 802.3) of everything before it
+ *
+ * A frame flagged TELEMETRY_FRAME_BACKFILLED was spooled while the link was 
+ * down and sent late, alongside live frames. It keeps the sequence number 
+ * it was given when first sent, so backfilled frames fill the sequence gaps 
+ * of the live stream and the two merge in sequence order.
+ *
+ * Sample frame payload:
+ *
+ *   0       8     index of the first sample since acquisition started
+ *   8       4     sample rate in millihertz
+ *   12      1     VGA gain of every sample in the frame. Frames end where 
+ *                 the gain changes, so a frame flagged SAMPLE_BLOCK_GAIN_CHANGED 
+ *                 starts at the first sample taken at its gain.
+ *   13      1     sample block flags, the SAMPLE_BLOCK_* bits of
+ *                 every block the samples came from
+ *   14      2     number of samples
+ *   16      3n    samples as 24-bit two's complement words
+ *
+ * Spectrum frame payload:
+ *
+ *   0       8     index of the first sample in the estimate
+ *   8       4     sample rate in millihertz
+ *   12      1     VGA gain
+ *   13      1     bands per octave, or zero for no bands
+ *   14      2     FFT length
+ *   16      2     number of averaged segments
+ *   18      2     number of PSD bins, from DC up
+ *   20      2     number of bands
+ *   22      2     reserved, zero
+ *   24      2m    PSD bins as 10 * log10(counts^2 / Hz) in hundredths of a 
+ *                 decibel, INT16_MIN for zero power
+ *   24 + 2m 8k    bands as IEEE 754 single precision center frequency in Hz 
+ *                 and power in counts^2
+ *
+ * Event frame payload. An event is sent as numbered chunks, each of which 
+ * carries the full event metadata so it can be used without the others:
+ *
+ *   0       4     event number since the detector was configured
+ *   4       2     chunk number within the event
+ *   6       1     VGA gain
+ *   7       1     event flags
+ *   8       8     index of the sample that triggered the event
+ *   16      8     index of the first sample in this chunk
+ *   24      4     sample rate in millihertz
+ *   28      4     peak STA/LTA ratio so far as IEEE 754 single precision
+ *   32      2     number of samples
+ *   34      2     reserved, zero
+ *   36      3n    samples as 24-bit two's complement words
+ *
+ * Heartbeat frame payload, sent periodically while no event is in progress:
+ *
+ *   0       8     index of the last sample processed
+ *   8       4     sample rate in millihertz
+ *   12      1     VGA gain
+ *   13      1     detector state
+ *   14      2     reserved, zero
+ *   16      4     STA in counts^2 as IEEE 754 single precision
+ *   20      4     LTA in counts^2 as IEEE 754 single precision
+ *   24      4     number of events detected
+ *
+ * Stats frame payload, sent periodically while telemetry runs:
+ *
+ *   0       8     microseconds since boot
+ *   8       4     CPU clock in hertz, to convert cycle counts to time
+ *   12      1     number of counters, c
+ *   13      1     number of histograms, h
+ *   14      1     buckets per histogram, b
+ *   15      1     reserved, zero
+ *   16      4c    counters
+ *   16 + 4c       h histograms, each:
+ *           1     unit, 0 for CPU cycles and 1 for microseconds
+ *           3     reserved, zero
+ *           4     number of values
+ *           4     smallest value
+ *           4     largest value
+ *           8     sum of the values
+ *           4b    bucket counts, bucket i counting values below 2^i
+ *
+ * Health frame payload, sent with each stats frame. Voltages are IEEE 754 
+ * single precision:
+ *
+ *   0       8     microseconds since boot
+ *   8       4     seconds between readings as IEEE 754 single precision
+ *   12      2     conversions averaged per reading
+ *   14      1     number of inputs, n: amplifier output, virtual ground and 
+ *                 reference, in that order
+ *   15      1     reserved, zero
+ *   16      32n   inputs, each:
+ *           4     readings taken
+ *           4     readings missed, while Wi-Fi held the ADC
+ *           4     last reading in volts
+ *           4     mean of the rolling window in volts
+ *           4     smallest conversion in the window in volts
+ *           4     largest conversion in the window in volts
+ *           4     RMS noise of the last reading's conversions in volts
+ *           4     drift in volts per hour, NaN until known
+ */
+
+#define TELEMETRY_FRAME_MAGIC 0x4945
+#define TELEMETRY_FRAME_VERSION 1
+
+#define TELEMETRY_FRAME_HEADER_LENGTH 12
+#define TELEMETRY_FRAME_CRC_LENGTH 4
+
+// Frame flags
+#define TELEMETRY_FRAME_BACKFILLED 0x01
+
+// Largest UDP payload that fits in a 1500 byte Ethernet/Wi-Fi MTU over IPv4
+#define TELEMETRY_FRAME_MAX_LENGTH 1472
+#define TELEMETRY_FRAME_MAX_PAYLOAD_LENGTH \
+    (TELEMETRY_FRAME_MAX_LENGTH - TELEMETRY_FRAME_HEADER_LENGTH - TELEMETRY_FRAME_CRC_LENGTH)
+
+#define TELEMETRY_SAMPLE_HEADER_LENGTH 16
+#define TELEMETRY_SAMPLE_WIDTH 3
+#define TELEMETRY_FRAME_MAX_SAMPLES \
+    ((TELEMETRY_FRAME_MAX_PAYLOAD_LENGTH - TELEMETRY_SAMPLE_HEADER_LENGTH) / TELEMETRY_SAMPLE_WIDTH)
+
+#define TELEMETRY_SPECTRUM_HEADER_LENGTH 24
+#define TELEMETRY_SPECTRUM_BIN_WIDTH 2
+#define TELEMETRY_SPECTRUM_BAND_WIDTH 8
+
+#define TELEMETRY_EVENT_HEADER_LENGTH 36
+#define TELEMETRY_EVENT_MAX_SAMPLES \
+    ((TELEMETRY_FRAME_MAX_PAYLOAD_LENGTH - TELEMETRY_EVENT_HEADER_LENGTH) / TELEMETRY_SAMPLE_WIDTH)
+
+#define TELEMETRY_EVENT_FIRST_CHUNK 0x01
+#define TELEMETRY_EVENT_LAST_CHUNK 0x02
+
+#define TELEMETRY_HEARTBEAT_LENGTH 28
+
+#define TELEMETRY_STATS_HEADER_LENGTH 16
+#define TELEMETRY_STATS_HISTOGRAM_HEADER_LENGTH 24
+
+#define TELEMETRY_HEALTH_HEADER_LENGTH 16
+#define TELEMETRY_HEALTH_INPUT_LENGTH 32
+#define TELEMETRY_HEALTH_MAX_INPUTS 8
+
+typedef enum {
+    TELEMETRY_DETECTOR_IDLE = 0,
+    TELEMETRY_DETECTOR_IN_EVENT = 1,
+    TELEMETRY_DETECTOR_WARMING_UP = 2,
+} TelemetryDetectorState;
+
+typedef enum {
+    TELEMETRY_FRAME_SAMPLES = 1,
+    TELEMETRY_FRAME_SPECTRUM = 2,
+    TELEMETRY_FRAME_EVENT = 3,
+    TELEMETRY_FRAME_HEARTBEAT = 4,
+    TELEMETRY_FRAME_STATS = 5,
+    TELEMETRY_FRAME_HEALTH = 6,
+} TelemetryFrameType;
+
+typedef struct {
+    uint8_t version;
+    uint8_t type;
+    uint8_t flags;
+    uint32_t sequence;
+    uint16_t payload_length;
+    const uint8_t *payload;
+} TelemetryFrame;
+
+typedef struct {
+    uint64_t first_sample_index;
+    uint32_t sample_rate_mhz;
+    uint8_t vga_gain;
+    uint8_t flags;
+    uint16_t num_samples;
+} TelemetrySampleHeader;
+
+typedef struct {
+    uint64_t first_sample_index;
+    uint32_t sample_rate_mhz;
+    uint8_t vga_gain;
+    uint8_t bands_per_octave;
+    uint16_t fft_length;
+    uint16_t num_averages;
+    uint16_t num_bins;
+    uint16_t num_bands;
+} TelemetrySpectrumHeader;
+
+typedef struct {
+    uint32_t event_number;
+    uint16_t chunk_number;
+    uint8_t vga_gain;
+    uint8_t flags;
+    uint64_t trigger_sample_index;
+    uint64_t first_sample_index;
+    uint32_t sample_rate_mhz;
+    float peak_ratio;
+    uint16_t num_samples;
+} TelemetryEventHeader;
+
+typedef struct {
+    uint64_t last_sample_index;
+    uint32_t sample_rate_mhz;
+    uint8_t vga_gain;
+    uint8_t detector_state;
+    float sta;
+    float lta;
+    uint32_t num_events;
+} TelemetryHeartbeat;
+
+typedef struct {
+    uint64_t uptime_us;
+    float reading_period;
+    uint16_t oversampling;
+    uint8_t num_inputs;
+} TelemetryHealthHeader;
+
+uint32_t telemetry_crc32(const uint8_t data[], size_t length);
+
+size_t telemetry_frame_encode_samples(
+    uint8_t frame[TELEMETRY_FRAME_MAX_LENGTH],
+    uint32_t sequence,
+    const TelemetrySampleHeader *header,
+    const int32_t samples[]
+);
+
+size_t telemetry_frame_encode_spectrum(
+    uint8_t frame[TELEMETRY_FRAME_MAX_LENGTH],
+    uint32_t sequence,
+    const TelemetrySpectrumHeader *header,
+    const float psd[],
+    const float band_centers[],
+    const float band_powers[]
+);
+
+size_t telemetry_frame_encode_event(
+    uint8_t frame[TELEMETRY_FRAME_MAX_LENGTH],
+    uint32_t sequence,
+    const TelemetryEventHeader *header,
+    const int32_t samples[]
+);
+
+size_t telemetry_frame_encode_heartbeat(
+    uint8_t frame[TELEMETRY_FRAME_MAX_LENGTH],
+    uint32_t sequence,
+    const TelemetryHeartbeat *heartbeat
+);
+
+size_t telemetry_frame_encode_stats(
+    uint8_t frame[TELEMETRY_FRAME_MAX_LENGTH],
+    uint32_t sequence,
+    uint64_t uptime_us,
+    uint32_t cpu_frequency,
+    const PipelineStats *stats
+);
+
+size_t telemetry_frame_encode_health(
+    uint8_t frame[TELEMETRY_FRAME_MAX_LENGTH],
+    uint32_t sequence,
+    const TelemetryHealthHeader *header,
+    const InputHealthSummary inputs[]
+);
+
+int telemetry_frame_decode(const uint8_t frame[], size_t length, TelemetryFrame *out_frame);
+int telemetry_frame_set_flags(uint8_t frame[], size_t length, uint8_t flags);
+int telemetry_frame_decode_samples(
+    const TelemetryFrame *frame, 
+    TelemetrySampleHeader *out_header, 
+    int32_t out_samples[TELEMETRY_FRAME_MAX_SAMPLES]
+);
+int telemetry_frame_decode_spectrum(
+    const TelemetryFrame *frame,
+    TelemetrySpectrumHeader *out_header,
+    float out_psd[],
+    float out_band_centers[],
+    float out_band_powers[]
+);
+int telemetry_frame_decode_event(
+    const TelemetryFrame *frame,
+    TelemetryEventHeader *out_header,
+    int32_t out_samples[TELEMETRY_EVENT_MAX_SAMPLES]
+);
+int telemetry_frame_decode_heartbeat(const TelemetryFrame *frame, TelemetryHeartbeat *out_heartbeat);
+int telemetry_frame_decode_stats(
+    const TelemetryFrame *frame,
+    uint64_t *out_uptime_us,
+    uint32_t *out_cpu_frequency,
+    PipelineStats *out_stats
+);
+int telemetry_frame_decode_health(
+    const TelemetryFrame *frame,
+    TelemetryHealthHeader *out_header,
+    InputHealthSummary out_inputs[TELEMETRY_HEALTH_MAX_INPUTS]
+);
@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdarg.h>
+
+#include "esp_log.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "driver/uart.h"
+
+#include "sdkconfig.h"
+
+#include "uart_stream.h"
+#include "telemetry_frame.h"
+#include "sample_framer.h"
+#include "cobs.h"
+#include "adc.h"
+
+#define CONSOLE_UART CONFIG_ESP_CONSOLE_UART_NUM
+
+// Time the host is given to follow a change of baud rate
+#define BAUD_RATE_SWITCH_DELAY_MS 100
+
+static const char *TAG = "uart_stream";
+
+static uint8_t frame[TELEMETRY_FRAME_MAX_LENGTH];
+static uint8_t encoded_frame[COBS_MAX_ENCODED_LENGTH(TELEMETRY_FRAME_MAX_LENGTH) + 1];
+static SampleFramer framer;
+static uint32_t frame_sequence;
+
+static int discard_log(const char *format, va_list arguments) {
+    return 0;
+}
+
+static int set_console_baud_rate(uint32_t baud_rate) {
+    uart_wait_tx_done(CONSOLE_UART, portMAX_DELAY);
+    esp_err_t error = uart_set_baudrate(CONSOLE_UART, baud_rate);
+    if (error != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to set console baud rate. details: %s", esp_err_to_name(error));
+        return 1;
+    }
+    vTaskDelay(pdMS_TO_TICKS(BAUD_RATE_SWITCH_DELAY_MS));
+    return 0;
+}
+
+/**
+ * @brief 
+ * Send samples as a COBS encoded telemetry sample frame followed by a 
+ * delimiter
+ * @return 0 if success
+ */
+static int send_sample_frame(void *context, const TelemetrySampleHeader *header, const int32_t samples[]) {
+    size_t frame_length = telemetry_frame_encode_samples(frame, frame_sequence++, header, samples);
+
+    size_t encoded_length = cobs_encode(encoded_frame, frame, frame_length);
+    encoded_frame[encoded_length++] = COBS_DELIMITER;
+    return uart_write_bytes(CONSOLE_UART, encoded_frame, encoded_length) != (int) encoded_length;
+}
+
+/**
+ * @brief 
+ * Stream samples over the console UART as binary telemetry sample frames, the 
+ * same frames sent over UDP, each COBS encoded and ended by a zero byte. 
+ * Frames carry sequence numbers and CRCs, so a capture can be checked for 
+ * loss and corruption.
+ * 
+ * The stream is announced by a `binary <baud rate>` line at the console baud 
+ * rate. The UART then switches to the stream baud rate, waits for the host to 
+ * follow, and sends a lone delimiter to clear the host's framing before the 
+ * first frame. Logging is silenced while streaming. Once the samples are sent, 
+ * the console returns to its baud rate.
+ * 
+ * Stream output bypasses stdio so no line ending translation touches it.
+ * @param sample_broker 
+ * @param num_samples 
+ * @param baud_rate Stream baud rate, or 0 to keep the console rate
+ * @return 0 if success
+ */
+int stream_samples_over_uart(SampleBroker *sample_broker, uint64_t num_samples, uint32_t baud_rate) {
+    uint32_t console_baud_rate;
+    esp_err_t error = uart_get_baudrate(CONSOLE_UART, &console_baud_rate);
+    if (error != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to get console baud rate. details: %s", esp_err_to_name(error));
+        return 1;
+    }
+    if (baud_rate == 0) {
+        baud_rate = console_baud_rate;
+    }
+
+    SampleSubscriber *subscriber = sample_broker_subscribe(sample_broker, CONFIG_SAMPLE_SUBSCRIBER_DEPTH);
+    if (subscriber == NULL) {
+        ESP_LOGE(TAG, "Too many sample subscribers to stream over UART");
+        return 1;
+    }
+
+    printf("binary %lu\n", (unsigned long) baud_rate);
+    fflush(stdout);
+    vprintf_like_t log_output = esp_log_set_vprintf(discard_log);
+    if (baud_rate != console_baud_rate && set_console_baud_rate(baud_rate)) {
+        esp_log_set_vprintf(log_output);
+        sample_broker_unsubscribe(subscriber);
+        return 1;
+    }
+
+    uint8_t delimiter = COBS_DELIMITER;
+    uart_write_bytes(CONSOLE_UART, &delimiter, 1);
+
+    sample_framer_initialize(&framer, send_sample_frame, NULL);
+    uint64_t samples_sent = 0;
+    while (samples_sent < num_samples) {
+        const SampleBlock *block = sample_subscriber_receive(subscriber);
+        if (block == NULL) {
+            vTaskDelay(pdMS_TO_TICKS(SAMPLE_BUFFER_POLL_PERIOD_MS));
+            continue;
+        }
+        samples_sent += sample_framer_add_block(&framer, block, num_samples - samples_sent, get_adc_sample_rate());
+        sample_block_release(block);
+    }
+    sample_framer_flush(&framer);
+    sample_broker_unsubscribe(subscriber);
+
+    int result = 0;
+    if (baud_rate != console_baud_rate) {
+        result = set_console_baud_rate(console_baud_rate);
+    }
+    esp_log_set_vprintf(log_output);
+    return result;
+}
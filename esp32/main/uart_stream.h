@@ -0,0 +1,10 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "sample_broker.h"
+
+#define UART_STREAM_MIN_BAUD_RATE 9600
+#define UART_STREAM_MAX_BAUD_RATE 5000000
+
+int stream_samples_over_uart(SampleBroker *sample_broker, uint64_t num_samples, uint32_t baud_rate);
@@ -1,11 +1,14 @@
 #include "esp_log.h"
 
 #include <stdio.h>
-#include <assert.h>
 #include <math.h>
 
+#include "freertos/FreeRTOS.h"
+
 #include "driver/gpio.h"
+#include "soc/gpio_reg.h"
 #include "vga.h"
+#include "vga_gain.h"
 
 #define VGA_G0_PIN GPIO_NUM_13
 
@@ -13,34 +16,25 @@
 
 #define VGA_G2_PIN GPIO_NUM_2
 
-static const gpio_num_t vga_pins[] = {VGA_G0_PIN, VGA_G1_PIN, VGA_G2_PIN};
-
-static const char *TAG = "VGA";
-
-int set_vga_gain(unsigned int gain) {
-    assert(gain <= 64);
-    assert((gain & (gain - 1)) == 0);
-
-    ESP_LOGI(TAG, "Setting VGA gain level to %u", gain);
-
-    unsigned int gain_code;
-    switch (gain) {
-        case 0: gain_code = 0b000; break;
-        case 1: gain_code = 0b001; break;
-        case 2: gain_code = 0b010; break;
-        case 4: gain_code = 0b011; break;
-        case 8: gain_code = 0b100; break;
-        case 16: gain_code = 0b101; break;
-        case 32: gain_code = 0b110; break;
-        case 64: gain_code = 0b111; break;
-        default: assert(false);
-    }
+static const unsigned int vga_pins[VGA_NUM_GAIN_PINS] = {VGA_G0_PIN, VGA_G1_PIN, VGA_G2_PIN};
 
+// All gain pins are below GPIO 32, so GPIO_OUT_REG holds every one of them. 
+// Nothing else in the firmware drives a GPIO output, so the read, modify and 
+// write of the register under `vga_lock` cannot lose another pin's level.
+static const uint32_t vga_pin_mask = (1u << VGA_G0_PIN) | (1u << VGA_G1_PIN) | (1u << VGA_G2_PIN);
 
+static const char *TAG = "VGA";
 
+static volatile unsigned int vga_gain = 0;
+static portMUX_TYPE vga_lock = portMUX_INITIALIZER_UNLOCKED;
 
-    for (int i = 0; i < 3; i++) {
-        ESP_LOGI(TAG, "Setting G%d pin to output", i);
+/**
+ * @brief 
+ * Set the gain pins to outputs, at gain 0
+ * @return 0 if success
+ */
+int initialize_vga(void) {
+    for (int i = 0; i < VGA_NUM_GAIN_PINS; i++) {
         esp_err_t error = gpio_set_direction(vga_pins[i], GPIO_MODE_OUTPUT);
         if (error != ESP_OK) {
             ESP_LOGE(
@@ -51,19 +45,36 @@ int set_vga_gain(unsigned int gain) {
             );
             return 1;
         }
-
-        uint32_t level = (gain_code >> i) & 1;
-        ESP_LOGD(TAG, "Setting G%d pin to %lu", i, level);
-        error = gpio_set_level(vga_pins[i], level);
-        if (error != ESP_OK) {
-            ESP_LOGE(
-                TAG, 
-                "Error setting G%d pin level. Details: %s", 
-                i, 
-                esp_err_to_name(error));
-            return 1;
-        }
     }
+    return set_vga_gain(0);
+}
+
+/**
+ * @brief 
+ * Switch the VGA gain. All three gain pins change in one write of the GPIO 
+ * output register, so the VGA never sees an intermediate gain, and the call 
+ * is quick enough to make between two conversions.
+ * @param gain Zero or a power of two up to 64
+ * @return 0 if success
+ */
+int set_vga_gain(unsigned int gain) {
+    int gain_code = vga_gain_code(gain);
+    if (gain_code < 0) {
+        ESP_LOGE(TAG, "There is no VGA gain of %u", gain);
+        return 1;
+    }
+
+    uint32_t levels = vga_gain_pin_levels(gain_code, vga_pins);
 
+    portENTER_CRITICAL_SAFE(&vga_lock);
+    REG_WRITE(GPIO_OUT_REG, (REG_READ(GPIO_OUT_REG) & ~vga_pin_mask) | levels);
+    vga_gain = gain;
+    portEXIT_CRITICAL_SAFE(&vga_lock);
+
+    ESP_LOGD(TAG, "VGA gain set to %u", gain);
     return 0;
-}
\ No newline at end of file
+}
+
+unsigned int get_vga_gain(void) {
+    return vga_gain;
+}
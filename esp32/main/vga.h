@@ -1 +1,3 @@
-int set_vga_gain(unsigned int gain);
\ No newline at end of file
+int initialize_vga(void);
+int set_vga_gain(unsigned int gain);
+unsigned int get_vga_gain(void);
\ No newline at end of file
@@ -0,0 +1,36 @@
+#include "vga_gain.h"
+
+/**
+ * @brief 
+ * @param gain 
+ * @return The G2 G1 G0 pin code of a gain, or -1 if the VGA has no such gain
+ */
+int vga_gain_code(unsigned int gain) {
+    switch (gain) {
+        case 0: return 0b000;
+        case 1: return 0b001;
+        case 2: return 0b010;
+        case 4: return 0b011;
+        case 8: return 0b100;
+        case 16: return 0b101;
+        case 32: return 0b110;
+        case 64: return 0b111;
+        default: return -1;
+    }
+}
+
+/**
+ * @brief 
+ * @param gain_code 
+ * @param pins GPIO numbers of G0, G1 and G2, all below 32
+ * @return The GPIO output register bits to set for a gain code, one per pin
+ */
+uint32_t vga_gain_pin_levels(int gain_code, const unsigned int pins[VGA_NUM_GAIN_PINS]) {
+    uint32_t levels = 0;
+    for (int i = 0; i < VGA_NUM_GAIN_PINS; i++) {
+        if ((gain_code >> i) & 1) {
+            levels |= 1u << pins[i];
+        }
+    }
+    return levels;
+}
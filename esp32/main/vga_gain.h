@@ -0,0 +1,8 @@
+#pragma once
+
+#include <stdint.h>
+
+#define VGA_NUM_GAIN_PINS 3
+
+int vga_gain_code(unsigned int gain);
+uint32_t vga_gain_pin_levels(int gain_code, const unsigned int pins[VGA_NUM_GAIN_PINS]);
@@ -0,0 +1,125 @@
+#include <math.h>
+#include <string.h>
+
+#include "waveform.h"
+
+#define RANDOM_SEED 0x2545F491
+
+/**
+ * @brief
+ * @param waveform
+ * @param settings
+ * @param sample_rate Samples per second
+ */
+void waveform_initialize(Waveform *waveform, const WaveformSettings *settings, double sample_rate) {
+    *waveform = (Waveform) {
+        .settings = *settings,
+        .sample_rate = sample_rate,
+        .random_state = RANDOM_SEED
+    };
+}
+
+void waveform_set_sample_rate(Waveform *waveform, double sample_rate) {
+    waveform->sample_rate = sample_rate;
+    waveform->sweep_index = 0;
+}
+
+/**
+ * @brief
+ * xorshift32, which is plenty for a test signal and cheap enough to run in
+ * an interrupt
+ * @return A uniform value from -0.5 up to 0.5
+ */
+static float next_uniform(Waveform *waveform) {
+    uint32_t x = waveform->random_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    waveform->random_state = x;
+    return x * (1.0f / 4294967296.0f) - 0.5f;
+}
+
+/**
+ * @brief
+ * @return An approximately Gaussian value of unit variance, the sum of four
+ * uniform values
+ */
+static float next_gaussian(Waveform *waveform) {
+    float sum = next_uniform(waveform) + next_uniform(waveform) + next_uniform(waveform) + next_uniform(waveform);
+    // The sum of four uniform values has a variance of 1/3
+    return sum * 1.7320508f;
+}
+
+static double instantaneous_frequency(const Waveform *waveform) {
+    const WaveformSettings *settings = &waveform->settings;
+    if (settings->type != WAVEFORM_CHIRP || settings->sweep_period <= 0) {
+        return settings->frequency;
+    }
+    double sweep_fraction = waveform->sweep_index / (settings->sweep_period * waveform->sample_rate);
+    return settings->frequency + (settings->end_frequency - settings->frequency) * sweep_fraction;
+}
+
+/**
+ * @brief
+ * @return The next sample, clipped to 24 bits
+ */
+int32_t waveform_next(Waveform *waveform) {
+    const WaveformSettings *settings = &waveform->settings;
+    float value;
+    if (settings->type == WAVEFORM_NOISE) {
+        value = settings->amplitude * next_gaussian(waveform);
+    }
+    else {
+        value = settings->amplitude * sinf(2 * (float) M_PI * (float) waveform->phase);
+        waveform->phase += instantaneous_frequency(waveform) / waveform->sample_rate;
+        waveform->phase -= floor(waveform->phase);
+        waveform->sweep_index++;
+        if (settings->type == WAVEFORM_CHIRP &&
+            waveform->sweep_index >= settings->sweep_period * waveform->sample_rate) {
+            waveform->sweep_index = 0;
+        }
+    }
+    if (settings->noise > 0) {
+        value += settings->noise * next_gaussian(waveform);
+    }
+
+    if (value > WAVEFORM_FULL_SCALE) {
+        return WAVEFORM_FULL_SCALE;
+    }
+    if (value < -WAVEFORM_FULL_SCALE) {
+        return -WAVEFORM_FULL_SCALE;
+    }
+    return (int32_t) lrintf(value);
+}
+
+void waveform_generate(Waveform *waveform, int32_t samples[], size_t num_samples) {
+    for (size_t i = 0; i < num_samples; i++) {
+        samples[i] = waveform_next(waveform);
+    }
+}
+
+const char *waveform_type_name(WaveformType type) {
+    switch (type) {
+        case WAVEFORM_SINE: return "sine";
+        case WAVEFORM_CHIRP: return "chirp";
+        case WAVEFORM_NOISE: return "noise";
+        default: return "unknown";
+    }
+}
+
+/**
+ * @brief
+ * @param name
+ * @param out_type
+ * @return 0 if `name` is a waveform type
+ */
+int waveform_type_from_name(const char name[], WaveformType *out_type) {
+    static const WaveformType types[] = {WAVEFORM_SINE, WAVEFORM_CHIRP, WAVEFORM_NOISE};
+    for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+        if (! strcmp(waveform_type_name(types[i]), name)) {
+            *out_type = types[i];
+            return 0;
+        }
+    }
+    return 1;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Largest magnitude of a 24 bit sample
+#define WAVEFORM_FULL_SCALE 8388607
+
+typedef enum {
+    WAVEFORM_SINE,
+    // Linear sweep from `frequency` to `end_frequency`, repeated every
+    // `sweep_period`
+    WAVEFORM_CHIRP,
+    // Gaussian white noise of RMS `amplitude`
+    WAVEFORM_NOISE
+} WaveformType;
+
+typedef struct {
+    WaveformType type;
+    // Peak amplitude in counts, or the RMS of a noise waveform
+    double amplitude;
+    // RMS in counts of white noise added to every waveform
+    double noise;
+    // Hz
+    double frequency;
+    double end_frequency;
+    // Seconds
+    double sweep_period;
+} WaveformSettings;
+
+/**
+ * @brief
+ * Synthetic test signal as 24 bit samples, generated one sample at a time
+ * for a stand-in ADC. The phase is kept across sample rate changes, so a
+ * sine stays continuous when the rate steps.
+ */
+typedef struct {
+    WaveformSettings settings;
+    double sample_rate;
+    // Phase of the tone in cycles, from 0 up to 1
+    double phase;
+    // Samples since the chirp sweep began
+    uint64_t sweep_index;
+    uint32_t random_state;
+} Waveform;
+
+void waveform_initialize(Waveform *waveform, const WaveformSettings *settings, double sample_rate);
+void waveform_set_sample_rate(Waveform *waveform, double sample_rate);
+int32_t waveform_next(Waveform *waveform);
+void waveform_generate(Waveform *waveform, int32_t samples[], size_t num_samples);
+const char *waveform_type_name(WaveformType type);
+int waveform_type_from_name(const char name[], WaveformType *out_type);
@@ -1,52 +1,262 @@
 #include <assert.h>
 #include <string.h>
 #include "esp_wifi.h"
+#include "esp_netif_sntp.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "sdkconfig.h"
+#ifdef CONFIG_ETH_USE_OPENETH
+#include "esp_eth.h"
+#endif
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 
 #include "esp_log.h"
 #include "wifi.h"
+#include "adc.h"
 
 
 static const char* TAG = "wifi";
 
+#define WIFI_NVS_NAMESPACE "wifi"
+#define CACHED_AP_NVS_KEY "ap"
+
+// Failed attempts on the cached access point's channel before scanning all 
+// of them, for when the access point has come back on another channel
+#define CACHED_AP_MAX_ATTEMPTS 3
+
+// The access point last associated with. Connecting to it directly on its 
+// channel skips the scan of every channel, which takes most of a second.
+typedef struct {
+    char ssid[WIFI_MAX_SSID_LENGTH + 1];
+    uint8_t bssid[6];
+    uint8_t channel;
+} CachedAccessPoint;
+
 wifi_config_t station_config;
 esp_netif_t *esp_netif;
 
 esp_event_loop_handle_t event_loop;
 extern bool wifi_is_connected;
 
+static CachedAccessPoint cached_ap;
+static bool station_associated;
+static bool ever_got_ip;
+static unsigned int cached_ap_failures;
+static SemaphoreHandle_t got_ip;
+static StaticSemaphore_t got_ip_buffer;
+static WifiTiming timing;
+
 static void on_station_start(void *context, esp_event_base_t event_base, int32_t event_id, void *event_data);
 static void on_wifi_connected(void *context, esp_event_base_t event_base, int32_t event_id, void *event_data);
 static void on_wifi_disconnected(void *context, esp_event_base_t event_base, int32_t event_id, void *event_data);
 static void on_got_ip(void *wifi_connected_semaphore, esp_event_base_t event_base, int32_t event_id, void *event_data);
+static void on_time_synchronized(struct timeval *time);
+static void load_cached_ap(void);
+static void save_cached_ap(const CachedAccessPoint *ap);
+static void configure_address(const WifiSettings *settings);
 
+/**
+ * @brief 
+ * Connect to an access point with DHCP
+ * @param ssid 
+ * @param password 
+ */
 void initialize_wifi(const char ssid[], const char password[]) {
-    assert(strlen(ssid) <= 32);
-    assert(strlen(password) <= 64);
+    assert(strlen(ssid) <= WIFI_MAX_SSID_LENGTH);
+    assert(strlen(password) <= WIFI_MAX_PASSWORD_LENGTH);
 
-    ESP_ERROR_CHECK(esp_netif_init());
-    esp_netif = esp_netif_create_default_wifi_sta();
+    WifiSettings settings = {0};
+    strcpy(settings.ssid, ssid);
+    strcpy(settings.password, password);
+    start_wifi(&settings);
+}
+
+/**
+ * @brief 
+ * Connect to an access point. The Wi-Fi driver and network interface are 
+ * set up on the first call only, since each setup allocates them afresh; 
+ * later calls switch the station to the new access point. If the station 
+ * last associated with an access point of this SSID, it goes straight to 
+ * that access point on its channel, and falls back to a full scan should 
+ * that fail CACHED_AP_MAX_ATTEMPTS times in a row.
+ * @param settings 
+ */
+void start_wifi(const WifiSettings *settings) {
+    static bool wifi_initialized;
+    if (! wifi_initialized) {
+        ESP_ERROR_CHECK(esp_netif_init());
+        esp_netif = esp_netif_create_default_wifi_sta();
+
+        wifi_init_config_t wifi_config = WIFI_INIT_CONFIG_DEFAULT();
+        ESP_ERROR_CHECK(esp_wifi_init(&wifi_config));
 
-    wifi_init_config_t wifi_config = WIFI_INIT_CONFIG_DEFAULT();
-    ESP_ERROR_CHECK(esp_wifi_init(&wifi_config));
+        ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
 
-    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-    strncpy((char *) station_config.sta.ssid, ssid, 32);
+        got_ip = xSemaphoreCreateBinaryStatic(&got_ip_buffer);
+        load_cached_ap();
+    }
+
+    timing = (WifiTiming) {.start_us = esp_timer_get_time()};
+    ever_got_ip = false;
+    cached_ap_failures = 0;
+    configure_address(settings);
+
+    memset(&station_config, 0, sizeof(station_config));
+    strncpy((char *) station_config.sta.ssid, settings->ssid, WIFI_MAX_SSID_LENGTH);
     ESP_LOGI(TAG, "SSID: \"%s\"", station_config.sta.ssid);
-    strncpy((char *) station_config.sta.password, password, 64);
-    ESP_LOGI(TAG, "PASS: \"%s\"", station_config.sta.password);
+    strncpy((char *) station_config.sta.password, settings->password, WIFI_MAX_PASSWORD_LENGTH);
+    if (! strcmp(cached_ap.ssid, settings->ssid)) {
+        station_config.sta.bssid_set = true;
+        memcpy(station_config.sta.bssid, cached_ap.bssid, sizeof(cached_ap.bssid));
+        station_config.sta.channel = cached_ap.channel;
+        station_config.sta.scan_method = WIFI_FAST_SCAN;
+        timing.used_cached_ap = true;
+        ESP_LOGI(TAG, "Trying the cached access point on channel %u", cached_ap.channel);
+    }
+    else {
+        station_config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+    }
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &station_config));
 
+    if (wifi_initialized) {
+        // The disconnection handler reconnects with the new configuration
+        wifi_is_connected = false;
+        ESP_ERROR_CHECK(esp_wifi_disconnect());
+        return;
+    }
+
     ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_STA_START, on_station_start, NULL));
     ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_STA_CONNECTED, on_wifi_connected, NULL));
     ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, on_wifi_disconnected, NULL));
     ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, on_got_ip, NULL));
     ESP_ERROR_CHECK(esp_wifi_start());
+    wifi_initialized = true;
+}
+
+#ifdef CONFIG_ETH_USE_OPENETH
+/**
+ * @brief 
+ * Connect through the Ethernet MAC that QEMU emulates, in place of Wi-Fi, 
+ * which QEMU lacks. The address comes from DHCP, and the connection is 
+ * reported like a Wi-Fi one, so telemetry and SNTP run over it unchanged.
+ */
+void start_ethernet(void) {
+    ESP_ERROR_CHECK(esp_netif_init());
+    esp_netif_config_t netif_config = ESP_NETIF_DEFAULT_ETH();
+    esp_netif = esp_netif_new(&netif_config);
+    got_ip = xSemaphoreCreateBinaryStatic(&got_ip_buffer);
+
+    eth_mac_config_t mac_config = ETH_MAC_DEFAULT_CONFIG();
+    eth_phy_config_t phy_config = ETH_PHY_DEFAULT_CONFIG();
+    phy_config.autonego_timeout_ms = 100;
+    esp_eth_mac_t *mac = esp_eth_mac_new_openeth(&mac_config);
+    esp_eth_phy_t *phy = esp_eth_phy_new_dp83848(&phy_config);
+    esp_eth_config_t eth_config = ETH_DEFAULT_CONFIG(mac, phy);
+    esp_eth_handle_t eth_handle;
+    ESP_ERROR_CHECK(esp_eth_driver_install(&eth_config, &eth_handle));
+    ESP_ERROR_CHECK(esp_netif_attach(esp_netif, esp_eth_new_netif_glue(eth_handle)));
 
+    // The emulated link is always up
+    station_associated = true;
+    timing = (WifiTiming) {.start_us = esp_timer_get_time()};
+    ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_ETH_GOT_IP, on_got_ip, NULL));
+    ESP_ERROR_CHECK(esp_eth_start(eth_handle));
 }
+#endif
 
+/**
+ * @brief 
+ * Use the static address of `settings`, or DHCP if it has none. A static 
+ * address skips the DHCP exchange, which is most of the time to an address 
+ * after association. The gateway serves as the DNS server.
+ */
+static void configure_address(const WifiSettings *settings) {
+    if (settings->ip == 0) {
+        esp_err_t error = esp_netif_dhcpc_start(esp_netif);
+        if (error != ESP_OK && error != ESP_ERR_ESP_NETIF_DHCP_ALREADY_STARTED) {
+            ESP_LOGE(TAG, "Failed to start DHCP. details: %s", esp_err_to_name(error));
+        }
+        return;
+    }
+
+    esp_err_t error = esp_netif_dhcpc_stop(esp_netif);
+    if (error != ESP_OK && error != ESP_ERR_ESP_NETIF_DHCP_ALREADY_STOPPED) {
+        ESP_LOGE(TAG, "Failed to stop DHCP. details: %s", esp_err_to_name(error));
+        return;
+    }
+    esp_netif_ip_info_t ip_info = {
+        .ip.addr = settings->ip,
+        .netmask.addr = settings->netmask,
+        .gw.addr = settings->gateway
+    };
+    error = esp_netif_set_ip_info(esp_netif, &ip_info);
+    if (error != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to set the static address. details: %s", esp_err_to_name(error));
+        return;
+    }
+    esp_netif_dns_info_t dns_info = {
+        .ip.u_addr.ip4.addr = settings->gateway,
+        .ip.type = ESP_IPADDR_TYPE_V4
+    };
+    error = esp_netif_set_dns_info(esp_netif, ESP_NETIF_DNS_MAIN, &dns_info);
+    if (error != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to set the DNS server. details: %s", esp_err_to_name(error));
+    }
+}
+
+/**
+ * @brief 
+ * Wait until the station has an address
+ * @param timeout 
+ * @return 0 if connected
+ */
+int wait_for_wifi(TickType_t timeout) {
+    if (got_ip == NULL) {
+        return 1;
+    }
+    if (wifi_is_connected) {
+        return 0;
+    }
+    if (xSemaphoreTake(got_ip, timeout) != pdTRUE) {
+        return 1;
+    }
+    return wifi_is_connected ? 0 : 1;
+}
+
+void get_wifi_timing(WifiTiming *status) {
+    *status = timing;
+}
+
+static void load_cached_ap(void) {
+    nvs_handle_t nvs;
+    if (nvs_open(WIFI_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return;
+    }
+    size_t length = sizeof(cached_ap);
+    if (nvs_get_blob(nvs, CACHED_AP_NVS_KEY, &cached_ap, &length) != ESP_OK || length != sizeof(cached_ap)) {
+        memset(&cached_ap, 0, sizeof(cached_ap));
+    }
+    nvs_close(nvs);
+}
+
+static void save_cached_ap(const CachedAccessPoint *ap) {
+    nvs_handle_t nvs;
+    esp_err_t error = nvs_open(WIFI_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (error != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open NVS to cache the access point. details: %s", esp_err_to_name(error));
+        return;
+    }
+    error = nvs_set_blob(nvs, CACHED_AP_NVS_KEY, ap, sizeof(*ap));
+    if (error == ESP_OK) {
+        error = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    if (error != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to cache the access point. details: %s", esp_err_to_name(error));
+    }
+}
 
 static void on_station_start(void *context, esp_event_base_t event_base, int32_t event_id, void *event_data) {
     ESP_LOGI(TAG, "Wifi station started!");
@@ -54,15 +264,82 @@ static void on_station_start(void *context, esp_event_base_t event_base, int32_t
 }
 
 static void on_wifi_connected(void *context, esp_event_base_t event_base, int32_t event_id, void *event_data) {
-    ESP_LOGI(TAG, "Connected to wifi!");
+    const wifi_event_sta_connected_t *event = event_data;
+    station_associated = true;
+    cached_ap_failures = 0;
+    if (timing.connected_us == 0) {
+        timing.connected_us = esp_timer_get_time();
+    }
+    ESP_LOGI(TAG, "Connected to wifi on channel %u!", event->channel);
+
+    // Flash is only written when the access point has changed
+    CachedAccessPoint ap = {.channel = event->channel};
+    memcpy(ap.ssid, station_config.sta.ssid, WIFI_MAX_SSID_LENGTH);
+    memcpy(ap.bssid, event->bssid, sizeof(ap.bssid));
+    if (memcmp(&ap, &cached_ap, sizeof(ap))) {
+        cached_ap = ap;
+        save_cached_ap(&ap);
+    }
 }
 
 static void on_wifi_disconnected(void *context, esp_event_base_t event_base, int32_t event_id, void *event_data) {
+    const wifi_event_sta_disconnected_t *event = event_data;
+    station_associated = false;
+    wifi_is_connected = false;
+
+    // The cached access point may be gone or on another channel, whether or 
+    // not it worked before, so after a few failures scan for any access point 
+    // of the SSID instead. Leaving to switch access point is no failure.
+    if (event->reason != WIFI_REASON_ASSOC_LEAVE && station_config.sta.bssid_set && 
+        ++cached_ap_failures >= CACHED_AP_MAX_ATTEMPTS) {
+        ESP_LOGW(TAG, "Cached access point failed, scanning all channels");
+        station_config.sta.bssid_set = false;
+        station_config.sta.channel = 0;
+        station_config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+        timing.used_cached_ap = false;
+        ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &station_config));
+    }
     ESP_LOGI(TAG, "Wifi disconnected! Attempting to reconnect...");
     ESP_ERROR_CHECK(esp_wifi_connect());
 }
 
 static void on_got_ip(void *context, esp_event_base_t event_base, int32_t event_id, void *event_data) {
+    // A static address is announced when it is set, before association
+    if (! station_associated) {
+        return;
+    }
     ESP_LOGI(TAG, "Receieved an IP Address.");
     wifi_is_connected = true;
+    if (! ever_got_ip) {
+        ever_got_ip = true;
+        timing.got_ip_us = esp_timer_get_time();
+        ESP_LOGI(
+            TAG, 
+            "Address %lld ms after boot, %lld ms after the station started", 
+            (long long) (timing.got_ip_us / 1000), 
+            (long long) ((timing.got_ip_us - timing.start_us) / 1000)
+        );
+    }
+    xSemaphoreGive(got_ip);
+
+    // SNTP keeps running across reconnections, so it is only started once
+    static bool sntp_started;
+    if (! sntp_started) {
+        esp_sntp_config_t sntp_config = ESP_NETIF_SNTP_DEFAULT_CONFIG(CONFIG_SNTP_SERVER);
+        sntp_config.sync_cb = on_time_synchronized;
+        esp_err_t error = esp_netif_sntp_init(&sntp_config);
+        if (error != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to start SNTP. details: %s", esp_err_to_name(error));
+            return;
+        }
+#ifdef CONFIG_ADC_CLOCK_DISCIPLINE
+        sntp_set_sync_interval(CONFIG_ADC_DISCIPLINE_SNTP_INTERVAL * 1000);
+#endif
+        sntp_started = true;
+    }
+}
+
+static void on_time_synchronized(struct timeval *time) {
+    ESP_LOGD(TAG, "Wall clock synchronized.");
+    adc_clock_time_synchronized(time);
 }
\ No newline at end of file
@@ -1,4 +1,42 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sdkconfig.h"
+
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 
-void initialize_wifi(const char ssid[], const char password[]);
\ No newline at end of file
+#define WIFI_MAX_SSID_LENGTH 32
+#define WIFI_MAX_PASSWORD_LENGTH 64
+
+typedef struct {
+    char ssid[WIFI_MAX_SSID_LENGTH + 1];
+    char password[WIFI_MAX_PASSWORD_LENGTH + 1];
+    // Static address in network byte order, or an ip of 0 to use DHCP
+    uint32_t ip;
+    uint32_t netmask;
+    uint32_t gateway;
+} WifiSettings;
+
+/**
+ * @brief 
+ * Microseconds since boot at which the station was last started, associated 
+ * with its access point and given an address, 0 if not yet
+ */
+typedef struct {
+    int64_t start_us;
+    int64_t connected_us;
+    int64_t got_ip_us;
+    // Whether the last association used the cached access point and channel
+    bool used_cached_ap;
+} WifiTiming;
+
+void initialize_wifi(const char ssid[], const char password[]);
+void start_wifi(const WifiSettings *settings);
+int wait_for_wifi(TickType_t timeout);
+void get_wifi_timing(WifiTiming *timing);
+#ifdef CONFIG_ETH_USE_OPENETH
+void start_ethernet(void);
+#endif
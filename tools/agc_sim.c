@@ -0,0 +1,278 @@
+/*
+ * Host simulation of the firmware's automatic gain control on recorded data:
+ *
+ *   cc -O2 -I esp32/main -o agc_sim tools/agc_sim.c esp32/main/agc.c -lm
+ *
+ *   agc_sim [options] <samples_file | synthetic>
+ *
+ *   -g <gain>     VGA gain the samples were recorded at (default 1)
+ *   -s <scale>    scale the recorded pressure by this, to try louder or
+ *                 quieter signals (default 1)
+ *   -b <length>   block length (default 128)
+ *   -i <gain>     gain to start from (default 1)
+ *   -o <file>     write "<sample index> <sample> <gain>" lines of the
+ *                 simulated stream
+ *
+ * The samples file holds one sample per line; lines with two numbers, like the
+ * output of `telemetry_tool listen` or `uart_capture`, use the second. With
+ * "synthetic", ten minutes of noise with bursts rising to well past full
+ * scale is generated.
+ *
+ * The recording is taken as pressure, sample / recorded gain, and sampled
+ * again as the firmware would: each block at one gain, clipped to 24 bits,
+ * with the AGC choosing the gain of the next block. Every gain change is
+ * listed at the index of the first sample taken at the new gain. The time
+ * spent at each gain, clipped samples and the rounding error of the pressure
+ * recovered from sample / gain of the unclipped samples are reported, against
+ * holding the starting gain for comparison.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "agc.h"
+
+#define MAX_SAMPLE 8388607
+#define MIN_SAMPLE -8388608
+
+#define SYNTHETIC_SAMPLE_RATE 100.0
+#define SYNTHETIC_DURATION 600.0
+#define SYNTHETIC_NOISE 2000.0
+#define SYNTHETIC_NUM_BURSTS 6
+
+#define MAX_GAIN_STEPS 7
+
+typedef struct {
+    double *pressure;
+    size_t length;
+    size_t capacity;
+} Waveform;
+
+// Clipped samples are counted apart, so that the error is the resolution
+typedef struct {
+    unsigned long clipped_samples;
+    double sum_squared_error;
+} Reconstruction;
+
+static void append_pressure(Waveform *waveform, double pressure) {
+    if (waveform->length == waveform->capacity) {
+        waveform->capacity = waveform->capacity ? 2 * waveform->capacity : 65536;
+        waveform->pressure = realloc(waveform->pressure, waveform->capacity * sizeof(double));
+        if (waveform->pressure == NULL) {
+            fprintf(stderr, "error: out of memory\n");
+            exit(1);
+        }
+    }
+    waveform->pressure[waveform->length++] = pressure;
+}
+
+static int read_waveform(const char path[], double recorded_gain, double scale, Waveform *waveform) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        perror(path);
+        return 1;
+    }
+
+    char line[256];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        double first;
+        double second;
+        int fields = sscanf(line, "%lf %lf", &first, &second);
+        if (fields >= 1) {
+            append_pressure(waveform, (fields == 2 ? second : first) / recorded_gain * scale);
+        }
+    }
+    fclose(file);
+    return 0;
+}
+
+static double gaussian(void) {
+    double u1 = (rand() + 1.0) / (RAND_MAX + 2.0);
+    double u2 = (rand() + 1.0) / (RAND_MAX + 2.0);
+    return sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+}
+
+/**
+ * @brief
+ * Quiet noise with decaying tone bursts each four times louder than the
+ * last, the loudest of which would clip even at the lowest gain
+ */
+static void synthesize_waveform(double scale, Waveform *waveform) {
+    size_t length = (size_t) (SYNTHETIC_DURATION * SYNTHETIC_SAMPLE_RATE);
+    size_t burst_spacing = length / (SYNTHETIC_NUM_BURSTS + 1);
+
+    srand(1);
+    for (size_t i = 0; i < length; i++) {
+        double pressure = SYNTHETIC_NOISE * gaussian();
+        for (int b = 0; b < SYNTHETIC_NUM_BURSTS; b++) {
+            size_t onset = (b + 1) * burst_spacing;
+            if (i < onset) {
+                break;
+            }
+            double t = (i - onset) / SYNTHETIC_SAMPLE_RATE;
+            double amplitude = 10 * SYNTHETIC_NOISE * pow(4, b);
+            pressure += amplitude * exp(-t / 5) * sin(2 * M_PI * 0.5 * t);
+        }
+        append_pressure(waveform, pressure * scale);
+    }
+}
+
+static int32_t sample_pressure(double pressure, unsigned int gain) {
+    double sample = round(pressure * gain);
+    if (sample > MAX_SAMPLE) {
+        return MAX_SAMPLE;
+    }
+    if (sample < MIN_SAMPLE) {
+        return MIN_SAMPLE;
+    }
+    return (int32_t) sample;
+}
+
+static void account_sample(Reconstruction *reconstruction, double pressure, int32_t sample, unsigned int gain) {
+    if (sample == MAX_SAMPLE || sample == MIN_SAMPLE) {
+        reconstruction->clipped_samples++;
+        return;
+    }
+    double error = (double) sample / gain - pressure;
+    reconstruction->sum_squared_error += error * error;
+}
+
+static void print_reconstruction(const char label[], const Reconstruction *reconstruction, size_t length) {
+    size_t unclipped = length - reconstruction->clipped_samples;
+    printf(
+        "%-16s %8lu clipped samples, rms error of the rest %.4f counts at unity gain\n",
+        label,
+        reconstruction->clipped_samples,
+        unclipped > 0 ? sqrt(reconstruction->sum_squared_error / unclipped) : 0
+    );
+}
+
+static int gain_step(unsigned int gain) {
+    int step = 0;
+    while (gain > 1) {
+        gain >>= 1;
+        step++;
+    }
+    return step;
+}
+
+static void usage(const char program[]) {
+    fprintf(
+        stderr,
+        "usage: %s [-g recorded_gain] [-s scale] [-b block_length] [-i initial_gain] [-o file] "
+        "<samples_file | synthetic>\n",
+        program
+    );
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    double recorded_gain = 1;
+    double scale = 1;
+    size_t block_length = 128;
+    unsigned int initial_gain = AGC_MIN_GAIN;
+    const char *output_path = NULL;
+
+    int option;
+    while ((option = getopt(argc, argv, "g:s:b:i:o:")) != -1) {
+        switch (option) {
+            case 'g': recorded_gain = atof(optarg); break;
+            case 's': scale = atof(optarg); break;
+            case 'b': block_length = atol(optarg); break;
+            case 'i': initial_gain = atoi(optarg); break;
+            case 'o': output_path = optarg; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1 || recorded_gain <= 0 || block_length < 1) {
+        usage(argv[0]);
+    }
+    if (initial_gain < AGC_MIN_GAIN || initial_gain > AGC_MAX_GAIN || (initial_gain & (initial_gain - 1))) {
+        fprintf(stderr, "error: initial gain %u is not a power of two from 1 to 64\n", initial_gain);
+        return 1;
+    }
+
+    Waveform waveform = {0};
+    if (! strcmp(argv[optind], "synthetic")) {
+        synthesize_waveform(scale, &waveform);
+    }
+    else if (read_waveform(argv[optind], recorded_gain, scale, &waveform)) {
+        return 1;
+    }
+    if (waveform.length == 0) {
+        fprintf(stderr, "error: no samples read\n");
+        return 1;
+    }
+
+    FILE *output = NULL;
+    if (output_path != NULL) {
+        output = fopen(output_path, "w");
+        if (output == NULL) {
+            perror(output_path);
+            return 1;
+        }
+    }
+
+    AgcSettings settings;
+    agc_default_settings(&settings);
+    Agc agc;
+    agc_initialize(&agc, &settings, initial_gain);
+
+    int32_t *block = malloc(block_length * sizeof(int32_t));
+    if (block == NULL) {
+        fprintf(stderr, "error: out of memory\n");
+        return 1;
+    }
+
+    Reconstruction automatic = {0};
+    Reconstruction fixed = {0};
+    size_t samples_at_step[MAX_GAIN_STEPS] = {0};
+    unsigned int gain = initial_gain;
+
+    printf("%12s %8s %8s\n", "sample", "from", "to");
+    for (size_t first = 0; first < waveform.length; first += block_length) {
+        size_t length = waveform.length - first < block_length ? waveform.length - first : block_length;
+        for (size_t i = 0; i < length; i++) {
+            double pressure = waveform.pressure[first + i];
+            block[i] = sample_pressure(pressure, gain);
+            account_sample(&automatic, pressure, block[i], gain);
+            account_sample(&fixed, pressure, sample_pressure(pressure, initial_gain), initial_gain);
+            if (output != NULL) {
+                fprintf(output, "%zu %ld %u\n", first + i, (long) block[i], gain);
+            }
+        }
+        samples_at_step[gain_step(gain)] += length;
+
+        unsigned int next_gain = agc_update(&agc, block, length);
+        if (next_gain != gain && first + length < waveform.length) {
+            printf("%12zu %8u %8u\n", first + length, gain, next_gain);
+        }
+        gain = next_gain;
+    }
+
+    printf("\n%zu samples in blocks of %zu\n", waveform.length, block_length);
+    printf(
+        "%lu gain increases, %lu decreases, %lu clipped blocks\n",
+        agc.num_increases,
+        agc.num_decreases,
+        agc.num_clipped_blocks
+    );
+    for (int step = 0; step < MAX_GAIN_STEPS; step++) {
+        if (samples_at_step[step] > 0) {
+            printf("gain %2u      %6.2f%% of samples\n", 1U << step, 100.0 * samples_at_step[step] / waveform.length);
+        }
+    }
+    print_reconstruction("automatic gain", &automatic, waveform.length);
+    char fixed_label[32];
+    snprintf(fixed_label, sizeof(fixed_label), "fixed gain %u", initial_gain);
+    print_reconstruction(fixed_label, &fixed, waveform.length);
+
+    if (output != NULL) {
+        fclose(output);
+    }
+    free(block);
+    free(waveform.pressure);
+    return 0;
+}
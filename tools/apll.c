@@ -1,59 +1,144 @@
+/*
+ * ESP32 APLL coefficient solver, using the same solver as the firmware:
+ *
+ *   cc -O2 -I esp32/main -o apll tools/apll.c esp32/main/apll.c esp32/main/adc_profile.c -lm
+ *
+ *   apll [-x <xtal Hz>] [-n <count>] <frequency>
+ *     Print the coefficients closest to a frequency, best first, with their
+ *     error and VCO frequency.
+ *
+ *   apll [-x <xtal Hz>] -t > apll_table.h
+ *     Print a C header with the closest coefficients to the MCLK of every
+ *     ADC profile.
+ *
+ * The crystal defaults to 40 MHz.
+ */
 #include <stdio.h>
-#include <math.h>
 #include <stdlib.h>
+#include <unistd.h>
 
-const double fxtal = 40E6;
-
-double dividend(int sdm0, int sdm1, int sdm2);
-double divisor(int odiv);
-
-int main(int arcg, char *argv[]) {
-  double desired_frequency = atof(argv[1]);
-
-  double closest_frequency;
-  int closest_sdm0;
-  int closest_sdm1;
-  int closest_sdm2;
-  int closest_odiv;
-
-  for (int sdm0 = 0; sdm0 <= 255; sdm0++) {
-    for (int sdm1 = 0; sdm1 <= 255; sdm1++) {
-      for (int sdm2 = 0; sdm2 <= 63; sdm2++) {
-        for (int odiv = 0; odiv <= 31; odiv++) {
-          double candidate_dividend = dividend(sdm0, sdm1, sdm2);
-          if (candidate_dividend >= 350E6 && candidate_dividend <= 500E6) {
-            double candidate_frequency = candidate_dividend / divisor(odiv);
-            if (fabs(candidate_frequency - desired_frequency) < fabs(closest_frequency - desired_frequency)) {
-              closest_frequency = candidate_frequency;
-              closest_sdm0 = sdm0;
-              closest_sdm1 = sdm1;
-              closest_sdm2 = sdm2;
-              closest_odiv = odiv;
-            }
-          }
+#include "apll.h"
+#include "adc_profile.h"
+
+#define DEFAULT_XTAL_FREQUENCY 40E6
+#define DEFAULT_NUM_CANDIDATES 5
+// Each divider gives at most two candidates
+#define MAX_CANDIDATES (2 * (APLL_MAX_ODIV + 1))
+
+static double error_ppm(double actual, double desired) {
+    return (actual / desired - 1) * 1E6;
+}
+
+int print_candidates(double xtal_frequency, double frequency, size_t num_candidates);
+int print_profile_table(double xtal_frequency);
+
+static void usage(const char program[]) {
+    fprintf(
+        stderr,
+        "usage: %s [-x xtal] [-n count] <frequency>\n"
+        "       %s [-x xtal] -t\n",
+        program,
+        program
+    );
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    double xtal_frequency = DEFAULT_XTAL_FREQUENCY;
+    size_t num_candidates = DEFAULT_NUM_CANDIDATES;
+    int print_table = 0;
+
+    int option;
+    while ((option = getopt(argc, argv, "x:n:t")) != -1) {
+        switch (option) {
+            case 'x': xtal_frequency = atof(optarg); break;
+            case 'n': num_candidates = atoi(optarg); break;
+            case 't': print_table = 1; break;
+            default: usage(argv[0]);
         }
-      }
-    }
-  }
-
-  printf(
-      "Desired Frequency: %f\n"
-      "Closest Frequency: %f\n"
-      "sdm0: %d, sdm1: %d, sdm2: %d, odiv: %d",
-      desired_frequency,
-      closest_frequency,
-      closest_sdm0,
-      closest_sdm1,
-      closest_sdm2,
-      closest_odiv
-  );
+    }
+    if (xtal_frequency <= 0 || num_candidates < 1) {
+        usage(argv[0]);
+    }
+    if (num_candidates > MAX_CANDIDATES) {
+        num_candidates = MAX_CANDIDATES;
+    }
+
+    if (print_table && optind == argc) {
+        return print_profile_table(xtal_frequency);
+    }
+    if (! print_table && optind == argc - 1) {
+        return print_candidates(xtal_frequency, atof(argv[optind]), num_candidates);
+    }
+    usage(argv[0]);
 }
 
-double dividend(int sdm0, int sdm1, int sdm2) {
-  return fxtal * 
-    (sdm2 + sdm1 / (1 << 8) + sdm0 / (1 << 16) + 4);
+int print_candidates(double xtal_frequency, double frequency, size_t num_candidates) {
+    ApllCoefficients candidates[MAX_CANDIDATES];
+    size_t num_found = apll_solve(xtal_frequency, frequency, candidates, num_candidates);
+    if (num_found == 0) {
+        fprintf(stderr, "error: %.3f Hz is out of the APLL's range\n", frequency);
+        return 1;
+    }
+
+    printf("%16s %12s %8s %6s %6s %6s %6s\n", "frequency", "error ppm", "VCO MHz", "odiv", "sdm2", "sdm1", "sdm0");
+    for (size_t c = 0; c < num_found; c++) {
+        const ApllCoefficients *candidate = &candidates[c];
+        double actual = apll_frequency(xtal_frequency, candidate);
+        printf(
+            "%16.3f %12.4f %8.3f %6u %6u %6u %6u\n",
+            actual,
+            error_ppm(actual, frequency),
+            apll_vco_frequency(xtal_frequency, candidate) / 1E6,
+            (unsigned) candidate->odiv,
+            (unsigned) candidate->sdm2,
+            (unsigned) candidate->sdm1,
+            (unsigned) candidate->sdm0
+        );
+    }
+    return 0;
 }
 
-double divisor(int odiv) {
-  return (2 * (odiv + 2));
+int print_profile_table(double xtal_frequency) {
+    printf(
+        "#pragma once\n"
+        "\n"
+        "// Generated by tools/apll -x %.0f -t\n"
+        "\n"
+        "#include \"apll.h\"\n"
+        "\n"
+        "#define APLL_TABLE_XTAL_FREQUENCY %.0f\n"
+        "\n"
+        "typedef struct {\n"
+        "    const char *profile;\n"
+        "    double mclk_frequency;\n"
+        "    ApllCoefficients coefficients;\n"
+        "} ApllProfileCoefficients;\n"
+        "\n"
+        "static const ApllProfileCoefficients apll_profile_coefficients[] = {\n",
+        xtal_frequency,
+        xtal_frequency
+    );
+    for (size_t p = 0; p < num_adc_profiles; p++) {
+        const AdcProfile *profile = &adc_profiles[p];
+        ApllCoefficients coefficients;
+        if (apll_solve(xtal_frequency, profile->mclk_frequency, &coefficients, 1) == 0) {
+            fprintf(stderr, "error: MCLK of profile %s is out of the APLL's range\n", profile->name);
+            return 1;
+        }
+        printf(
+            "    // %.3f Hz, %+.4f ppm\n"
+            "    {\"%s\", %.1f, {.odiv = %u, .sdm0 = %u, .sdm1 = %u, .sdm2 = %u}},\n",
+            apll_frequency(xtal_frequency, &coefficients),
+            error_ppm(apll_frequency(xtal_frequency, &coefficients), profile->mclk_frequency),
+            profile->name,
+            profile->mclk_frequency,
+            (unsigned) coefficients.odiv,
+            (unsigned) coefficients.sdm0,
+            (unsigned) coefficients.sdm1,
+            (unsigned) coefficients.sdm2
+        );
+    }
+    printf("};\n");
+    return 0;
 }
@@ -0,0 +1,615 @@
+/*
+ * Reads, writes and benchmarks sample archives, the time-indexed files
+ * telemetry_ingest -a keeps of each microphone's samples:
+ *
+ *   cc -O2 -I esp32/main -I esp32/host -o archive_tool tools/archive_tool.c esp32/host/sample_archive.c \
+ *       esp32/main/decimator.c -lm
+ *
+ *   archive_tool import [-c samples] [-n name] <archive> <sample_rate> <start_time> < samples.txt
+ *     Append one sample per line from stdin, with sample 0 taken at
+ *     `start_time`. Lines with two numbers, like the output of
+ *     `telemetry_tool listen`, give the sample index and the sample, and a gap
+ *     in the index starts a new chunk.
+ *     -c sets the samples per chunk and -n the microphone's name of a new
+ *     archive.
+ *
+ *   archive_tool info [-v] <archive>
+ *     Print what the archive holds and where its samples are not contiguous.
+ *     -v also checks every chunk's CRC.
+ *
+ *   archive_tool extract [-f from] [-t to] [-r rate] [-i] <archive>
+ *     Print "<time> <sample>" lines for the samples taken from `from` up to
+ *     `to`, by default all of them. -r decimates to `rate` samples/s with the
+ *     firmware's decimation filters, and -i prints sample indexes instead of
+ *     times.
+ *
+ *   archive_tool repair <archive>
+ *     Index any chunks missing from the index and cut off a chunk left half
+ *     written, as opening the archive to append does.
+ *
+ *   archive_tool bench [-s megabytes] [-r rate] [-l seconds] [-q queries] <archive>
+ *     Write a synthetic archive of `megabytes` (default 4096) at `rate`
+ *     samples/s (default 1000) and report how fast it was written. Then time
+ *     `queries` (default 200) reads of `seconds` (default 300) at random
+ *     times, once with the archive dropped from the page cache and once
+ *     with it cached. The archive must not exist already, and is left behind.
+ *
+ * Times are given as seconds since the epoch or in UTC as
+ * 2026-10-17T02:00:00[.fraction][Z], and printed as seconds since the epoch.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "sample_archive.h"
+#include "decimator.h"
+
+#define IMPORT_BLOCK_LENGTH 4096
+#define EXTRACT_BLOCK_LENGTH 4096
+
+#define BENCH_DEFAULT_MEGABYTES 4096
+#define BENCH_DEFAULT_RATE 1000
+#define BENCH_DEFAULT_QUERY_SECONDS 300
+#define BENCH_DEFAULT_QUERIES 200
+#define BENCH_BLOCK_LENGTH 1024
+// One block in this many is left out, so that the archive has gaps
+#define BENCH_GAP_PERIOD 5000
+
+static int import_samples(int argc, char *argv[]);
+static int print_info(int argc, char *argv[]);
+static int extract_samples(int argc, char *argv[]);
+static int repair_archive(int argc, char *argv[]);
+static int run_bench(int argc, char *argv[]);
+
+static void usage(void) {
+    fprintf(
+        stderr,
+        "usage: archive_tool import [-c samples] [-n name] <archive> <sample_rate> <start_time>\n"
+        "       archive_tool info [-v] <archive>\n"
+        "       archive_tool extract [-f from] [-t to] [-r rate] [-i] <archive>\n"
+        "       archive_tool repair <archive>\n"
+        "       archive_tool bench [-s megabytes] [-r rate] [-l seconds] [-q queries] <archive>\n"
+    );
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        usage();
+    }
+    // Options are parsed after the command
+    if (! strcmp(argv[1], "import")) {
+        return import_samples(argc - 1, argv + 1);
+    }
+    if (! strcmp(argv[1], "info")) {
+        return print_info(argc - 1, argv + 1);
+    }
+    if (! strcmp(argv[1], "extract")) {
+        return extract_samples(argc - 1, argv + 1);
+    }
+    if (! strcmp(argv[1], "repair")) {
+        return repair_archive(argc - 1, argv + 1);
+    }
+    if (! strcmp(argv[1], "bench")) {
+        return run_bench(argc - 1, argv + 1);
+    }
+    usage();
+}
+
+/**
+ * @brief
+ * Parse seconds since the epoch or a UTC date and time
+ * @return 0 if success
+ */
+static int parse_time(const char text[], int64_t *out_time_us) {
+    char *end;
+    double seconds = strtod(text, &end);
+    if (*end == '\0' && end != text) {
+        *out_time_us = (int64_t) llround(seconds * 1E6);
+        return 0;
+    }
+
+    struct tm fields = {0};
+    end = strptime(text, "%Y-%m-%dT%H:%M:%S", &fields);
+    if (end == NULL) {
+        return 1;
+    }
+    double fraction = 0;
+    if (*end == '.') {
+        fraction = strtod(end, &end);
+    }
+    if (*end == 'Z') {
+        end++;
+    }
+    if (*end != '\0') {
+        return 1;
+    }
+    *out_time_us = (int64_t) timegm(&fields) * 1000000 + (int64_t) llround(fraction * 1E6);
+    return 0;
+}
+
+static void format_time(char out[], size_t length, int64_t time_us) {
+    time_t seconds = (time_t) (time_us / 1000000);
+    struct tm fields;
+    gmtime_r(&seconds, &fields);
+    size_t written = strftime(out, length, "%Y-%m-%dT%H:%M:%S", &fields);
+    snprintf(out + written, length - written, ".%06lldZ", (long long) (time_us % 1000000));
+}
+
+static double monotonic_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1E-9;
+}
+
+static int import_samples(int argc, char *argv[]) {
+    uint32_t chunk_samples = SAMPLE_ARCHIVE_DEFAULT_CHUNK_SAMPLES;
+    const char *name = "";
+
+    int option;
+    while ((option = getopt(argc, argv, "c:n:")) != -1) {
+        switch (option) {
+            case 'c': chunk_samples = strtoul(optarg, NULL, 0); break;
+            case 'n': name = optarg; break;
+            default: usage();
+        }
+    }
+    int64_t start_us;
+    if (argc - optind != 3 || chunk_samples == 0 || parse_time(argv[optind + 2], &start_us)) {
+        usage();
+    }
+    double sample_rate = atof(argv[optind + 1]);
+    if (sample_rate <= 0 || sample_rate * 1000 > UINT32_MAX) {
+        usage();
+    }
+    uint32_t sample_rate_mhz = (uint32_t) (sample_rate * 1000 + 0.5);
+
+    SampleArchiveWriter writer;
+    if (sample_archive_open_writer(&writer, argv[optind], name, chunk_samples)) {
+        return 1;
+    }
+
+    static int32_t samples[IMPORT_BLOCK_LENGTH];
+    size_t num_samples = 0;
+    uint64_t first_sample_index = 0;
+    uint64_t next_sample_index = 0;
+    uint64_t total = 0;
+    int result = 0;
+    char line[256];
+    for ( ;; ) {
+        bool at_end = fgets(line, sizeof(line), stdin) == NULL;
+        long long first;
+        long long second;
+        int fields = at_end ? 0 : sscanf(line, "%lld %lld", &first, &second);
+        if (! at_end && fields < 1) {
+            continue;
+        }
+        uint64_t sample_index = fields == 2 ? (uint64_t) first : next_sample_index;
+
+        // Samples are appended a contiguous block at a time
+        if (num_samples > 0 && (at_end || num_samples == IMPORT_BLOCK_LENGTH || sample_index != next_sample_index)) {
+            SampleArchiveSpan block = {
+                .first_time_us = start_us,
+                .sample_rate_mhz = sample_rate_mhz
+            };
+            if (sample_archive_append(&writer, first_sample_index, sample_archive_sample_time(&block, first_sample_index),
+                                      sample_rate_mhz, samples, num_samples)) {
+                result = 1;
+                break;
+            }
+            total += num_samples;
+            num_samples = 0;
+        }
+        if (at_end) {
+            break;
+        }
+        if (num_samples == 0) {
+            first_sample_index = sample_index;
+        }
+        samples[num_samples++] = (int32_t) (fields == 2 ? second : first);
+        next_sample_index = sample_index + 1;
+    }
+
+    if (sample_archive_close_writer(&writer)) {
+        result = 1;
+    }
+    printf("%llu samples appended, %llu chunks in the archive\n",
+        (unsigned long long) total, (unsigned long long) writer.num_chunks);
+    return result;
+}
+
+static int print_info(int argc, char *argv[]) {
+    bool verify = false;
+    int option;
+    while ((option = getopt(argc, argv, "v")) != -1) {
+        switch (option) {
+            case 'v': verify = true; break;
+            default: usage();
+        }
+    }
+    if (argc - optind != 1) {
+        usage();
+    }
+
+    SampleArchiveReader reader;
+    if (sample_archive_open_reader(&reader, argv[optind])) {
+        return 1;
+    }
+    char created[40];
+    format_time(created, sizeof(created), reader.header.created_us);
+    printf("microphone \"%s\", created %s, up to %u samples a chunk\n",
+        reader.header.name, created, reader.header.chunk_samples);
+    printf("%zu chunks, %zu bytes, index %zu bytes\n", reader.num_chunks, reader.archive_length, reader.index_length);
+
+    uint64_t num_samples = 0;
+    size_t num_bad = 0;
+    SampleArchiveSpan run = {0};
+    SampleArchiveSpan chunk;
+    for (size_t c = 0; c < reader.num_chunks; c++) {
+        if (sample_archive_read_chunk(&reader, c, &chunk)) {
+            fprintf(stderr, "error: chunk %zu is not where the index says\n", c);
+            sample_archive_close_reader(&reader);
+            return 1;
+        }
+        if (verify && sample_archive_verify_chunk(&reader, c)) {
+            fprintf(stderr, "warning: chunk %zu does not match its CRC\n", c);
+            num_bad++;
+        }
+        num_samples += chunk.num_samples;
+
+        // Print each contiguous run of chunks
+        bool continues = c > 0 &&
+            chunk.first_sample_index == run.first_sample_index + run.num_samples &&
+            chunk.sample_rate_mhz == run.sample_rate_mhz &&
+            llabs(chunk.first_time_us - sample_archive_span_end(&run)) <= SAMPLE_ARCHIVE_MAX_TIME_ERROR_US;
+        if (continues) {
+            run.num_samples += chunk.num_samples;
+            continue;
+        }
+        if (c > 0) {
+            char start[40];
+            format_time(start, sizeof(start), run.first_time_us);
+            printf("  %s  %.3f s at %.3f samples/s from sample %llu\n",
+                start, run.num_samples * 1000.0 / run.sample_rate_mhz, run.sample_rate_mhz / 1000.0,
+                (unsigned long long) run.first_sample_index);
+        }
+        run = chunk;
+    }
+    if (reader.num_chunks > 0) {
+        char start[40];
+        format_time(start, sizeof(start), run.first_time_us);
+        printf("  %s  %.3f s at %.3f samples/s from sample %llu\n",
+            start, run.num_samples * 1000.0 / run.sample_rate_mhz, run.sample_rate_mhz / 1000.0,
+            (unsigned long long) run.first_sample_index);
+    }
+    printf("%llu samples\n", (unsigned long long) num_samples);
+    if (verify) {
+        printf("%zu chunks do not match their CRC\n", num_bad);
+    }
+    sample_archive_close_reader(&reader);
+    return num_bad > 0;
+}
+
+static void print_sample(int64_t time_us, uint64_t sample_index, int32_t sample, bool print_index) {
+    if (print_index) {
+        printf("%llu %ld\n", (unsigned long long) sample_index, (long) sample);
+    }
+    else {
+        printf("%lld.%06lld %ld\n", (long long) (time_us / 1000000), (long long) (time_us % 1000000), (long) sample);
+    }
+}
+
+static int extract_samples(int argc, char *argv[]) {
+    int64_t from_us = INT64_MIN;
+    int64_t to_us = INT64_MAX;
+    double output_rate = 0;
+    bool print_index = false;
+
+    int option;
+    while ((option = getopt(argc, argv, "f:t:r:i")) != -1) {
+        switch (option) {
+            case 'f': if (parse_time(optarg, &from_us)) usage(); break;
+            case 't': if (parse_time(optarg, &to_us)) usage(); break;
+            case 'r': output_rate = atof(optarg); break;
+            case 'i': print_index = true; break;
+            default: usage();
+        }
+    }
+    if (argc - optind != 1 || output_rate < 0 || from_us >= to_us) {
+        usage();
+    }
+
+    SampleArchiveReader reader;
+    if (sample_archive_open_reader(&reader, argv[optind])) {
+        return 1;
+    }
+    SampleArchiveQuery query;
+    SampleArchiveSpan span;
+    if (output_rate == 0) {
+        sample_archive_query(&reader, from_us, to_us, &query);
+        while (sample_archive_query_next(&query, &span)) {
+            for (uint32_t i = 0; i < span.num_samples; i++) {
+                print_sample(sample_archive_sample_time(&span, i), span.first_sample_index + i, span.samples[i], print_index);
+            }
+        }
+        sample_archive_close_reader(&reader);
+        return 0;
+    }
+
+    // Decimating, the filters are run from before `from` so that they have
+    // settled by then, and until after `to`, since their outputs lag their
+    // inputs
+    static DecimatorCascade cascade;
+    static int32_t block[EXTRACT_BLOCK_LENGTH];
+    sample_archive_query(&reader, from_us, to_us, &query);
+    if (! sample_archive_query_next(&query, &span)) {
+        sample_archive_close_reader(&reader);
+        return 0;
+    }
+    if (decimator_cascade_initialize(&cascade, span.sample_rate_mhz / 1000.0, output_rate)) {
+        fprintf(stderr, "error: cannot decimate %.3f samples/s to %.3f samples/s\n",
+            span.sample_rate_mhz / 1000.0, output_rate);
+        sample_archive_close_reader(&reader);
+        return 1;
+    }
+    int64_t settle_us = (int64_t) (2 * decimator_cascade_delay(&cascade) * 1E9 / span.sample_rate_mhz);
+
+    int result = 0;
+    uint32_t cascade_rate_mhz = span.sample_rate_mhz;
+    uint64_t next_sample_index = span.first_sample_index + 1;
+    int64_t run_start_us = 0;
+    uint64_t run_start_index = 0;
+    sample_archive_query(
+        &reader,
+        from_us == INT64_MIN ? from_us : from_us - settle_us,
+        to_us == INT64_MAX ? to_us : to_us + settle_us,
+        &query
+    );
+    while (sample_archive_query_next(&query, &span)) {
+        if (span.sample_rate_mhz != cascade_rate_mhz) {
+            if (decimator_cascade_initialize(&cascade, span.sample_rate_mhz / 1000.0, output_rate)) {
+                fprintf(stderr, "error: cannot decimate %.3f samples/s to %.3f samples/s\n",
+                    span.sample_rate_mhz / 1000.0, output_rate);
+                result = 1;
+                break;
+            }
+            cascade_rate_mhz = span.sample_rate_mhz;
+            next_sample_index = span.first_sample_index + 1;
+        }
+        // Filter history does not carry across a gap
+        if (span.first_sample_index != next_sample_index) {
+            decimator_cascade_reset(&cascade, span.first_sample_index);
+            run_start_us = span.first_time_us;
+            run_start_index = span.first_sample_index;
+        }
+        SampleArchiveSpan run = {
+            .first_time_us = run_start_us,
+            .sample_rate_mhz = span.sample_rate_mhz
+        };
+        double delay_us = decimator_cascade_delay(&cascade) * 1E9 / span.sample_rate_mhz;
+
+        for (uint32_t offset = 0; offset < span.num_samples; offset += EXTRACT_BLOCK_LENGTH) {
+            uint32_t count = span.num_samples - offset < EXTRACT_BLOCK_LENGTH ? span.num_samples - offset : EXTRACT_BLOCK_LENGTH;
+            memcpy(block, span.samples + offset, count * sizeof(int32_t));
+            uint64_t block_index = span.first_sample_index + offset;
+            size_t num_outputs = decimator_cascade_process(&cascade, block, count);
+
+            // Output k comes from input k * factor + factor - 1
+            uint64_t input_index = block_index + (cascade.factor - 1 - block_index % cascade.factor) % cascade.factor;
+            for (size_t k = 0; k < num_outputs; k++, input_index += cascade.factor) {
+                int64_t time_us = sample_archive_sample_time(&run, input_index - run_start_index) - (int64_t) delay_us;
+                // Outputs before the run starts are only the filters filling
+                if (time_us >= from_us && time_us < to_us && time_us >= run_start_us) {
+                    print_sample(time_us, input_index / cascade.factor, block[k], print_index);
+                }
+            }
+        }
+        next_sample_index = span.first_sample_index + span.num_samples;
+    }
+    sample_archive_close_reader(&reader);
+    return result;
+}
+
+static int repair_archive(int argc, char *argv[]) {
+    if (argc != 2) {
+        usage();
+    }
+    SampleArchiveWriter writer;
+    if (sample_archive_open_writer(&writer, argv[1], "", SAMPLE_ARCHIVE_DEFAULT_CHUNK_SAMPLES)) {
+        return 1;
+    }
+    printf("%llu chunks, %llu indexed again, %llu bytes cut off\n",
+        (unsigned long long) writer.num_chunks,
+        (unsigned long long) writer.chunks_reindexed,
+        (unsigned long long) writer.bytes_truncated);
+    return sample_archive_close_writer(&writer);
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double difference = *(const double *) a - *(const double *) b;
+    return (difference > 0) - (difference < 0);
+}
+
+/**
+ * @brief
+ * Time reading every sample of each query, and print the spread of the
+ * times
+ */
+static void time_queries(
+    const char label[],
+    const SampleArchiveReader *reader,
+    const int64_t starts_us[],
+    size_t num_queries,
+    int64_t length_us,
+    double latencies[]
+) {
+    volatile int64_t sink = 0;
+    uint64_t num_samples = 0;
+    for (size_t q = 0; q < num_queries; q++) {
+        double start = monotonic_seconds();
+        SampleArchiveQuery query;
+        SampleArchiveSpan span;
+        int64_t sum = 0;
+        sample_archive_query(reader, starts_us[q], starts_us[q] + length_us, &query);
+        while (sample_archive_query_next(&query, &span)) {
+            for (uint32_t i = 0; i < span.num_samples; i++) {
+                sum += span.samples[i];
+            }
+            num_samples += span.num_samples;
+        }
+        sink += sum;
+        latencies[q] = monotonic_seconds() - start;
+    }
+
+    double total = 0;
+    for (size_t q = 0; q < num_queries; q++) {
+        total += latencies[q];
+    }
+    qsort(latencies, num_queries, sizeof(double), compare_doubles);
+    printf(
+        "%s: %zu queries of %.0f s, %.0f samples each, latency p50 %.3f ms, p99 %.3f ms, max %.3f ms, %.0f MB/s\n",
+        label,
+        num_queries,
+        length_us / 1E6,
+        (double) num_samples / num_queries,
+        latencies[num_queries / 2] * 1E3,
+        latencies[(size_t) (num_queries * 0.99)] * 1E3,
+        latencies[num_queries - 1] * 1E3,
+        num_samples * (double) SAMPLE_ARCHIVE_SAMPLE_WIDTH / total / 1E6
+    );
+}
+
+/**
+ * @brief
+ * Drop a file from the page cache, so that reads of it go to the disk
+ */
+static void drop_cached(const char path[]) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1 || posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED)) {
+        fprintf(stderr, "warning: could not drop %s from the page cache\n", path);
+    }
+    if (fd != -1) {
+        close(fd);
+    }
+}
+
+static int run_bench(int argc, char *argv[]) {
+    double megabytes = BENCH_DEFAULT_MEGABYTES;
+    double sample_rate = BENCH_DEFAULT_RATE;
+    double query_seconds = BENCH_DEFAULT_QUERY_SECONDS;
+    size_t num_queries = BENCH_DEFAULT_QUERIES;
+
+    int option;
+    while ((option = getopt(argc, argv, "s:r:l:q:")) != -1) {
+        switch (option) {
+            case 's': megabytes = atof(optarg); break;
+            case 'r': sample_rate = atof(optarg); break;
+            case 'l': query_seconds = atof(optarg); break;
+            case 'q': num_queries = strtoul(optarg, NULL, 0); break;
+            default: usage();
+        }
+    }
+    if (argc - optind != 1 || megabytes <= 0 || sample_rate <= 0 || sample_rate * 1000 > UINT32_MAX ||
+        query_seconds <= 0 || num_queries == 0) {
+        usage();
+    }
+    const char *path = argv[optind];
+    struct stat existing;
+    if (stat(path, &existing) == 0) {
+        fprintf(stderr, "error: %s already exists\n", path);
+        return 1;
+    }
+
+    // A sine with a little noise, so that samples are not all alike
+    static int32_t signal[BENCH_BLOCK_LENGTH * 64];
+    srand48(1);
+    for (size_t i = 0; i < sizeof(signal) / sizeof(int32_t); i++) {
+        signal[i] = (int32_t) (1E6 * sin(2 * M_PI * i / 1000.0) + 1E3 * (drand48() - 0.5));
+    }
+
+    SampleArchiveWriter writer;
+    if (sample_archive_open_writer(&writer, path, "bench", SAMPLE_ARCHIVE_DEFAULT_CHUNK_SAMPLES)) {
+        return 1;
+    }
+    uint32_t sample_rate_mhz = (uint32_t) (sample_rate * 1000 + 0.5);
+    uint64_t target_samples = (uint64_t) (megabytes * 1E6 / SAMPLE_ARCHIVE_SAMPLE_WIDTH);
+    SampleArchiveSpan timeline = {
+        .first_time_us = (int64_t) 1767225600 * 1000000,
+        .sample_rate_mhz = sample_rate_mhz
+    };
+
+    double start = monotonic_seconds();
+    uint64_t num_samples = 0;
+    uint64_t sample_index = 0;
+    for (uint64_t block = 0; num_samples < target_samples; block++) {
+        if (block % BENCH_GAP_PERIOD != BENCH_GAP_PERIOD - 1) {
+            const int32_t *samples = signal + (block % 64) * BENCH_BLOCK_LENGTH;
+            if (sample_archive_append(&writer, sample_index, sample_archive_sample_time(&timeline, sample_index),
+                                      sample_rate_mhz, samples, BENCH_BLOCK_LENGTH)) {
+                sample_archive_close_writer(&writer);
+                return 1;
+            }
+            num_samples += BENCH_BLOCK_LENGTH;
+        }
+        sample_index += BENCH_BLOCK_LENGTH;
+    }
+    uint64_t num_chunks = writer.num_chunks;
+    if (sample_archive_close_writer(&writer)) {
+        return 1;
+    }
+    double elapsed = monotonic_seconds() - start;
+    int64_t end_us = sample_archive_sample_time(&timeline, sample_index);
+
+    struct stat archive_stat;
+    stat(path, &archive_stat);
+    printf(
+        "wrote %llu samples, %.1f days at %.3f samples/s, in %llu chunks: %.0f MB in %.2f s, %.0f MB/s, %.1f M samples/s\n",
+        (unsigned long long) num_samples,
+        (end_us - timeline.first_time_us) / 86400E6,
+        sample_rate,
+        (unsigned long long) num_chunks,
+        archive_stat.st_size / 1E6,
+        elapsed,
+        archive_stat.st_size / 1E6 / elapsed,
+        num_samples / 1E6 / elapsed
+    );
+
+    // Queries at random times, some of which overlap gaps
+    int64_t length_us = (int64_t) (query_seconds * 1E6);
+    int64_t *starts_us = malloc(num_queries * sizeof(int64_t));
+    double *latencies = malloc(num_queries * sizeof(double));
+    if (starts_us == NULL || latencies == NULL) {
+        perror("malloc");
+        return 1;
+    }
+    for (size_t q = 0; q < num_queries; q++) {
+        starts_us[q] = timeline.first_time_us + (int64_t) (drand48() * (end_us - timeline.first_time_us - length_us));
+    }
+
+    drop_cached(path);
+    char *path_of_index = malloc(strlen(path) + sizeof(SAMPLE_ARCHIVE_INDEX_SUFFIX));
+    sprintf(path_of_index, "%s%s", path, SAMPLE_ARCHIVE_INDEX_SUFFIX);
+    drop_cached(path_of_index);
+    free(path_of_index);
+
+    start = monotonic_seconds();
+    SampleArchiveReader reader;
+    if (sample_archive_open_reader(&reader, path)) {
+        return 1;
+    }
+    printf("opened in %.3f ms, %zu chunks indexed\n", (monotonic_seconds() - start) * 1E3, reader.num_chunks);
+
+    time_queries("uncached", &reader, starts_us, num_queries, length_us, latencies);
+    time_queries("cached", &reader, starts_us, num_queries, length_us, latencies);
+    sample_archive_close_reader(&reader);
+    free(starts_us);
+    free(latencies);
+    return 0;
+}
@@ -0,0 +1,216 @@
+/*
+ * Host simulation of the firmware's telemetry spool through a Wi-Fi outage:
+ *
+ *   cc -O2 -I esp32/main -o backfill_sim tools/backfill_sim.c esp32/main/datagram_log.c
+ *
+ *   backfill_sim [options]
+ *
+ *   -r <rate>     live datagrams per second (default 2.1, binary frames at
+ *                 1000 samples per second)
+ *   -l <length>   datagram length in bytes (default 1472)
+ *   -b <rate>     backfilled datagrams per second (default 20)
+ *   -s <KiB>      spool size (default 2048)
+ *   -S <bytes>    spool sector size (default 4096)
+ *   -o <seconds>  outage length (default 300)
+ *   -t <seconds>  link up time before the outage (default 10)
+ *
+ * Datagrams are spooled through the same log as the firmware, in RAM that
+ * behaves like flash, and backfilled on the firmware's 10 ms polling period
+ * with its rate budget. Each datagram carries its sequence number and a
+ * pattern derived from it, so every backfilled datagram is checked to be
+ * intact and in order. Reports what was spooled, dropped when the spool
+ * filled and backfilled, and how long the backfill took after the link came
+ * back.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "datagram_log.h"
+
+#define POLL_PERIOD 0.01
+
+static void fill_datagram(uint8_t datagram[], size_t length, uint32_t sequence) {
+    for (size_t i = 0; i < length; i++) {
+        datagram[i] = (uint8_t) (sequence * 31 + i * 7);
+    }
+    memcpy(datagram, &sequence, sizeof(sequence));
+}
+
+static int check_datagram(const uint8_t datagram[], size_t length, size_t expected_length, uint32_t *out_sequence) {
+    if (length != expected_length) {
+        return 1;
+    }
+    uint32_t sequence;
+    memcpy(&sequence, datagram, sizeof(sequence));
+    for (size_t i = sizeof(sequence); i < length; i++) {
+        if (datagram[i] != (uint8_t) (sequence * 31 + i * 7)) {
+            return 1;
+        }
+    }
+    *out_sequence = sequence;
+    return 0;
+}
+
+static void usage(const char program[]) {
+    fprintf(
+        stderr,
+        "usage: %s [-r live_rate] [-l length] [-b backfill_rate] [-s spool_kib] [-S sector_size] "
+        "[-o outage] [-t up_time]\n",
+        program
+    );
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    double live_rate = 2.1;
+    size_t length = 1472;
+    double backfill_rate = 20;
+    size_t spool_kib = 2048;
+    size_t sector_size = 4096;
+    double outage = 300;
+    double up_time = 10;
+
+    int option;
+    while ((option = getopt(argc, argv, "r:l:b:s:S:o:t:")) != -1) {
+        switch (option) {
+            case 'r': live_rate = atof(optarg); break;
+            case 'l': length = atol(optarg); break;
+            case 'b': backfill_rate = atof(optarg); break;
+            case 's': spool_kib = atol(optarg); break;
+            case 'S': sector_size = atol(optarg); break;
+            case 'o': outage = atof(optarg); break;
+            case 't': up_time = atof(optarg); break;
+            default: usage(argv[0]);
+        }
+    }
+    if (optind != argc || live_rate <= 0 || backfill_rate <= 0 || length < sizeof(uint32_t)) {
+        usage(argv[0]);
+    }
+
+    size_t size = spool_kib * 1024;
+    uint8_t *memory = malloc(size);
+    DatagramLogStorage storage;
+    DatagramLog log;
+    if (memory == NULL ||
+        datagram_log_ram_storage(&storage, memory, size, sector_size) ||
+        datagram_log_initialize(&log, &storage)) {
+        fprintf(stderr, "error: cannot make a %zu KiB spool of %zu byte sectors\n", spool_kib, sector_size);
+        return 1;
+    }
+    if (length > datagram_log_max_length(&log)) {
+        fprintf(stderr, "error: datagrams of %zu bytes do not fit in a sector\n", length);
+        return 1;
+    }
+
+    uint8_t *datagram = malloc(length);
+    uint8_t *backfilled = malloc(datagram_log_max_length(&log));
+    uint32_t next_sequence = 0;
+    double live_budget = 0;
+    double backfill_budget = 0;
+    unsigned long num_live = 0;
+    unsigned long num_backfilled = 0;
+    unsigned long num_corrupt = 0;
+    unsigned long num_out_of_order = 0;
+    uint32_t first_spooled = UINT32_MAX;
+    uint32_t last_spooled = 0;
+    uint32_t first_backfilled = UINT32_MAX;
+    int64_t last_backfilled = -1;
+    size_t most_used = 0;
+    double drained_time = -1;
+
+    double outage_end = up_time + outage;
+    for (double time = 0; drained_time < 0; time += POLL_PERIOD) {
+        bool link_up = time < up_time || time >= outage_end;
+
+        live_budget += live_rate * POLL_PERIOD;
+        while (live_budget >= 1) {
+            live_budget -= 1;
+            uint32_t sequence = next_sequence++;
+            if (link_up) {
+                num_live++;
+                continue;
+            }
+            fill_datagram(datagram, length, sequence);
+            if (datagram_log_append(&log, datagram, length)) {
+                fprintf(stderr, "error: failed to spool datagram %u\n", sequence);
+                return 1;
+            }
+            if (first_spooled == UINT32_MAX) {
+                first_spooled = sequence;
+            }
+            last_spooled = sequence;
+        }
+        if (datagram_log_bytes_used(&log) > most_used) {
+            most_used = datagram_log_bytes_used(&log);
+        }
+
+        backfill_budget += backfill_rate * POLL_PERIOD;
+        if (backfill_budget > backfill_rate) {
+            backfill_budget = backfill_rate;
+        }
+        while (link_up && backfill_budget >= 1 && ! datagram_log_is_empty(&log)) {
+            size_t backfilled_length;
+            if (datagram_log_peek(&log, backfilled, &backfilled_length)) {
+                fprintf(stderr, "error: failed to read the spool\n");
+                return 1;
+            }
+            uint32_t sequence;
+            if (check_datagram(backfilled, backfilled_length, length, &sequence)) {
+                num_corrupt++;
+            }
+            else {
+                if ((int64_t) sequence <= last_backfilled) {
+                    num_out_of_order++;
+                }
+                if (first_backfilled == UINT32_MAX) {
+                    first_backfilled = sequence;
+                }
+                last_backfilled = sequence;
+            }
+            datagram_log_pop(&log);
+            backfill_budget -= 1;
+            num_backfilled++;
+        }
+        if (time >= outage_end && datagram_log_is_empty(&log)) {
+            drained_time = time - outage_end;
+        }
+    }
+
+    printf("%lu datagrams sent live\n", num_live);
+    printf(
+        "%lu spooled over the %g s outage, %.0f KiB at most of %zu KiB\n",
+        log.records_written,
+        outage,
+        most_used / 1024.0,
+        spool_kib
+    );
+    printf("%lu dropped as the spool filled, the oldest first\n", log.records_dropped);
+    if (num_backfilled > 0) {
+        printf(
+            "%lu backfilled, frames %u to %lld, in %.1f s after the link came back\n",
+            num_backfilled,
+            first_backfilled,
+            (long long) last_backfilled,
+            drained_time
+        );
+    }
+    if (first_spooled != UINT32_MAX &&
+        (last_backfilled != last_spooled ||
+         first_backfilled != first_spooled + log.records_dropped ||
+         num_backfilled != log.records_written - log.records_dropped)) {
+        printf("error: backfilled frames are not the newest spooled ones\n");
+        return 1;
+    }
+    if (num_corrupt > 0 || num_out_of_order > 0) {
+        printf("error: %lu corrupt and %lu out of order\n", num_corrupt, num_out_of_order);
+        return 1;
+    }
+
+    free(backfilled);
+    free(datagram);
+    free(memory);
+    return 0;
+}
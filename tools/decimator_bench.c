@@ -0,0 +1,199 @@
+/*
+ * Host benchmark and reference check for the firmware decimation cascade:
+ *
+ *   cc -O2 -I esp32/main -o decimator_bench tools/decimator_bench.c esp32/main/decimator.c \
+ *       esp32/main/adc_profile.c -lm
+ *
+ *   decimator_bench [input_rate] [seconds]
+ *
+ * For each output rate, times the fixed point cascade on a noisy multi-tone 
+ * signal, compares it with the same filters evaluated directly in double 
+ * precision, and measures the gain at a passband and an aliasing tone. 
+ * Without an input rate, every rate an ADC profile runs at is benchmarked, 
+ * each for as many samples as 600 s at 1000 samples/s.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "decimator.h"
+#include "adc_profile.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_CYCLE_COUNTER 1
+static unsigned long long cycle_count(void) {
+    return __rdtsc();
+}
+#else
+#define HAVE_CYCLE_COUNTER 0
+static unsigned long long cycle_count(void) {
+    return 0;
+}
+#endif
+
+static const double output_rates[] = {200, 100, 40};
+
+static double now_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1E-9;
+}
+
+/**
+ * @brief 
+ * Decimate with the cascade's own quantized coefficients in double precision, 
+ * without the polyphase and fixed point shortcuts.
+ */
+static size_t reference_decimate(const DecimatorCascade *cascade, const double input[], size_t num_samples, double output[]) {
+    double *stage_input = malloc(num_samples * sizeof(double));
+    double *stage_output = malloc(num_samples * sizeof(double));
+    memcpy(stage_input, input, num_samples * sizeof(double));
+
+    for (unsigned int s = 0; s < cascade->num_stages; s++) {
+        const DecimatorStage *stage = &cascade->stages[s];
+        size_t num_outputs = 0;
+        for (size_t i = stage->factor - 1; i < num_samples; i += stage->factor) {
+            double sum = 0;
+            for (unsigned int k = 0; k < stage->num_taps; k++) {
+                if (i >= k) {
+                    double coefficient = stage->coefficients[stage->num_taps - 1 - k] / (double) (1 << DECIMATOR_COEFFICIENT_SHIFT);
+                    sum += coefficient * stage_input[i - k];
+                }
+            }
+            stage_output[num_outputs++] = sum;
+        }
+        memcpy(stage_input, stage_output, num_outputs * sizeof(double));
+        num_samples = num_outputs;
+    }
+
+    memcpy(output, stage_input, num_samples * sizeof(double));
+    free(stage_input);
+    free(stage_output);
+    return num_samples;
+}
+
+static double tone_gain(double input_rate, double output_rate, double frequency) {
+    DecimatorCascade cascade;
+    decimator_cascade_initialize(&cascade, input_rate, output_rate);
+
+    size_t num_samples = (size_t) (input_rate * 20);
+    int32_t *samples = malloc(num_samples * sizeof(int32_t));
+    double amplitude = 4E6;
+    for (size_t i = 0; i < num_samples; i++) {
+        samples[i] = (int32_t) lround(amplitude * sin(2 * M_PI * frequency * i / input_rate));
+    }
+    size_t num_outputs = decimator_cascade_process(&cascade, samples, num_samples);
+
+    // Skip the filter start up and take the RMS of what is left
+    double sum_of_squares = 0;
+    size_t first_output = num_outputs / 4;
+    for (size_t i = first_output; i < num_outputs; i++) {
+        sum_of_squares += (double) samples[i] * samples[i];
+    }
+    free(samples);
+    return sqrt(sum_of_squares / (num_outputs - first_output)) / (amplitude / sqrt(2));
+}
+
+static void benchmark_input_rate(double input_rate, size_t num_samples) {
+    int32_t *input = malloc(num_samples * sizeof(int32_t));
+    int32_t *samples = malloc(num_samples * sizeof(int32_t));
+    double *reference_input = malloc(num_samples * sizeof(double));
+    double *reference_output = malloc(num_samples * sizeof(double));
+
+    srand(1);
+    for (size_t i = 0; i < num_samples; i++) {
+        double t = i / input_rate;
+        double value = 2E6 * sin(2 * M_PI * 0.5 * t) + 1E6 * sin(2 * M_PI * 13 * t) + 
+            5E5 * sin(2 * M_PI * 310 * t) + (rand() % 20001 - 10000);
+        input[i] = (int32_t) lround(value);
+        reference_input[i] = input[i];
+    }
+
+    printf("\n%g samples/s in\n", input_rate);
+    printf("%-8s %-16s %-6s %-12s %-12s %-14s %-12s %-12s\n", 
+        "rate", "stages", "taps", "ns/sample", "cycles/sample", "max error", "passband dB", "alias dB");
+
+    for (size_t r = 0; r < sizeof(output_rates) / sizeof(double); r++) {
+        DecimatorCascade cascade;
+        if (decimator_cascade_initialize(&cascade, input_rate, output_rates[r])) {
+            printf("%-8g unsupported\n", output_rates[r]);
+            continue;
+        }
+
+        unsigned int total_taps = 0;
+        char stages[32] = "";
+        for (unsigned int s = 0; s < cascade.num_stages; s++) {
+            total_taps += cascade.stages[s].num_taps;
+            snprintf(stages + strlen(stages), sizeof(stages) - strlen(stages), 
+                "%s%u", s == 0 ? "" : "x", cascade.stages[s].factor);
+        }
+
+        memcpy(samples, input, num_samples * sizeof(int32_t));
+        double start_time = now_seconds();
+        unsigned long long start_cycles = cycle_count();
+        size_t num_outputs = decimator_cascade_process(&cascade, samples, num_samples);
+        unsigned long long cycles = cycle_count() - start_cycles;
+        double elapsed = now_seconds() - start_time;
+
+        // The direct reference is slow, so only check the first minute
+        size_t reference_length = num_samples < input_rate * 60 ? num_samples : (size_t) (input_rate * 60);
+        size_t num_reference = reference_decimate(&cascade, reference_input, reference_length, reference_output);
+        double max_error = 0;
+        for (size_t i = 0; i < num_reference && i < num_outputs; i++) {
+            double error = fabs(samples[i] - reference_output[i]);
+            max_error = error > max_error ? error : max_error;
+        }
+
+        double passband_gain = tone_gain(input_rate, output_rates[r], 0.25 * output_rates[r]);
+        double alias_gain = tone_gain(input_rate, output_rates[r], 0.75 * output_rates[r]);
+
+        char cycles_text[32] = "n/a";
+        if (HAVE_CYCLE_COUNTER) {
+            snprintf(cycles_text, sizeof(cycles_text), "%.2f", (double) cycles / num_samples);
+        }
+        printf("%-8g %-16s %-6u %-12.2f %-12s %-14.2f %-12.4f %-12.1f\n", 
+            output_rates[r], 
+            stages, 
+            total_taps, 
+            elapsed * 1E9 / num_samples, 
+            cycles_text, 
+            max_error, 
+            20 * log10(passband_gain), 
+            20 * log10(alias_gain));
+    }
+
+    free(input);
+    free(samples);
+    free(reference_input);
+    free(reference_output);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1) {
+        double input_rate = atof(argv[1]);
+        double seconds = argc > 2 ? atof(argv[2]) : 600;
+        benchmark_input_rate(input_rate, (size_t) (input_rate * seconds));
+        return 0;
+    }
+
+    double benchmarked_rates[16];
+    size_t num_benchmarked = 0;
+    for (size_t p = 0; p < num_adc_profiles; p++) {
+        const AdcProfile *profile = &adc_profiles[p];
+        double input_rate = adc_profile_sample_rate(profile, profile->mclk_frequency);
+
+        int already_benchmarked = 0;
+        for (size_t b = 0; b < num_benchmarked; b++) {
+            already_benchmarked |= benchmarked_rates[b] == input_rate;
+        }
+        if (already_benchmarked || num_benchmarked == sizeof(benchmarked_rates) / sizeof(double)) {
+            continue;
+        }
+        benchmarked_rates[num_benchmarked++] = input_rate;
+        benchmark_input_rate(input_rate, 600000);
+    }
+    return 0;
+}
@@ -0,0 +1,223 @@
+/*
+ * Host simulation of the firmware ADC clock discipline loop:
+ *
+ *   cc -O2 -I esp32/main -o discipline_sim tools/discipline_sim.c esp32/main/clock_discipline.c \
+ *       esp32/main/apll.c -lm
+ *
+ *   discipline_sim [options]
+ *
+ *   -r <samples/s>  nominal sample rate (default 1000)
+ *   -x <ppm>        crystal frequency error (default 25)
+ *   -w <ppm>        amplitude of a daily temperature wander of the crystal (default 3)
+ *   -j <us>         standard deviation of reference time jitter (default 2000)
+ *   -i <seconds>    interval between references (default 64)
+ *   -c <seconds>    loop time constant (default 4096)
+ *   -t <ppm>        tolerance (default 1)
+ *   -d <hours>      simulated duration (default 48)
+ *
+ * The defaults model SNTP time; `-j 0.1 -i 16 -c 128` models a GPIO PPS 
+ * receiver.
+ *
+ * The crystal drives both the ESP32 and, through the APLL, the ADC, as on the
+ * board. The APLL is set to the nominal MCLK as the firmware does and is only
+ * trimmed by its sigma delta coefficients, so corrections are quantized the same way as in
+ * the firmware, and the rate steps between neighbouring APLL settings.
+ * 
+ * Reported are the time to lock, then the instantaneous sample rate error 
+ * against true time, the mean rate error over each time constant, which is 
+ * what the tolerance applies to, and the error of the disciplined time of the 
+ * conversion at each reference. The exit status is 0 if the loop locks and 
+ * then holds the mean rate within the tolerance at least 95% of the time.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "clock_discipline.h"
+#include "apll.h"
+
+#define XTAL_FREQUENCY 40E6
+#define ADC_RATE_DIVISION (16 * 1024)
+
+// Seconds per integration step of the sample clock phase
+#define TIME_STEP 1.0
+#define WANDER_PERIOD (24 * 3600.0)
+
+// Start of the simulated time, in microseconds since the Unix epoch
+#define START_TIME_US 1700000000000000LL
+
+static double gaussian(void) {
+    double u1 = (rand() + 1.0) / (RAND_MAX + 2.0);
+    double u2 = (rand() + 1.0) / (RAND_MAX + 2.0);
+    return sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: discipline_sim [-r rate] [-x ppm] [-w ppm] [-j us] [-i seconds] [-c seconds] [-t ppm] [-d hours]\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    double nominal_rate = 1000;
+    double crystal_error_ppm = 25;
+    double wander_ppm = 3;
+    double jitter_us = 2000;
+    double interval = 64;
+    double time_constant = 4096;
+    double tolerance_ppm = 1;
+    double duration = 48 * 3600.0;
+
+    int option;
+    while ((option = getopt(argc, argv, "r:x:w:j:i:c:t:d:")) != -1) {
+        switch (option) {
+            case 'r': nominal_rate = atof(optarg); break;
+            case 'x': crystal_error_ppm = atof(optarg); break;
+            case 'w': wander_ppm = atof(optarg); break;
+            case 'j': jitter_us = atof(optarg); break;
+            case 'i': interval = atof(optarg); break;
+            case 'c': time_constant = atof(optarg); break;
+            case 't': tolerance_ppm = atof(optarg); break;
+            case 'd': duration = atof(optarg) * 3600; break;
+            default: usage();
+        }
+    }
+    if (optind != argc || nominal_rate <= 0 || interval < TIME_STEP || time_constant < interval || tolerance_ppm <= 0) {
+        usage();
+    }
+
+    // The APLL divides down to the nominal rate, so scale MCLK to suit it
+    double mclk_frequency = nominal_rate * ADC_RATE_DIVISION;
+
+    ClockDiscipline discipline;
+    clock_discipline_initialize(&discipline, nominal_rate, tolerance_ppm, time_constant);
+
+    ApllCoefficients coefficients;
+    if (apll_solve(XTAL_FREQUENCY, mclk_frequency, &coefficients, 1) == 0) {
+        fprintf(stderr, "error: the APLL cannot make an MCLK of %g Hz\n", mclk_frequency);
+        return 1;
+    }
+    double apll_setting = apll_frequency(XTAL_FREQUENCY, &coefficients);
+
+    double position = 0;
+    double t = 0;
+    double next_reference = interval;
+    double lock_time = -1;
+    unsigned long steps_after_lock = 0;
+    unsigned long steps_in_tolerance = 0;
+    double max_rate_error_ppm = 0;
+    double sum_squared_rate_error = 0;
+    double sum_squared_time_error = 0;
+    double max_time_error_us = 0;
+    unsigned long num_time_errors = 0;
+
+    // Sample positions at past references, to find the mean rate over a time constant
+    size_t window_length = (size_t) ceil(time_constant / interval);
+    double *past_positions = calloc(window_length, sizeof(double));
+    size_t num_references = 0;
+    unsigned long num_mean_rates = 0;
+    unsigned long num_mean_rates_in_tolerance = 0;
+    double max_mean_rate_error_ppm = 0;
+
+    printf("%10s %10s %12s %12s %12s %8s\n", "hours", "xtal ppm", "phase ms", "correction", "rate ppm", "locked");
+    while (t < duration) {
+        double xtal_error = 1E-6 * (crystal_error_ppm + wander_ppm * sin(2 * M_PI * t / WANDER_PERIOD));
+        double rate = apll_setting * (1 + xtal_error) / ADC_RATE_DIVISION;
+        double rate_error_ppm = (rate / nominal_rate - 1) * 1E6;
+
+        if (lock_time >= 0) {
+            steps_after_lock++;
+            steps_in_tolerance += fabs(rate_error_ppm) <= tolerance_ppm;
+            sum_squared_rate_error += rate_error_ppm * rate_error_ppm;
+            if (fabs(rate_error_ppm) > max_rate_error_ppm) {
+                max_rate_error_ppm = fabs(rate_error_ppm);
+            }
+        }
+
+        position += rate * TIME_STEP;
+        t += TIME_STEP;
+        if (t < next_reference) {
+            continue;
+        }
+        next_reference += interval;
+
+        // The firmware measures the fraction of a sample with the microsecond timer
+        double count = floor(position);
+        double fraction = round((position - count) * 1E6 / rate) * rate / 1E6;
+        int64_t reference_time_us = START_TIME_US + (int64_t) llround(t * 1E6 + jitter_us * gaussian());
+
+        if (discipline.have_reference && lock_time >= 0) {
+            double time_error_us =
+                clock_discipline_time_us(&discipline, (uint32_t) count) - (START_TIME_US + (t - (position - count) / rate) * 1E6);
+            sum_squared_time_error += time_error_us * time_error_us;
+            num_time_errors++;
+            if (fabs(time_error_us) > max_time_error_us) {
+                max_time_error_us = fabs(time_error_us);
+            }
+        }
+
+        if (lock_time >= 0 && num_references >= window_length) {
+            double window_start = past_positions[num_references % window_length];
+            double mean_rate_error_ppm = ((position - window_start) / (window_length * interval) / nominal_rate - 1) * 1E6;
+            num_mean_rates++;
+            num_mean_rates_in_tolerance += fabs(mean_rate_error_ppm) <= tolerance_ppm;
+            if (fabs(mean_rate_error_ppm) > max_mean_rate_error_ppm) {
+                max_mean_rate_error_ppm = fabs(mean_rate_error_ppm);
+            }
+        }
+        past_positions[num_references++ % window_length] = position;
+
+        if (clock_discipline_update(&discipline, reference_time_us, (uint32_t) count, fraction)) {
+            apll_setting = apll_fine_tune(
+                XTAL_FREQUENCY,
+                mclk_frequency * (1 + discipline.correction_ppm * 1E-6),
+                &coefficients
+            );
+        }
+        if (discipline.locked && lock_time < 0) {
+            lock_time = t;
+        }
+
+        if (fmod(t, 3600) < interval) {
+            printf(
+                "%10.2f %10.3f %12.3f %12.3f %12.3f %8s\n",
+                t / 3600,
+                xtal_error * 1E6,
+                discipline.filtered_phase_error * 1E3,
+                (apll_setting / mclk_frequency - 1) * 1E6,
+                rate_error_ppm,
+                discipline.locked ? "yes" : "no"
+            );
+        }
+    }
+
+    if (lock_time < 0) {
+        printf("\nnever locked\n");
+        return 1;
+    }
+    printf("\nlocked after %.0f s, %lu updates, %lu steps\n", lock_time, discipline.num_updates, discipline.num_steps);
+    printf(
+        "rate error after lock: rms %.3f ppm, max %.3f ppm, %.1f%% of the time within %g ppm\n",
+        sqrt(sum_squared_rate_error / steps_after_lock),
+        max_rate_error_ppm,
+        100.0 * steps_in_tolerance / steps_after_lock,
+        tolerance_ppm
+    );
+    double in_tolerance = num_mean_rates > 0 ? (double) num_mean_rates_in_tolerance / num_mean_rates : 0;
+    printf(
+        "mean rate error over %g s after lock: max %.3f ppm, %.1f%% of the time within %g ppm\n",
+        window_length * interval,
+        max_mean_rate_error_ppm,
+        in_tolerance * 100,
+        tolerance_ppm
+    );
+    if (num_time_errors > 0) {
+        printf(
+            "disciplined time error: rms %.1f us, max %.1f us\n",
+            sqrt(sum_squared_time_error / num_time_errors),
+            max_time_error_us
+        );
+    }
+    free(past_positions);
+    return in_tolerance >= 0.95 ? 0 : 1;
+}
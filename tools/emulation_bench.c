@@ -0,0 +1,490 @@
+/*
+ * End-to-end throughput benchmark of the firmware running under QEMU with
+ * the AD7768-1 emulated. It drives the firmware's console, acts as the UDP
+ * sink for its telemetry and steps the ADC profiles up in output data rate
+ * until samples are lost:
+ *
+ *   cc -O2 -I esp32/main -o emulation_bench tools/emulation_bench.c esp32/main/telemetry_frame.c \
+ *       esp32/main/pipeline_stats.c -lm
+ *
+ *   emulation_bench [-c host:port] [-p udp_port] [-a address] [-w warmup] [-d duration] [profile ...]
+ *
+ *   -c  console of the emulated board (default localhost:5555)
+ *   -p  UDP port the benchmark receives telemetry on (default 5005)
+ *   -a  address of this host as the board sees it (default 10.0.2.2, the
+ *       host under QEMU user networking)
+ *   -w  seconds to let each profile settle before measuring (default 3)
+ *   -d  seconds to measure each profile for (default 10)
+ *
+ * The profiles default to every profile from eco_500 to fast_64k in order of
+ * output data rate. Build the firmware with CONFIG_ADC_EMULATED and
+ * CONFIG_ETH_USE_OPENETH, merge the build into a flash image and run it with
+ * its console on a TCP port:
+ *
+ *   (cd esp32/build && esptool.py --chip esp32 merge_bin --fill-flash-size 4MB \
+ *       -o flash.bin @flash_args)
+ *   qemu-system-xtensa -nographic -machine esp32 -icount 3 \
+ *       -drive file=esp32/build/flash.bin,if=mtd,format=raw \
+ *       -nic user,model=open_eth -serial tcp::5555,server
+ *
+ * A profile is sustained when, over the measurement, no conversion was lost,
+ * discarded or read in error, no block was dropped, every sample frame
+ * arrived and the samples arrived at the profile's rate. For each profile
+ * the benchmark prints the samples received, the loss counters, the CPU
+ * load of acquisition as the firmware measures it, the CPU time of the
+ * telemetry stages from the stats histograms and the latency from a
+ * sample's conversion to the datagram carrying it. It ends with the fastest
+ * profile sustained, and exits 0 if there was one.
+ *
+ * With -icount QEMU runs instructions at a fixed virtual rate, so results
+ * are repeatable from run to run and comparable between firmware versions,
+ * but they are not the throughput of a real board.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/time.h>
+
+#include "telemetry_frame.h"
+#include "pipeline_stats.h"
+
+#define DEFAULT_CONSOLE "localhost:5555"
+#define DEFAULT_PORT "5005"
+#define DEFAULT_ADDRESS "10.0.2.2"
+
+// How long the board may take to boot and to get an address
+#define BOOT_TIMEOUT_MS 60000
+#define CONNECT_TIMEOUT_MS 30000
+// Console output is taken to be complete after this long without any
+#define CONSOLE_QUIET_MS 300
+
+#define MAX_LINE_LENGTH 256
+
+// Samples received must reach this fraction of the profile's rate
+#define MIN_RATE_FRACTION 0.99
+
+static const char *default_profiles[] = {
+    "eco_500", "eco_1k", "median_4k", "fast_8k", "fast_16k", "fast_32k", "fast_64k"
+};
+
+typedef struct {
+    unsigned long frames;
+    unsigned long lost_frames;
+    unsigned long bad_frames;
+    uint64_t samples;
+    unsigned long sample_gaps;
+    double sample_rate;
+
+    bool have_sequence;
+    uint32_t expected_sequence;
+    bool have_sample_index;
+    uint64_t expected_sample_index;
+
+    // First and last stats frames of the measurement
+    unsigned long num_stats;
+    uint64_t first_uptime_us;
+    uint64_t last_uptime_us;
+    uint32_t cpu_frequency;
+    PipelineStats first_stats;
+    PipelineStats last_stats;
+} Measurement;
+
+static int64_t time_us(void) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (int64_t) now.tv_sec * 1000000 + now.tv_usec;
+}
+
+static int open_console(const char console[]) {
+    char host[MAX_LINE_LENGTH];
+    const char *colon = strrchr(console, ':');
+    if (colon == NULL || (size_t) (colon - console) >= sizeof(host)) {
+        fprintf(stderr, "error: console %s is not host:port\n", console);
+        return -1;
+    }
+    memcpy(host, console, colon - console);
+    host[colon - console] = '\0';
+
+    struct addrinfo hints = {
+        .ai_family = AF_UNSPEC,
+        .ai_socktype = SOCK_STREAM
+    };
+    struct addrinfo *address;
+    int error = getaddrinfo(host, colon + 1, &hints, &address);
+    if (error != 0) {
+        fprintf(stderr, "error: could not resolve %s: %s\n", console, gai_strerror(error));
+        return -1;
+    }
+    int fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+    if (fd == -1 || connect(fd, address->ai_addr, address->ai_addrlen) == -1) {
+        perror("connect");
+        freeaddrinfo(address);
+        return -1;
+    }
+    freeaddrinfo(address);
+    return fd;
+}
+
+static int open_sink(const char port[]) {
+    struct addrinfo hints = {
+        .ai_family = AF_INET,
+        .ai_socktype = SOCK_DGRAM,
+        .ai_flags = AI_PASSIVE
+    };
+    struct addrinfo *address;
+    int error = getaddrinfo(NULL, port, &hints, &address);
+    if (error != 0) {
+        fprintf(stderr, "error: could not resolve port %s: %s\n", port, gai_strerror(error));
+        return -1;
+    }
+    int sd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+    if (sd == -1 || bind(sd, address->ai_addr, address->ai_addrlen) == -1) {
+        perror("bind");
+        freeaddrinfo(address);
+        return -1;
+    }
+    freeaddrinfo(address);
+
+    // Room for a few seconds of the fastest profile should this process stall
+    int buffer_size = 8 << 20;
+    setsockopt(sd, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size));
+    return sd;
+}
+
+/**
+ * @brief
+ * Send a console command and collect its output until the console goes
+ * quiet. Log lines from the firmware may be mixed in.
+ * @param fd
+ * @param command
+ * @param expected Text of the output line wanted, or NULL
+ * @param out_line Receives the first line holding `expected`, from that text on
+ * @param timeout_ms Longest to wait for `expected`
+ * @return 0 if the command printed no error and, if `expected` is given,
+ * the line was found
+ */
+static int console_command(int fd, const char command[], const char expected[], char out_line[], int timeout_ms) {
+    char buffer[MAX_LINE_LENGTH + 2];
+    snprintf(buffer, sizeof(buffer), "%s\n", command);
+    if (write(fd, buffer, strlen(buffer)) < 0) {
+        perror("write");
+        return 1;
+    }
+
+    char line[MAX_LINE_LENGTH + 1];
+    size_t line_length = 0;
+    bool found = expected == NULL;
+    bool failed = false;
+    int64_t deadline = time_us() + timeout_ms * 1000LL;
+    int64_t quiet_deadline = time_us() + CONSOLE_QUIET_MS * 1000LL;
+    for ( ;; ) {
+        int64_t now = time_us();
+        int64_t until = found ? quiet_deadline : deadline;
+        if (now >= until) {
+            break;
+        }
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(fd, &readable);
+        struct timeval timeout = {
+            .tv_sec = (until - now) / 1000000,
+            .tv_usec = (until - now) % 1000000
+        };
+        if (select(fd + 1, &readable, NULL, NULL, &timeout) <= 0) {
+            continue;
+        }
+        uint8_t byte;
+        if (read(fd, &byte, 1) != 1) {
+            fprintf(stderr, "error: the console closed\n");
+            return 1;
+        }
+        quiet_deadline = time_us() + CONSOLE_QUIET_MS * 1000LL;
+
+        if (byte != '\n' && byte != '\r') {
+            if (line_length < MAX_LINE_LENGTH) {
+                line[line_length++] = byte;
+            }
+            continue;
+        }
+        line[line_length] = '\0';
+        line_length = 0;
+        const char *error = strstr(line, "error:");
+        if (error != NULL) {
+            fprintf(stderr, "device %s: %s\n", command, error);
+            failed = true;
+        }
+        const char *match = expected != NULL ? strstr(line, expected) : NULL;
+        if (! found && match != NULL) {
+            strcpy(out_line, match);
+            found = true;
+        }
+    }
+    return failed || ! found;
+}
+
+static void record_frame(const uint8_t datagram[], size_t length, Measurement *measurement) {
+    static int32_t samples[TELEMETRY_FRAME_MAX_SAMPLES];
+
+    TelemetryFrame frame;
+    if (telemetry_frame_decode(datagram, length, &frame)) {
+        measurement->bad_frames++;
+        return;
+    }
+    if (frame.flags & TELEMETRY_FRAME_BACKFILLED) {
+        return;
+    }
+    if (measurement->have_sequence && frame.sequence != measurement->expected_sequence) {
+        measurement->lost_frames += frame.sequence - measurement->expected_sequence;
+    }
+    measurement->expected_sequence = frame.sequence + 1;
+    measurement->frames++;
+
+    if (frame.type == TELEMETRY_FRAME_SAMPLES) {
+        TelemetrySampleHeader header;
+        if (telemetry_frame_decode_samples(&frame, &header, samples)) {
+            measurement->bad_frames++;
+            return;
+        }
+        if (measurement->have_sample_index && header.first_sample_index != measurement->expected_sample_index) {
+            measurement->sample_gaps++;
+        }
+        measurement->have_sample_index = true;
+        measurement->expected_sample_index = header.first_sample_index + header.num_samples;
+        measurement->samples += header.num_samples;
+        measurement->sample_rate = header.sample_rate_mhz / 1E3;
+    }
+    else if (frame.type == TELEMETRY_FRAME_STATS) {
+        uint64_t uptime_us;
+        uint32_t cpu_frequency;
+        PipelineStats stats;
+        if (telemetry_frame_decode_stats(&frame, &uptime_us, &cpu_frequency, &stats) || cpu_frequency == 0) {
+            measurement->bad_frames++;
+            return;
+        }
+        if (measurement->num_stats++ == 0) {
+            measurement->first_uptime_us = uptime_us;
+            measurement->first_stats = stats;
+        }
+        measurement->last_uptime_us = uptime_us;
+        measurement->last_stats = stats;
+        measurement->cpu_frequency = cpu_frequency;
+    }
+    measurement->have_sequence = true;
+}
+
+/**
+ * @brief
+ * Receive telemetry for a while. The frames are recorded if `measurement` is
+ * given, and otherwise discarded.
+ */
+static void receive_telemetry(int sd, double seconds, Measurement *measurement) {
+    uint8_t datagram[TELEMETRY_FRAME_MAX_LENGTH + 1];
+    int64_t end = time_us() + (int64_t) (seconds * 1E6);
+    for (int64_t now = time_us(); now < end; now = time_us()) {
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(sd, &readable);
+        struct timeval timeout = {
+            .tv_sec = (end - now) / 1000000,
+            .tv_usec = (end - now) % 1000000
+        };
+        if (select(sd + 1, &readable, NULL, NULL, &timeout) <= 0) {
+            continue;
+        }
+        ssize_t length = recv(sd, datagram, sizeof(datagram), 0);
+        if (length > 0 && measurement != NULL) {
+            record_frame(datagram, length, measurement);
+        }
+    }
+}
+
+/**
+ * @brief
+ * @return Share of a core taken by the stages, from the growth of their
+ * cycle histograms between the first and last stats frames
+ */
+static double stage_load(const Measurement *measurement, const StatsHistogramId stages[], size_t num_stages) {
+    double elapsed_us = (double) (measurement->last_uptime_us - measurement->first_uptime_us);
+    if (measurement->num_stats < 2 || elapsed_us <= 0) {
+        return NAN;
+    }
+    double cycles = 0;
+    for (size_t i = 0; i < num_stages; i++) {
+        cycles += (double) (measurement->last_stats.histograms[stages[i]].total -
+            measurement->first_stats.histograms[stages[i]].total);
+    }
+    return cycles / measurement->cpu_frequency / (elapsed_us * 1E-6);
+}
+
+static uint32_t counter_growth(const Measurement *measurement, StatsCounterId id) {
+    return measurement->last_stats.counters[id] - measurement->first_stats.counters[id];
+}
+
+/**
+ * @brief
+ * Run one profile and print a line of results
+ * @return 1 if the profile was sustained, 0 if not and -1 if it could not
+ * be run
+ */
+static int run_profile(
+    int console,
+    int sink,
+    const char profile[],
+    const char address[],
+    const char port[],
+    double warmup,
+    double duration
+) {
+    char command[MAX_LINE_LENGTH];
+    char line[MAX_LINE_LENGTH + 1];
+
+    console_command(console, "telemetry stop", NULL, NULL, 0);
+    snprintf(command, sizeof(command), "adc_profile set %s", profile);
+    if (console_command(console, command, NULL, NULL, 0)) {
+        return -1;
+    }
+    if (console_command(console, "stats interval 1", NULL, NULL, 0)) {
+        return -1;
+    }
+    // The board may still be getting its address
+    snprintf(command, sizeof(command), "telemetry start %s %s binary", address, port);
+    int64_t connect_deadline = time_us() + CONNECT_TIMEOUT_MS * 1000LL;
+    while (console_command(console, command, NULL, NULL, 0)) {
+        if (time_us() > connect_deadline) {
+            return -1;
+        }
+        sleep(1);
+    }
+    receive_telemetry(sink, warmup, NULL);
+
+    Measurement measurement = {0};
+    console_command(console, "stats reset", NULL, NULL, 0);
+    receive_telemetry(sink, duration, &measurement);
+
+    double acquisition_load = NAN;
+    if (! console_command(console, "adc_profile", "CPU load", line, CONSOLE_QUIET_MS * 10)) {
+        acquisition_load = atof(line + strlen("CPU load")) / 100;
+    }
+    console_command(console, "telemetry stop", NULL, NULL, 0);
+
+    static const StatsHistogramId telemetry_stages[] = {STATS_DECIMATION, STATS_PROCESSING, STATS_SEND};
+    double telemetry_load = stage_load(&measurement, telemetry_stages, 3);
+    const StatsHistogram *latency = &measurement.last_stats.histograms[STATS_SAMPLE_TO_PACKET];
+
+    uint32_t lost = counter_growth(&measurement, STATS_SAMPLES_LOST) +
+        counter_growth(&measurement, STATS_READ_ERRORS);
+    uint32_t discarded = counter_growth(&measurement, STATS_SAMPLES_DISCARDED);
+    uint32_t dropped = counter_growth(&measurement, STATS_BLOCKS_DROPPED);
+    double received_rate = measurement.samples / duration;
+    bool sustained =
+        measurement.num_stats >= 2 &&
+        lost == 0 && discarded == 0 && dropped == 0 &&
+        measurement.lost_frames == 0 && measurement.sample_gaps == 0 && measurement.bad_frames == 0 &&
+        measurement.sample_rate > 0 && received_rate >= MIN_RATE_FRACTION * measurement.sample_rate;
+
+    printf(
+        "%-12s %10.1f %10.1f %6lu %6lu %6lu %6lu %7.1f%% %7.1f%% %8.2f %8.2f %8.2f  %s\n",
+        profile,
+        measurement.sample_rate,
+        received_rate,
+        (unsigned long) lost,
+        (unsigned long) discarded,
+        (unsigned long) dropped,
+        measurement.lost_frames,
+        acquisition_load * 100,
+        telemetry_load * 100,
+        stats_histogram_percentile(latency, 0.5) / 1E3,
+        stats_histogram_percentile(latency, 0.99) / 1E3,
+        latency->max / 1E3,
+        sustained ? "ok" : "FAIL"
+    );
+    fflush(stdout);
+    return sustained;
+}
+
+static void usage(const char program[]) {
+    fprintf(
+        stderr,
+        "usage: %s [-c host:port] [-p udp_port] [-a address] [-w warmup] [-d duration] [profile ...]\n",
+        program
+    );
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    const char *console_address = DEFAULT_CONSOLE;
+    const char *port = DEFAULT_PORT;
+    const char *address = DEFAULT_ADDRESS;
+    double warmup = 3;
+    double duration = 10;
+
+    int option;
+    while ((option = getopt(argc, argv, "c:p:a:w:d:")) != -1) {
+        switch (option) {
+            case 'c': console_address = optarg; break;
+            case 'p': port = optarg; break;
+            case 'a': address = optarg; break;
+            case 'w': warmup = atof(optarg); break;
+            case 'd': duration = atof(optarg); break;
+            default: usage(argv[0]);
+        }
+    }
+    // Stats frames come once a second and two are needed
+    if (duration < 3 || warmup < 0) {
+        usage(argv[0]);
+    }
+    const char **profiles = default_profiles;
+    size_t num_profiles = sizeof(default_profiles) / sizeof(default_profiles[0]);
+    if (optind < argc) {
+        profiles = (const char **) &argv[optind];
+        num_profiles = argc - optind;
+    }
+
+    int console = open_console(console_address);
+    int sink = open_sink(port);
+    if (console == -1 || sink == -1) {
+        return 1;
+    }
+
+    char line[MAX_LINE_LENGTH + 1];
+    int64_t boot_deadline = time_us() + BOOT_TIMEOUT_MS * 1000LL;
+    while (console_command(console, "adc_profile", "profile", line, 2000)) {
+        if (time_us() > boot_deadline) {
+            fprintf(stderr, "error: the board did not answer on its console\n");
+            return 1;
+        }
+    }
+
+    printf(
+        "%-12s %10s %10s %6s %6s %6s %6s %8s %8s %8s %8s %8s  %s\n",
+        "profile", "rate", "received", "lost", "disc", "drop", "frames",
+        "acq cpu", "tel cpu", "p50 ms", "p99 ms", "max ms", "result"
+    );
+
+    const char *fastest = NULL;
+    for (size_t i = 0; i < num_profiles; i++) {
+        int result = run_profile(console, sink, profiles[i], address, port, warmup, duration);
+        if (result < 0) {
+            fprintf(stderr, "error: could not run profile %s\n", profiles[i]);
+            return 1;
+        }
+        if (result == 0) {
+            break;
+        }
+        fastest = profiles[i];
+    }
+
+    if (fastest == NULL) {
+        printf("no profile was sustained\n");
+        return 1;
+    }
+    printf("fastest sustained profile: %s\n", fastest);
+    return 0;
+}
@@ -0,0 +1,311 @@
+/*
+ * Host replay harness for the firmware STA/LTA event trigger:
+ *
+ *   cc -O2 -I esp32/main -o event_replay tools/event_replay.c esp32/main/event_detector.c -lm
+ *
+ *   event_replay [options] <sample_rate> <samples_file | synthetic> [onsets_file]
+ *
+ *   -s <seconds>  STA window (default 1)
+ *   -l <seconds>  LTA window (default 30)
+ *   -t <ratio>    trigger ratio (default 4)
+ *   -d <ratio>    detrigger ratio (default 1.5)
+ *   -p <seconds>  pre-trigger (default 2)
+ *   -q <seconds>  post-trigger (default 10)
+ *
+ * The samples file holds one sample per line; lines with two numbers, like the
+ * output of `telemetry_tool listen`, use the second. The onsets file holds the
+ * known sample index of each event onset. With "synthetic", ten minutes of
+ * noise with bursts of increasing amplitude at known onsets is generated.
+ *
+ * Every detected event is listed with its capture window. When onsets are
+ * known, each is matched to the first trigger after it to report the trigger
+ * latency, along with missed events and false triggers. The CPU cost of the
+ * detector is reported per sample.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "event_detector.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_CYCLE_COUNTER 1
+static unsigned long long cycle_count(void) {
+    return __rdtsc();
+}
+#else
+#define HAVE_CYCLE_COUNTER 0
+static unsigned long long cycle_count(void) {
+    return 0;
+}
+#endif
+
+#define MAX_EVENTS 1024
+
+// An onset counts as detected if a trigger follows it within this many seconds
+#define MATCH_WINDOW 10.0
+
+#define SYNTHETIC_DURATION 600.0
+#define SYNTHETIC_NOISE 100.0
+#define SYNTHETIC_OFFSET 50000.0
+#define SYNTHETIC_NUM_EVENTS 8
+
+typedef struct {
+    int32_t *samples;
+    size_t length;
+    size_t capacity;
+} Waveform;
+
+typedef struct {
+    uint64_t first_sample_index;
+    uint64_t trigger_sample_index;
+    uint64_t last_sample_index;
+    float peak_ratio;
+} DetectedEvent;
+
+static EventDetector detector;
+
+static double now_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1E-9;
+}
+
+static void append_sample(Waveform *waveform, int32_t sample) {
+    if (waveform->length == waveform->capacity) {
+        waveform->capacity = waveform->capacity ? 2 * waveform->capacity : 65536;
+        waveform->samples = realloc(waveform->samples, waveform->capacity * sizeof(int32_t));
+        if (waveform->samples == NULL) {
+            fprintf(stderr, "error: out of memory\n");
+            exit(1);
+        }
+    }
+    waveform->samples[waveform->length++] = sample;
+}
+
+static int read_waveform(const char path[], Waveform *waveform) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        perror(path);
+        return 1;
+    }
+
+    char line[256];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        double first;
+        double second;
+        int fields = sscanf(line, "%lf %lf", &first, &second);
+        if (fields >= 1) {
+            append_sample(waveform, (int32_t) (fields == 2 ? second : first));
+        }
+    }
+    fclose(file);
+    return 0;
+}
+
+static size_t read_onsets(const char path[], uint64_t onsets[]) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        perror(path);
+        exit(1);
+    }
+
+    size_t num_onsets = 0;
+    unsigned long long onset;
+    while (num_onsets < MAX_EVENTS && fscanf(file, "%llu", &onset) == 1) {
+        onsets[num_onsets++] = onset;
+    }
+    fclose(file);
+    return num_onsets;
+}
+
+static double gaussian(void) {
+    double u1 = (rand() + 1.0) / (RAND_MAX + 2.0);
+    double u2 = (rand() + 1.0) / (RAND_MAX + 2.0);
+    return sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+}
+
+/**
+ * @brief
+ * Noise on a drifting offset with decaying tone bursts, the smallest of which
+ * are near the limit of detection with the default trigger settings
+ */
+static size_t synthesize_waveform(double sample_rate, Waveform *waveform, uint64_t onsets[]) {
+    size_t length = (size_t) (SYNTHETIC_DURATION * sample_rate);
+    static const double amplitudes[SYNTHETIC_NUM_EVENTS] = {1, 2, 3, 5, 8, 13, 21, 34};
+
+    for (size_t i = 0; i < length; i++) {
+        double t = i / sample_rate;
+        double value = SYNTHETIC_OFFSET +
+            1000 * sin(2 * M_PI * t / SYNTHETIC_DURATION) +
+            SYNTHETIC_NOISE * gaussian();
+
+        for (int e = 0; e < SYNTHETIC_NUM_EVENTS; e++) {
+            double onset = (e + 1) * SYNTHETIC_DURATION / (SYNTHETIC_NUM_EVENTS + 1);
+            double age = t - onset;
+            if (age >= 0 && age < 20) {
+                double frequency = 0.5 + e * 0.5;
+                value += amplitudes[e] * SYNTHETIC_NOISE * exp(-age / 4) * sin(2 * M_PI * frequency * age);
+            }
+        }
+        append_sample(waveform, (int32_t) lround(value));
+    }
+
+    for (int e = 0; e < SYNTHETIC_NUM_EVENTS; e++) {
+        onsets[e] = (uint64_t) ceil((e + 1) * SYNTHETIC_DURATION / (SYNTHETIC_NUM_EVENTS + 1) * sample_rate);
+    }
+    return SYNTHETIC_NUM_EVENTS;
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: event_replay [-s sta] [-l lta] [-t ratio] [-d ratio] [-p pre] [-q post] "
+        "<sample_rate> <samples_file | synthetic> [onsets_file]\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    double sta = 1;
+    double lta = 30;
+    double trigger_ratio = 4;
+    double detrigger_ratio = 1.5;
+    double pre_trigger = 2;
+    double post_trigger = 10;
+
+    int option;
+    while ((option = getopt(argc, argv, "s:l:t:d:p:q:")) != -1) {
+        switch (option) {
+            case 's': sta = atof(optarg); break;
+            case 'l': lta = atof(optarg); break;
+            case 't': trigger_ratio = atof(optarg); break;
+            case 'd': detrigger_ratio = atof(optarg); break;
+            case 'p': pre_trigger = atof(optarg); break;
+            case 'q': post_trigger = atof(optarg); break;
+            default: usage();
+        }
+    }
+    if (argc - optind != 2 && argc - optind != 3) {
+        usage();
+    }
+
+    double sample_rate = atof(argv[optind]);
+    if (sample_rate <= 0) {
+        usage();
+    }
+
+    Waveform waveform = {0};
+    static uint64_t onsets[MAX_EVENTS];
+    size_t num_onsets = 0;
+    if (! strcmp(argv[optind + 1], "synthetic")) {
+        num_onsets = synthesize_waveform(sample_rate, &waveform, onsets);
+    }
+    else if (read_waveform(argv[optind + 1], &waveform)) {
+        return 1;
+    }
+    if (argc - optind == 3) {
+        num_onsets = read_onsets(argv[optind + 2], onsets);
+    }
+
+    EventDetectorConfig config = {
+        .sta_length = (unsigned int) lround(sta * sample_rate),
+        .lta_length = (unsigned int) lround(lta * sample_rate),
+        .trigger_ratio = trigger_ratio,
+        .detrigger_ratio = detrigger_ratio,
+        .pre_trigger_length = (unsigned int) lround(pre_trigger * sample_rate),
+        .post_trigger_length = (unsigned int) lround(post_trigger * sample_rate),
+        .max_event_length = (unsigned int) lround(120 * sample_rate)
+    };
+    if (config.pre_trigger_length > EVENT_MAX_PRE_TRIGGER_LENGTH) {
+        fprintf(stderr, "warning: pre-trigger limited to %d samples\n", EVENT_MAX_PRE_TRIGGER_LENGTH);
+        config.pre_trigger_length = EVENT_MAX_PRE_TRIGGER_LENGTH;
+    }
+    if (event_detector_initialize(&detector, &config)) {
+        fprintf(stderr, "error: invalid trigger settings\n");
+        return 1;
+    }
+
+    static DetectedEvent events[MAX_EVENTS];
+    size_t num_events = 0;
+    static int32_t pre_trigger_samples[EVENT_MAX_PRE_TRIGGER_LENGTH];
+
+    double start_time = now_seconds();
+    unsigned long long start_cycles = cycle_count();
+    for (size_t i = 0; i < waveform.length; i++) {
+        EventDetectorResult result = event_detector_update(&detector, waveform.samples[i], i);
+        if (result == EVENT_TRIGGERED && num_events < MAX_EVENTS) {
+            size_t num_pre_trigger = event_detector_pre_trigger(&detector, pre_trigger_samples);
+            events[num_events].first_sample_index = i - num_pre_trigger;
+            events[num_events].trigger_sample_index = i;
+        }
+        else if (result == EVENT_FINISHED && num_events < MAX_EVENTS) {
+            events[num_events].last_sample_index = i;
+            events[num_events].peak_ratio = detector.peak_ratio;
+            num_events++;
+        }
+    }
+    if (detector.in_event && num_events < MAX_EVENTS) {
+        events[num_events].last_sample_index = waveform.length - 1;
+        events[num_events].peak_ratio = detector.peak_ratio;
+        num_events++;
+    }
+    double elapsed = now_seconds() - start_time;
+    unsigned long long cycles = cycle_count() - start_cycles;
+
+    printf("%zu samples, %.1f s at %g samples/s\n", waveform.length, waveform.length / sample_rate, sample_rate);
+    printf("%8s %12s %12s %12s %8s %10s\n", "event", "first", "trigger", "last", "seconds", "peak");
+    for (size_t e = 0; e < num_events; e++) {
+        printf(
+            "%8zu %12llu %12llu %12llu %8.1f %10.1f\n",
+            e + 1,
+            (unsigned long long) events[e].first_sample_index,
+            (unsigned long long) events[e].trigger_sample_index,
+            (unsigned long long) events[e].last_sample_index,
+            (events[e].last_sample_index - events[e].first_sample_index + 1) / sample_rate,
+            events[e].peak_ratio
+        );
+    }
+
+    if (num_onsets > 0) {
+        printf("\n%12s %12s %10s\n", "onset", "trigger", "latency s");
+        uint64_t match_window = (uint64_t) (MATCH_WINDOW * sample_rate);
+        size_t num_detected = 0;
+        static unsigned char matched[MAX_EVENTS];
+        for (size_t o = 0; o < num_onsets; o++) {
+            size_t e = 0;
+            while (e < num_events && events[e].trigger_sample_index < onsets[o]) {
+                e++;
+            }
+            if (e < num_events && events[e].trigger_sample_index - onsets[o] <= match_window) {
+                matched[e] = 1;
+                num_detected++;
+                printf(
+                    "%12llu %12llu %10.3f\n",
+                    (unsigned long long) onsets[o],
+                    (unsigned long long) events[e].trigger_sample_index,
+                    (events[e].trigger_sample_index - onsets[o]) / sample_rate
+                );
+            }
+            else {
+                printf("%12llu %12s %10s\n", (unsigned long long) onsets[o], "missed", "-");
+            }
+        }
+
+        size_t num_false = 0;
+        for (size_t e = 0; e < num_events; e++) {
+            num_false += ! matched[e];
+        }
+        printf("%zu of %zu onsets detected, %zu false triggers\n", num_detected, num_onsets, num_false);
+    }
+
+    printf("\ndetector cost: %.1f ns/sample", elapsed * 1E9 / waveform.length);
+    if (HAVE_CYCLE_COUNTER) {
+        printf(", %.1f cycles/sample", (double) cycles / waveform.length);
+    }
+    printf(", %.3g%% of one core at %g samples/s\n", elapsed / (waveform.length / sample_rate) * 100, sample_rate);
+
+    free(waveform.samples);
+    return 0;
+}
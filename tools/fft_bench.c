@@ -0,0 +1,136 @@
+/*
+ * Host benchmark of the firmware spectrum engine against a double precision 
+ * reference:
+ *
+ *   cc -O2 -I esp32/main -o fft_bench tools/fft_bench.c esp32/main/spectrum.c -lm
+ *
+ *   fft_bench [iterations]
+ *
+ * For every supported FFT length, reports the time per single precision real 
+ * FFT and its largest error relative to a double precision DFT, then checks 
+ * that a Welch estimate of a sine puts its power in the right band.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include "spectrum.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_CYCLE_COUNTER 1
+static unsigned long long cycle_count(void) {
+    return __rdtsc();
+}
+#else
+#define HAVE_CYCLE_COUNTER 0
+static unsigned long long cycle_count(void) {
+    return 0;
+}
+#endif
+
+static SpectrumAnalyzer analyzer;
+
+static double now_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1E-9;
+}
+
+static void reference_dft(const float input[], unsigned int length, double output[]) {
+    for (unsigned int k = 0; k <= length / 2; k++) {
+        double real = 0;
+        double imaginary = 0;
+        for (unsigned int n = 0; n < length; n++) {
+            double angle = -2 * M_PI * (double) k * n / length;
+            real += input[n] * cos(angle);
+            imaginary += input[n] * sin(angle);
+        }
+        output[2 * k] = real;
+        output[2 * k + 1] = imaginary;
+    }
+}
+
+static void benchmark_fft(unsigned int length, unsigned int iterations) {
+    spectrum_analyzer_initialize(&analyzer, 1000, length, 1, SPECTRUM_BANDS_NONE);
+
+    static float input[SPECTRUM_MAX_FFT_LENGTH];
+    static float output[SPECTRUM_MAX_FFT_LENGTH + 2];
+    static double reference[SPECTRUM_MAX_FFT_LENGTH + 2];
+    for (unsigned int n = 0; n < length; n++) {
+        input[n] = (float) (rand() % 16777216 - 8388608);
+    }
+
+    spectrum_real_fft(&analyzer, input, output);
+    reference_dft(input, length, reference);
+
+    double max_error = 0;
+    double max_magnitude = 0;
+    for (unsigned int k = 0; k <= length / 2; k++) {
+        double error = hypot(output[2 * k] - reference[2 * k], output[2 * k + 1] - reference[2 * k + 1]);
+        double magnitude = hypot(reference[2 * k], reference[2 * k + 1]);
+        max_error = error > max_error ? error : max_error;
+        max_magnitude = magnitude > max_magnitude ? magnitude : max_magnitude;
+    }
+
+    double start_time = now_seconds();
+    unsigned long long start_cycles = cycle_count();
+    for (unsigned int i = 0; i < iterations; i++) {
+        spectrum_real_fft(&analyzer, input, output);
+    }
+    unsigned long long cycles = cycle_count() - start_cycles;
+    double elapsed = now_seconds() - start_time;
+
+    char cycles_text[32] = "n/a";
+    if (HAVE_CYCLE_COUNTER) {
+        snprintf(cycles_text, sizeof(cycles_text), "%.0f", (double) cycles / iterations);
+    }
+    printf("%-8u %-12.0f %-12s %-14.3e\n", 
+        length, 
+        elapsed * 1E9 / iterations, 
+        cycles_text, 
+        max_error / max_magnitude);
+}
+
+static void check_welch(void) {
+    double sample_rate = 40;
+    double frequency = 2;
+    double amplitude = 1E5;
+    spectrum_analyzer_initialize(&analyzer, sample_rate, 1024, 8, SPECTRUM_BANDS_THIRD_OCTAVE);
+
+    int32_t sample;
+    for (uint64_t n = 0; ! analyzer.estimate_ready; n++) {
+        sample = (int32_t) lround(amplitude * sin(2 * M_PI * frequency * n / sample_rate));
+        spectrum_analyzer_process(&analyzer, &sample, 1, n);
+    }
+
+    double total_power = 0;
+    const SpectrumBand *peak_band = &analyzer.bands[0];
+    for (unsigned int b = 0; b < analyzer.num_bands; b++) {
+        total_power += analyzer.bands[b].power;
+        if (analyzer.bands[b].power > peak_band->power) {
+            peak_band = &analyzer.bands[b];
+        }
+    }
+    printf(
+        "\nWelch check: %g Hz sine in band %.3g Hz holds %.1f%% of the band power, "
+        "total power %.4g of expected %.4g\n",
+        frequency,
+        peak_band->center_frequency,
+        100 * peak_band->power / total_power,
+        total_power,
+        amplitude * amplitude / 2
+    );
+}
+
+int main(int argc, char *argv[]) {
+    unsigned int iterations = argc > 1 ? atoi(argv[1]) : 10000;
+
+    printf("%-8s %-12s %-12s %-14s\n", "length", "ns/fft", "cycles/fft", "relative error");
+    for (unsigned int length = SPECTRUM_MIN_FFT_LENGTH; length <= SPECTRUM_MAX_FFT_LENGTH; length *= 2) {
+        benchmark_fft(length, iterations);
+    }
+    check_welch();
+    return 0;
+}
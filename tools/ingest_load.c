@@ -0,0 +1,271 @@
+/*
+ * Load generator for telemetry_ingest, simulating many microphones:
+ *
+ *   cc -O2 -I esp32/main -o ingest_load tools/ingest_load.c esp32/main/telemetry_frame.c \
+ *       esp32/main/pipeline_stats.c -lm
+ *
+ *   ingest_load [options] <host> <port>
+ *
+ *   -n <nodes>     microphones simulated (default 100)
+ *   -r <rate>      samples/s sent by each microphone, or 0 to send as fast as
+ *                  possible, in frames claiming 1000 samples/s (default 1000)
+ *   -s <samples>   samples per frame (default 128)
+ *   -d <seconds>   how long to send for (default 10)
+ *   -l <fraction>  fraction of frames dropped instead of sent (default 0)
+ *   -x <fraction>  fraction of frames held back and sent after the next one
+ *                  (default 0)
+ *
+ * Each simulated microphone sends sample frames from its own socket, so from
+ * its own source port, like a microphone would. A dropped frame still uses
+ * its sequence number and samples, so the receiver sees it missing. The
+ * microphones' frames are spread evenly over each frame period.
+ *
+ * What was sent is printed at the end, to be compared with the table printed
+ * by telemetry_ingest: each node should have as many frames missing as were
+ * dropped for it and as many out of order as were held back.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+
+#include "telemetry_frame.h"
+
+#define DEFAULT_NODES 100
+#define DEFAULT_SAMPLE_RATE 1000
+#define DEFAULT_FRAME_SAMPLES 128
+#define DEFAULT_DURATION 10
+
+// Length of each microphone's signal, a sine played over and over
+#define SIGNAL_LENGTH 4096
+#define SIGNAL_AMPLITUDE 1000000
+
+typedef struct {
+    int sd;
+    uint32_t sequence;
+    uint64_t next_sample_index;
+    int32_t signal[SIGNAL_LENGTH];
+
+    uint8_t held[TELEMETRY_FRAME_MAX_LENGTH];
+    size_t held_length;
+
+    uint64_t sent;
+    uint64_t dropped;
+    uint64_t reordered;
+    uint64_t send_errors;
+} SimulatedNode;
+
+static double monotonic_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1E-9;
+}
+
+static void sleep_until(double time) {
+    struct timespec until = {
+        .tv_sec = (time_t) time,
+        .tv_nsec = (long) ((time - (time_t) time) * 1E9)
+    };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) == EINTR) {
+    }
+}
+
+static double cpu_seconds(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1E-6 +
+        usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1E-6;
+}
+
+static void send_datagram(SimulatedNode *node, const uint8_t datagram[], size_t length) {
+    if (send(node->sd, datagram, length, 0) == -1) {
+        node->send_errors++;
+    }
+    else {
+        node->sent++;
+    }
+}
+
+/**
+ * @brief
+ * Send a node's next frame, or drop or hold it back
+ */
+static void send_frame(SimulatedNode *node, unsigned int frame_samples, uint32_t sample_rate_mhz,
+                       double loss, double reorder) {
+    static int32_t samples[TELEMETRY_FRAME_MAX_SAMPLES];
+    static uint8_t frame[TELEMETRY_FRAME_MAX_LENGTH];
+
+    for (unsigned int i = 0; i < frame_samples; i++) {
+        samples[i] = node->signal[(node->next_sample_index + i) % SIGNAL_LENGTH];
+    }
+    TelemetrySampleHeader header = {
+        .first_sample_index = node->next_sample_index,
+        .sample_rate_mhz = sample_rate_mhz,
+        .num_samples = frame_samples
+    };
+    size_t length = telemetry_frame_encode_samples(frame, node->sequence++, &header, samples);
+    node->next_sample_index += frame_samples;
+
+    double chance = drand48();
+    if (chance < loss) {
+        // A held back frame waits for the next frame sent
+        node->dropped++;
+        return;
+    }
+    if (chance < loss + reorder && node->held_length == 0) {
+        memcpy(node->held, frame, length);
+        node->held_length = length;
+        node->reordered++;
+        return;
+    }
+    send_datagram(node, frame, length);
+    if (node->held_length > 0) {
+        send_datagram(node, node->held, node->held_length);
+        node->held_length = 0;
+    }
+}
+
+static int open_node_socket(const struct addrinfo *address) {
+    int sd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+    if (sd == -1) {
+        perror("socket");
+        return -1;
+    }
+    if (connect(sd, address->ai_addr, address->ai_addrlen) == -1) {
+        perror("connect");
+        close(sd);
+        return -1;
+    }
+    return sd;
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: ingest_load [-n nodes] [-r rate] [-s samples] [-d seconds] [-l fraction] [-x fraction] "
+        "<host> <port>\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    unsigned int num_nodes = DEFAULT_NODES;
+    double sample_rate = DEFAULT_SAMPLE_RATE;
+    unsigned int frame_samples = DEFAULT_FRAME_SAMPLES;
+    double duration = DEFAULT_DURATION;
+    double loss = 0;
+    double reorder = 0;
+
+    int option;
+    while ((option = getopt(argc, argv, "n:r:s:d:l:x:")) != -1) {
+        switch (option) {
+            case 'n': num_nodes = atoi(optarg); break;
+            case 'r': sample_rate = atof(optarg); break;
+            case 's': frame_samples = atoi(optarg); break;
+            case 'd': duration = atof(optarg); break;
+            case 'l': loss = atof(optarg); break;
+            case 'x': reorder = atof(optarg); break;
+            default: usage();
+        }
+    }
+    if (argc - optind != 2 || num_nodes == 0 || sample_rate < 0 || duration <= 0 ||
+        frame_samples == 0 || frame_samples > TELEMETRY_FRAME_MAX_SAMPLES ||
+        loss < 0 || reorder < 0 || loss + reorder > 1) {
+        usage();
+    }
+
+    struct addrinfo hints = {
+        .ai_family = AF_UNSPEC,
+        .ai_socktype = SOCK_DGRAM
+    };
+    struct addrinfo *address;
+    int error = getaddrinfo(argv[optind], argv[optind + 1], &hints, &address);
+    if (error != 0) {
+        fprintf(stderr, "error: could not resolve %s:%s: %s\n", argv[optind], argv[optind + 1], gai_strerror(error));
+        return 1;
+    }
+
+    SimulatedNode *nodes = calloc(num_nodes, sizeof(SimulatedNode));
+    if (nodes == NULL) {
+        perror("calloc");
+        return 1;
+    }
+    srand48(1);
+    for (unsigned int n = 0; n < num_nodes; n++) {
+        nodes[n].sd = open_node_socket(address);
+        if (nodes[n].sd == -1) {
+            fprintf(stderr, "error: could only open %u sockets, see ulimit -n\n", n);
+            return 1;
+        }
+        // A different number of cycles for each node, so their signals differ
+        double cycles = 1 + n % 64;
+        for (int i = 0; i < SIGNAL_LENGTH; i++) {
+            nodes[n].signal[i] = (int32_t) (SIGNAL_AMPLITUDE * sin(2 * M_PI * cycles * i / SIGNAL_LENGTH));
+        }
+    }
+    freeaddrinfo(address);
+
+    // With every node sending at the same rate, each node's frames are due in
+    // turn, one every period / num_nodes
+    uint32_t sample_rate_mhz = sample_rate > 0 ? (uint32_t) (sample_rate * 1000 + 0.5) : 1000000;
+    double interval = sample_rate > 0 ? frame_samples / sample_rate / num_nodes : 0;
+    double start = monotonic_seconds();
+    double start_cpu = cpu_seconds();
+    uint64_t turns = 0;
+    for ( ;; ) {
+        if (interval > 0) {
+            double due = start + turns * interval;
+            if (due - start >= duration) {
+                break;
+            }
+            sleep_until(due);
+        }
+        else if (turns % num_nodes == 0 && monotonic_seconds() - start >= duration) {
+            break;
+        }
+        // Likewise each node starts with a frame that is sent
+        bool first = turns < num_nodes;
+        send_frame(&nodes[turns % num_nodes], frame_samples, sample_rate_mhz, first ? 0 : loss, first ? 0 : reorder);
+        turns++;
+    }
+
+    uint64_t sent = 0;
+    uint64_t dropped = 0;
+    uint64_t reordered = 0;
+    uint64_t send_errors = 0;
+    for (unsigned int n = 0; n < num_nodes; n++) {
+        // Every node ends with a frame that is sent, so that the receiver
+        // sees the frames dropped before it and frames held back go out
+        // after it
+        send_frame(&nodes[n], frame_samples, sample_rate_mhz, 0, 0);
+        sent += nodes[n].sent;
+        dropped += nodes[n].dropped;
+        reordered += nodes[n].reordered;
+        send_errors += nodes[n].send_errors;
+        close(nodes[n].sd);
+    }
+    double elapsed = monotonic_seconds() - start;
+    double cpu = cpu_seconds() - start_cpu;
+
+    printf(
+        "%u nodes, %llu frames sent, %llu dropped, %llu held back, %llu send errors\n",
+        num_nodes,
+        (unsigned long long) sent,
+        (unsigned long long) dropped,
+        (unsigned long long) reordered,
+        (unsigned long long) send_errors
+    );
+    printf(
+        "%.1f s, %.0f frames/s, %.0f samples/s, CPU %.1f%%\n",
+        elapsed,
+        (sent + dropped) / elapsed,
+        (sent + dropped) * (double) frame_samples / elapsed,
+        cpu / elapsed * 100
+    );
+    return 0;
+}
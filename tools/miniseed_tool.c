@@ -0,0 +1,184 @@
+/*
+ * Host side companion for the miniSEED telemetry sent by the microphone. 
+ * Shares the record encoder with the firmware:
+ *
+ *   cc -O2 -I esp32/main -o miniseed_tool tools/miniseed_tool.c esp32/main/miniseed.c -lm
+ *
+ *   miniseed_tool listen <port> > stream.mseed
+ *     Append records received on a UDP port to stdout. The result can be read 
+ *     by any SEED tooling, such as libmseed's msview or ObsPy.
+ *
+ *   miniseed_tool encode <network> <station> <location> <channel> <sample_rate> < samples.txt > stream.mseed
+ *     Encode one integer sample per line from stdin, starting at the current time.
+ *
+ *   miniseed_tool dump < stream.mseed
+ *     Decode records and print "<record> <sample>" lines, checking every record's 
+ *     last sample against its reverse integration constant.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "miniseed.h"
+
+int listen_for_records(const char port[]);
+int encode_records(char *argv[]);
+int dump_records(void);
+
+int main(int argc, char *argv[]) {
+    if (argc == 3 && ! strcmp(argv[1], "listen")) {
+        return listen_for_records(argv[2]);
+    }
+    if (argc == 7 && ! strcmp(argv[1], "encode")) {
+        return encode_records(argv + 2);
+    }
+    if (argc == 2 && ! strcmp(argv[1], "dump")) {
+        return dump_records();
+    }
+
+    fprintf(
+        stderr, 
+        "usage: %s listen <port>\n"
+        "       %s encode <network> <station> <location> <channel> <sample_rate>\n"
+        "       %s dump\n",
+        argv[0],
+        argv[0],
+        argv[0]
+    );
+    return 1;
+}
+
+int listen_for_records(const char port[]) {
+    struct addrinfo hints = {
+        .ai_family = AF_UNSPEC,
+        .ai_socktype = SOCK_DGRAM,
+        .ai_flags = AI_PASSIVE
+    };
+    struct addrinfo *address;
+    int error = getaddrinfo(NULL, port, &hints, &address);
+    if (error != 0) {
+        fprintf(stderr, "error: could not resolve port %s: %s\n", port, gai_strerror(error));
+        return 1;
+    }
+
+    int sd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+    if (sd == -1 || bind(sd, address->ai_addr, address->ai_addrlen) == -1) {
+        perror("bind");
+        return 1;
+    }
+    freeaddrinfo(address);
+
+    uint8_t record[MINISEED_RECORD_LENGTH + 1];
+    for ( ;; ) {
+        ssize_t length = recv(sd, record, sizeof(record), 0);
+        if (length == -1) {
+            perror("recv");
+            return 1;
+        }
+        if (length != MINISEED_RECORD_LENGTH) {
+            fprintf(stderr, "warning: discarded datagram of %zd bytes\n", length);
+            continue;
+        }
+        fwrite(record, 1, MINISEED_RECORD_LENGTH, stdout);
+        fflush(stdout);
+    }
+}
+
+int encode_records(char *argv[]) {
+    MiniseedStream stream;
+    if (miniseed_stream_initialize(&stream, argv[0], argv[1], argv[2], argv[3])) {
+        fprintf(stderr, "error: invalid stream identifier\n");
+        return 1;
+    }
+    double sample_rate = atof(argv[4]);
+
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    int64_t start_time_us = (int64_t) now.tv_sec * 1000000 + now.tv_usec;
+
+    int32_t samples[MINISEED_MAX_RECORD_SAMPLES];
+    size_t num_samples = 0;
+    int at_end = 0;
+    while (! at_end || num_samples > 0) {
+        long sample;
+        at_end = at_end || scanf("%ld", &sample) != 1;
+        if (! at_end) {
+            samples[num_samples++] = (int32_t) sample;
+        }
+        if (num_samples < MINISEED_MAX_RECORD_SAMPLES && ! at_end) {
+            continue;
+        }
+
+        uint8_t record[MINISEED_RECORD_LENGTH];
+        size_t encoded = miniseed_encode_record(
+            &stream, record, samples, num_samples, start_time_us, sample_rate);
+        fwrite(record, 1, MINISEED_RECORD_LENGTH, stdout);
+
+        start_time_us += (int64_t) (encoded * 1E6 / sample_rate);
+        num_samples -= encoded;
+        memmove(samples, samples + encoded, num_samples * sizeof(int32_t));
+    }
+    return 0;
+}
+
+static uint32_t get_u32(const uint8_t *source) {
+    return ((uint32_t) source[0] << 24) | ((uint32_t) source[1] << 16) | 
+        ((uint32_t) source[2] << 8) | source[3];
+}
+
+static int32_t sign_extend(uint32_t value, unsigned int bits) {
+    uint32_t sign = (uint32_t) 1 << (bits - 1);
+    value &= ((uint32_t) 1 << bits) - 1;
+    return (int32_t) (value ^ sign) - (int32_t) sign;
+}
+
+int dump_records(void) {
+    uint8_t record[MINISEED_RECORD_LENGTH];
+    unsigned long record_number = 0;
+    int status = 0;
+
+    while (fread(record, 1, MINISEED_RECORD_LENGTH, stdin) == MINISEED_RECORD_LENGTH) {
+        unsigned int num_samples = (record[30] << 8) | record[31];
+        unsigned int data_offset = (record[44] << 8) | record[45];
+
+        int32_t sample = 0;
+        unsigned int samples_decoded = 0;
+        int32_t first_sample = (int32_t) get_u32(record + data_offset + 4);
+        int32_t last_sample = (int32_t) get_u32(record + data_offset + 8);
+
+        for (unsigned int offset = data_offset; offset < MINISEED_RECORD_LENGTH; offset += 64) {
+            uint32_t control_word = get_u32(record + offset);
+            for (unsigned int w = 1; w < 16; w++) {
+                uint32_t word = get_u32(record + offset + 4 * w);
+                unsigned int nibble = (control_word >> (2 * (15 - w))) & 3;
+                unsigned int dnib = word >> 30;
+                unsigned int count = 0;
+                unsigned int bits = 0;
+
+                switch (nibble) {
+                    case 1: count = 4; bits = 8; break;
+                    case 2: count = dnib == 1 ? 1 : dnib == 2 ? 2 : 3; bits = 30 / count; break;
+                    case 3: count = 5 + dnib; bits = dnib == 2 ? 4 : dnib == 1 ? 5 : 6; break;
+                }
+
+                for (unsigned int i = 0; i < count && samples_decoded < num_samples; i++) {
+                    int32_t difference = sign_extend(word >> (bits * (count - 1 - i)), bits);
+                    sample = samples_decoded == 0 ? first_sample : sample + difference;
+                    printf("%lu %ld\n", record_number, (long) sample);
+                    samples_decoded++;
+                }
+            }
+        }
+
+        if (samples_decoded != num_samples || sample != last_sample) {
+            fprintf(stderr, "error: record %lu failed to decode\n", record_number);
+            status = 1;
+        }
+        record_number++;
+    }
+    return status;
+}
@@ -0,0 +1,127 @@
+/*
+ * Builds a flash image of a recording for the replay sample source:
+ *
+ *   cc -O2 -I esp32/main -o replay_image tools/replay_image.c esp32/main/recording.c
+ *
+ *   replay_image [-s size] <sample_rate> <samples_file | -> <image_file>
+ *
+ *   -s <bytes>  size of the replay partition (default 0x70000)
+ *
+ * The samples file holds one sample per line; lines with two numbers, like the
+ * output of `telemetry_tool listen`, use the second. Samples are clipped to 24
+ * bits, and the recording is cut short if it does not fit the partition.
+ * Write the image to a microphone with
+ *
+ *   parttool.py write_partition --partition-name replay --input <image_file>
+ *
+ * and play it with `source replay`.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "recording.h"
+
+#define DEFAULT_PARTITION_SIZE 0x70000
+
+#define MAX_SAMPLE 8388607
+#define MIN_SAMPLE -8388608
+
+static void usage(void) {
+    fprintf(stderr, "usage: replay_image [-s size] <sample_rate> <samples_file | -> <image_file>\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    unsigned long partition_size = DEFAULT_PARTITION_SIZE;
+
+    int option;
+    while ((option = getopt(argc, argv, "s:")) != -1) {
+        switch (option) {
+            case 's': partition_size = strtoul(optarg, NULL, 0); break;
+            default: usage();
+        }
+    }
+    if (argc - optind != 3) {
+        usage();
+    }
+
+    double sample_rate = atof(argv[optind]);
+    if (sample_rate <= 0 || sample_rate * 1000 > UINT32_MAX || partition_size <= RECORDING_HEADER_LENGTH) {
+        usage();
+    }
+    size_t max_samples = (partition_size - RECORDING_HEADER_LENGTH) / RECORDING_SAMPLE_WIDTH;
+
+    FILE *input = strcmp(argv[optind + 1], "-") ? fopen(argv[optind + 1], "r") : stdin;
+    if (input == NULL) {
+        perror(argv[optind + 1]);
+        return 1;
+    }
+    FILE *output = fopen(argv[optind + 2], "wb");
+    if (output == NULL) {
+        perror(argv[optind + 2]);
+        return 1;
+    }
+
+    // The header is written once the number of samples is known
+    uint8_t header[RECORDING_HEADER_LENGTH] = {0};
+    fwrite(header, 1, sizeof(header), output);
+
+    size_t num_samples = 0;
+    size_t num_clipped = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), input) != NULL) {
+        double first;
+        double second;
+        int fields = sscanf(line, "%lf %lf", &first, &second);
+        if (fields < 1) {
+            continue;
+        }
+        if (num_samples == max_samples) {
+            fprintf(stderr, "warning: recording cut to the %zu samples that fit the partition\n", max_samples);
+            break;
+        }
+
+        double value = fields == 2 ? second : first;
+        if (value > MAX_SAMPLE || value < MIN_SAMPLE) {
+            value = value > MAX_SAMPLE ? MAX_SAMPLE : MIN_SAMPLE;
+            num_clipped++;
+        }
+        int32_t sample = (int32_t) value;
+        uint8_t packed[RECORDING_SAMPLE_WIDTH];
+        recording_pack_samples(packed, &sample, 1);
+        fwrite(packed, 1, sizeof(packed), output);
+        num_samples++;
+    }
+    if (input != stdin) {
+        fclose(input);
+    }
+    if (num_samples == 0) {
+        fprintf(stderr, "error: no samples read\n");
+        fclose(output);
+        return 1;
+    }
+    if (num_clipped > 0) {
+        fprintf(stderr, "warning: %zu samples clipped to 24 bits\n", num_clipped);
+    }
+
+    RecordingHeader recording = {
+        .sample_rate_mhz = (uint32_t) (sample_rate * 1000 + 0.5),
+        .num_samples = num_samples
+    };
+    recording_encode_header(header, &recording);
+    if (fseek(output, 0, SEEK_SET) || fwrite(header, 1, sizeof(header), output) != sizeof(header) || fclose(output)) {
+        perror(argv[optind + 2]);
+        return 1;
+    }
+
+    printf(
+        "%zu samples, %.1f s at %.3f samples/s, %zu bytes\n",
+        num_samples,
+        num_samples / sample_rate,
+        sample_rate,
+        RECORDING_HEADER_LENGTH + num_samples * RECORDING_SAMPLE_WIDTH
+    );
+    return 0;
+}
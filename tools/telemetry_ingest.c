@@ -0,0 +1,894 @@
+/*
+ * Ingest daemon for telemetry from many microphones on one UDP port:
+ *
+ *   cc -O2 -I esp32/main -I esp32/host -o telemetry_ingest tools/telemetry_ingest.c \
+ *       esp32/main/telemetry_frame.c esp32/main/pipeline_stats.c esp32/host/sample_archive.c -lm
+ *
+ *   telemetry_ingest [options] <port>
+ *
+ *   -o <dir>      write each node's samples, in order, to <dir>/<address>_<port>.txt
+ *                 as "<sample index> <sample>" lines, like `telemetry_tool listen`
+ *   -a <dir>      append each node's samples, in order, to the sample archive
+ *                 <dir>/<address>_<port>.iarc, to be read with archive_tool
+ *   -w <frames>   sample frames a node may hold while waiting for a gap to fill
+ *                 (default 32)
+ *   -t <ms>       longest a gap is waited for before its samples count as lost
+ *                 (default 2000)
+ *   -i <seconds>  interval between summary lines on stderr (default 10)
+ *   -m <nodes>    most nodes tracked (default 1024)
+ *   -b <bytes>    socket receive buffer (default 8 MB, limited by net.core.rmem_max)
+ *   -d <seconds>  stop after this long instead of at SIGINT or SIGTERM
+ *
+ * Nodes are told apart by their source address and port. Datagrams are taken
+ * from the socket in batches with recvmmsg whenever epoll reports it
+ * readable, with their kernel arrival time.
+ *
+ * Each node's sample frames are put back in sample index order into one
+ * contiguous stream. A frame ahead of the stream is held until the frames
+ * before it arrive, including ones backfilled after an outage. If they have
+ * not arrived when the node holds too many frames or the oldest has waited
+ * too long, their samples count as lost and the stream skips ahead. Frames
+ * arriving after the stream has passed them count as late.
+ *
+ * For every node, missing and out of order frame sequence numbers, lost
+ * samples and delay are counted. The delay of a frame is its arrival time
+ * less the time of its last sample, taken from its sample index and rate,
+ * and is given above the least delay seen in the last minute or two, since
+ * a node's clock is not known.
+ *
+ * Archived samples are given the time the node's clock is estimated to
+ * have taken them at: the time of the sample index plus the least delay
+ * offset. That is late by the least time a frame takes to arrive.
+ *
+ * The summary lines give the frame and sample rates, the CPU used and the
+ * drops counted by the kernel when the receive buffer overflows. A table of
+ * every node is printed on exit.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+#include "telemetry_frame.h"
+#include "pipeline_stats.h"
+#include "sample_archive.h"
+
+#define RECEIVE_BATCH 64
+#define DATAGRAM_BUFFER_LENGTH (TELEMETRY_FRAME_MAX_LENGTH + 1)
+#define CONTROL_BUFFER_LENGTH (CMSG_SPACE(sizeof(struct timespec)) + CMSG_SPACE(sizeof(uint32_t)))
+
+#define DEFAULT_WINDOW_FRAMES 32
+#define DEFAULT_GAP_TIMEOUT_MS 2000
+#define DEFAULT_REPORT_INTERVAL 10
+#define DEFAULT_MAX_NODES 1024
+#define DEFAULT_RECEIVE_BUFFER (8 << 20)
+
+// Gap timeouts are checked this often
+#define TICK_MS 100
+
+// The least delay is taken over the current and the previous window of this
+// length, so that it follows the drift of a node's clock
+#define DELAY_WINDOW_US 60000000LL
+
+// A live frame further behind its node's stream than this means the node
+// restarted and its sample index began again
+#define RESTART_SECONDS 60
+
+#define NUM_FRAME_TYPES (TELEMETRY_FRAME_HEALTH + 1)
+
+typedef struct PendingFrame {
+    struct PendingFrame *next;
+    TelemetrySampleHeader header;
+    int64_t arrival_us;
+    int32_t samples[TELEMETRY_FRAME_MAX_SAMPLES];
+} PendingFrame;
+
+typedef struct {
+    struct sockaddr_storage address;
+    socklen_t address_length;
+    char name[INET6_ADDRSTRLEN + 8];
+
+    uint64_t frames;
+    uint64_t frames_by_type[NUM_FRAME_TYPES];
+    uint64_t malformed;
+    uint64_t backfilled;
+    bool have_sequence;
+    uint32_t expected_sequence;
+    uint64_t frames_missing;
+    uint64_t frames_out_of_order;
+
+    // Contiguous stream of samples, and the frames held ahead of it in
+    // sample index order
+    bool have_stream;
+    uint64_t next_sample_index;
+    uint32_t sample_rate_mhz;
+    PendingFrame *pending;
+    unsigned int num_pending;
+    uint64_t samples_emitted;
+    uint64_t samples_lost;
+    uint64_t gaps;
+    uint64_t late_frames;
+    uint64_t restarts;
+    FILE *output;
+    SampleArchiveWriter *archive;
+    // Least offset of arrival time from sample time, INT64_MAX until known
+    int64_t time_offset_us;
+    uint64_t samples_unarchived;
+
+    int64_t min_offset_us[2];
+    int64_t delay_window_start_us;
+    // Microseconds
+    StatsHistogram delay;
+} Node;
+
+typedef struct {
+    const char *output_directory;
+    const char *archive_directory;
+    unsigned int window_frames;
+    int64_t gap_timeout_us;
+    double report_interval;
+    size_t max_nodes;
+    int receive_buffer;
+    double duration;
+} IngestOptions;
+
+typedef struct {
+    uint64_t datagrams;
+    uint64_t batches;
+    uint64_t samples;
+    uint64_t unknown_nodes;
+    uint32_t kernel_drops;
+} IngestTotals;
+
+static IngestOptions options = {
+    .window_frames = DEFAULT_WINDOW_FRAMES,
+    .gap_timeout_us = DEFAULT_GAP_TIMEOUT_MS * 1000LL,
+    .report_interval = DEFAULT_REPORT_INTERVAL,
+    .max_nodes = DEFAULT_MAX_NODES,
+    .receive_buffer = DEFAULT_RECEIVE_BUFFER
+};
+
+// Nodes in order of first arrival, found through an open addressing hash
+// table of indexes into `nodes`
+static Node *nodes;
+static size_t num_nodes;
+static int32_t *node_table;
+static size_t node_table_size;
+
+static PendingFrame *free_frames;
+static IngestTotals totals;
+
+static int64_t realtime_us(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (int64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static double cpu_seconds(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1E-6 +
+        usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1E-6;
+}
+
+/**
+ * @brief
+ * FNV-1a of the address and port, which is all that tells nodes apart
+ */
+static uint32_t hash_address(const struct sockaddr_storage *address) {
+    const uint8_t *bytes;
+    size_t length;
+    uint16_t port;
+    if (address->ss_family == AF_INET6) {
+        const struct sockaddr_in6 *in6 = (const struct sockaddr_in6 *) address;
+        bytes = in6->sin6_addr.s6_addr;
+        length = sizeof(in6->sin6_addr);
+        port = in6->sin6_port;
+    }
+    else {
+        const struct sockaddr_in *in = (const struct sockaddr_in *) address;
+        bytes = (const uint8_t *) &in->sin_addr;
+        length = sizeof(in->sin_addr);
+        port = in->sin_port;
+    }
+
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    hash = (hash ^ (port & 0xff)) * 16777619u;
+    return (hash ^ (port >> 8)) * 16777619u;
+}
+
+static bool same_address(const struct sockaddr_storage *a, const struct sockaddr_storage *b) {
+    if (a->ss_family != b->ss_family) {
+        return false;
+    }
+    if (a->ss_family == AF_INET6) {
+        const struct sockaddr_in6 *a6 = (const struct sockaddr_in6 *) a;
+        const struct sockaddr_in6 *b6 = (const struct sockaddr_in6 *) b;
+        return a6->sin6_port == b6->sin6_port && ! memcmp(&a6->sin6_addr, &b6->sin6_addr, sizeof(a6->sin6_addr));
+    }
+    const struct sockaddr_in *a4 = (const struct sockaddr_in *) a;
+    const struct sockaddr_in *b4 = (const struct sockaddr_in *) b;
+    return a4->sin_port == b4->sin_port && a4->sin_addr.s_addr == b4->sin_addr.s_addr;
+}
+
+static void name_node(Node *node) {
+    char host[INET6_ADDRSTRLEN];
+    unsigned int port;
+    if (node->address.ss_family == AF_INET6) {
+        const struct sockaddr_in6 *in6 = (const struct sockaddr_in6 *) &node->address;
+        inet_ntop(AF_INET6, &in6->sin6_addr, host, sizeof(host));
+        port = ntohs(in6->sin6_port);
+    }
+    else {
+        const struct sockaddr_in *in = (const struct sockaddr_in *) &node->address;
+        inet_ntop(AF_INET, &in->sin_addr, host, sizeof(host));
+        port = ntohs(in->sin_port);
+    }
+    snprintf(node->name, sizeof(node->name), "%s_%u", host, port);
+}
+
+static int open_node_output(Node *node) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s.txt", options.output_directory, node->name);
+    node->output = fopen(path, "a");
+    if (node->output == NULL) {
+        perror(path);
+        return 1;
+    }
+    return 0;
+}
+
+static int open_node_archive(Node *node) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s.iarc", options.archive_directory, node->name);
+    node->archive = malloc(sizeof(SampleArchiveWriter));
+    if (node->archive == NULL ||
+        sample_archive_open_writer(node->archive, path, node->name, SAMPLE_ARCHIVE_DEFAULT_CHUNK_SAMPLES)) {
+        return 1;
+    }
+    if (node->archive->chunks_reindexed > 0 || node->archive->bytes_truncated > 0) {
+        fprintf(stderr, "note: %s: %llu chunks indexed again, %llu bytes cut off\n", path,
+            (unsigned long long) node->archive->chunks_reindexed, (unsigned long long) node->archive->bytes_truncated);
+    }
+    return 0;
+}
+
+/**
+ * @brief
+ * @return The node sending from `address`, which is added if it is new, or
+ * NULL if there are already as many nodes as can be tracked
+ */
+static Node *find_node(const struct sockaddr_storage *address, socklen_t address_length) {
+    size_t slot = hash_address(address) & (node_table_size - 1);
+    while (node_table[slot] >= 0) {
+        Node *node = &nodes[node_table[slot]];
+        if (same_address(&node->address, address)) {
+            return node;
+        }
+        slot = (slot + 1) & (node_table_size - 1);
+    }
+
+    if (num_nodes == options.max_nodes) {
+        return NULL;
+    }
+    node_table[slot] = (int32_t) num_nodes;
+    Node *node = &nodes[num_nodes++];
+    *node = (Node) {
+        .address = *address,
+        .address_length = address_length,
+        .time_offset_us = INT64_MAX,
+        .min_offset_us = {INT64_MAX, INT64_MAX}
+    };
+    name_node(node);
+    if (options.output_directory != NULL && open_node_output(node)) {
+        exit(1);
+    }
+    if (options.archive_directory != NULL && open_node_archive(node)) {
+        exit(1);
+    }
+    fprintf(stderr, "note: new node %s\n", node->name);
+    return node;
+}
+
+static PendingFrame *allocate_frame(void) {
+    PendingFrame *frame = free_frames;
+    if (frame != NULL) {
+        free_frames = frame->next;
+        return frame;
+    }
+    frame = malloc(sizeof(PendingFrame));
+    if (frame == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    return frame;
+}
+
+static void free_frame(PendingFrame *frame) {
+    frame->next = free_frames;
+    free_frames = frame;
+}
+
+static void emit_samples(
+    Node *node,
+    uint64_t first_sample_index,
+    uint32_t sample_rate_mhz,
+    const int32_t samples[],
+    size_t num_samples
+) {
+    if (node->output != NULL) {
+        for (size_t i = 0; i < num_samples; i++) {
+            fprintf(node->output, "%llu %ld\n", (unsigned long long) (first_sample_index + i), (long) samples[i]);
+        }
+    }
+    if (node->archive != NULL) {
+        if (node->time_offset_us == INT64_MAX || sample_rate_mhz == 0 ||
+            sample_archive_append(
+                node->archive,
+                first_sample_index,
+                node->time_offset_us + (int64_t) (first_sample_index * 1E9 / sample_rate_mhz),
+                sample_rate_mhz,
+                samples,
+                num_samples
+            )) {
+            node->samples_unarchived += num_samples;
+        }
+    }
+    node->samples_emitted += num_samples;
+    node->next_sample_index = first_sample_index + num_samples;
+}
+
+/**
+ * @brief
+ * Append the part of a frame the stream has not passed yet
+ * @return false if the stream has passed all of it
+ */
+static bool emit_frame(Node *node, const TelemetrySampleHeader *header, const int32_t samples[]) {
+    uint64_t end = header->first_sample_index + header->num_samples;
+    if (end <= node->next_sample_index) {
+        node->late_frames++;
+        return false;
+    }
+    size_t skip = node->next_sample_index > header->first_sample_index ?
+        node->next_sample_index - header->first_sample_index : 0;
+    emit_samples(node, header->first_sample_index + skip, header->sample_rate_mhz, samples + skip, header->num_samples - skip);
+    return true;
+}
+
+/**
+ * @brief
+ * Append the held frames that the stream has caught up with
+ */
+static void drain_pending(Node *node) {
+    while (node->pending != NULL && node->pending->header.first_sample_index <= node->next_sample_index) {
+        PendingFrame *frame = node->pending;
+        node->pending = frame->next;
+        node->num_pending--;
+        emit_frame(node, &frame->header, frame->samples);
+        free_frame(frame);
+    }
+}
+
+/**
+ * @brief
+ * Give up on the samples before the first held frame and carry on from it
+ */
+static void skip_gap(Node *node) {
+    uint64_t first = node->pending->header.first_sample_index;
+    node->samples_lost += first - node->next_sample_index;
+    node->gaps++;
+    node->next_sample_index = first;
+    drain_pending(node);
+}
+
+static void hold_frame(Node *node, const TelemetrySampleHeader *header, const int32_t samples[], int64_t arrival_us) {
+    PendingFrame **link = &node->pending;
+    while (*link != NULL && (*link)->header.first_sample_index < header->first_sample_index) {
+        link = &(*link)->next;
+    }
+    if (*link != NULL && (*link)->header.first_sample_index == header->first_sample_index) {
+        node->late_frames++;
+        return;
+    }
+
+    PendingFrame *frame = allocate_frame();
+    frame->header = *header;
+    frame->arrival_us = arrival_us;
+    memcpy(frame->samples, samples, header->num_samples * sizeof(int32_t));
+    frame->next = *link;
+    *link = frame;
+    node->num_pending++;
+
+    if (node->num_pending > options.window_frames) {
+        skip_gap(node);
+    }
+}
+
+static void restart_stream(Node *node, uint64_t first_sample_index) {
+    while (node->pending != NULL) {
+        skip_gap(node);
+    }
+    node->next_sample_index = first_sample_index;
+    node->restarts++;
+    node->have_sequence = false;
+    node->min_offset_us[0] = node->min_offset_us[1] = INT64_MAX;
+    node->time_offset_us = INT64_MAX;
+    fprintf(stderr, "note: node %s restarted at sample %llu\n", node->name, (unsigned long long) first_sample_index);
+}
+
+static void record_delay(Node *node, const TelemetrySampleHeader *header, int64_t arrival_us) {
+    if (header->sample_rate_mhz == 0) {
+        return;
+    }
+    if (header->sample_rate_mhz != node->sample_rate_mhz) {
+        node->sample_rate_mhz = header->sample_rate_mhz;
+        node->min_offset_us[0] = node->min_offset_us[1] = INT64_MAX;
+    }
+
+    uint64_t last_sample_index = header->first_sample_index + header->num_samples - 1;
+    int64_t sample_time_us = (int64_t) (last_sample_index * 1E9 / header->sample_rate_mhz);
+    int64_t offset_us = arrival_us - sample_time_us;
+    if (arrival_us - node->delay_window_start_us > DELAY_WINDOW_US) {
+        node->min_offset_us[1] = node->min_offset_us[0];
+        node->min_offset_us[0] = INT64_MAX;
+        node->delay_window_start_us = arrival_us;
+    }
+    if (offset_us < node->min_offset_us[0]) {
+        node->min_offset_us[0] = offset_us;
+    }
+    int64_t least = node->min_offset_us[0] < node->min_offset_us[1] ? node->min_offset_us[0] : node->min_offset_us[1];
+    node->time_offset_us = least;
+    int64_t delay_us = offset_us - least;
+    stats_histogram_record(&node->delay, delay_us > UINT32_MAX ? UINT32_MAX : (uint32_t) delay_us);
+}
+
+static void accept_samples(Node *node, const TelemetryFrame *frame, int64_t arrival_us) {
+    static int32_t samples[TELEMETRY_FRAME_MAX_SAMPLES];
+    TelemetrySampleHeader header;
+    if (telemetry_frame_decode_samples(frame, &header, samples) || header.num_samples == 0) {
+        node->malformed++;
+        return;
+    }
+    totals.samples += header.num_samples;
+
+    bool backfilled = frame->flags & TELEMETRY_FRAME_BACKFILLED;
+    uint64_t first = header.first_sample_index;
+    uint64_t end = first + header.num_samples;
+    if (! node->have_stream) {
+        node->have_stream = true;
+        node->next_sample_index = first;
+    }
+    else if (! backfilled && header.sample_rate_mhz > 0 && end < node->next_sample_index &&
+             (node->next_sample_index - end) * 1000.0 / header.sample_rate_mhz > RESTART_SECONDS) {
+        restart_stream(node, first);
+    }
+    if (! backfilled) {
+        record_delay(node, &header, arrival_us);
+    }
+
+    if (first <= node->next_sample_index) {
+        if (emit_frame(node, &header, samples)) {
+            drain_pending(node);
+        }
+    }
+    else {
+        hold_frame(node, &header, samples, arrival_us);
+    }
+}
+
+static void count_sequence(Node *node, const TelemetryFrame *frame) {
+    // Backfilled frames keep the sequence numbers they were first sent
+    // with, so only live frames are checked
+    if (frame->flags & TELEMETRY_FRAME_BACKFILLED) {
+        node->backfilled++;
+        return;
+    }
+    if (node->have_sequence && frame->sequence != node->expected_sequence) {
+        int32_t ahead = (int32_t) (frame->sequence - node->expected_sequence);
+        if (ahead > 0) {
+            node->frames_missing += ahead;
+        }
+        else {
+            // Counted as missing when the frames after it arrived
+            node->frames_out_of_order++;
+            if (node->frames_missing > 0) {
+                node->frames_missing--;
+            }
+            return;
+        }
+    }
+    node->have_sequence = true;
+    node->expected_sequence = frame->sequence + 1;
+}
+
+static void ingest_datagram(
+    const uint8_t datagram[],
+    size_t length,
+    const struct sockaddr_storage *address,
+    socklen_t address_length,
+    int64_t arrival_us
+) {
+    Node *node = find_node(address, address_length);
+    if (node == NULL) {
+        totals.unknown_nodes++;
+        return;
+    }
+
+    TelemetryFrame frame;
+    if (telemetry_frame_decode(datagram, length, &frame)) {
+        node->malformed++;
+        return;
+    }
+    node->frames++;
+    if (frame.type < NUM_FRAME_TYPES) {
+        node->frames_by_type[frame.type]++;
+    }
+    count_sequence(node, &frame);
+    if (frame.type == TELEMETRY_FRAME_SAMPLES) {
+        accept_samples(node, &frame, arrival_us);
+    }
+}
+
+/**
+ * @brief
+ * Take every datagram waiting on the socket, a batch at a time
+ * @return 0 if success
+ */
+static int receive_datagrams(int sd) {
+    static uint8_t buffers[RECEIVE_BATCH][DATAGRAM_BUFFER_LENGTH];
+    static uint8_t controls[RECEIVE_BATCH][CONTROL_BUFFER_LENGTH];
+    static struct sockaddr_storage addresses[RECEIVE_BATCH];
+    static struct iovec iovecs[RECEIVE_BATCH];
+    static struct mmsghdr messages[RECEIVE_BATCH];
+
+    for ( ;; ) {
+        for (int i = 0; i < RECEIVE_BATCH; i++) {
+            iovecs[i] = (struct iovec) {
+                .iov_base = buffers[i],
+                .iov_len = DATAGRAM_BUFFER_LENGTH
+            };
+            messages[i].msg_hdr = (struct msghdr) {
+                .msg_name = &addresses[i],
+                .msg_namelen = sizeof(addresses[i]),
+                .msg_iov = &iovecs[i],
+                .msg_iovlen = 1,
+                .msg_control = controls[i],
+                .msg_controllen = CONTROL_BUFFER_LENGTH
+            };
+        }
+
+        int count = recvmmsg(sd, messages, RECEIVE_BATCH, MSG_DONTWAIT, NULL);
+        if (count == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                return 0;
+            }
+            perror("recvmmsg");
+            return 1;
+        }
+        totals.batches++;
+        totals.datagrams += count;
+
+        int64_t now_us = realtime_us();
+        for (int i = 0; i < count; i++) {
+            struct msghdr *header = &messages[i].msg_hdr;
+            int64_t arrival_us = now_us;
+            for (struct cmsghdr *control = CMSG_FIRSTHDR(header); control != NULL; control = CMSG_NXTHDR(header, control)) {
+                if (control->cmsg_level != SOL_SOCKET) {
+                    continue;
+                }
+                if (control->cmsg_type == SCM_TIMESTAMPNS) {
+                    struct timespec time;
+                    memcpy(&time, CMSG_DATA(control), sizeof(time));
+                    arrival_us = (int64_t) time.tv_sec * 1000000 + time.tv_nsec / 1000;
+                }
+                else if (control->cmsg_type == SO_RXQ_OVFL) {
+                    memcpy(&totals.kernel_drops, CMSG_DATA(control), sizeof(uint32_t));
+                }
+            }
+            ingest_datagram(buffers[i], messages[i].msg_len, &addresses[i], header->msg_namelen, arrival_us);
+        }
+        if (count < RECEIVE_BATCH) {
+            return 0;
+        }
+    }
+}
+
+static void check_gap_timeouts(int64_t now_us) {
+    for (size_t n = 0; n < num_nodes; n++) {
+        Node *node = &nodes[n];
+        while (node->pending != NULL && now_us - node->pending->arrival_us > options.gap_timeout_us) {
+            skip_gap(node);
+        }
+    }
+}
+
+typedef struct {
+    double time;
+    double cpu;
+    uint64_t datagrams;
+    uint64_t batches;
+    uint64_t samples;
+} ReportPoint;
+
+static void report(const char label[], const ReportPoint *previous, const ReportPoint *current) {
+    double interval = current->time - previous->time;
+    if (interval <= 0) {
+        return;
+    }
+
+    uint64_t missing = 0;
+    uint64_t lost = 0;
+    uint64_t late = 0;
+    for (size_t n = 0; n < num_nodes; n++) {
+        missing += nodes[n].frames_missing;
+        lost += nodes[n].samples_lost;
+        late += nodes[n].late_frames;
+    }
+
+    double cpu_load = (current->cpu - previous->cpu) / interval;
+    uint64_t batches = current->batches - previous->batches;
+    fprintf(
+        stderr,
+        "%s: %zu nodes, %.0f frames/s, %.0f samples/s, %.1f frames/batch, "
+        "CPU %.1f%% (%.3f%% per node), %llu frames missing, %llu samples lost, %llu late, %u dropped by the kernel\n",
+        label,
+        num_nodes,
+        (current->datagrams - previous->datagrams) / interval,
+        (current->samples - previous->samples) / interval,
+        batches > 0 ? (double) (current->datagrams - previous->datagrams) / batches : 0.0,
+        cpu_load * 100,
+        num_nodes > 0 ? cpu_load * 100 / num_nodes : 0.0,
+        (unsigned long long) missing,
+        (unsigned long long) lost,
+        (unsigned long long) late,
+        totals.kernel_drops
+    );
+}
+
+static ReportPoint report_point(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (ReportPoint) {
+        .time = now.tv_sec + now.tv_nsec * 1E-9,
+        .cpu = cpu_seconds(),
+        .datagrams = totals.datagrams,
+        .batches = totals.batches,
+        .samples = totals.samples
+    };
+}
+
+static void print_node_table(void) {
+    printf(
+        "%-28s %10s %8s %8s %8s %8s %12s %6s %10s %9s %9s %9s\n",
+        "node", "frames", "missing", "reorder", "backfill", "late", "samples", "gaps", "lost",
+        "delay p50", "p99", "max ms"
+    );
+    for (size_t n = 0; n < num_nodes; n++) {
+        const Node *node = &nodes[n];
+        printf(
+            "%-28s %10llu %8llu %8llu %8llu %8llu %12llu %6llu %10llu %9.1f %9.1f %9.1f\n",
+            node->name,
+            (unsigned long long) node->frames,
+            (unsigned long long) node->frames_missing,
+            (unsigned long long) node->frames_out_of_order,
+            (unsigned long long) node->backfilled,
+            (unsigned long long) node->late_frames,
+            (unsigned long long) node->samples_emitted,
+            (unsigned long long) node->gaps,
+            (unsigned long long) node->samples_lost,
+            stats_histogram_percentile(&node->delay, 0.5) / 1E3,
+            stats_histogram_percentile(&node->delay, 0.99) / 1E3,
+            node->delay.count > 0 ? node->delay.max / 1E3 : 0.0
+        );
+    }
+    uint64_t unarchived = 0;
+    for (size_t n = 0; n < num_nodes; n++) {
+        unarchived += nodes[n].samples_unarchived;
+    }
+    if (unarchived > 0) {
+        printf("%llu samples could not be archived\n", (unsigned long long) unarchived);
+    }
+    if (totals.unknown_nodes > 0) {
+        printf("%llu datagrams from nodes past the first %zu were ignored\n",
+            (unsigned long long) totals.unknown_nodes, options.max_nodes);
+    }
+}
+
+static int open_receive_socket(const char port[]) {
+    struct addrinfo hints = {
+        .ai_family = AF_UNSPEC,
+        .ai_socktype = SOCK_DGRAM,
+        .ai_flags = AI_PASSIVE
+    };
+    struct addrinfo *address;
+    int error = getaddrinfo(NULL, port, &hints, &address);
+    if (error != 0) {
+        fprintf(stderr, "error: could not resolve *:%s: %s\n", port, gai_strerror(error));
+        return -1;
+    }
+
+    int sd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+    if (sd == -1) {
+        perror("socket");
+        freeaddrinfo(address);
+        return -1;
+    }
+    int on = 1;
+    setsockopt(sd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+    setsockopt(sd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on));
+    if (setsockopt(sd, SOL_SOCKET, SO_RCVBUF, &options.receive_buffer, sizeof(options.receive_buffer)) == -1) {
+        perror("warning: SO_RCVBUF");
+    }
+    if (bind(sd, address->ai_addr, address->ai_addrlen) == -1) {
+        perror("bind");
+        freeaddrinfo(address);
+        close(sd);
+        return -1;
+    }
+    freeaddrinfo(address);
+    return sd;
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: telemetry_ingest [-o dir] [-a dir] [-w frames] [-t ms] [-i seconds] [-m nodes] [-b bytes] "
+        "[-d seconds] <port>\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    int option;
+    while ((option = getopt(argc, argv, "o:a:w:t:i:m:b:d:")) != -1) {
+        switch (option) {
+            case 'o': options.output_directory = optarg; break;
+            case 'a': options.archive_directory = optarg; break;
+            case 'w': options.window_frames = atoi(optarg); break;
+            case 't': options.gap_timeout_us = atof(optarg) * 1000; break;
+            case 'i': options.report_interval = atof(optarg); break;
+            case 'm': options.max_nodes = strtoul(optarg, NULL, 0); break;
+            case 'b': options.receive_buffer = atoi(optarg); break;
+            case 'd': options.duration = atof(optarg); break;
+            default: usage();
+        }
+    }
+    if (argc - optind != 1 || options.window_frames == 0 || options.max_nodes == 0 || options.report_interval <= 0) {
+        usage();
+    }
+    if (options.output_directory != NULL && mkdir(options.output_directory, 0777) == -1 && errno != EEXIST) {
+        perror(options.output_directory);
+        return 1;
+    }
+    if (options.archive_directory != NULL && mkdir(options.archive_directory, 0777) == -1 && errno != EEXIST) {
+        perror(options.archive_directory);
+        return 1;
+    }
+
+    nodes = calloc(options.max_nodes, sizeof(Node));
+    node_table_size = 1;
+    while (node_table_size < 2 * options.max_nodes) {
+        node_table_size *= 2;
+    }
+    node_table = malloc(node_table_size * sizeof(int32_t));
+    if (nodes == NULL || node_table == NULL) {
+        perror("malloc");
+        return 1;
+    }
+    memset(node_table, -1, node_table_size * sizeof(int32_t));
+
+    int sd = open_receive_socket(argv[optind]);
+    if (sd == -1) {
+        return 1;
+    }
+
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &signals, NULL);
+    int signal_fd = signalfd(-1, &signals, SFD_CLOEXEC);
+
+    int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    struct itimerspec tick = {
+        .it_interval = {.tv_nsec = TICK_MS * 1000000L},
+        .it_value = {.tv_nsec = TICK_MS * 1000000L}
+    };
+    timerfd_settime(timer_fd, 0, &tick, NULL);
+
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    int fds[] = {sd, timer_fd, signal_fd};
+    for (int i = 0; i < 3; i++) {
+        struct epoll_event event = {
+            .events = EPOLLIN,
+            .data.fd = fds[i]
+        };
+        if (fds[i] == -1 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fds[i], &event) == -1) {
+            perror("epoll");
+            return 1;
+        }
+    }
+
+    fprintf(stderr, "note: listening on port %s\n", argv[optind]);
+    ReportPoint start = report_point();
+    ReportPoint last_report = start;
+    bool running = true;
+    int result = 0;
+    while (running) {
+        struct epoll_event events[3];
+        int count = epoll_wait(epoll_fd, events, 3, -1);
+        if (count == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait");
+            result = 1;
+            break;
+        }
+
+        for (int i = 0; i < count; i++) {
+            int fd = events[i].data.fd;
+            if (fd == sd) {
+                if (receive_datagrams(sd)) {
+                    running = false;
+                    result = 1;
+                }
+            }
+            else if (fd == timer_fd) {
+                uint64_t expirations;
+                if (read(timer_fd, &expirations, sizeof(expirations)) < 0) {
+                    continue;
+                }
+                check_gap_timeouts(realtime_us());
+
+                ReportPoint now = report_point();
+                if (now.time - last_report.time >= options.report_interval) {
+                    char label[32];
+                    snprintf(label, sizeof(label), "%.0f s", now.time - start.time);
+                    report(label, &last_report, &now);
+                    last_report = now;
+                }
+                if (options.duration > 0 && now.time - start.time >= options.duration) {
+                    running = false;
+                }
+            }
+            else {
+                struct signalfd_siginfo info;
+                if (read(signal_fd, &info, sizeof(info)) > 0) {
+                    running = false;
+                }
+            }
+        }
+    }
+
+    // Whatever is still held is written out, with the gaps before it
+    ReportPoint end = report_point();
+    report("overall", &start, &end);
+    for (size_t n = 0; n < num_nodes; n++) {
+        while (nodes[n].pending != NULL) {
+            skip_gap(&nodes[n]);
+        }
+        if (nodes[n].output != NULL) {
+            fclose(nodes[n].output);
+        }
+        if (nodes[n].archive != NULL && sample_archive_close_writer(nodes[n].archive)) {
+            result = 1;
+        }
+    }
+    print_node_table();
+    return result;
+}
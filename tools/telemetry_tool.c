@@ -0,0 +1,322 @@
+/*
+ * Host side encoder/decoder for the binary telemetry frames sent by the 
+ * microphone. Shares the frame format code with the firmware:
+ *
+ *   cc -O2 -I esp32/main -o telemetry_tool tools/telemetry_tool.c esp32/main/telemetry_frame.c \
+ *       esp32/main/pipeline_stats.c -lm
+ *
+ *   telemetry_tool listen <port>
+ *     Decode frames received on a UDP port and print "<sample index> <sample>" 
+ *     lines for sample frames and "band <sample index> <center Hz> <power>" 
+ *     lines for spectrum frames. Stats frames are printed as "counter <name> 
+ *     <value>" and "latency <name> <count> <min> <mean> <p50> <p99> <max>" 
+ *     lines, with times in microseconds. Health frames are printed as "health 
+ *     <input> <last> <mean> <min> <max> <noise> <drift per hour> <readings> 
+ *     <missed>" lines in volts. Sequence gaps, malformed frames and ADC faults 
+ *     flagged in sample frames are reported on stderr, as are switches between 
+ *     ADC and synthetic samples. Frames backfilled after an outage are printed 
+ *     as they arrive, behind live ones, so sort the lines by sample index to 
+ *     merge them; they do not count as gaps.
+ *
+ *   telemetry_tool send <host> <port> <sample_rate>
+ *     Read one integer sample per line from stdin and send it as frames, 
+ *     acting as a stand-in for a microphone.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "telemetry_frame.h"
+#include "sample_broker.h"
+
+int listen_for_frames(const char port[]);
+int send_frames(const char host[], const char port[], double sample_rate);
+int open_socket(const char host[], const char port[], struct addrinfo **out_address);
+void print_spectrum(const TelemetryFrame *frame);
+void print_stats(const TelemetryFrame *frame);
+void print_health(const TelemetryFrame *frame);
+
+int main(int argc, char *argv[]) {
+    if (argc == 3 && ! strcmp(argv[1], "listen")) {
+        return listen_for_frames(argv[2]);
+    }
+    if (argc == 5 && ! strcmp(argv[1], "send")) {
+        return send_frames(argv[2], argv[3], atof(argv[4]));
+    }
+
+    fprintf(
+        stderr, 
+        "usage: %s listen <port>\n"
+        "       %s send <host> <port> <sample_rate>\n",
+        argv[0],
+        argv[0]
+    );
+    return 1;
+}
+
+int open_socket(const char host[], const char port[], struct addrinfo **out_address) {
+    struct addrinfo hints = {
+        .ai_family = AF_UNSPEC,
+        .ai_socktype = SOCK_DGRAM,
+        .ai_flags = host == NULL ? AI_PASSIVE : 0
+    };
+
+    int error = getaddrinfo(host, port, &hints, out_address);
+    if (error != 0) {
+        fprintf(stderr, "error: could not resolve %s:%s: %s\n", host ? host : "*", port, gai_strerror(error));
+        return -1;
+    }
+
+    struct addrinfo *address = *out_address;
+    int sd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+    if (sd == -1) {
+        perror("socket");
+        freeaddrinfo(address);
+    }
+    return sd;
+}
+
+int listen_for_frames(const char port[]) {
+    struct addrinfo *address;
+    int sd = open_socket(NULL, port, &address);
+    if (sd == -1) {
+        return 1;
+    }
+    if (bind(sd, address->ai_addr, address->ai_addrlen) == -1) {
+        perror("bind");
+        return 1;
+    }
+    freeaddrinfo(address);
+
+    uint8_t datagram[TELEMETRY_FRAME_MAX_LENGTH + 1];
+    int32_t samples[TELEMETRY_FRAME_MAX_SAMPLES];
+    int have_sequence = 0;
+    uint32_t expected_sequence = 0;
+    int have_backfill_sequence = 0;
+    uint32_t expected_backfill_sequence = 0;
+    bool previous_clock_unlocked = false;
+    bool previous_synthetic = false;
+
+    for ( ;; ) {
+        ssize_t length = recv(sd, datagram, sizeof(datagram), 0);
+        if (length == -1) {
+            perror("recv");
+            return 1;
+        }
+
+        TelemetryFrame frame;
+        if (telemetry_frame_decode(datagram, length, &frame)) {
+            fprintf(stderr, "warning: discarded malformed frame of %zd bytes\n", length);
+            continue;
+        }
+        if (frame.flags & TELEMETRY_FRAME_BACKFILLED) {
+            if (! have_backfill_sequence || frame.sequence != expected_backfill_sequence) {
+                fprintf(stderr, "note: backfilling from frame %u\n", frame.sequence);
+            }
+            have_backfill_sequence = 1;
+            expected_backfill_sequence = frame.sequence + 1;
+        }
+        else {
+            if (have_sequence && frame.sequence != expected_sequence) {
+                fprintf(
+                    stderr, 
+                    "warning: expected frame %u, received frame %u\n", 
+                    expected_sequence, 
+                    frame.sequence
+                );
+            }
+            have_sequence = 1;
+            expected_sequence = frame.sequence + 1;
+        }
+
+        if (frame.type == TELEMETRY_FRAME_SPECTRUM) {
+            print_spectrum(&frame);
+            continue;
+        }
+        if (frame.type == TELEMETRY_FRAME_STATS) {
+            print_stats(&frame);
+            continue;
+        }
+        if (frame.type == TELEMETRY_FRAME_HEALTH) {
+            print_health(&frame);
+            continue;
+        }
+
+        TelemetrySampleHeader header;
+        if (telemetry_frame_decode_samples(&frame, &header, samples)) {
+            continue;
+        }
+        if (header.flags & SAMPLE_BLOCK_ADC_STATUS_ERROR) {
+            fprintf(stderr, "warning: ADC status fault in frame %u\n", frame.sequence);
+        }
+        if (header.flags & SAMPLE_BLOCK_ADC_CRC_ERROR) {
+            fprintf(stderr, "warning: ADC readout CRC failure in frame %u\n", frame.sequence);
+        }
+        // The clock stays unlocked for a long while after boot, so only 
+        // changes are reported
+        bool clock_unlocked = header.flags & SAMPLE_BLOCK_CLOCK_UNLOCKED;
+        if (clock_unlocked != previous_clock_unlocked) {
+            fprintf(
+                stderr, 
+                "%s: ADC clock %s in frame %u\n", 
+                clock_unlocked ? "warning" : "note",
+                clock_unlocked ? "not locked to its time reference" : "locked to its time reference",
+                frame.sequence
+            );
+            previous_clock_unlocked = clock_unlocked;
+        }
+        bool synthetic = header.flags & SAMPLE_BLOCK_SYNTHETIC;
+        if (synthetic != previous_synthetic) {
+            fprintf(
+                stderr, 
+                "note: samples %s from sample %llu\n", 
+                synthetic ? "synthetic or replayed" : "acquired from the ADC",
+                (unsigned long long) header.first_sample_index
+            );
+            previous_synthetic = synthetic;
+        }
+        if (header.flags & SAMPLE_BLOCK_GAIN_CHANGED) {
+            fprintf(
+                stderr, 
+                "note: VGA gain %u from sample %llu\n", 
+                (unsigned) header.vga_gain,
+                (unsigned long long) header.first_sample_index
+            );
+        }
+        for (int i = 0; i < header.num_samples; i++) {
+            printf("%llu %ld\n", (unsigned long long) (header.first_sample_index + i), (long) samples[i]);
+        }
+        fflush(stdout);
+    }
+}
+
+void print_spectrum(const TelemetryFrame *frame) {
+    static float psd[TELEMETRY_FRAME_MAX_PAYLOAD_LENGTH / TELEMETRY_SPECTRUM_BIN_WIDTH];
+    static float band_centers[TELEMETRY_FRAME_MAX_PAYLOAD_LENGTH / TELEMETRY_SPECTRUM_BAND_WIDTH];
+    static float band_powers[TELEMETRY_FRAME_MAX_PAYLOAD_LENGTH / TELEMETRY_SPECTRUM_BAND_WIDTH];
+
+    TelemetrySpectrumHeader header;
+    if (telemetry_frame_decode_spectrum(frame, &header, psd, band_centers, band_powers)) {
+        fprintf(stderr, "warning: discarded malformed spectrum frame\n");
+        return;
+    }
+    for (int b = 0; b < header.num_bands; b++) {
+        printf(
+            "band %llu %g %g\n", 
+            (unsigned long long) header.first_sample_index, 
+            band_centers[b], 
+            band_powers[b]
+        );
+    }
+    fflush(stdout);
+}
+
+void print_stats(const TelemetryFrame *frame) {
+    uint64_t uptime_us;
+    uint32_t cpu_frequency;
+    PipelineStats stats;
+    if (telemetry_frame_decode_stats(frame, &uptime_us, &cpu_frequency, &stats) || cpu_frequency == 0) {
+        fprintf(stderr, "warning: discarded malformed stats frame\n");
+        return;
+    }
+
+    printf("uptime %.3f\n", uptime_us / 1E6);
+    for (int c = 0; c < STATS_NUM_COUNTERS; c++) {
+        printf("counter %s %lu\n", stats_counter_name(c), (unsigned long) stats.counters[c]);
+    }
+    for (int h = 0; h < STATS_NUM_HISTOGRAMS; h++) {
+        const StatsHistogram *histogram = &stats.histograms[h];
+        double scale = stats_histogram_unit(h) == STATS_UNIT_CYCLES ? 1E6 / cpu_frequency : 1;
+        double mean = histogram->count > 0 ? (double) histogram->total / histogram->count : 0;
+        printf(
+            "latency %s %lu %.1f %.1f %.1f %.1f %.1f\n",
+            stats_histogram_name(h),
+            (unsigned long) histogram->count,
+            histogram->min * scale,
+            mean * scale,
+            stats_histogram_percentile(histogram, 0.5) * scale,
+            stats_histogram_percentile(histogram, 0.99) * scale,
+            histogram->max * scale
+        );
+    }
+    fflush(stdout);
+}
+
+void print_health(const TelemetryFrame *frame) {
+    static const char *input_names[] = {"amp_out", "virtual_ground", "reference"};
+
+    TelemetryHealthHeader header;
+    InputHealthSummary inputs[TELEMETRY_HEALTH_MAX_INPUTS];
+    if (telemetry_frame_decode_health(frame, &header, inputs)) {
+        fprintf(stderr, "warning: discarded malformed health frame\n");
+        return;
+    }
+
+    for (int i = 0; i < header.num_inputs; i++) {
+        const InputHealthSummary *input = &inputs[i];
+        char name[16];
+        if (i < (int) (sizeof(input_names) / sizeof(input_names[0]))) {
+            snprintf(name, sizeof(name), "%s", input_names[i]);
+        }
+        else {
+            snprintf(name, sizeof(name), "input%d", i);
+        }
+        printf(
+            "health %s %.6f %.6f %.6f %.6f %.6f %g %lu %lu\n",
+            name,
+            input->last,
+            input->mean,
+            input->min,
+            input->max,
+            input->noise,
+            input->drift,
+            (unsigned long) input->num_readings,
+            (unsigned long) input->num_missed
+        );
+    }
+    fflush(stdout);
+}
+
+int send_frames(const char host[], const char port[], double sample_rate) {
+    struct addrinfo *address;
+    int sd = open_socket(host, port, &address);
+    if (sd == -1) {
+        return 1;
+    }
+
+    uint8_t frame[TELEMETRY_FRAME_MAX_LENGTH];
+    int32_t samples[TELEMETRY_FRAME_MAX_SAMPLES];
+    uint32_t sequence = 0;
+    TelemetrySampleHeader header = {
+        .first_sample_index = 0,
+        .sample_rate_mhz = (uint32_t) lround(sample_rate * 1000),
+        .num_samples = 0
+    };
+
+    int at_end = 0;
+    while (! at_end) {
+        long sample;
+        at_end = scanf("%ld", &sample) != 1;
+        if (! at_end) {
+            samples[header.num_samples++] = (int32_t) sample;
+        }
+
+        if (header.num_samples == TELEMETRY_FRAME_MAX_SAMPLES || (at_end && header.num_samples > 0)) {
+            size_t length = telemetry_frame_encode_samples(frame, sequence++, &header, samples);
+            if (sendto(sd, frame, length, 0, address->ai_addr, address->ai_addrlen) == -1) {
+                perror("sendto");
+                return 1;
+            }
+            header.first_sample_index += header.num_samples;
+            header.num_samples = 0;
+        }
+    }
+
+    freeaddrinfo(address);
+    close(sd);
+    return 0;
+}
@@ -0,0 +1,357 @@
+/*
+ * Wired capture of the microphone's samples over its console UART, without
+ * Wi-Fi. Asks the firmware to stream binary telemetry frames, follows it to
+ * the stream baud rate and writes "<sample index> <sample>" lines:
+ *
+ *   cc -O2 -I esp32/main -o uart_capture tools/uart_capture.c esp32/main/telemetry_frame.c \
+ *       esp32/main/pipeline_stats.c esp32/main/cobs.c -lm
+ *
+ *   uart_capture [-c console_baud] [-b stream_baud] [-o file] <device> <num_samples>
+ *
+ * The console baud rate defaults to 115200 and the stream runs at 921600
+ * unless given. Lost frames, gaps in the sample index, frames that fail
+ * their CRC or COBS decoding and the throughput are reported on stderr. The
+ * exit status is 0 if every sample arrived intact.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/select.h>
+#include <sys/time.h>
+
+#include "telemetry_frame.h"
+#include "sample_broker.h"
+#include "cobs.h"
+
+#define DEFAULT_CONSOLE_BAUD_RATE 115200
+#define DEFAULT_STREAM_BAUD_RATE 921600
+
+// How long to wait for the stream to be announced, and then for each byte
+#define ANNOUNCE_TIMEOUT_MS 5000
+#define IDLE_TIMEOUT_MS 3000
+#define PROGRESS_INTERVAL_US 1000000
+
+#define MAX_LINE_LENGTH 256
+#define MAX_ENCODED_FRAME_LENGTH COBS_MAX_ENCODED_LENGTH(TELEMETRY_FRAME_MAX_LENGTH)
+
+typedef struct {
+    uint64_t samples;
+    uint64_t bytes;
+    unsigned long frames;
+    unsigned long lost_frames;
+    unsigned long sample_gaps;
+    uint64_t samples_missing;
+    unsigned long bad_frames;
+    unsigned long flagged_frames;
+} CaptureStats;
+
+static const struct {
+    long rate;
+    speed_t speed;
+} baud_rates[] = {
+    {9600, B9600}, {19200, B19200}, {38400, B38400}, {57600, B57600}, {115200, B115200},
+    {230400, B230400}, {460800, B460800}, {500000, B500000}, {576000, B576000},
+    {921600, B921600}, {1000000, B1000000}, {1152000, B1152000}, {1500000, B1500000},
+    {2000000, B2000000}, {2500000, B2500000}, {3000000, B3000000}, {3500000, B3500000},
+    {4000000, B4000000}
+};
+
+static int set_baud_rate(int fd, long baud_rate) {
+    for (size_t i = 0; i < sizeof(baud_rates) / sizeof(baud_rates[0]); i++) {
+        if (baud_rates[i].rate != baud_rate) {
+            continue;
+        }
+
+        struct termios options;
+        if (tcgetattr(fd, &options)) {
+            perror("tcgetattr");
+            return 1;
+        }
+        cfmakeraw(&options);
+        options.c_cflag |= CLOCAL | CREAD;
+        options.c_cc[VMIN] = 0;
+        options.c_cc[VTIME] = 0;
+        cfsetispeed(&options, baud_rates[i].speed);
+        cfsetospeed(&options, baud_rates[i].speed);
+        if (tcsetattr(fd, TCSANOW, &options)) {
+            perror("tcsetattr");
+            return 1;
+        }
+        return 0;
+    }
+    fprintf(stderr, "error: baud rate %ld is not supported by the host\n", baud_rate);
+    return 1;
+}
+
+static int64_t time_us(void) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (int64_t) now.tv_sec * 1000000 + now.tv_usec;
+}
+
+/**
+ * @brief
+ * @return Bytes read, 0 on timeout or -1 on error
+ */
+static ssize_t read_with_timeout(int fd, uint8_t buffer[], size_t length, int timeout_ms) {
+    fd_set readable;
+    FD_ZERO(&readable);
+    FD_SET(fd, &readable);
+    struct timeval timeout = {
+        .tv_sec = timeout_ms / 1000,
+        .tv_usec = (timeout_ms % 1000) * 1000
+    };
+    int ready = select(fd + 1, &readable, NULL, NULL, &timeout);
+    if (ready <= 0) {
+        return ready;
+    }
+    return read(fd, buffer, length);
+}
+
+/**
+ * @brief
+ * Skip console output, like the echo of the command, until the stream is
+ * announced
+ * @return 0 if the stream was announced
+ */
+static int wait_for_announcement(int fd, long stream_baud_rate) {
+    char line[MAX_LINE_LENGTH + 1];
+    size_t line_length = 0;
+    char expected[32];
+    snprintf(expected, sizeof(expected), "binary %ld", stream_baud_rate);
+
+    int64_t deadline = time_us() + ANNOUNCE_TIMEOUT_MS * 1000LL;
+    while (time_us() < deadline) {
+        uint8_t byte;
+        ssize_t length = read_with_timeout(fd, &byte, 1, (deadline - time_us()) / 1000 + 1);
+        if (length < 0) {
+            perror("read");
+            return 1;
+        }
+        if (length == 0) {
+            continue;
+        }
+
+        if (byte == '\n' || byte == '\r') {
+            line[line_length] = '\0';
+            if (! strncmp(line, expected, strlen(expected))) {
+                return 0;
+            }
+            if (! strncmp(line, "error:", 6)) {
+                fprintf(stderr, "device %s\n", line);
+                return 1;
+            }
+            line_length = 0;
+        }
+        else if (line_length < MAX_LINE_LENGTH) {
+            line[line_length++] = byte;
+        }
+    }
+    fprintf(stderr, "error: the device did not start streaming\n");
+    return 1;
+}
+
+/**
+ * @brief
+ * Check a decoded frame against the last one and write its samples
+ */
+static void handle_frame(
+    uint8_t decoded[],
+    size_t length,
+    FILE *output,
+    CaptureStats *stats,
+    int *have_previous,
+    uint32_t *next_sequence,
+    uint64_t *next_sample_index
+) {
+    static int32_t samples[TELEMETRY_FRAME_MAX_SAMPLES];
+
+    TelemetryFrame frame;
+    TelemetrySampleHeader header;
+    if (telemetry_frame_decode(decoded, length, &frame) ||
+        frame.type != TELEMETRY_FRAME_SAMPLES ||
+        telemetry_frame_decode_samples(&frame, &header, samples)) {
+        stats->bad_frames++;
+        return;
+    }
+
+    stats->frames++;
+    if (*have_previous && frame.sequence != *next_sequence) {
+        stats->lost_frames += frame.sequence - *next_sequence;
+        fprintf(stderr, "warning: %u frames lost before frame %u\n", frame.sequence - *next_sequence, frame.sequence);
+    }
+    if (*have_previous && header.first_sample_index != *next_sample_index) {
+        uint64_t missing = header.first_sample_index - *next_sample_index;
+        stats->sample_gaps++;
+        stats->samples_missing += missing;
+        fprintf(
+            stderr,
+            "warning: %llu samples missing before sample %llu\n",
+            (unsigned long long) missing,
+            (unsigned long long) header.first_sample_index
+        );
+    }
+    if (header.flags & (SAMPLE_BLOCK_ADC_STATUS_ERROR | SAMPLE_BLOCK_ADC_CRC_ERROR)) {
+        stats->flagged_frames++;
+    }
+    *have_previous = 1;
+    *next_sequence = frame.sequence + 1;
+    *next_sample_index = header.first_sample_index + header.num_samples;
+
+    for (int i = 0; i < header.num_samples; i++) {
+        fprintf(output, "%llu %ld\n", (unsigned long long) (header.first_sample_index + i), (long) samples[i]);
+    }
+    stats->samples += header.num_samples;
+}
+
+static void print_progress(const CaptureStats *stats, double elapsed) {
+    fprintf(
+        stderr,
+        "%8.1f s %10llu samples %8.0f samples/s %8.0f bytes/s %lu frames lost %llu samples missing %lu bad frames\n",
+        elapsed,
+        (unsigned long long) stats->samples,
+        elapsed > 0 ? stats->samples / elapsed : 0,
+        elapsed > 0 ? stats->bytes / elapsed : 0,
+        stats->lost_frames,
+        (unsigned long long) stats->samples_missing,
+        stats->bad_frames
+    );
+}
+
+static int capture(int fd, FILE *output, uint64_t num_samples, CaptureStats *stats) {
+    static uint8_t encoded[MAX_ENCODED_FRAME_LENGTH];
+    static uint8_t decoded[MAX_ENCODED_FRAME_LENGTH];
+    size_t encoded_length = 0;
+    // Bytes before the first delimiter may be the tail of console output
+    int synchronized = 0;
+    int have_previous = 0;
+    uint32_t next_sequence = 0;
+    uint64_t next_sample_index = 0;
+
+    int64_t start_time = time_us();
+    int64_t last_progress_time = start_time;
+    while (stats->samples < num_samples) {
+        uint8_t buffer[4096];
+        ssize_t length = read_with_timeout(fd, buffer, sizeof(buffer), IDLE_TIMEOUT_MS);
+        if (length < 0) {
+            perror("read");
+            return 1;
+        }
+        if (length == 0) {
+            fprintf(stderr, "error: the stream stopped\n");
+            break;
+        }
+        stats->bytes += length;
+
+        for (ssize_t i = 0; i < length; i++) {
+            if (buffer[i] != COBS_DELIMITER) {
+                if (encoded_length < sizeof(encoded)) {
+                    encoded[encoded_length] = buffer[i];
+                }
+                encoded_length++;
+                continue;
+            }
+
+            if (synchronized && encoded_length > 0) {
+                size_t decoded_length;
+                if (encoded_length > sizeof(encoded) ||
+                    cobs_decode(decoded, encoded, encoded_length, &decoded_length)) {
+                    stats->bad_frames++;
+                }
+                else {
+                    handle_frame(
+                        decoded, decoded_length, output, stats, &have_previous, &next_sequence, &next_sample_index
+                    );
+                }
+            }
+            synchronized = 1;
+            encoded_length = 0;
+        }
+
+        int64_t now = time_us();
+        if (now - last_progress_time >= PROGRESS_INTERVAL_US) {
+            print_progress(stats, (now - start_time) / 1E6);
+            last_progress_time = now;
+        }
+    }
+    print_progress(stats, (time_us() - start_time) / 1E6);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    long console_baud_rate = DEFAULT_CONSOLE_BAUD_RATE;
+    long stream_baud_rate = DEFAULT_STREAM_BAUD_RATE;
+    const char *output_path = NULL;
+
+    int option;
+    while ((option = getopt(argc, argv, "c:b:o:")) != -1) {
+        switch (option) {
+            case 'c': console_baud_rate = atol(optarg); break;
+            case 'b': stream_baud_rate = atol(optarg); break;
+            case 'o': output_path = optarg; break;
+            default: optind = argc + 1;
+        }
+    }
+    if (optind != argc - 2) {
+        fprintf(stderr, "usage: %s [-c console_baud] [-b stream_baud] [-o file] <device> <num_samples>\n", argv[0]);
+        return 1;
+    }
+    const char *device = argv[optind];
+    uint64_t num_samples = strtoull(argv[optind + 1], NULL, 10);
+
+    FILE *output = stdout;
+    if (output_path != NULL) {
+        output = fopen(output_path, "w");
+        if (output == NULL) {
+            perror(output_path);
+            return 1;
+        }
+    }
+
+    int fd = open(device, O_RDWR | O_NOCTTY);
+    if (fd < 0) {
+        perror(device);
+        return 1;
+    }
+    if (set_baud_rate(fd, console_baud_rate)) {
+        return 1;
+    }
+    tcflush(fd, TCIOFLUSH);
+
+    char command[64];
+    int command_length = snprintf(
+        command, sizeof(command), "read_adc %llu binary %ld\r", (unsigned long long) num_samples, stream_baud_rate
+    );
+    if (write(fd, command, command_length) != command_length) {
+        perror("write");
+        return 1;
+    }
+    if (wait_for_announcement(fd, stream_baud_rate)) {
+        return 1;
+    }
+    if (stream_baud_rate != console_baud_rate && set_baud_rate(fd, stream_baud_rate)) {
+        return 1;
+    }
+
+    CaptureStats stats = {0};
+    int result = capture(fd, output, num_samples, &stats);
+
+    // The device returns to the console baud rate once it has sent everything
+    set_baud_rate(fd, console_baud_rate);
+    close(fd);
+    if (output != stdout) {
+        fclose(output);
+    }
+
+    if (stats.flagged_frames > 0) {
+        fprintf(stderr, "warning: %lu frames hold samples the ADC flagged\n", stats.flagged_frames);
+    }
+    if (result || stats.samples < num_samples || stats.lost_frames || stats.samples_missing || stats.bad_frames) {
+        return 1;
+    }
+    return 0;
+}